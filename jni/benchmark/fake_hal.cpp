@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fake_hal.h"
+
+#include <string.h>
+
+#include "hardware/hardware.h"
+#include "jni.h"
+
+namespace bluetooth_jni_benchmark {
+
+static bt_callbacks_t* sBluetoothCallbacks = NULL;
+static const btgatt_callbacks_t* sGattCallbacks = NULL;
+static btsdp_callbacks_t* sSdpCallbacks = NULL;
+static btrc_ctrl_callbacks_t* sAvrcpCtrlCallbacks = NULL;
+
+bt_callbacks_t* FakeHalBluetoothCallbacks() { return sBluetoothCallbacks; }
+const btgatt_callbacks_t* FakeHalGattCallbacks() { return sGattCallbacks; }
+btsdp_callbacks_t* FakeHalSdpCallbacks() { return sSdpCallbacks; }
+btrc_ctrl_callbacks_t* FakeHalAvrcpCtrlCallbacks() {
+  return sAvrcpCtrlCallbacks;
+}
+
+/* GATT */
+static bt_status_t fake_gatt_init(const btgatt_callbacks_t* callbacks) {
+  sGattCallbacks = callbacks;
+  return BT_STATUS_SUCCESS;
+}
+
+static void fake_gatt_cleanup() { sGattCallbacks = NULL; }
+
+static btgatt_client_interface_t sGattClientInterface;
+static btgatt_server_interface_t sGattServerInterface;
+static btgatt_interface_t sGattInterface;
+
+/* SDP */
+static bt_status_t fake_sdp_init(btsdp_callbacks_t* callbacks) {
+  sSdpCallbacks = callbacks;
+  return BT_STATUS_SUCCESS;
+}
+
+static bt_status_t fake_sdp_deinit() {
+  sSdpCallbacks = NULL;
+  return BT_STATUS_SUCCESS;
+}
+
+static btsdp_interface_t sSdpInterface;
+
+/* AVRCP controller */
+static bt_status_t fake_avrcp_ctrl_init(btrc_ctrl_callbacks_t* callbacks) {
+  sAvrcpCtrlCallbacks = callbacks;
+  return BT_STATUS_SUCCESS;
+}
+
+static void fake_avrcp_ctrl_cleanup() { sAvrcpCtrlCallbacks = NULL; }
+
+static btrc_ctrl_interface_t sAvrcpCtrlInterface;
+
+/* Adapter */
+static int fake_init(bt_callbacks_t* callbacks) {
+  sBluetoothCallbacks = callbacks;
+  return BT_STATUS_SUCCESS;
+}
+
+static void fake_cleanup() { sBluetoothCallbacks = NULL; }
+
+static const void* fake_get_profile_interface(const char* profile_id) {
+  if (!strcmp(profile_id, BT_PROFILE_GATT_ID)) return &sGattInterface;
+  if (!strcmp(profile_id, BT_PROFILE_SDP_CLIENT_ID)) return &sSdpInterface;
+  if (!strcmp(profile_id, BT_PROFILE_AV_RC_CTRL_ID))
+    return &sAvrcpCtrlInterface;
+  return NULL;
+}
+
+static bt_interface_t sBluetoothInterface;
+
+static const bt_interface_t* fake_get_bluetooth_interface() {
+  return &sBluetoothInterface;
+}
+
+static bluetooth_module_t sBluetoothModule;
+
+static int fake_open(const hw_module_t* module, const char* id,
+                     hw_device_t** device) {
+  memset(&sGattClientInterface, 0, sizeof(sGattClientInterface));
+  memset(&sGattServerInterface, 0, sizeof(sGattServerInterface));
+  memset(&sGattInterface, 0, sizeof(sGattInterface));
+  sGattInterface.size = sizeof(sGattInterface);
+  sGattInterface.init = fake_gatt_init;
+  sGattInterface.cleanup = fake_gatt_cleanup;
+  sGattInterface.client = &sGattClientInterface;
+  sGattInterface.server = &sGattServerInterface;
+
+  memset(&sSdpInterface, 0, sizeof(sSdpInterface));
+  sSdpInterface.size = sizeof(sSdpInterface);
+  sSdpInterface.init = fake_sdp_init;
+  sSdpInterface.deinit = fake_sdp_deinit;
+
+  memset(&sAvrcpCtrlInterface, 0, sizeof(sAvrcpCtrlInterface));
+  sAvrcpCtrlInterface.size = sizeof(sAvrcpCtrlInterface);
+  sAvrcpCtrlInterface.init = fake_avrcp_ctrl_init;
+  sAvrcpCtrlInterface.cleanup = fake_avrcp_ctrl_cleanup;
+
+  memset(&sBluetoothInterface, 0, sizeof(sBluetoothInterface));
+  sBluetoothInterface.size = sizeof(sBluetoothInterface);
+  sBluetoothInterface.init = fake_init;
+  sBluetoothInterface.cleanup = fake_cleanup;
+  sBluetoothInterface.get_profile_interface = fake_get_profile_interface;
+
+  memset(&sBluetoothModule, 0, sizeof(sBluetoothModule));
+  sBluetoothModule.common.module = const_cast<hw_module_t*>(module);
+  sBluetoothModule.get_bluetooth_interface = fake_get_bluetooth_interface;
+
+  *device = &sBluetoothModule.common;
+  return 0;
+}
+
+static hw_module_methods_t sModuleMethods = {.open = fake_open};
+
+static hw_module_t sModule;
+
+}  // namespace bluetooth_jni_benchmark
+
+using namespace bluetooth_jni_benchmark;
+
+namespace android {
+
+/* The vendor extension is not built into the benchmark. */
+int register_com_android_bluetooth_btservice_vendor(JNIEnv* env) { return 0; }
+
+}  // namespace android
+
+int hw_get_module(const char* id, const hw_module_t** module) {
+  sModule.methods = &sModuleMethods;
+  *module = &sModule;
+  return 0;
+}
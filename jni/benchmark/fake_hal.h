@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BLUETOOTH_JNI_BENCHMARK_FAKE_HAL_H
+#define BLUETOOTH_JNI_BENCHMARK_FAKE_HAL_H
+
+#include "hardware/bluetooth.h"
+#include "hardware/bt_gatt.h"
+#include "hardware/bt_rc.h"
+#include "hardware/bt_sdp.h"
+
+namespace bluetooth_jni_benchmark {
+
+/*
+ * The fake HAL replaces libhardware's hw_get_module() and hands the JNI layer
+ * a bt_interface_t whose entry points do nothing. Only the GATT, SDP and
+ * AVRCP controller profiles are exposed; every other get_profile_interface()
+ * lookup returns NULL, which the JNI layer already treats as "profile not
+ * available".
+ *
+ * The accessors below return the callback tables the JNI layer registered
+ * through the fake interfaces' init(), or NULL before registration. The
+ * benchmark drives upcalls by invoking them directly.
+ */
+bt_callbacks_t* FakeHalBluetoothCallbacks();
+const btgatt_callbacks_t* FakeHalGattCallbacks();
+btsdp_callbacks_t* FakeHalSdpCallbacks();
+btrc_ctrl_callbacks_t* FakeHalAvrcpCtrlCallbacks();
+
+}  // namespace bluetooth_jni_benchmark
+
+#endif  // BLUETOOTH_JNI_BENCHMARK_FAKE_HAL_H
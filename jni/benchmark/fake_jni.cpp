@@ -0,0 +1,502 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Minimal in-process JNIEnv/JavaVM used to drive libbluetooth_jni without a
+ * Java runtime. Every reference is a heap allocated FakeObject with a
+ * reference count; local and global references share the same count. Local
+ * references are also recorded per thread so FakeJniDeleteLocalRefs() can
+ * drop the ones the native code never deleted, as a JVM does when a native
+ * frame returns. Java upcalls do nothing except count themselves, and calls
+ * returning objects hand back a fresh plain object so the native code under
+ * test keeps going. Object fields read back one shared object per field.
+ * Only the JNI functions used by the Bluetooth JNI sources are implemented;
+ * the remaining table entries are left NULL.
+ */
+
+#include "fake_jni.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "android_runtime/AndroidRuntime.h"
+
+namespace bluetooth_jni_benchmark {
+
+namespace {
+
+enum class Kind { kClass, kObject, kString, kArray, kDirectBuffer };
+
+struct FakeObject {
+  Kind kind;
+  std::atomic<int> refs;
+  std::string class_name;
+  size_t element_size;
+  size_t length;
+  std::vector<uint8_t> data;
+  std::vector<jobject> elements;
+  void* address;
+  jlong capacity;
+};
+
+std::atomic<uint64_t> sAllocations;
+std::atomic<uint64_t> sUpcalls;
+std::atomic<uint64_t> sLiveObjects;
+
+std::mutex sLock;
+std::map<std::string, FakeObject*> sClasses;
+std::set<std::string> sIds;
+std::map<std::string, std::map<std::string, void*>> sNatives;
+std::map<jfieldID, FakeObject*> sFieldValues;
+
+// Local references handed out on this thread and not deleted yet.
+thread_local std::vector<jobject> tLocalRefs;
+
+JNINativeInterface sFunctions;
+JNIInvokeInterface sInvokeFunctions;
+JNIEnv sEnv;
+JavaVM sVm;
+std::once_flag sInitOnce;
+
+FakeObject* AsObject(jobject ref) { return reinterpret_cast<FakeObject*>(ref); }
+
+FakeObject* NewFakeObject(Kind kind, const std::string& class_name) {
+  FakeObject* object = new FakeObject();
+  object->kind = kind;
+  object->refs = 1;
+  object->class_name = class_name;
+  object->element_size = 0;
+  object->length = 0;
+  object->address = NULL;
+  object->capacity = 0;
+  sAllocations++;
+  sLiveObjects++;
+  return object;
+}
+
+jobject Ref(jobject ref) {
+  if (ref && AsObject(ref)->kind != Kind::kClass) AsObject(ref)->refs++;
+  return ref;
+}
+
+void Unref(jobject ref) {
+  if (!ref) return;
+  FakeObject* object = AsObject(ref);
+  if (object->kind == Kind::kClass) return;
+  if (--object->refs > 0) return;
+
+  for (jobject element : object->elements) Unref(element);
+  delete object;
+  sLiveObjects--;
+}
+
+// Records |ref| as a local reference of the calling thread.
+jobject Local(jobject ref) {
+  if (ref && AsObject(ref)->kind != Kind::kClass) tLocalRefs.push_back(ref);
+  return ref;
+}
+
+jobject Local(FakeObject* object) {
+  return Local(reinterpret_cast<jobject>(object));
+}
+
+jclass ClassForName(const std::string& name) {
+  std::lock_guard<std::mutex> lock(sLock);
+  FakeObject*& clazz = sClasses[name];
+  if (!clazz) {
+    clazz = new FakeObject();
+    clazz->kind = Kind::kClass;
+    clazz->refs = 1;
+    clazz->class_name = name;
+  }
+  return reinterpret_cast<jclass>(clazz);
+}
+
+const char* InternId(const char* name, const char* sig) {
+  std::lock_guard<std::mutex> lock(sLock);
+  return sIds.insert(std::string(name) + sig).first->c_str();
+}
+
+FakeObject* NewArray(const char* class_name, size_t element_size,
+                     jsize length) {
+  FakeObject* array = NewFakeObject(Kind::kArray, class_name);
+  array->element_size = element_size;
+  array->length = length;
+  array->data.resize(element_size * length);
+  return array;
+}
+
+/* Environment functions */
+
+jint GetVersion(JNIEnv*) { return JNI_VERSION_1_6; }
+
+jclass FindClass(JNIEnv*, const char* name) { return ClassForName(name); }
+
+jclass GetObjectClass(JNIEnv*, jobject obj) {
+  return ClassForName(AsObject(obj)->class_name);
+}
+
+jboolean IsInstanceOf(JNIEnv*, jobject, jclass) { return JNI_TRUE; }
+
+jboolean IsSameObject(JNIEnv*, jobject a, jobject b) {
+  return a == b ? JNI_TRUE : JNI_FALSE;
+}
+
+jint Throw(JNIEnv*, jthrowable) { return 0; }
+
+jint ThrowNew(JNIEnv*, jclass, const char*) { return 0; }
+
+jthrowable ExceptionOccurred(JNIEnv*) { return NULL; }
+
+void ExceptionClear(JNIEnv*) {}
+
+jboolean ExceptionCheck(JNIEnv*) { return JNI_FALSE; }
+
+jint PushLocalFrame(JNIEnv*, jint) { return 0; }
+
+jobject PopLocalFrame(JNIEnv*, jobject result) { return result; }
+
+jint EnsureLocalCapacity(JNIEnv*, jint) { return 0; }
+
+jobject NewRef(JNIEnv*, jobject obj) { return Ref(obj); }
+
+void DeleteRef(JNIEnv*, jobject obj) { Unref(obj); }
+
+jobject NewLocalRef(JNIEnv*, jobject obj) { return Local(Ref(obj)); }
+
+void DeleteLocalRef(JNIEnv*, jobject obj) {
+  auto it = std::find(tLocalRefs.rbegin(), tLocalRefs.rend(), obj);
+  if (it != tLocalRefs.rend()) tLocalRefs.erase(std::next(it).base());
+  Unref(obj);
+}
+
+jobject NewObjectV(JNIEnv*, jclass clazz, jmethodID, va_list) {
+  return Local(NewFakeObject(Kind::kObject, AsObject(clazz)->class_name));
+}
+
+jmethodID GetMethodID(JNIEnv*, jclass, const char* name, const char* sig) {
+  return reinterpret_cast<jmethodID>(const_cast<char*>(InternId(name, sig)));
+}
+
+jfieldID GetFieldID(JNIEnv*, jclass, const char* name, const char* sig) {
+  return reinterpret_cast<jfieldID>(const_cast<char*>(InternId(name, sig)));
+}
+
+jobject CallObjectMethodV(JNIEnv*, jobject, jmethodID, va_list) {
+  sUpcalls++;
+  return Local(NewFakeObject(Kind::kObject, "java/lang/Object"));
+}
+
+jboolean CallBooleanMethodV(JNIEnv*, jobject, jmethodID, va_list) {
+  sUpcalls++;
+  return JNI_TRUE;
+}
+
+jint CallIntMethodV(JNIEnv*, jobject, jmethodID, va_list) {
+  sUpcalls++;
+  return 0;
+}
+
+jlong CallLongMethodV(JNIEnv*, jobject, jmethodID, va_list) {
+  sUpcalls++;
+  return 0;
+}
+
+void CallVoidMethodV(JNIEnv*, jobject, jmethodID, va_list) { sUpcalls++; }
+
+jobject GetObjectField(JNIEnv*, jobject, jfieldID field) {
+  std::lock_guard<std::mutex> lock(sLock);
+  FakeObject*& value = sFieldValues[field];
+  if (!value) {
+    // Created once and never counted: reading a field allocates nothing.
+    value = new FakeObject();
+    value->kind = Kind::kObject;
+    value->refs = 1;
+    value->class_name = "java/lang/Object";
+    value->element_size = 0;
+    value->length = 0;
+    value->address = NULL;
+    value->capacity = 0;
+  }
+  return Local(Ref(reinterpret_cast<jobject>(value)));
+}
+
+jint GetIntField(JNIEnv*, jobject, jfieldID) { return 0; }
+
+void SetObjectField(JNIEnv*, jobject, jfieldID, jobject) {}
+
+void SetIntField(JNIEnv*, jobject, jfieldID, jint) {}
+
+void SetLongField(JNIEnv*, jobject, jfieldID, jlong) {}
+
+jstring NewStringUTF(JNIEnv*, const char* utf) {
+  FakeObject* string = NewFakeObject(Kind::kString, "java/lang/String");
+  string->length = strlen(utf);
+  string->data.assign(utf, utf + string->length + 1);
+  return reinterpret_cast<jstring>(Local(string));
+}
+
+jsize GetStringUTFLength(JNIEnv*, jstring string) {
+  return AsObject(string)->length;
+}
+
+const char* GetStringUTFChars(JNIEnv*, jstring string, jboolean* is_copy) {
+  if (is_copy) *is_copy = JNI_FALSE;
+  return reinterpret_cast<const char*>(AsObject(string)->data.data());
+}
+
+void ReleaseStringUTFChars(JNIEnv*, jstring, const char*) {}
+
+jsize GetArrayLength(JNIEnv*, jarray array) { return AsObject(array)->length; }
+
+jobjectArray NewObjectArray(JNIEnv*, jsize length, jclass, jobject initial) {
+  FakeObject* array = NewFakeObject(Kind::kArray, "[Ljava/lang/Object;");
+  array->length = length;
+  array->elements.resize(length, NULL);
+  for (jobject& element : array->elements) element = Ref(initial);
+  return reinterpret_cast<jobjectArray>(Local(array));
+}
+
+jobject GetObjectArrayElement(JNIEnv*, jobjectArray array, jsize index) {
+  return Local(Ref(AsObject(array)->elements[index]));
+}
+
+void SetObjectArrayElement(JNIEnv*, jobjectArray array, jsize index,
+                           jobject value) {
+  jobject& element = AsObject(array)->elements[index];
+  Ref(value);
+  Unref(element);
+  element = value;
+}
+
+template <typename ArrayT, typename ElementT>
+ArrayT NewPrimitiveArray(JNIEnv*, jsize length) {
+  return reinterpret_cast<ArrayT>(
+      Local(NewArray("[", sizeof(ElementT), length)));
+}
+
+template <typename ArrayT, typename ElementT>
+ElementT* GetArrayElements(JNIEnv*, ArrayT array, jboolean* is_copy) {
+  if (is_copy) *is_copy = JNI_FALSE;
+  return reinterpret_cast<ElementT*>(AsObject(array)->data.data());
+}
+
+template <typename ArrayT, typename ElementT>
+void ReleaseArrayElements(JNIEnv*, ArrayT, ElementT*, jint) {}
+
+template <typename ArrayT, typename ElementT>
+void GetArrayRegion(JNIEnv*, ArrayT array, jsize start, jsize length,
+                    ElementT* buf) {
+  memcpy(buf, AsObject(array)->data.data() + start * sizeof(ElementT),
+         length * sizeof(ElementT));
+}
+
+template <typename ArrayT, typename ElementT>
+void SetArrayRegion(JNIEnv*, ArrayT array, jsize start, jsize length,
+                    const ElementT* buf) {
+  memcpy(AsObject(array)->data.data() + start * sizeof(ElementT), buf,
+         length * sizeof(ElementT));
+}
+
+void* GetPrimitiveArrayCritical(JNIEnv*, jarray array, jboolean* is_copy) {
+  if (is_copy) *is_copy = JNI_FALSE;
+  return AsObject(array)->data.data();
+}
+
+void ReleasePrimitiveArrayCritical(JNIEnv*, jarray, void*, jint) {}
+
+jint RegisterNatives(JNIEnv*, jclass clazz, const JNINativeMethod* methods,
+                     jint count) {
+  std::lock_guard<std::mutex> lock(sLock);
+  std::map<std::string, void*>& natives =
+      sNatives[AsObject(clazz)->class_name];
+  for (jint i = 0; i < count; i++) natives[methods[i].name] = methods[i].fnPtr;
+  return 0;
+}
+
+jint UnregisterNatives(JNIEnv*, jclass) { return 0; }
+
+jint GetJavaVM(JNIEnv*, JavaVM** vm) {
+  *vm = &sVm;
+  return 0;
+}
+
+jobject NewDirectByteBuffer(JNIEnv*, void* address, jlong capacity) {
+  FakeObject* buffer =
+      NewFakeObject(Kind::kDirectBuffer, "java/nio/DirectByteBuffer");
+  buffer->address = address;
+  buffer->capacity = capacity;
+  return Local(buffer);
+}
+
+void* GetDirectBufferAddress(JNIEnv*, jobject buffer) {
+  return AsObject(buffer)->address;
+}
+
+jlong GetDirectBufferCapacity(JNIEnv*, jobject buffer) {
+  return AsObject(buffer)->capacity;
+}
+
+/* Invocation functions */
+
+jint DestroyJavaVM(JavaVM*) { return 0; }
+
+jint AttachCurrentThread(JavaVM*, JNIEnv** env, void*) {
+  *env = &sEnv;
+  return 0;
+}
+
+jint DetachCurrentThread(JavaVM*) { return 0; }
+
+jint GetEnv(JavaVM*, void** env, jint) {
+  *env = &sEnv;
+  return 0;
+}
+
+#define FAKE_ARRAY_FUNCTIONS(Name, ArrayT, ElementT)                        \
+  sFunctions.New##Name##Array = NewPrimitiveArray<ArrayT, ElementT>;        \
+  sFunctions.Get##Name##ArrayElements = GetArrayElements<ArrayT, ElementT>; \
+  sFunctions.Release##Name##ArrayElements =                                 \
+      ReleaseArrayElements<ArrayT, ElementT>;                               \
+  sFunctions.Get##Name##ArrayRegion = GetArrayRegion<ArrayT, ElementT>;     \
+  sFunctions.Set##Name##ArrayRegion = SetArrayRegion<ArrayT, ElementT>
+
+void InitFakeJni() {
+  sFunctions.GetVersion = GetVersion;
+  sFunctions.FindClass = FindClass;
+  sFunctions.GetObjectClass = GetObjectClass;
+  sFunctions.IsInstanceOf = IsInstanceOf;
+  sFunctions.IsSameObject = IsSameObject;
+  sFunctions.Throw = Throw;
+  sFunctions.ThrowNew = ThrowNew;
+  sFunctions.ExceptionOccurred = ExceptionOccurred;
+  sFunctions.ExceptionClear = ExceptionClear;
+  sFunctions.ExceptionCheck = ExceptionCheck;
+  sFunctions.PushLocalFrame = PushLocalFrame;
+  sFunctions.PopLocalFrame = PopLocalFrame;
+  sFunctions.EnsureLocalCapacity = EnsureLocalCapacity;
+  sFunctions.NewGlobalRef = NewRef;
+  sFunctions.NewLocalRef = NewLocalRef;
+  sFunctions.NewWeakGlobalRef = NewRef;
+  sFunctions.DeleteGlobalRef = DeleteRef;
+  sFunctions.DeleteLocalRef = DeleteLocalRef;
+  sFunctions.DeleteWeakGlobalRef = DeleteRef;
+  sFunctions.NewObjectV = NewObjectV;
+  sFunctions.GetMethodID = GetMethodID;
+  sFunctions.GetStaticMethodID = GetMethodID;
+  sFunctions.GetFieldID = GetFieldID;
+  sFunctions.GetStaticFieldID = GetFieldID;
+  sFunctions.CallObjectMethodV = CallObjectMethodV;
+  sFunctions.CallBooleanMethodV = CallBooleanMethodV;
+  sFunctions.CallIntMethodV = CallIntMethodV;
+  sFunctions.CallLongMethodV = CallLongMethodV;
+  sFunctions.CallVoidMethodV = CallVoidMethodV;
+  sFunctions.GetObjectField = GetObjectField;
+  sFunctions.GetIntField = GetIntField;
+  sFunctions.SetObjectField = SetObjectField;
+  sFunctions.SetIntField = SetIntField;
+  sFunctions.SetLongField = SetLongField;
+  sFunctions.NewStringUTF = NewStringUTF;
+  sFunctions.GetStringUTFLength = GetStringUTFLength;
+  sFunctions.GetStringUTFChars = GetStringUTFChars;
+  sFunctions.ReleaseStringUTFChars = ReleaseStringUTFChars;
+  sFunctions.GetArrayLength = GetArrayLength;
+  sFunctions.NewObjectArray = NewObjectArray;
+  sFunctions.GetObjectArrayElement = GetObjectArrayElement;
+  sFunctions.SetObjectArrayElement = SetObjectArrayElement;
+  FAKE_ARRAY_FUNCTIONS(Boolean, jbooleanArray, jboolean);
+  FAKE_ARRAY_FUNCTIONS(Byte, jbyteArray, jbyte);
+  FAKE_ARRAY_FUNCTIONS(Char, jcharArray, jchar);
+  FAKE_ARRAY_FUNCTIONS(Short, jshortArray, jshort);
+  FAKE_ARRAY_FUNCTIONS(Int, jintArray, jint);
+  FAKE_ARRAY_FUNCTIONS(Long, jlongArray, jlong);
+  sFunctions.GetPrimitiveArrayCritical = GetPrimitiveArrayCritical;
+  sFunctions.ReleasePrimitiveArrayCritical = ReleasePrimitiveArrayCritical;
+  sFunctions.RegisterNatives = RegisterNatives;
+  sFunctions.UnregisterNatives = UnregisterNatives;
+  sFunctions.GetJavaVM = GetJavaVM;
+  sFunctions.NewDirectByteBuffer = NewDirectByteBuffer;
+  sFunctions.GetDirectBufferAddress = GetDirectBufferAddress;
+  sFunctions.GetDirectBufferCapacity = GetDirectBufferCapacity;
+  sEnv.functions = &sFunctions;
+
+  sInvokeFunctions.DestroyJavaVM = DestroyJavaVM;
+  sInvokeFunctions.AttachCurrentThread = AttachCurrentThread;
+  sInvokeFunctions.AttachCurrentThreadAsDaemon = AttachCurrentThread;
+  sInvokeFunctions.DetachCurrentThread = DetachCurrentThread;
+  sInvokeFunctions.GetEnv = GetEnv;
+  sVm.functions = &sInvokeFunctions;
+}
+
+}  // namespace
+
+JavaVM* FakeJavaVM() {
+  std::call_once(sInitOnce, InitFakeJni);
+  return &sVm;
+}
+
+JNIEnv* FakeJniEnv() {
+  std::call_once(sInitOnce, InitFakeJni);
+  return &sEnv;
+}
+
+FakeJniStats FakeJniGetStats() {
+  FakeJniStats stats;
+  stats.allocations = sAllocations;
+  stats.upcalls = sUpcalls;
+  stats.live_objects = sLiveObjects;
+  return stats;
+}
+
+jobject FakeJniNewObject(const char* class_name) {
+  return Local(NewFakeObject(Kind::kObject, class_name));
+}
+
+void FakeJniDeleteLocalRefs() {
+  std::vector<jobject> refs;
+  refs.swap(tLocalRefs);
+  for (jobject ref : refs) Unref(ref);
+}
+
+void* FakeJniFindNative(const char* class_name, const char* method_name) {
+  std::lock_guard<std::mutex> lock(sLock);
+  auto clazz = sNatives.find(class_name);
+  if (clazz == sNatives.end()) return NULL;
+  auto method = clazz->second.find(method_name);
+  return method == clazz->second.end() ? NULL : method->second;
+}
+
+}  // namespace bluetooth_jni_benchmark
+
+namespace android {
+
+JavaVM* AndroidRuntime::getJavaVM() {
+  return bluetooth_jni_benchmark::FakeJavaVM();
+}
+
+JNIEnv* AndroidRuntime::getJNIEnv() {
+  return bluetooth_jni_benchmark::FakeJniEnv();
+}
+
+}  // namespace android
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BLUETOOTH_JNI_BENCHMARK_FAKE_JNI_H
+#define BLUETOOTH_JNI_BENCHMARK_FAKE_JNI_H
+
+#include <stdint.h>
+
+#include "jni.h"
+
+namespace bluetooth_jni_benchmark {
+
+/**
+ * Counters kept by the fake JNIEnv. Allocations count every Java object the
+ * JNI layer (or a Java upcall returning an object) would have created:
+ * objects, arrays, strings and direct buffers. Classes, method and field IDs
+ * are not counted.
+ */
+struct FakeJniStats {
+  uint64_t allocations;
+  uint64_t upcalls;
+  uint64_t live_objects;
+};
+
+/* Returns the process wide fake VM and environment. */
+JavaVM* FakeJavaVM();
+JNIEnv* FakeJniEnv();
+
+FakeJniStats FakeJniGetStats();
+
+/* Creates a plain object of the given class, as Java would pass to a native
+ * method. The caller owns one local reference. */
+jobject FakeJniNewObject(const char* class_name);
+
+/* Drops the local references the calling thread still holds, as a JVM does
+ * when a native method or an attached callback frame returns. */
+void FakeJniDeleteLocalRefs();
+
+/* Looks up a native registered through RegisterNatives. Returns NULL if the
+ * class or method was never registered. */
+void* FakeJniFindNative(const char* class_name, const char* method_name);
+
+}  // namespace bluetooth_jni_benchmark
+
+#endif  // BLUETOOTH_JNI_BENCHMARK_FAKE_JNI_H
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Benchmark replacement for the framework AndroidRuntime header. Only the
+ * pieces used by libbluetooth_jni are provided; they resolve to the fake
+ * JavaVM in benchmark/fake_jni.cpp.
+ */
+
+#ifndef BLUETOOTH_JNI_BENCHMARK_ANDROID_RUNTIME_H
+#define BLUETOOTH_JNI_BENCHMARK_ANDROID_RUNTIME_H
+
+#include "jni.h"
+
+#ifndef DISALLOW_COPY_AND_ASSIGN
+#define DISALLOW_COPY_AND_ASSIGN(TypeName) \
+  TypeName(const TypeName&) = delete;      \
+  void operator=(const TypeName&) = delete
+#endif
+
+namespace android {
+
+class AndroidRuntime {
+ public:
+  static JavaVM* getJavaVM();
+  static JNIEnv* getJNIEnv();
+};
+
+}  // namespace android
+
+#endif  // BLUETOOTH_JNI_BENCHMARK_ANDROID_RUNTIME_H
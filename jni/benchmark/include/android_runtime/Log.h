@@ -0,0 +1,23 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BLUETOOTH_JNI_BENCHMARK_ANDROID_RUNTIME_LOG_H
+#define BLUETOOTH_JNI_BENCHMARK_ANDROID_RUNTIME_LOG_H
+
+// The fake JNIEnv never raises Java exceptions.
+#define LOGE_EX(env) ((void)(env))
+
+#endif  // BLUETOOTH_JNI_BENCHMARK_ANDROID_RUNTIME_LOG_H
@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Benchmark replacement for the vendor HAL extension header, which lives
+ * outside AOSP. AdapterService only keeps a pointer to the interface, so an
+ * opaque type is enough; the vendor JNI sources are not part of the
+ * benchmark and fake_hal.cpp registers no vendor natives.
+ */
+
+#ifndef BLUETOOTH_JNI_BENCHMARK_HARDWARE_VENDOR_H
+#define BLUETOOTH_JNI_BENCHMARK_HARDWARE_VENDOR_H
+
+typedef struct btvendor_interface_t btvendor_interface_t;
+
+#endif  // BLUETOOTH_JNI_BENCHMARK_HARDWARE_VENDOR_H
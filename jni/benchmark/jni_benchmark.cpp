@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host benchmarks for the HAL -> Java upcall paths of libbluetooth_jni.
+ *
+ * The JNI sources are linked unmodified against a fake HAL (fake_hal.cpp) and
+ * a fake JNIEnv (fake_jni.cpp). Each benchmark invokes a HAL callback the way
+ * the stack would and reports, besides the default time per iteration:
+ *   allocs/op  - Java objects, arrays and strings created per callback
+ *   upcalls/op - Call*Method invocations per callback
+ * Allocation counts are deterministic and comparable across changes; timings
+ * only reflect the native marshalling cost since no Java code runs. Local
+ * references left over by a callback are dropped after every iteration, as
+ * the JVM would on return, so the heap stays flat over the run.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "cutils/properties.h"
+#include "fake_hal.h"
+#include "fake_jni.h"
+
+namespace bluetooth_jni_benchmark {
+namespace {
+
+typedef void (*ClassInitNativeFn)(JNIEnv*, jclass);
+typedef void (*InitNativeFn)(JNIEnv*, jobject);
+typedef jboolean (*AdapterInitNativeFn)(JNIEnv*, jobject);
+typedef void (*ConnIdNativeFn)(JNIEnv*, jobject, jint);
+
+const char kAdapterService[] = "com/android/bluetooth/btservice/AdapterService";
+const char kGattService[] = "com/android/bluetooth/gatt/GattService";
+const char kSdpManager[] = "com/android/bluetooth/sdp/SdpManager";
+const char kAvrcpControllerService[] =
+    "com/android/bluetooth/avrcpcontroller/AvrcpControllerService";
+
+const RawAddress kRemoteAddress = {{0x00, 0x11, 0x22, 0x33, 0x44, 0x55}};
+
+/* Looks up a registered native, aborting if the library under test does not
+ * register it: every result below would be meaningless without it. */
+template <typename Fn>
+Fn FindNative(const char* class_name, const char* method_name) {
+  void* fn = FakeJniFindNative(class_name, method_name);
+  if (fn == NULL) {
+    fprintf(stderr, "%s.%s is not registered\n", class_name, method_name);
+    abort();
+  }
+  return reinterpret_cast<Fn>(fn);
+}
+
+void ClassInit(JNIEnv* env, const char* class_name) {
+  ClassInitNativeFn fn =
+      FindNative<ClassInitNativeFn>(class_name, "classInitNative");
+  jclass clazz = env->FindClass(class_name);
+  fn(env, clazz);
+  env->DeleteLocalRef(clazz);
+}
+
+void Init(JNIEnv* env, const char* class_name, const char* method_name) {
+  InitNativeFn fn = FindNative<InitNativeFn>(class_name, method_name);
+  jobject object = FakeJniNewObject(class_name);
+  fn(env, object);
+  env->DeleteLocalRef(object);
+}
+
+/* Loads the library and brings up the profiles exercised below, mirroring
+ * what AdapterService and the profile services do on the Java side. */
+void SetUpOnce() {
+  static bool done = false;
+  if (done) return;
+  done = true;
+
+  JNIEnv* env = FakeJniEnv();
+  JNI_OnLoad(FakeJavaVM(), NULL);
+
+  ClassInit(env, kAdapterService);
+  AdapterInitNativeFn adapter_init =
+      FindNative<AdapterInitNativeFn>(kAdapterService, "initNative");
+  jobject adapter = FakeJniNewObject(kAdapterService);
+  adapter_init(env, adapter);
+  env->DeleteLocalRef(adapter);
+  FakeHalBluetoothCallbacks()->thread_evt_cb(ASSOCIATE_JVM);
+
+  ClassInit(env, kGattService);
+  Init(env, kGattService, "initializeNative");
+  ClassInit(env, kSdpManager);
+  Init(env, kSdpManager, "initializeNative");
+  ClassInit(env, kAvrcpControllerService);
+  Init(env, kAvrcpControllerService, "initNative");
+}
+
+/* Snapshots the fake JNIEnv counters around the timed loop. */
+class JniCounters {
+ public:
+  explicit JniCounters(benchmark::State& state)
+      : state_(state), start_(FakeJniGetStats()) {}
+
+  ~JniCounters() {
+    FakeJniStats end = FakeJniGetStats();
+    state_.counters["allocs/op"] =
+        benchmark::Counter(end.allocations - start_.allocations,
+                           benchmark::Counter::kAvgIterations);
+    state_.counters["upcalls/op"] = benchmark::Counter(
+        end.upcalls - start_.upcalls, benchmark::Counter::kAvgIterations);
+  }
+
+ private:
+  benchmark::State& state_;
+  FakeJniStats start_;
+};
+
+/* LE scan result carrying an advertising payload of state.range(0) bytes. */
+void BM_ScanResult(benchmark::State& state) {
+  SetUpOnce();
+  const btgatt_scanner_callbacks_t* scanner = FakeHalGattCallbacks()->scanner;
+  RawAddress bda = kRemoteAddress;
+  std::vector<uint8_t> adv_data(state.range(0), 0xA5);
+
+  JniCounters counters(state);
+  while (state.KeepRunning()) {
+    scanner->scan_result_cb(0x0013, 0x00, &bda, 0x01, 0x00, 0xFF, 127, -60, 0,
+                            adv_data);
+    FakeJniDeleteLocalRefs();
+  }
+}
+BENCHMARK(BM_ScanResult)->Arg(31)->Arg(251);
+
+/* Characteristic notification of state.range(0) bytes. */
+void BM_Notify(benchmark::State& state) {
+  SetUpOnce();
+  const btgatt_client_callbacks_t* client = FakeHalGattCallbacks()->client;
+  btgatt_notify_params_t params;
+  memset(&params, 0, sizeof(params));
+  params.bda = kRemoteAddress;
+  params.handle = 0x002A;
+  params.len = state.range(0);
+  params.is_notify = 1;
+
+  JniCounters counters(state);
+  while (state.KeepRunning()) {
+    client->notify_cb(1, params);
+    FakeJniDeleteLocalRefs();
+  }
+}
+BENCHMARK(BM_Notify)->Arg(20)->Arg(244);
+
+/* Remote GATT database of |count| elements in services of |service_len|
+ * elements: each service followed by characteristic/descriptor pairs. */
+std::vector<btgatt_db_element_t> MakeGattDb(size_t count, size_t service_len) {
+  std::vector<btgatt_db_element_t> db(count);
+  for (size_t i = 0; i < db.size(); i++) {
+    btgatt_db_element_t& el = db[i];
+    memset(&el, 0, sizeof(el));
+    el.id = i + 1;
+    el.uuid.uu[12] = i & 0xFF;
+    el.attribute_handle = i + 1;
+    size_t pos = i % service_len;
+    if (pos == 0) {
+      el.type = BTGATT_DB_PRIMARY_SERVICE;
+      el.start_handle = i + 1;
+      el.end_handle = std::min(i + service_len, db.size());
+    } else if (pos % 2) {
+      el.type = BTGATT_DB_CHARACTERISTIC;
+      el.properties = 0x12;
+    } else {
+      el.type = BTGATT_DB_DESCRIPTOR;
+    }
+  }
+  return db;
+}
+
+/* Full GATT database delivery of state.range(0) elements in one service, as
+ * after the first discovery on a connection. */
+void BM_GetGattDb(benchmark::State& state) {
+  SetUpOnce();
+  const btgatt_client_callbacks_t* client = FakeHalGattCallbacks()->client;
+  ConnIdNativeFn forget =
+      FindNative<ConnIdNativeFn>(kGattService, "gattClientForgetGattDbNative");
+  std::vector<btgatt_db_element_t> db =
+      MakeGattDb(state.range(0), state.range(0));
+
+  JniCounters counters(state);
+  while (state.KeepRunning()) {
+    forget(FakeJniEnv(), NULL, 1);
+    client->get_gatt_db_cb(1, db.data(), db.size());
+    FakeJniDeleteLocalRefs();
+  }
+}
+BENCHMARK(BM_GetGattDb)->Arg(8)->Arg(64)->Arg(256);
+
+/* Rediscovery of a database of state.range(0) elements in services of 8
+ * elements where a single service toggles a characteristic property. */
+void BM_GetGattDbServiceChanged(benchmark::State& state) {
+  SetUpOnce();
+  const btgatt_client_callbacks_t* client = FakeHalGattCallbacks()->client;
+  std::vector<btgatt_db_element_t> db = MakeGattDb(state.range(0), 8);
+  client->get_gatt_db_cb(2, db.data(), db.size());
+
+  JniCounters counters(state);
+  while (state.KeepRunning()) {
+    db[1].properties ^= 0x08;
+    client->get_gatt_db_cb(2, db.data(), db.size());
+    FakeJniDeleteLocalRefs();
+  }
+}
+BENCHMARK(BM_GetGattDbServiceChanged)->Arg(64)->Arg(256);
+
+/* AVRCP browsing response with state.range(0) media items, each carrying
+ * state.range(1) element attributes. */
+void BM_AvrcpGetFolderItems(benchmark::State& state) {
+  SetUpOnce();
+  btrc_ctrl_callbacks_t* callbacks = FakeHalAvrcpCtrlCallbacks();
+  RawAddress bda = kRemoteAddress;
+  std::vector<btrc_element_attr_val_t> attrs(state.range(1));
+  for (size_t i = 0; i < attrs.size(); i++) {
+    attrs[i].attr_id = i + 1;
+    snprintf(reinterpret_cast<char*>(attrs[i].text), sizeof(attrs[i].text),
+             "Attribute value %zu", i);
+  }
+  std::vector<btrc_folder_items_t> items(state.range(0));
+  for (size_t i = 0; i < items.size(); i++) {
+    btrc_folder_items_t& item = items[i];
+    memset(&item, 0, sizeof(item));
+    item.item_type = BTRC_ITEM_MEDIA;
+    item.media.uid[7] = i & 0xFF;
+    item.media.charset_id = BTRC_CHARSET_ID_UTF8;
+    item.media.type = BTRC_MEDIA_TYPE_AUDIO;
+    snprintf(reinterpret_cast<char*>(item.media.name), sizeof(item.media.name),
+             "Track %zu", i);
+    item.media.num_attrs = attrs.size();
+    item.media.p_attrs = attrs.data();
+  }
+
+  JniCounters counters(state);
+  while (state.KeepRunning()) {
+    callbacks->get_folder_items_cb(&bda, BTRC_STS_NO_ERROR, items.data(),
+                                   items.size());
+    FakeJniDeleteLocalRefs();
+  }
+}
+BENCHMARK(BM_AvrcpGetFolderItems)->Args({10, 2})->Args({100, 7});
+
+/* SDP search for MAP MAS returning state.range(0) records. */
+void BM_SdpSearchMas(benchmark::State& state) {
+  SetUpOnce();
+  // With the SDP cache on, every search would also store its records and
+  // schedule a cache file write.
+  if (property_get_int32("persist.bt.sdp.cache_ttl_s", 0) > 0) {
+    state.SkipWithError("SDP cache enabled by persist.bt.sdp.cache_ttl_s");
+    return;
+  }
+  btsdp_callbacks_t* callbacks = FakeHalSdpCallbacks();
+  RawAddress bda = kRemoteAddress;
+  uint8_t uuid[] = {0x00, 0x00, 0x11, 0x32, 0x00, 0x00, 0x10, 0x00,
+                    0x80, 0x00, 0x00, 0x80, 0x5F, 0x9B, 0x34, 0xFB};
+  std::vector<std::string> names(state.range(0));
+  std::vector<bluetooth_sdp_record> records(state.range(0));
+  for (size_t i = 0; i < records.size(); i++) {
+    bluetooth_sdp_mas_record& mas = records[i].mas;
+    memset(&records[i], 0, sizeof(records[i]));
+    names[i] = "MAP MAS " + std::to_string(i);
+    mas.hdr.type = SDP_TYPE_MAP_MAS;
+    mas.hdr.service_name = const_cast<char*>(names[i].c_str());
+    mas.hdr.service_name_length = names[i].size();
+    mas.hdr.rfcomm_channel_number = 2 + i;
+    mas.hdr.l2cap_psm = 0x1005;
+    mas.hdr.profile_version = 0x0102;
+    mas.mas_instance_id = i;
+    mas.supported_features = 0x7F;
+    mas.supported_message_types = 0x0F;
+  }
+
+  JniCounters counters(state);
+  while (state.KeepRunning()) {
+    callbacks->sdp_search_cb(BT_STATUS_SUCCESS, &bda, uuid, records.size(),
+                             records.data());
+    FakeJniDeleteLocalRefs();
+  }
+}
+BENCHMARK(BM_SdpSearchMas)->Arg(1)->Arg(4);
+
+}  // namespace
+}  // namespace bluetooth_jni_benchmark
+
+BENCHMARK_MAIN();
@@ -27,21 +27,46 @@
 #include "nativehelper/ScopedLocalRef.h"
 #include "utils/Log.h"
 
+#include <chrono>
+
 namespace android {
 
 JNIEnv* getCallbackEnv();
 
+/**
+ * Optional per-callback upcall statistics, enabled by the
+ * persist.bt.callback_stats property. CallbackEnv reports the time spent in
+ * its scope and whether the upcall threw; the results are written by
+ * dumpCallbackStats() as part of the adapter dump. Upcalls from native worker
+ * threads bypass CallbackEnv and are excluded.
+ */
+bool callbackStatsEnabled();
+
+void recordCallbackStats(const char* name, uint64_t elapsed_ns,
+                         bool exception);
+
+void dumpCallbackStats(int fd);
+
 class CallbackEnv {
 public:
-    CallbackEnv(const char *methodName) : mName(methodName) {
+    CallbackEnv(const char *methodName) : mName(methodName), mStart() {
         mCallbackEnv = getCallbackEnv();
+        if (callbackStatsEnabled()) mStart = std::chrono::steady_clock::now();
     }
 
     ~CallbackEnv() {
+      bool exception = false;
       if (mCallbackEnv && mCallbackEnv->ExceptionCheck()) {
           ALOGE("An exception was thrown by callback '%s'.", mName);
           LOGE_EX(mCallbackEnv);
           mCallbackEnv->ExceptionClear();
+          exception = true;
+      }
+
+      if (mStart.time_since_epoch().count() != 0) {
+          std::chrono::nanoseconds elapsed =
+              std::chrono::steady_clock::now() - mStart;
+          recordCallbackStats(mName, elapsed.count(), exception);
       }
     }
 
@@ -65,12 +90,30 @@ public:
 private:
     JNIEnv *mCallbackEnv;
     const char *mName;
+    std::chrono::steady_clock::time_point mStart;
 
     DISALLOW_COPY_AND_ASSIGN(CallbackEnv);
 };
 
 const bt_interface_t* getBluetoothInterface();
 
+/**
+ * Interned Java representations of remote device addresses, shared by all
+ * profile callbacks. The returned local references point to cached objects
+ * and must be treated as read-only; they return NULL on allocation failure.
+ */
+jbyteArray getAddressByteArray(JNIEnv* env, const RawAddress& bd_addr);
+
+jstring getAddressString(JNIEnv* env, const RawAddress& bd_addr);
+
+void clearAddressCache(JNIEnv* env);
+
+/* Drops the cached SDP search results of a device. */
+void sdpCacheInvalidate(const RawAddress& bd_addr);
+
+/* Drops the cached GATT database of a device. */
+void gattCacheInvalidate(const RawAddress& bd_addr);
+
 int register_com_android_bluetooth_hfp(JNIEnv* env);
 
 int register_com_android_bluetooth_hfpclient(JNIEnv* env);
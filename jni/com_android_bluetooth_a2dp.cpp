@@ -61,14 +61,12 @@ static void bta2dp_connection_state_callback(btav_connection_state_t state,
   if (!sCallbackEnv.valid()) return;
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr for connection state");
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onConnectionStateChanged,
                                (jint)state, addr.get());
 }
@@ -80,14 +78,12 @@ static void bta2dp_audio_state_callback(btav_audio_state_t state,
   if (!sCallbackEnv.valid()) return;
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr for connection state");
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onAudioStateChanged,
                                (jint)state, addr.get());
 }
@@ -102,13 +98,11 @@ static void bta2dp_audio_config_callback(
   if (!sCallbackEnv.valid()) return;
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr for connection state");
     return;
   }
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
 
   jobject codecConfigObj = sCallbackEnv->NewObject(
       android_bluetooth_BluetoothCodecConfig.clazz,
@@ -164,13 +158,12 @@ static void bta2dp_connection_priority_callback(RawAddress* bd_addr) {
   if (!sCallbackEnv.valid()) return;
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr for connection priority");
     return;
   }
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*) bd_addr);
+
   sCallbackEnv->CallVoidMethod(mCallbacksObj,
                                method_onCheckConnectionPriority, addr.get());
 }
@@ -188,13 +181,12 @@ static void bta2dp_reconfig_a2dp_trigger_callback(int reason, RawAddress* bd_add
   CallbackEnv sCallbackEnv(__func__);
   if (!sCallbackEnv.valid()) return;
   ScopedLocalRef<jbyteArray> addr(
-    sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+    sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
       ALOGE("Fail to new jbyteArray bd addr for connection state");
       return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress), (jbyte*) bd_addr);
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onReconfigA2dpTriggered, reason, addr.get());
 }
 
@@ -28,8 +28,13 @@
 #include "utils/Log.h"
 
 #include <string.h>
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <shared_mutex>
+#include <vector>
 
 namespace android {
 static jmethodID method_getRcFeatures;
@@ -60,17 +65,145 @@ static const btrc_interface_t *sBluetoothAvrcpInterface = NULL;
 static jobject mCallbacksObj = NULL;
 static std::shared_timed_mutex callbacks_mutex;
 
+/* Bump-pointer arena backing the structures passed to the *_rsp calls of
+ * sBluetoothAvrcpInterface. The stack copies a response before the call
+ * returns, so the whole arena is reset once the response has been sent. After
+ * warm-up a response fits in the retained block and needs no heap allocation.
+ */
+#define RSP_ARENA_BLOCK_SIZE (16 * 1024)
+#define RSP_ARENA_MAX_RETAINED (256 * 1024)
+
+class RspArena {
+ public:
+  void* alloc(size_t size) {
+    size = (size + kAlign - 1) & ~(kAlign - 1);
+    if (blocks_.empty() || blocks_.back().size - used_ < size) {
+      size_t block_size = blocks_.empty() ? (size_t)RSP_ARENA_BLOCK_SIZE
+                                          : blocks_.back().size * 2;
+      block_size = std::max(block_size, size);
+      blocks_.push_back(
+          {std::unique_ptr<uint8_t[]>(new uint8_t[block_size]), block_size});
+      used_ = 0;
+    }
+    void* ptr = blocks_.back().data.get() + used_;
+    used_ += size;
+    return ptr;
+  }
+
+  /* Keeps only the newest, largest block unless it grew past the limit. */
+  void reset() {
+    if (blocks_.empty()) return;
+    if (blocks_.back().size > RSP_ARENA_MAX_RETAINED) {
+      blocks_.clear();
+    } else if (blocks_.size() > 1) {
+      blocks_.erase(blocks_.begin(), blocks_.end() - 1);
+    }
+    used_ = 0;
+  }
+
+ private:
+  static const size_t kAlign = alignof(std::max_align_t);
+
+  struct Block {
+    std::unique_ptr<uint8_t[]> data;
+    size_t size;
+  };
+
+  std::vector<Block> blocks_;
+  size_t used_ = 0;
+};
+
+static RspArena sRspArena;
+static std::mutex sRspArenaMutex;
+
+/* Holds the response arena for the duration of one *_rsp native and resets
+ * it on every return path. */
+class RspArenaScope {
+ public:
+  RspArenaScope() : lock_(sRspArenaMutex) {}
+  ~RspArenaScope() { sRspArena.reset(); }
+
+  template <typename T>
+  T* alloc(size_t count) {
+    return static_cast<T*>(sRspArena.alloc(count * sizeof(T)));
+  }
+
+ private:
+  std::lock_guard<std::mutex> lock_;
+  DISALLOW_COPY_AND_ASSIGN(RspArenaScope);
+};
+
+/* Element attributes Java last returned for the current track, per device.
+ * Head units poll GetElementAttributes for the same track repeatedly; polls
+ * whose attributes are all cached are answered here without an upcall. An
+ * entry is dropped on every track change notification to its device and on
+ * its disconnect. All entries are dropped whenever Java replaces the
+ * attributes it answers from, changes the addressed player, or sees a device
+ * disconnect.
+ */
+struct ElementAttrCache {
+  bool valid[BTRC_MAX_ELEM_ATTR_SIZE];
+  btrc_element_attr_val_t attrs[BTRC_MAX_ELEM_ATTR_SIZE];
+};
+
+static std::map<RawAddress, ElementAttrCache> sElementAttrCache;
+static std::mutex sElementAttrCacheMutex;
+
+static void element_attr_cache_store(const RawAddress& bd_addr, int num_attr,
+                                     const btrc_element_attr_val_t* p_attrs) {
+  std::lock_guard<std::mutex> lock(sElementAttrCacheMutex);
+  auto it = sElementAttrCache.find(bd_addr);
+  if (it == sElementAttrCache.end()) {
+    it = sElementAttrCache.insert({bd_addr, ElementAttrCache()}).first;
+    memset(it->second.valid, 0, sizeof(it->second.valid));
+  }
+
+  for (int i = 0; i < num_attr; i++) {
+    uint32_t id = p_attrs[i].attr_id;
+    if (id < 1 || id > BTRC_MAX_ELEM_ATTR_SIZE) continue;
+    it->second.attrs[id - 1] = p_attrs[i];
+    it->second.valid[id - 1] = true;
+  }
+}
+
+/* Fills |p_out| with the requested attributes, in request order. Returns
+ * false unless every one of them is cached. */
+static bool element_attr_cache_lookup(const RawAddress& bd_addr, int num_attr,
+                                      const btrc_media_attr_t* p_ids,
+                                      btrc_element_attr_val_t* p_out) {
+  if (num_attr == 0 || num_attr > BTRC_MAX_ELEM_ATTR_SIZE) return false;
+
+  std::lock_guard<std::mutex> lock(sElementAttrCacheMutex);
+  auto it = sElementAttrCache.find(bd_addr);
+  if (it == sElementAttrCache.end()) return false;
+
+  for (int i = 0; i < num_attr; i++) {
+    uint32_t id = p_ids[i];
+    if (id < 1 || id > BTRC_MAX_ELEM_ATTR_SIZE || !it->second.valid[id - 1])
+      return false;
+    p_out[i] = it->second.attrs[id - 1];
+  }
+  return true;
+}
+
+/* Drops the entry of |bd_addr|, or every entry if it is NULL. */
+static void element_attr_cache_invalidate(const RawAddress* bd_addr) {
+  std::lock_guard<std::mutex> lock(sElementAttrCacheMutex);
+  if (bd_addr)
+    sElementAttrCache.erase(*bd_addr);
+  else
+    sElementAttrCache.clear();
+}
+
 /* Function declarations */
 static bool copy_item_attributes(JNIEnv* env, jobject object,
                                  btrc_folder_items_t* pitem,
                                  jint* p_attributesIds,
                                  jobjectArray attributesArray, int item_idx,
-                                 int attribCopiedIndex);
+                                 int attribCopiedIndex, RspArenaScope& arena);
 
 static bool copy_jstring(uint8_t* str, int maxBytes, jstring jstr, JNIEnv* env);
 
-static void cleanup_items(btrc_folder_items_t* p_items, int numItems);
-
 static void btavrcp_remote_features_callback(RawAddress* bd_addr,
                                              btrc_remote_features_t features) {
   CallbackEnv sCallbackEnv(__func__);
@@ -83,14 +216,12 @@ static void btavrcp_remote_features_callback(RawAddress* bd_addr,
   }
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr for remote features");
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_getRcFeatures, addr.get(),
                                (jint)features, addr.get());
 }
@@ -107,14 +238,12 @@ static void btavrcp_get_play_status_callback(RawAddress* bd_addr) {
   }
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr for get_play_status command");
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_getPlayStatus, addr.get());
 }
 
@@ -130,14 +259,12 @@ static void btavrcp_get_player_seeting_value_callback(btrc_player_attr_t player_
   }
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr for get_play_status command");
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress), (jbyte*) bd_addr);
-
   sCallbackEnv->CallVoidMethod(mCallbacksObj ,method_onListPlayerAttributeValues,
                               (jbyte)player_att, addr.get());
 }
@@ -153,14 +280,12 @@ static void btavrcp_get_player_attribute_id_callback(RawAddress* bd_addr) {
   }
 
   ScopedLocalRef<jbyteArray> addr(
-  sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+  sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr for get_play_status command");
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress), (jbyte*) bd_addr);
-
   sCallbackEnv->CallVoidMethod(mCallbacksObj,method_onListPlayerAttributeRequest, addr.get());
 }
 
@@ -177,14 +302,12 @@ static void btavrcp_getcurrent_player_app_setting_values( uint8_t num_attr,
   }
 
   ScopedLocalRef<jbyteArray> addr(
-  sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+  sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr for get_play_status command");
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress), (jbyte*) bd_addr);
-
   ScopedLocalRef<jintArray> attrs(
   sCallbackEnv.get(), (jintArray) sCallbackEnv->NewIntArray(sizeof(RawAddress)));
   if (!attrs.get()) {
@@ -210,14 +333,12 @@ static void btavrcp_set_playerapp_setting_value_callback(btrc_player_settings_t
   }
 
   ScopedLocalRef<jbyteArray> addr(
-  sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+  sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr for get_play_status command");
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress), (jbyte*) bd_addr);
-
   ScopedLocalRef<jbyteArray> attrs_ids(
   sCallbackEnv.get(), sCallbackEnv->NewByteArray(attr->num_attr));
   if (!attrs_ids.get()) {
@@ -250,14 +371,12 @@ static void btavrcp_getPlayer_app_attribute_text(uint8_t num , btrc_player_attr_
   }
 
   ScopedLocalRef<jbyteArray> addr(
-  sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+  sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr for getPlayer_app_attribute_text command");
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress), (jbyte*) bd_addr);
-
   ScopedLocalRef<jbyteArray> attrs(
   sCallbackEnv.get(), sCallbackEnv->NewByteArray(num));
   if (!attrs.get()) {
@@ -282,14 +401,12 @@ static void btavrcp_getPlayer_app_value_text(uint8_t attr_id , uint8_t num_val ,
   }
 
   ScopedLocalRef<jbyteArray> addr(
-  sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+  sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr for getPlayer_app_value_text command");
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress), (jbyte*) bd_addr);
-
   ScopedLocalRef<jbyteArray> Attr_Value(
   sCallbackEnv.get(), sCallbackEnv->NewByteArray(num_val));
   if (!Attr_Value.get()) {
@@ -313,8 +430,19 @@ static void btavrcp_get_element_attr_callback(uint8_t num_attr,
     return;
   }
 
+  btrc_element_attr_val_t cached[BTRC_MAX_ELEM_ATTR_SIZE];
+  if (sBluetoothAvrcpInterface &&
+      element_attr_cache_lookup(*bd_addr, num_attr, p_attrs, cached)) {
+    bt_status_t status =
+        sBluetoothAvrcpInterface->get_element_attr_rsp(bd_addr, num_attr,
+                                                       cached);
+    if (status == BT_STATUS_SUCCESS) return;
+    ALOGE("%s: cached get_element_attr_rsp failed, status: %d", __func__,
+          status);
+  }
+
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr for get_element_attr command");
     return;
@@ -329,8 +457,6 @@ static void btavrcp_get_element_attr_callback(uint8_t num_attr,
 
   sCallbackEnv->SetIntArrayRegion(attrs.get(), 0, num_attr, (jint*)p_attrs);
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_getElementAttr, addr.get(),
                                (jbyte)num_attr, attrs.get());
 }
@@ -348,14 +474,12 @@ static void btavrcp_register_notification_callback(btrc_event_id_t event_id,
   }
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr for register_notification command");
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_registerNotification,
                                addr.get(), (jint)event_id, (jint)param);
 }
@@ -372,15 +496,12 @@ static void btavrcp_volume_change_callback(uint8_t volume, uint8_t ctype,
   }
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr for volume_change command");
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
-
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_volumeChangeCallback,
                                addr.get(), (jint)volume, (jint)ctype);
 }
@@ -397,13 +518,11 @@ static void btavrcp_passthrough_command_callback(int id, int pressed,
   }
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr for passthrough_command command");
     return;
   }
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
 
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_handlePassthroughCmd,
                                addr.get(), (jint)id, (jint)pressed);
@@ -421,14 +540,12 @@ static void btavrcp_set_addressed_player_callback(uint16_t player_id,
   }
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr for set_addressed_player command");
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_setAddressedPlayerCallback,
                                addr.get(), (jint)player_id);
 }
@@ -444,13 +561,11 @@ static void btavrcp_set_browsed_player_callback(uint16_t player_id,
   }
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr for set_browsed_player command");
     return;
   }
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
 
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_setBrowsedPlayerCallback,
                                addr.get(), (jint)player_id);
@@ -469,7 +584,7 @@ static void btavrcp_get_folder_items_callback(
   }
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr for get_folder_items command");
     return;
@@ -477,8 +592,6 @@ static void btavrcp_get_folder_items_callback(
 
   uint32_t* puiAttr = (uint32_t*)p_attr_ids;
   ScopedLocalRef<jintArray> attr_ids(sCallbackEnv.get(), NULL);
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
 
   /* check number of attributes requested by remote device */
   if ((num_attr != BTRC_NUM_ATTR_ALL) && (num_attr != BTRC_NUM_ATTR_NONE)) {
@@ -517,14 +630,12 @@ static void btavrcp_change_path_callback(uint8_t direction, uint8_t* folder_uid,
   }
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr for change_path command");
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
   sCallbackEnv->SetByteArrayRegion(
       attrs.get(), 0, sizeof(uint8_t) * BTRC_UID_SIZE, (jbyte*)folder_uid);
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_changePathCallback,
@@ -553,7 +664,7 @@ static void btavrcp_get_item_attr_callback(uint8_t scope, uint8_t* uid,
   }
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr for get_item_attr command");
     return;
@@ -566,8 +677,6 @@ static void btavrcp_get_item_attr_callback(uint8_t scope, uint8_t* uid,
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
   sCallbackEnv->SetIntArrayRegion(attrs.get(), 0, num_attr, (jint*)p_attrs);
   sCallbackEnv->SetByteArrayRegion(
       attr_uid.get(), 0, sizeof(uint8_t) * BTRC_UID_SIZE, (jbyte*)uid);
@@ -595,14 +704,12 @@ static void btavrcp_play_item_callback(uint8_t scope, uint16_t uid_counter,
   }
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr for play_item command");
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
   sCallbackEnv->SetByteArrayRegion(
       attrs.get(), 0, sizeof(uint8_t) * BTRC_UID_SIZE, (jbyte*)uid);
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_playItemCallback,
@@ -613,6 +720,8 @@ static void btavrcp_play_item_callback(uint8_t scope, uint16_t uid_counter,
 static void btavrcp_connection_state_callback(bool rc_connect, bool br_connect,
                                               RawAddress* bd_addr) {
   ALOGI("%s: conn state: rc: %d br: %d", __func__, rc_connect, br_connect);
+  if (!rc_connect) element_attr_cache_invalidate(bd_addr);
+
   CallbackEnv sCallbackEnv(__func__);
   std::shared_lock<std::shared_timed_mutex> lock(callbacks_mutex);
   if (!sCallbackEnv.valid()) return;
@@ -622,14 +731,12 @@ static void btavrcp_connection_state_callback(bool rc_connect, bool br_connect,
   }
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr for connection state");
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onConnectionStateChanged,
                                (jboolean)rc_connect, (jboolean)br_connect,
                                addr.get());
@@ -646,14 +753,12 @@ static void btavrcp_get_total_num_items_callback(uint8_t scope,
   }
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr for get_total_num_items command");
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_getTotalNumOfItemsCallback,
                                addr.get(), (jbyte)scope);
 }
@@ -676,14 +781,12 @@ static void btavrcp_search_callback(uint16_t charset_id, uint16_t str_len,
   }
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr for search command");
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
   sCallbackEnv->SetByteArrayRegion(attrs.get(), 0, str_len * sizeof(uint8_t),
                                    (jbyte*)p_str);
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_searchCallback, addr.get(),
@@ -702,7 +805,7 @@ static void btavrcp_add_to_play_list_callback(uint8_t scope, uint8_t* uid,
   }
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr for add_to_play_list command");
     return;
@@ -715,8 +818,6 @@ static void btavrcp_add_to_play_list_callback(uint8_t scope, uint8_t* uid,
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
   sCallbackEnv->SetByteArrayRegion(
       attrs.get(), 0, sizeof(uint8_t) * BTRC_UID_SIZE, (jbyte*)uid);
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_addToPlayListCallback,
@@ -876,6 +977,8 @@ static void cleanupNative(JNIEnv* env, jobject object) {
     env->DeleteGlobalRef(mCallbacksObj);
     mCallbacksObj = NULL;
   }
+
+  element_attr_cache_invalidate(NULL);
 }
 
 static jboolean getPlayStatusRspNative(JNIEnv* env, jobject object,
@@ -1228,16 +1331,12 @@ static jboolean getElementAttrRspNative(JNIEnv* env, jobject object,
     return JNI_FALSE;
   }
 
-  btrc_element_attr_val_t* pAttrs = new btrc_element_attr_val_t[numAttr];
-  if (!pAttrs) {
-    ALOGE("get_element_attr_rsp: not have enough memeory");
-    env->ReleaseByteArrayElements(address, addr, 0);
-    return JNI_FALSE;
-  }
+  RspArenaScope arena;
+  btrc_element_attr_val_t* pAttrs =
+      arena.alloc<btrc_element_attr_val_t>(numAttr);
 
   jint* attr = env->GetIntArrayElements(attrIds, NULL);
   if (!attr) {
-    delete[] pAttrs;
     jniThrowIOException(env, EINVAL);
     env->ReleaseByteArrayElements(address, addr, 0);
     return JNI_FALSE;
@@ -1256,7 +1355,6 @@ static jboolean getElementAttrRspNative(JNIEnv* env, jobject object,
   }
 
   if (attr_cnt < numAttr) {
-    delete[] pAttrs;
     env->ReleaseIntArrayElements(attrIds, attr, 0);
     ALOGE("%s: Failed to copy attributes", __func__);
     return JNI_FALSE;
@@ -1267,14 +1365,19 @@ static jboolean getElementAttrRspNative(JNIEnv* env, jobject object,
       sBluetoothAvrcpInterface->get_element_attr_rsp(btAddr, numAttr, pAttrs);
   if (status != BT_STATUS_SUCCESS) {
     ALOGE("Failed get_element_attr_rsp, status: %d", status);
+  } else {
+    element_attr_cache_store(*btAddr, numAttr, pAttrs);
   }
 
-  delete[] pAttrs;
   env->ReleaseIntArrayElements(attrIds, attr, 0);
   env->ReleaseByteArrayElements(address, addr, 0);
   return (status == BT_STATUS_SUCCESS) ? JNI_TRUE : JNI_FALSE;
 }
 
+static void invalidateElementAttrCacheNative(JNIEnv* env, jobject object) {
+  element_attr_cache_invalidate(NULL);
+}
+
 static jboolean getItemAttrRspNative(JNIEnv* env, jobject object,
                                      jbyteArray address, jint rspStatus,
                                      jbyte numAttr, jintArray attrIds,
@@ -1295,18 +1398,14 @@ static jboolean getItemAttrRspNative(JNIEnv* env, jobject object,
     return JNI_FALSE;
   }
 
-  btrc_element_attr_val_t* pAttrs = new btrc_element_attr_val_t[numAttr];
-  if (!pAttrs) {
-    ALOGE("%s: not have enough memory", __func__);
-    env->ReleaseByteArrayElements(address, addr, 0);
-    return JNI_FALSE;
-  }
+  RspArenaScope arena;
+  btrc_element_attr_val_t* pAttrs =
+      arena.alloc<btrc_element_attr_val_t>(numAttr);
 
   jint* attr = NULL;
   if (attrIds != NULL) {
     attr = env->GetIntArrayElements(attrIds, NULL);
     if (!attr) {
-      delete[] pAttrs;
       jniThrowIOException(env, EINVAL);
       env->ReleaseByteArrayElements(address, addr, 0);
       return JNI_FALSE;
@@ -1331,7 +1430,6 @@ static jboolean getItemAttrRspNative(JNIEnv* env, jobject object,
   if (status != BT_STATUS_SUCCESS)
     ALOGE("Failed get_item_attr_rsp, status: %d", status);
 
-  if (pAttrs) delete[] pAttrs;
   if (attr) env->ReleaseIntArrayElements(attrIds, attr, 0);
   env->ReleaseByteArrayElements(address, addr, 0);
 
@@ -1452,6 +1550,8 @@ static jboolean registerNotificationRspTrackChangeNative(JNIEnv* env,
   ALOGV("%s: Sending track change notification: %d -> %llu", __func__, type,
         uid);
 
+  element_attr_cache_invalidate((RawAddress*)addr);
+
   bt_status_t status = sBluetoothAvrcpInterface->register_notification_rsp(
       BTRC_EVT_TRACK_CHANGE, (btrc_notification_type_t)type, &param,
       (RawAddress *)addr);
@@ -1655,6 +1755,7 @@ static jboolean mediaPlayerListRspNative(
   jshort* p_FeatBitMaskValues = NULL;
   jint *p_playerIds = NULL, *p_playerSubTypes = NULL;
   btrc_folder_items_t* p_items = NULL;
+  RspArenaScope arena;
   if (rspStatus == BTRC_STS_NO_ERROR) {
     /* allocate memory */
     p_playerIds = env->GetIntArrayElements(playerIds, NULL);
@@ -1662,7 +1763,7 @@ static jboolean mediaPlayerListRspNative(
     p_playerSubTypes = env->GetIntArrayElements(playerSubtypes, NULL);
     p_PlayStatusValues = env->GetByteArrayElements(playStatusValues, NULL);
     p_FeatBitMaskValues = env->GetShortArrayElements(featureBitmask, NULL);
-    p_items = new btrc_folder_items_t[numItems];
+    p_items = arena.alloc<btrc_folder_items_t>(numItems);
     /* deallocate memory and return if allocation failed */
     if (!p_playerIds || !p_playerTypes || !p_playerSubTypes ||
         !p_PlayStatusValues || !p_FeatBitMaskValues || !p_items) {
@@ -1675,7 +1776,6 @@ static jboolean mediaPlayerListRspNative(
         env->ReleaseByteArrayElements(playStatusValues, p_PlayStatusValues, 0);
       if (p_FeatBitMaskValues)
         env->ReleaseShortArrayElements(featureBitmask, p_FeatBitMaskValues, 0);
-      if (p_items) delete[] p_items;
 
       jniThrowIOException(env, EINVAL);
       ALOGE("%s: not have enough memory", __func__);
@@ -1722,7 +1822,6 @@ static jboolean mediaPlayerListRspNative(
   }
 
   /* release allocated memory */
-  if (p_items) delete[] p_items;
   if (p_playerTypes)
     env->ReleaseByteArrayElements(playerTypes, p_playerTypes, 0);
   if (p_playerSubTypes)
@@ -1761,6 +1860,7 @@ static jboolean getFolderItemsRspNative(
       NULL; /* Folder properties like Album/Genre/Artists etc */
   jint* p_num_attrs = NULL;
   btrc_folder_items_t* p_items = NULL;
+  RspArenaScope arena;
   /* none of the parameters should be null when no error */
   if (rspStatus == BTRC_STS_NO_ERROR) {
     /* allocate memory to each rsp item */
@@ -1777,7 +1877,7 @@ static jboolean getFolderItemsRspNative(
     if (itemUidArray != NULL)
       p_item_uid = (jbyte*)env->GetByteArrayElements(itemUidArray, NULL);
 
-    p_items = new btrc_folder_items_t[numItems];
+    p_items = arena.alloc<btrc_folder_items_t>(numItems);
 
     /* if memory alloc failed, release memory */
     if (p_items && p_folder_types && p_playable && p_item_types && p_item_uid &&
@@ -1834,7 +1934,7 @@ static jboolean getFolderItemsRspNative(
 
             if (!copy_item_attributes(env, object, pitem, p_attributesIds,
                                       attributesArray, item_idx,
-                                      attribCopiedIndex)) {
+                                      attribCopiedIndex, arena)) {
               ALOGE("%s: error in copying attributes of item = %s", __func__,
                     pitem->media.name);
               rspStatus = BTRC_STS_INTERNAL_ERR;
@@ -1856,9 +1956,6 @@ static jboolean getFolderItemsRspNative(
   if (status != BT_STATUS_SUCCESS)
     ALOGE("Failed get_folder_items_list_rsp, status: %d", status);
 
-  /* Release allocated memory for all attributes in each media item */
-  if (p_items) cleanup_items(p_items, numItems);
-
   /* Release allocated memory  */
   if (p_folder_types)
     env->ReleaseByteArrayElements(folderType, p_folder_types, 0);
@@ -1868,7 +1965,158 @@ static jboolean getFolderItemsRspNative(
   if (p_attributesIds)
     env->ReleaseIntArrayElements(attributesIds, p_attributesIds, 0);
   if (p_item_uid) env->ReleaseByteArrayElements(itemUidArray, p_item_uid, 0);
-  if (p_items) delete[] p_items;
+  env->ReleaseByteArrayElements(address, addr, 0);
+
+  return (status == BT_STATUS_SUCCESS) ? JNI_TRUE : JNI_FALSE;
+}
+
+/* Packed folder items layout, all integers little-endian:
+ *   item table : numItems x FOLDER_ITEM_PACKED_LEN bytes
+ *                u8 item_type | u8 folder_type | u8 playable | u8 num_attrs |
+ *                u8 uid[BTRC_UID_SIZE] | u32 name_offset
+ *   attr table : (sum of num_attrs over media items) x FOLDER_ATTR_PACKED_LEN
+ *                u32 attr_id | u32 text_offset
+ *   string pool: u16 len | UTF-8 bytes (not NUL terminated)
+ * Offsets are relative to the start of the string pool. Attribute entries are
+ * consumed in item order, as with getFolderItemsRspNative.
+ */
+#define FOLDER_ITEM_PACKED_LEN (8 + BTRC_UID_SIZE)
+#define FOLDER_ATTR_PACKED_LEN 8
+
+static uint32_t read_le32(const uint8_t* p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Copies the pool string at |offset| into |dst|, truncating to
+ * BTRC_MAX_ATTR_STR_LEN - 1 bytes. |dst| must already be zeroed. */
+static bool copy_pool_string(uint8_t* dst, const uint8_t* pool,
+                             size_t pool_len, uint32_t offset) {
+  if (offset > pool_len || pool_len - offset < 2) return false;
+  size_t len = pool[offset] | (pool[offset + 1] << 8);
+  if (pool_len - offset - 2 < len) return false;
+  if (len > BTRC_MAX_ATTR_STR_LEN - 1) len = BTRC_MAX_ATTR_STR_LEN - 1;
+  memcpy(dst, pool + offset + 2, len);
+  return true;
+}
+
+/* Builds |numItems| folder items from |packed| into |arena|, which must hold
+ * numItems items followed by |numAttrs| attribute values and be zeroed.
+ * Returns false if the buffer is malformed. */
+static bool unpack_folder_items(const uint8_t* packed, size_t packed_len,
+                                int numItems, int numAttrs, uint8_t* arena) {
+  btrc_folder_items_t* p_items = (btrc_folder_items_t*)arena;
+  btrc_element_attr_val_t* p_attrs = (btrc_element_attr_val_t*)(
+      arena + numItems * sizeof(btrc_folder_items_t));
+  const uint8_t* attr_table = packed + numItems * FOLDER_ITEM_PACKED_LEN;
+  const uint8_t* pool = attr_table + numAttrs * FOLDER_ATTR_PACKED_LEN;
+  size_t pool_len = packed_len - (pool - packed);
+
+  int attr_idx = 0;
+  for (int item_idx = 0; item_idx < numItems; item_idx++) {
+    const uint8_t* rec = packed + item_idx * FOLDER_ITEM_PACKED_LEN;
+    btrc_folder_items_t* pitem = &p_items[item_idx];
+    uint32_t name_offset = read_le32(rec + 4 + BTRC_UID_SIZE);
+
+    if (rec[0] == BTRC_ITEM_FOLDER) {
+      pitem->item_type = (uint8_t)BTRC_ITEM_FOLDER;
+      memcpy(pitem->folder.uid, rec + 4, BTRC_UID_SIZE);
+      pitem->folder.charset_id = BTRC_CHARSET_ID_UTF8;
+      pitem->folder.type = rec[1];
+      pitem->folder.playable = rec[2];
+      if (!copy_pool_string(pitem->folder.name, pool, pool_len, name_offset))
+        return false;
+    } else if (rec[0] == BTRC_ITEM_MEDIA) {
+      pitem->item_type = (uint8_t)BTRC_ITEM_MEDIA;
+      memcpy(pitem->media.uid, rec + 4, BTRC_UID_SIZE);
+      pitem->media.charset_id = BTRC_CHARSET_ID_UTF8;
+      pitem->media.type = BTRC_MEDIA_TYPE_AUDIO;
+      pitem->media.num_attrs = rec[3];
+      if (!copy_pool_string(pitem->media.name, pool, pool_len, name_offset))
+        return false;
+
+      if (rec[3] == 0) continue;
+      if (attr_idx + rec[3] > numAttrs) return false;
+      pitem->media.p_attrs = &p_attrs[attr_idx];
+      for (int i = 0; i < rec[3]; i++, attr_idx++) {
+        const uint8_t* attr = attr_table + attr_idx * FOLDER_ATTR_PACKED_LEN;
+        p_attrs[attr_idx].attr_id = read_le32(attr);
+        if (!copy_pool_string(p_attrs[attr_idx].text, pool, pool_len,
+                              read_le32(attr + 4)))
+          return false;
+      }
+    }
+  }
+  return true;
+}
+
+/* Same response as getFolderItemsRspNative, but the items arrive serialized
+ * in one byte array (see FOLDER_ITEM_PACKED_LEN) and are built in one
+ * contiguous arena allocation, avoiding per item and per attribute JNI string
+ * access. */
+static jboolean getFolderItemsPackedRspNative(JNIEnv* env, jobject object,
+                                              jbyteArray address,
+                                              jint rspStatus,
+                                              jshort uidCounter, jbyte scope,
+                                              jint numItems,
+                                              jbyteArray packedItems) {
+  if (!sBluetoothAvrcpInterface) {
+    ALOGE("%s: sBluetoothAvrcpInterface is null", __func__);
+    return JNI_FALSE;
+  }
+
+  jbyte* addr = env->GetByteArrayElements(address, NULL);
+  if (!addr) {
+    jniThrowIOException(env, EINVAL);
+    return JNI_FALSE;
+  }
+
+  RspArenaScope arena;
+  uint8_t* p_items = NULL;
+  if (rspStatus == BTRC_STS_NO_ERROR && numItems > 0) {
+    if (packedItems == NULL || (scope != BTRC_SCOPE_FILE_SYSTEM &&
+                                scope != BTRC_SCOPE_SEARCH &&
+                                scope != BTRC_SCOPE_NOW_PLAYING)) {
+      rspStatus = BTRC_STS_INTERNAL_ERR;
+    } else {
+      size_t packed_len = env->GetArrayLength(packedItems);
+      uint8_t* packed =
+          (uint8_t*)env->GetPrimitiveArrayCritical(packedItems, NULL);
+      size_t table_len = (size_t)numItems * FOLDER_ITEM_PACKED_LEN;
+      int numAttrs = 0;
+      if (packed && packed_len >= table_len) {
+        for (int i = 0; i < numItems; i++) {
+          const uint8_t* rec = packed + i * FOLDER_ITEM_PACKED_LEN;
+          if (rec[0] == BTRC_ITEM_MEDIA) numAttrs += rec[3];
+        }
+      }
+
+      if (packed &&
+          packed_len >= table_len + numAttrs * FOLDER_ATTR_PACKED_LEN) {
+        size_t arena_len = numItems * sizeof(btrc_folder_items_t) +
+                           numAttrs * sizeof(btrc_element_attr_val_t);
+        p_items = arena.alloc<uint8_t>(arena_len);
+        memset(p_items, 0, arena_len);
+        if (!unpack_folder_items(packed, packed_len, numItems, numAttrs,
+                                 p_items))
+          p_items = NULL;
+      }
+      if (packed)
+        env->ReleasePrimitiveArrayCritical(packedItems, packed, JNI_ABORT);
+
+      if (!p_items) {
+        ALOGE("%s: malformed packed folder items", __func__);
+        rspStatus = BTRC_STS_INTERNAL_ERR;
+      }
+    }
+  }
+
+  RawAddress* btAddr = (RawAddress*)addr;
+  bt_status_t status = sBluetoothAvrcpInterface->get_folder_items_list_rsp(
+      btAddr, (btrc_status_t)rspStatus, uidCounter, p_items ? numItems : 0,
+      (btrc_folder_items_t*)p_items);
+  if (status != BT_STATUS_SUCCESS)
+    ALOGE("Failed get_folder_items_list_rsp, status: %d", status);
+
   env->ReleaseByteArrayElements(address, addr, 0);
 
   return (status == BT_STATUS_SUCCESS) ? JNI_TRUE : JNI_FALSE;
@@ -2155,11 +2403,17 @@ static JNINativeMethod sMethods[] = {
      "([BISBI[B[B[B[B[Ljava/lang/String;[I[I[Ljava/lang/String;)Z",
      (void*)getFolderItemsRspNative},
 
+    {"getFolderItemsPackedRspNative", "([BISBI[B)Z",
+     (void*)getFolderItemsPackedRspNative},
+
     {"changePathRspNative", "([BII)Z", (void*)changePathRspNative},
 
     {"getItemAttrRspNative", "([BIB[I[Ljava/lang/String;)Z",
      (void*)getItemAttrRspNative},
 
+    {"invalidateElementAttrCacheNative", "()V",
+     (void*)invalidateElementAttrCacheNative},
+
     {"playItemRspNative", "([BI)Z", (void*)playItemRspNative},
 
     {"getTotalNumOfItemsRspNative", "([BIII)Z",
@@ -2199,17 +2453,14 @@ static bool copy_item_attributes(JNIEnv* env, jobject object,
                                  btrc_folder_items_t* pitem,
                                  jint* p_attributesIds,
                                  jobjectArray attributesArray, int item_idx,
-                                 int attribCopiedIndex) {
+                                 int attribCopiedIndex, RspArenaScope& arena) {
   bool success = true;
 
   /* copy attributes of the item */
   if (0 < pitem->media.num_attrs) {
     int num_attrs = pitem->media.num_attrs;
     ALOGI("%s num_attr = %d", __func__, num_attrs);
-    pitem->media.p_attrs = new btrc_element_attr_val_t[num_attrs];
-    if (!pitem->media.p_attrs) {
-      return false;
-    }
+    pitem->media.p_attrs = arena.alloc<btrc_element_attr_val_t>(num_attrs);
 
     for (int tempAtrCount = 0; tempAtrCount < pitem->media.num_attrs;
          ++tempAtrCount) {
@@ -2247,14 +2498,4 @@ static bool copy_jstring(uint8_t* str, int maxBytes, jstring jstr,
   env->ReleaseStringUTFChars(jstr, p_str);
   return true;
 }
-
-/* Helper function to cleanup items */
-static void cleanup_items(btrc_folder_items_t* p_items, int numItems) {
-  for (int item_idx = 0; item_idx < numItems; item_idx++) {
-    /* release memory for attributes in case item is media item */
-    if ((BTRC_ITEM_MEDIA == p_items[item_idx].item_type) &&
-        p_items[item_idx].media.p_attrs != NULL)
-      delete[] p_items[item_idx].media.p_attrs;
-  }
-}
 }
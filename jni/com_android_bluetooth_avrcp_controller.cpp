@@ -20,10 +20,21 @@
 
 #include "android_runtime/AndroidRuntime.h"
 #include "com_android_bluetooth.h"
+#include "cutils/properties.h"
 #include "hardware/bt_rc.h"
 #include "utils/Log.h"
 
 #include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace android {
 static jmethodID method_handlePassthroughRsp;
@@ -37,22 +48,364 @@ static jmethodID method_handleRegisterNotificationAbsVol;
 static jmethodID method_handletrackchanged;
 static jmethodID method_handleplaypositionchanged;
 static jmethodID method_handleplaystatuschanged;
-static jmethodID method_handleGetFolderItemsRsp;
+static jmethodID method_handleGetFolderItemsPage;
 static jmethodID method_handleGetPlayerItemsRsp;
 static jmethodID method_handleGroupNavigationRsp;
-static jmethodID method_createFromNativeMediaItem;
-static jmethodID method_createFromNativeFolderItem;
 static jmethodID method_createFromNativePlayerItem;
 static jmethodID method_handleChangeFolderRsp;
 static jmethodID method_handleSetBrowsedPlayerRsp;
 static jmethodID method_handleSetAddressedPlayerRsp;
 
-static jclass class_MediaBrowser_MediaItem;
 static jclass class_AvrcpPlayer;
 
 static const btrc_ctrl_interface_t* sBluetoothAvrcpInterface = NULL;
 static jobject sCallbacksObj = NULL;
 
+/* Folder and media items of GetFolderItems responses, kept natively until
+ * Java materializes them. Each response becomes one page identified by a
+ * handle; Java tracks which folder or scope it requested and reads the page
+ * with getFolderItemsPageNative, then drops it with releaseFolderItemsNative.
+ * Pages Java never releases are evicted oldest first.
+ */
+#define FOLDER_PAGE_MAX_LIVE 16
+
+struct FolderPageItem {
+  uint8_t item_type;
+  uint8_t type;
+  uint8_t playable;
+  uint8_t uid[BTRC_UID_SIZE];
+  std::string name;
+};
+
+static struct {
+  std::mutex lock;
+  std::map<jint, std::vector<FolderPageItem>> pages;
+  std::deque<jint> order;  // live handles, oldest first
+  jint next_handle = 1;
+} sFolderPages;
+
+static jint folder_page_store(const btrc_folder_items_t* folder_items,
+                              uint8_t count) {
+  std::vector<FolderPageItem> page;
+  page.reserve(count);
+  for (int i = 0; i < count; i++) {
+    const btrc_folder_items_t* item = &folder_items[i];
+    FolderPageItem stored;
+    stored.item_type = item->item_type;
+    if (item->item_type == BTRC_ITEM_MEDIA) {
+      stored.type = item->media.type;
+      stored.playable = 1;
+      memcpy(stored.uid, item->media.uid, BTRC_UID_SIZE);
+      stored.name.assign((const char*)item->media.name,
+                         strnlen((const char*)item->media.name,
+                                 BTRC_MAX_ATTR_STR_LEN));
+    } else if (item->item_type == BTRC_ITEM_FOLDER) {
+      stored.type = item->folder.type;
+      stored.playable = item->folder.playable;
+      memcpy(stored.uid, item->folder.uid, BTRC_UID_SIZE);
+      stored.name.assign((const char*)item->folder.name,
+                         strnlen((const char*)item->folder.name,
+                                 BTRC_MAX_ATTR_STR_LEN));
+    } else {
+      ALOGE("%s cannot understand type %d", __func__, item->item_type);
+      continue;
+    }
+    page.push_back(std::move(stored));
+  }
+
+  std::lock_guard<std::mutex> lock(sFolderPages.lock);
+  if (sFolderPages.order.size() >= FOLDER_PAGE_MAX_LIVE) {
+    // Handles wrap, so the oldest page is not necessarily the smallest one.
+    jint oldest = sFolderPages.order.front();
+    ALOGW("%s: evicting unreleased page %d", __func__, oldest);
+    sFolderPages.order.pop_front();
+    sFolderPages.pages.erase(oldest);
+  }
+  jint handle;
+  do {
+    handle = sFolderPages.next_handle++;
+    if (sFolderPages.next_handle <= 0) sFolderPages.next_handle = 1;
+  } while (sFolderPages.pages.count(handle));
+  sFolderPages.pages[handle] = std::move(page);
+  sFolderPages.order.push_back(handle);
+  return handle;
+}
+
+/* Track-changed and play-position notifications are coalesced per device
+ * before they reach Java. Some targets send the same metadata repeatedly or
+ * report the position many times a second; bursts are merged into the latest
+ * state and handed to Java by the "BT AVRCP CT Updates" thread at most once
+ * per persist.bt.avrcp.ct.update_interval_ms (0 delivers every change).
+ * Track attributes identical to the set last delivered for the device, and
+ * unchanged positions, never reach Java at all.
+ *
+ * Deliveries hold deliver_lock, which keeps them ordered with the callback
+ * thread: a play status change first delivers the device's pending updates
+ * itself, and a disconnect waits for an in-flight delivery before dropping
+ * the device, so nothing for it reaches Java after the disconnect.
+ */
+#define CT_UPDATE_DEFAULT_INTERVAL_MS 250
+
+typedef std::vector<std::pair<uint32_t, std::string>> TrackAttrs;
+
+struct CtUpdateState {
+  bool track_pending = false;
+  TrackAttrs track;
+  TrackAttrs delivered_track;
+
+  bool position_pending = false;
+  uint32_t song_len = 0;
+  uint32_t song_pos = 0;
+  bool position_delivered = false;
+  uint32_t delivered_len = 0;
+  uint32_t delivered_pos = 0;
+
+  std::chrono::steady_clock::time_point last_delivery;
+};
+
+static struct {
+  std::mutex deliver_lock;  // taken before lock
+  std::mutex lock;
+  std::condition_variable cv;
+  std::thread thread;
+  bool running = false;
+  std::chrono::milliseconds interval;
+  std::map<RawAddress, CtUpdateState> devices;
+} sCtUpdates;
+
+static jclass class_String;
+
+// One device's updates, copied out of sCtUpdates for delivery.
+struct CtUpdate {
+  RawAddress address;
+  bool has_track;
+  TrackAttrs track;
+  bool has_position;
+  uint32_t song_len;
+  uint32_t song_pos;
+};
+
+static void ct_update_post_track(const RawAddress& bd_addr, uint8_t num_attr,
+                                 const btrc_element_attr_val_t* p_attrs) {
+  TrackAttrs attrs;
+  attrs.reserve(num_attr);
+  for (int i = 0; i < num_attr; i++) {
+    attrs.emplace_back(p_attrs[i].attr_id,
+                       std::string((const char*)p_attrs[i].text,
+                                   strnlen((const char*)p_attrs[i].text,
+                                           BTRC_MAX_ATTR_STR_LEN)));
+  }
+
+  std::lock_guard<std::mutex> lock(sCtUpdates.lock);
+  if (!sCtUpdates.running) return;
+
+  CtUpdateState& state = sCtUpdates.devices[bd_addr];
+  if (attrs == state.delivered_track) {
+    state.track_pending = false;
+    state.track.clear();
+    return;
+  }
+  state.track_pending = true;
+  state.track = std::move(attrs);
+  sCtUpdates.cv.notify_one();
+}
+
+static void ct_update_post_position(const RawAddress& bd_addr,
+                                    uint32_t song_len, uint32_t song_pos) {
+  std::lock_guard<std::mutex> lock(sCtUpdates.lock);
+  if (!sCtUpdates.running) return;
+
+  CtUpdateState& state = sCtUpdates.devices[bd_addr];
+  if (state.position_delivered && state.delivered_len == song_len &&
+      state.delivered_pos == song_pos) {
+    state.position_pending = false;
+    return;
+  }
+  state.position_pending = true;
+  state.song_len = song_len;
+  state.song_pos = song_pos;
+  sCtUpdates.cv.notify_one();
+}
+
+static void ct_update_forget(const RawAddress& bd_addr) {
+  std::lock_guard<std::mutex> deliver(sCtUpdates.deliver_lock);
+  std::lock_guard<std::mutex> lock(sCtUpdates.lock);
+  sCtUpdates.devices.erase(bd_addr);
+}
+
+// Moves the pending updates of |state| into |update|. Returns false if there
+// are none.
+static bool ct_update_take_locked(const RawAddress& bd_addr,
+                                  CtUpdateState& state,
+                                  std::chrono::steady_clock::time_point now,
+                                  CtUpdate* update) {
+  if (!state.track_pending && !state.position_pending) return false;
+
+  update->address = bd_addr;
+  update->has_track = state.track_pending;
+  update->has_position = state.position_pending;
+  if (state.track_pending) {
+    state.delivered_track = state.track;
+    update->track = std::move(state.track);
+    state.track.clear();
+    state.track_pending = false;
+  }
+  if (state.position_pending) {
+    update->song_len = state.delivered_len = state.song_len;
+    update->song_pos = state.delivered_pos = state.song_pos;
+    state.position_delivered = true;
+    state.position_pending = false;
+  }
+  state.last_delivery = now;
+  return true;
+}
+
+static void ct_update_deliver(JNIEnv* env, const CtUpdate& update) {
+  if (sCallbacksObj == NULL) return;
+
+  ScopedLocalRef<jbyteArray> addr(env,
+                                  getAddressByteArray(env, update.address));
+  if (!addr.get()) {
+    ALOGE("Fail to get new array ");
+    return;
+  }
+
+  if (update.has_track) {
+    jint num_attr = update.track.size();
+    ScopedLocalRef<jintArray> attribIds(env, env->NewIntArray(num_attr));
+    ScopedLocalRef<jobjectArray> stringArray(
+        env, env->NewObjectArray(num_attr, class_String, 0));
+    if (!attribIds.get() || !stringArray.get()) {
+      ALOGE("%s: failed to allocate track arrays", __func__);
+      return;
+    }
+
+    std::vector<jint> ids(num_attr);
+    for (jint i = 0; i < num_attr; i++) {
+      ids[i] = update.track[i].first;
+      ScopedLocalRef<jstring> str(
+          env, env->NewStringUTF(update.track[i].second.c_str()));
+      if (!str.get()) {
+        ALOGE("Unable to get str");
+        return;
+      }
+      env->SetObjectArrayElement(stringArray.get(), i, str.get());
+    }
+    env->SetIntArrayRegion(attribIds.get(), 0, num_attr, ids.data());
+
+    env->CallVoidMethod(sCallbacksObj, method_handletrackchanged, addr.get(),
+                        (jbyte)num_attr, attribIds.get(), stringArray.get());
+    if (env->ExceptionCheck()) {
+      ALOGE("An exception was thrown by callback 'handletrackchanged'.");
+      LOGE_EX(env);
+      env->ExceptionClear();
+    }
+  }
+
+  if (update.has_position) {
+    env->CallVoidMethod(sCallbacksObj, method_handleplaypositionchanged,
+                        addr.get(), (jint)update.song_len,
+                        (jint)update.song_pos);
+    if (env->ExceptionCheck()) {
+      ALOGE("An exception was thrown by callback 'handleplaypositionchanged'.");
+      LOGE_EX(env);
+      env->ExceptionClear();
+    }
+  }
+}
+
+static void ct_update_run() {
+  JavaVM* vm = AndroidRuntime::getJavaVM();
+  JNIEnv* env = NULL;
+  char name[] = "BT AVRCP CT Updates";
+  JavaVMAttachArgs args = {
+      .version = JNI_VERSION_1_6, .name = name, .group = NULL};
+  if (vm->AttachCurrentThread(&env, &args) != JNI_OK) {
+    ALOGE("Unable to attach AVRCP controller update thread to VM");
+    return;
+  }
+
+  std::vector<CtUpdate> ready;
+  while (true) {
+    std::unique_lock<std::mutex> deliver(sCtUpdates.deliver_lock);
+    std::unique_lock<std::mutex> lock(sCtUpdates.lock);
+    if (!sCtUpdates.running) break;
+
+    auto now = std::chrono::steady_clock::now();
+    auto next = std::chrono::steady_clock::time_point::max();
+    for (auto& entry : sCtUpdates.devices) {
+      CtUpdateState& state = entry.second;
+      if (!state.track_pending && !state.position_pending) continue;
+
+      auto due = state.last_delivery + sCtUpdates.interval;
+      if (now < due) {
+        next = std::min(next, due);
+        continue;
+      }
+
+      CtUpdate update;
+      ct_update_take_locked(entry.first, state, now, &update);
+      ready.push_back(std::move(update));
+    }
+
+    if (!ready.empty()) {
+      lock.unlock();
+      for (const CtUpdate& update : ready) ct_update_deliver(env, update);
+      ready.clear();
+      continue;
+    }
+
+    deliver.unlock();
+    if (next == std::chrono::steady_clock::time_point::max()) {
+      sCtUpdates.cv.wait(lock);
+    } else {
+      sCtUpdates.cv.wait_until(lock, next);
+    }
+  }
+
+  vm->DetachCurrentThread();
+}
+
+// Delivers the pending updates of |bd_addr| on the callback thread, ahead of
+// the callback being handled.
+static void ct_update_flush(JNIEnv* env, const RawAddress& bd_addr) {
+  std::lock_guard<std::mutex> deliver(sCtUpdates.deliver_lock);
+  CtUpdate update;
+  {
+    std::lock_guard<std::mutex> lock(sCtUpdates.lock);
+    auto it = sCtUpdates.devices.find(bd_addr);
+    if (it == sCtUpdates.devices.end() ||
+        !ct_update_take_locked(it->first, it->second,
+                               std::chrono::steady_clock::now(), &update))
+      return;
+  }
+  ct_update_deliver(env, update);
+}
+
+static void ct_update_start() {
+  std::lock_guard<std::mutex> lock(sCtUpdates.lock);
+  if (sCtUpdates.running) return;
+
+  sCtUpdates.interval = std::chrono::milliseconds(std::max(
+      0, property_get_int32("persist.bt.avrcp.ct.update_interval_ms",
+                            CT_UPDATE_DEFAULT_INTERVAL_MS)));
+  sCtUpdates.devices.clear();
+  sCtUpdates.running = true;
+  sCtUpdates.thread = std::thread(ct_update_run);
+}
+
+static void ct_update_stop() {
+  std::unique_lock<std::mutex> lock(sCtUpdates.lock);
+  if (!sCtUpdates.running) return;
+
+  sCtUpdates.running = false;
+  sCtUpdates.devices.clear();
+  sCtUpdates.cv.notify_all();
+  lock.unlock();
+
+  if (sCtUpdates.thread.joinable()) sCtUpdates.thread.join();
+}
+
 static void btavrcp_passthrough_response_callback(RawAddress* bd_addr, int id,
                                                   int pressed) {
   ALOGI("%s: id: %d, pressed: %d", __func__, id, pressed);
@@ -60,14 +413,12 @@ static void btavrcp_passthrough_response_callback(RawAddress* bd_addr, int id,
   if (!sCallbackEnv.valid()) return;
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr for passthrough response");
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
   sCallbackEnv->CallVoidMethod(sCallbacksObj, method_handlePassthroughRsp,
                                (jint)id, (jint)pressed, addr.get());
 }
@@ -84,18 +435,18 @@ static void btavrcp_groupnavigation_response_callback(int id, int pressed) {
 static void btavrcp_connection_state_callback(bool rc_connect, bool br_connect,
                                               RawAddress* bd_addr) {
   ALOGI("%s: conn state: rc: %d br: %d", __func__, rc_connect, br_connect);
+  if (!rc_connect) ct_update_forget(*bd_addr);
+
   CallbackEnv sCallbackEnv(__func__);
   if (!sCallbackEnv.valid()) return;
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr for connection state");
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
   sCallbackEnv->CallVoidMethod(sCallbacksObj, method_onConnectionStateChanged,
                                (jboolean)rc_connect, (jboolean)br_connect,
                                addr.get());
@@ -107,14 +458,12 @@ static void btavrcp_get_rcfeatures_callback(RawAddress* bd_addr, int features) {
   if (!sCallbackEnv.valid()) return;
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr ");
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
   sCallbackEnv->CallVoidMethod(sCallbacksObj, method_getRcFeatures, addr.get(),
                                (jint)features);
 }
@@ -126,14 +475,12 @@ static void btavrcp_setplayerapplicationsetting_rsp_callback(
   if (!sCallbackEnv.valid()) return;
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr ");
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
   sCallbackEnv->CallVoidMethod(sCallbacksObj, method_setplayerappsettingrsp,
                                addr.get(), (jint)accepted);
 }
@@ -146,13 +493,12 @@ static void btavrcp_playerapplicationsetting_callback(
   if (!sCallbackEnv.valid()) return;
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to new jbyteArray bd addr ");
     return;
   }
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
+
   /* TODO ext attrs
    * Flattening defined attributes: <id,num_values,values[]>
    */
@@ -193,13 +539,11 @@ static void btavrcp_playerapplicationsetting_changed_callback(
   if (!sCallbackEnv.valid()) return;
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to get new array ");
     return;
   }
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
 
   int arraylen = p_vals->num_attr * 2;
   ScopedLocalRef<jbyteArray> playerattribs(
@@ -231,14 +575,12 @@ static void btavrcp_set_abs_vol_cmd_callback(RawAddress* bd_addr,
   if (!sCallbackEnv.valid()) return;
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to get new array ");
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
   sCallbackEnv->CallVoidMethod(sCallbacksObj, method_handleSetAbsVolume,
                                addr.get(), (jbyte)abs_vol, (jbyte)label);
 }
@@ -250,14 +592,12 @@ static void btavrcp_register_notification_absvol_callback(RawAddress* bd_addr,
   if (!sCallbackEnv.valid()) return;
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to get new array ");
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
   sCallbackEnv->CallVoidMethod(sCallbacksObj,
                                method_handleRegisterNotificationAbsVol,
                                addr.get(), (jbyte)label);
@@ -266,74 +606,15 @@ static void btavrcp_register_notification_absvol_callback(RawAddress* bd_addr,
 static void btavrcp_track_changed_callback(RawAddress* bd_addr,
                                            uint8_t num_attr,
                                            btrc_element_attr_val_t* p_attrs) {
-  /*
-   * byteArray will be formatted like this: id,len,string
-   * Assuming text feild to be null terminated.
-   */
   ALOGI("%s", __func__);
-  CallbackEnv sCallbackEnv(__func__);
-  if (!sCallbackEnv.valid()) return;
-
-  ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
-  if (!addr.get()) {
-    ALOGE("Fail to get new array ");
-    return;
-  }
-
-  ScopedLocalRef<jintArray> attribIds(sCallbackEnv.get(),
-                                      sCallbackEnv->NewIntArray(num_attr));
-  if (!attribIds.get()) {
-    ALOGE(" failed to set new array for attribIds");
-    return;
-  }
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
-
-  jclass strclazz = sCallbackEnv->FindClass("java/lang/String");
-  ScopedLocalRef<jobjectArray> stringArray(
-      sCallbackEnv.get(),
-      sCallbackEnv->NewObjectArray((jint)num_attr, strclazz, 0));
-  if (!stringArray.get()) {
-    ALOGE(" failed to get String array");
-    return;
-  }
-
-  for (jint i = 0; i < num_attr; i++) {
-    ScopedLocalRef<jstring> str(
-        sCallbackEnv.get(),
-        sCallbackEnv->NewStringUTF((char*)(p_attrs[i].text)));
-    if (!str.get()) {
-      ALOGE("Unable to get str");
-      return;
-    }
-    sCallbackEnv->SetIntArrayRegion(attribIds.get(), i, 1,
-                                    (jint*)&(p_attrs[i].attr_id));
-    sCallbackEnv->SetObjectArrayElement(stringArray.get(), i, str.get());
-  }
-
-  sCallbackEnv->CallVoidMethod(sCallbacksObj, method_handletrackchanged,
-                               addr.get(), (jbyte)(num_attr), attribIds.get(),
-                               stringArray.get());
+  ct_update_post_track(*bd_addr, num_attr, p_attrs);
 }
 
 static void btavrcp_play_position_changed_callback(RawAddress* bd_addr,
                                                    uint32_t song_len,
                                                    uint32_t song_pos) {
-  ALOGI("%s", __func__);
-  CallbackEnv sCallbackEnv(__func__);
-  if (!sCallbackEnv.valid()) return;
-
-  ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
-  if (!addr.get()) {
-    ALOGE("Fail to get new array ");
-    return;
-  }
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
-  sCallbackEnv->CallVoidMethod(sCallbacksObj, method_handleplaypositionchanged,
-                               addr.get(), (jint)(song_len), (jint)song_pos);
+  ALOGV("%s", __func__);
+  ct_update_post_position(*bd_addr, song_len, song_pos);
 }
 
 static void btavrcp_play_status_changed_callback(
@@ -342,14 +623,15 @@ static void btavrcp_play_status_changed_callback(
   CallbackEnv sCallbackEnv(__func__);
   if (!sCallbackEnv.valid()) return;
 
+  ct_update_flush(sCallbackEnv.get(), *bd_addr);
+
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Fail to get new array ");
     return;
   }
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
+
   sCallbackEnv->CallVoidMethod(sCallbacksObj, method_handleplaystatuschanged,
                                addr.get(), (jbyte)play_status);
 }
@@ -358,8 +640,9 @@ static void btavrcp_get_folder_items_callback(
     RawAddress* bd_addr, btrc_status_t status,
     const btrc_folder_items_t* folder_items, uint8_t count) {
   /* Folder items are list of items that can be either BTRC_ITEM_PLAYER
-   * BTRC_ITEM_MEDIA, BTRC_ITEM_FOLDER. Here we translate them to their java
-   * counterparts by calling the java constructor for each of the items.
+   * BTRC_ITEM_MEDIA, BTRC_ITEM_FOLDER. Players are translated to their java
+   * counterparts right away; folder and media listings are parked in the page
+   * store and Java only gets a handle and the item count.
    */
   ALOGV("%s count %d", __func__, count);
   CallbackEnv sCallbackEnv(__func__);
@@ -370,15 +653,17 @@ static void btavrcp_get_folder_items_callback(
   bool isPlayerListing =
       count > 0 && (folder_items[0].item_type == BTRC_ITEM_PLAYER);
 
-  // Initialize arrays for Folder OR Player listing.
-  ScopedLocalRef<jobjectArray> itemArray(sCallbackEnv.get(), NULL);
-  if (isPlayerListing) {
-    itemArray.reset(
-        sCallbackEnv->NewObjectArray((jint)count, class_AvrcpPlayer, 0));
-  } else {
-    itemArray.reset(sCallbackEnv->NewObjectArray(
-        (jint)count, class_MediaBrowser_MediaItem, 0));
+  if (!isPlayerListing) {
+    jint handle = folder_page_store(folder_items, count);
+    sCallbackEnv->CallVoidMethod(sCallbacksObj,
+                                 method_handleGetFolderItemsPage, (jint)status,
+                                 handle, (jint)count);
+    return;
   }
+
+  ScopedLocalRef<jobjectArray> itemArray(
+      sCallbackEnv.get(),
+      sCallbackEnv->NewObjectArray((jint)count, class_AvrcpPlayer, 0));
   if (!itemArray.get()) {
     ALOGE("%s itemArray allocation failed.", __func__);
     return;
@@ -387,113 +672,8 @@ static void btavrcp_get_folder_items_callback(
     const btrc_folder_items_t* item = &(folder_items[i]);
     ALOGV("%s item type %d", __func__, item->item_type);
     switch (item->item_type) {
-      case BTRC_ITEM_MEDIA: {
-        // Parse name
-        ScopedLocalRef<jstring> mediaName(
-            sCallbackEnv.get(),
-            sCallbackEnv->NewStringUTF((const char*)item->media.name));
-        if (!mediaName.get()) {
-          ALOGE("%s can't allocate media name string!", __func__);
-          return;
-        }
-        // Parse UID
-        ScopedLocalRef<jbyteArray> uidByteArray(
-            sCallbackEnv.get(),
-            sCallbackEnv->NewByteArray(sizeof(uint8_t) * BTRC_UID_SIZE));
-        if (!uidByteArray.get()) {
-          ALOGE("%s can't allocate uid array!", __func__);
-          return;
-        }
-        sCallbackEnv->SetByteArrayRegion(uidByteArray.get(), 0,
-                                         BTRC_UID_SIZE * sizeof(uint8_t),
-                                         (jbyte*)item->media.uid);
-
-        // Parse Attrs
-        ScopedLocalRef<jintArray> attrIdArray(
-            sCallbackEnv.get(),
-            sCallbackEnv->NewIntArray(item->media.num_attrs));
-        if (!attrIdArray.get()) {
-          ALOGE("%s can't allocate attr id array!", __func__);
-          return;
-        }
-        ScopedLocalRef<jobjectArray> attrValArray(
-            sCallbackEnv.get(),
-            sCallbackEnv->NewObjectArray(
-                item->media.num_attrs,
-                sCallbackEnv->FindClass("java/lang/String"), 0));
-        if (!attrValArray.get()) {
-          ALOGE("%s can't allocate attr val array!", __func__);
-          return;
-        }
-
-        for (int j = 0; j < item->media.num_attrs; j++) {
-          sCallbackEnv->SetIntArrayRegion(
-              attrIdArray.get(), j, 1,
-              (jint*)&(item->media.p_attrs[j].attr_id));
-          ScopedLocalRef<jstring> attrValStr(
-              sCallbackEnv.get(),
-              sCallbackEnv->NewStringUTF((char*)(item->media.p_attrs[j].text)));
-          if (!uidByteArray.get()) {
-            ALOGE("%s can't allocate uid array!", __func__);
-            return;
-          }
-          sCallbackEnv->SetObjectArrayElement(attrValArray.get(), j,
-                                              attrValStr.get());
-        }
-
-        ScopedLocalRef<jobject> mediaObj(
-            sCallbackEnv.get(),
-            (jobject)sCallbackEnv->CallObjectMethod(
-                sCallbacksObj, method_createFromNativeMediaItem,
-                uidByteArray.get(), (jint)item->media.type, mediaName.get(),
-                attrIdArray.get(), attrValArray.get()));
-        if (!mediaObj.get()) {
-          ALOGE("%s failed to creae MediaItem for type ITEM_MEDIA", __func__);
-          return;
-        }
-        sCallbackEnv->SetObjectArrayElement(itemArray.get(), i, mediaObj.get());
-        break;
-      }
-
-      case BTRC_ITEM_FOLDER: {
-        // Parse name
-        ScopedLocalRef<jstring> folderName(
-            sCallbackEnv.get(),
-            sCallbackEnv->NewStringUTF((const char*)item->folder.name));
-        if (!folderName.get()) {
-          ALOGE("%s can't allocate folder name string!", __func__);
-          return;
-        }
-        // Parse UID
-        ScopedLocalRef<jbyteArray> uidByteArray(
-            sCallbackEnv.get(),
-            sCallbackEnv->NewByteArray(sizeof(uint8_t) * BTRC_UID_SIZE));
-        if (!uidByteArray.get()) {
-          ALOGE("%s can't allocate uid array!", __func__);
-          return;
-        }
-        sCallbackEnv->SetByteArrayRegion(uidByteArray.get(), 0,
-                                         BTRC_UID_SIZE * sizeof(uint8_t),
-                                         (jbyte*)item->folder.uid);
-
-        ScopedLocalRef<jobject> folderObj(
-            sCallbackEnv.get(),
-            (jobject)sCallbackEnv->CallObjectMethod(
-                sCallbacksObj, method_createFromNativeFolderItem,
-                uidByteArray.get(), (jint)item->folder.type, folderName.get(),
-                (jint)item->folder.playable));
-        if (!folderObj.get()) {
-          ALOGE("%s failed to create MediaItem for type ITEM_FOLDER", __func__);
-          return;
-        }
-        sCallbackEnv->SetObjectArrayElement(itemArray.get(), i,
-                                            folderObj.get());
-        break;
-      }
-
       case BTRC_ITEM_PLAYER: {
         // Parse name
-        isPlayerListing = true;
         jint id = (jint)item->player.player_id;
         jint playerType = (jint)item->player.major_type;
         jint playStatus = (jint)item->player.play_status;
@@ -536,13 +716,8 @@ static void btavrcp_get_folder_items_callback(
     }
   }
 
-  if (isPlayerListing) {
-    sCallbackEnv->CallVoidMethod(sCallbacksObj, method_handleGetPlayerItemsRsp,
-                                 itemArray.get());
-  } else {
-    sCallbackEnv->CallVoidMethod(sCallbacksObj, method_handleGetFolderItemsRsp,
-                                 status, itemArray.get());
-  }
+  sCallbackEnv->CallVoidMethod(sCallbacksObj, method_handleGetPlayerItemsRsp,
+                               itemArray.get());
 }
 
 static void btavrcp_change_path_callback(RawAddress* bd_addr, uint8_t count) {
@@ -596,6 +771,10 @@ static btrc_ctrl_callbacks_t sBluetoothAvrcpCallbacks = {
     btavrcp_set_addressed_player_callback};
 
 static void classInitNative(JNIEnv* env, jclass clazz) {
+  jclass stringClass = env->FindClass("java/lang/String");
+  class_String = (jclass)env->NewGlobalRef(stringClass);
+  env->DeleteLocalRef(stringClass);
+
   method_handlePassthroughRsp =
       env->GetMethodID(clazz, "handlePassthroughRsp", "(II[B)V");
 
@@ -631,20 +810,12 @@ static void classInitNative(JNIEnv* env, jclass clazz) {
   method_handleplaystatuschanged =
       env->GetMethodID(clazz, "onPlayStatusChanged", "([BB)V");
 
-  method_handleGetFolderItemsRsp =
-      env->GetMethodID(clazz, "handleGetFolderItemsRsp",
-                       "(I[Landroid/media/browse/MediaBrowser$MediaItem;)V");
+  method_handleGetFolderItemsPage =
+      env->GetMethodID(clazz, "handleGetFolderItemsPage", "(III)V");
   method_handleGetPlayerItemsRsp = env->GetMethodID(
       clazz, "handleGetPlayerItemsRsp",
       "([Lcom/android/bluetooth/avrcpcontroller/AvrcpPlayer;)V");
 
-  method_createFromNativeMediaItem =
-      env->GetMethodID(clazz, "createFromNativeMediaItem",
-                       "([BILjava/lang/String;[I[Ljava/lang/String;)Landroid/"
-                       "media/browse/MediaBrowser$MediaItem;");
-  method_createFromNativeFolderItem = env->GetMethodID(
-      clazz, "createFromNativeFolderItem",
-      "([BILjava/lang/String;I)Landroid/media/browse/MediaBrowser$MediaItem;");
   method_createFromNativePlayerItem =
       env->GetMethodID(clazz, "createFromNativePlayerItem",
                        "(ILjava/lang/String;[BII)Lcom/android/bluetooth/"
@@ -659,10 +830,6 @@ static void classInitNative(JNIEnv* env, jclass clazz) {
 }
 
 static void initNative(JNIEnv* env, jobject object) {
-  jclass tmpMediaItem =
-      env->FindClass("android/media/browse/MediaBrowser$MediaItem");
-  class_MediaBrowser_MediaItem = (jclass)env->NewGlobalRef(tmpMediaItem);
-
   jclass tmpBtPlayer =
       env->FindClass("com/android/bluetooth/avrcpcontroller/AvrcpPlayer");
   class_AvrcpPlayer = (jclass)env->NewGlobalRef(tmpBtPlayer);
@@ -679,6 +846,8 @@ static void initNative(JNIEnv* env, jobject object) {
     sBluetoothAvrcpInterface = NULL;
   }
 
+  ct_update_stop();
+
   if (sCallbacksObj != NULL) {
     ALOGW("Cleaning up Avrcp callback object");
     env->DeleteGlobalRef(sCallbacksObj);
@@ -703,6 +872,7 @@ static void initNative(JNIEnv* env, jobject object) {
   }
 
   sCallbacksObj = env->NewGlobalRef(object);
+  ct_update_start();
 }
 
 static void cleanupNative(JNIEnv* env, jobject object) {
@@ -717,10 +887,61 @@ static void cleanupNative(JNIEnv* env, jobject object) {
     sBluetoothAvrcpInterface = NULL;
   }
 
+  ct_update_stop();
+
   if (sCallbacksObj != NULL) {
     env->DeleteGlobalRef(sCallbacksObj);
     sCallbacksObj = NULL;
   }
+
+  std::lock_guard<std::mutex> lock(sFolderPages.lock);
+  sFolderPages.pages.clear();
+  sFolderPages.order.clear();
+}
+
+/* Packs items [start, start + count) of a page, all integers little-endian:
+ *   u8 item_type | u8 type | u8 playable | u8 uid[BTRC_UID_SIZE] |
+ *   u16 name_len | UTF-8 name
+ * Returns NULL if the handle is unknown. */
+static jbyteArray getFolderItemsPageNative(JNIEnv* env, jobject object,
+                                           jint handle, jint start,
+                                           jint count) {
+  std::vector<uint8_t> packed;
+  {
+    std::lock_guard<std::mutex> lock(sFolderPages.lock);
+    auto it = sFolderPages.pages.find(handle);
+    if (it == sFolderPages.pages.end()) {
+      ALOGE("%s: unknown page %d", __func__, handle);
+      return NULL;
+    }
+
+    const std::vector<FolderPageItem>& page = it->second;
+    if (start < 0) start = 0;
+    size_t end = std::min(page.size(), (size_t)start + std::max(count, 0));
+    for (size_t i = start; i < end; i++) {
+      const FolderPageItem& item = page[i];
+      packed.push_back(item.item_type);
+      packed.push_back(item.type);
+      packed.push_back(item.playable);
+      packed.insert(packed.end(), item.uid, item.uid + BTRC_UID_SIZE);
+      packed.push_back(item.name.size() & 0xFF);
+      packed.push_back((item.name.size() >> 8) & 0xFF);
+      packed.insert(packed.end(), item.name.begin(), item.name.end());
+    }
+  }
+
+  jbyteArray result = env->NewByteArray(packed.size());
+  if (!result) return NULL;
+  env->SetByteArrayRegion(result, 0, packed.size(), (jbyte*)packed.data());
+  return result;
+}
+
+static void releaseFolderItemsNative(JNIEnv* env, jobject object,
+                                     jint handle) {
+  std::lock_guard<std::mutex> lock(sFolderPages.lock);
+  if (!sFolderPages.pages.erase(handle)) return;
+  sFolderPages.order.erase(std::find(sFolderPages.order.begin(),
+                                     sFolderPages.order.end(), handle));
 }
 
 static jboolean sendPassThroughCommandNative(JNIEnv* env, jobject object,
@@ -1042,6 +1263,8 @@ static JNINativeMethod sMethods[] = {
     {"playItemNative", "([BB[BI)V", (void*)playItemNative},
     {"setBrowsedPlayerNative", "([BI)V", (void*)setBrowsedPlayerNative},
     {"setAddressedPlayerNative", "([BI)V", (void*)setAddressedPlayerNative},
+    {"getFolderItemsPageNative", "(III)[B", (void*)getFolderItemsPageNative},
+    {"releaseFolderItemsNative", "(I)V", (void*)releaseFolderItemsNative},
 };
 
 int register_com_android_bluetooth_avrcp_controller(JNIEnv* env) {
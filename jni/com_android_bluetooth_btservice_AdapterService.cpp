@@ -28,7 +28,16 @@
 #include <pthread.h>
 #include <string.h>
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <vector>
+
 #include <fcntl.h>
+#include <inttypes.h>
 #include <sys/prctl.h>
 #include <sys/stat.h>
 
@@ -41,8 +50,8 @@ namespace android {
 
 static jmethodID method_stateChangeCallback;
 static jmethodID method_adapterPropertyChangedCallback;
-static jmethodID method_devicePropertyChangedCallback;
-static jmethodID method_deviceFoundCallback;
+static jmethodID method_devicePropertiesChangedCallback;
+static jmethodID method_discoveryResultsPendingCallback;
 static jmethodID method_pinRequestCallback;
 static jmethodID method_sspRequestCallback;
 static jmethodID method_bondStateChangeCallback;
@@ -71,6 +80,208 @@ const bt_interface_t* getBluetoothInterface() { return sBluetoothInterface; }
 
 JNIEnv* getCallbackEnv() { return callbackEnv; }
 
+// Callback statistics are kept in a fixed table keyed by the callback name
+// pointer (__func__, so stable for the process lifetime). Slots are claimed
+// with a CAS and all counters are relaxed atomics, so recording never blocks
+// and dumps may read concurrently. Only CallbackEnv records, and it is valid
+// on the stack callback thread alone; upcalls made by the native worker
+// threads that attach their own JNIEnv (GATT scan batch flusher, fleet and
+// advertising rotation, AVRCP controller updates) do not go through it and
+// are not counted.
+// Latencies go into log-linear microsecond buckets,
+// CALLBACK_STATS_SUB_BUCKETS per power of two.
+#define CALLBACK_STATS_MAX_NAMES 128
+#define CALLBACK_STATS_SUB_BUCKETS 4
+#define CALLBACK_STATS_BUCKETS 96
+
+struct CallbackStats {
+  std::atomic<const char*> name;
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> total_ns;
+  std::atomic<uint64_t> exceptions;
+  std::atomic<uint64_t> buckets[CALLBACK_STATS_BUCKETS];
+};
+
+static CallbackStats sCallbackStats[CALLBACK_STATS_MAX_NAMES];
+static std::atomic<uint64_t> sCallbackStatsDropped;
+static std::atomic<bool> sCallbackStatsEnabled;
+
+bool callbackStatsEnabled() {
+  return sCallbackStatsEnabled.load(std::memory_order_relaxed);
+}
+
+static int callback_stats_bucket(uint64_t elapsed_ns) {
+  uint64_t us = elapsed_ns / 1000;
+  if (us < CALLBACK_STATS_SUB_BUCKETS) return us;
+
+  int msb = 63 - __builtin_clzll(us);
+  int sub = (us >> (msb - 2)) & (CALLBACK_STATS_SUB_BUCKETS - 1);
+  int bucket = (msb - 1) * CALLBACK_STATS_SUB_BUCKETS + sub;
+  return std::min(bucket, CALLBACK_STATS_BUCKETS - 1);
+}
+
+// Upper bound, in microseconds, of the values counted in |bucket|.
+static uint64_t callback_stats_bucket_limit(int bucket) {
+  if (bucket < CALLBACK_STATS_SUB_BUCKETS) return bucket + 1;
+
+  int msb = bucket / CALLBACK_STATS_SUB_BUCKETS + 1;
+  int sub = bucket % CALLBACK_STATS_SUB_BUCKETS;
+  return (uint64_t)(CALLBACK_STATS_SUB_BUCKETS + sub + 1) << (msb - 2);
+}
+
+static CallbackStats* callback_stats_slot(const char* name) {
+  size_t start = std::hash<const char*>()(name) % CALLBACK_STATS_MAX_NAMES;
+  for (size_t i = 0; i < CALLBACK_STATS_MAX_NAMES; i++) {
+    CallbackStats* slot =
+        &sCallbackStats[(start + i) % CALLBACK_STATS_MAX_NAMES];
+    const char* current = slot->name.load(std::memory_order_acquire);
+    if (current == name) return slot;
+    if (current == NULL &&
+        (slot->name.compare_exchange_strong(current, name,
+                                            std::memory_order_acq_rel) ||
+         current == name))
+      return slot;
+  }
+  return NULL;
+}
+
+void recordCallbackStats(const char* name, uint64_t elapsed_ns,
+                         bool exception) {
+  CallbackStats* slot = callback_stats_slot(name);
+  if (!slot) {
+    sCallbackStatsDropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  slot->count.fetch_add(1, std::memory_order_relaxed);
+  slot->total_ns.fetch_add(elapsed_ns, std::memory_order_relaxed);
+  if (exception) slot->exceptions.fetch_add(1, std::memory_order_relaxed);
+  slot->buckets[callback_stats_bucket(elapsed_ns)].fetch_add(
+      1, std::memory_order_relaxed);
+}
+
+static uint64_t callback_stats_percentile(const uint64_t* buckets,
+                                          uint64_t count, int percent) {
+  uint64_t rank = (count * percent + 99) / 100;
+  uint64_t seen = 0;
+  for (int i = 0; i < CALLBACK_STATS_BUCKETS; i++) {
+    seen += buckets[i];
+    if (seen >= rank) return callback_stats_bucket_limit(i);
+  }
+  return callback_stats_bucket_limit(CALLBACK_STATS_BUCKETS - 1);
+}
+
+void dumpCallbackStats(int fd) {
+  if (!callbackStatsEnabled()) return;
+
+  dprintf(fd, "\nJNI callback stats (times in us):\n");
+  dprintf(fd, "  %-56s %10s %12s %8s %8s %6s\n", "callback", "count", "total",
+          "p50", "p99", "exc");
+  for (CallbackStats& slot : sCallbackStats) {
+    const char* name = slot.name.load(std::memory_order_acquire);
+    if (!name) continue;
+
+    uint64_t buckets[CALLBACK_STATS_BUCKETS];
+    uint64_t count = 0;
+    for (int i = 0; i < CALLBACK_STATS_BUCKETS; i++) {
+      buckets[i] = slot.buckets[i].load(std::memory_order_relaxed);
+      count += buckets[i];
+    }
+    if (count == 0) continue;
+
+    dprintf(fd, "  %-56s %10" PRIu64 " %12" PRIu64 " %8" PRIu64 " %8" PRIu64
+                " %6" PRIu64 "\n",
+            name, slot.count.load(std::memory_order_relaxed),
+            slot.total_ns.load(std::memory_order_relaxed) / 1000,
+            callback_stats_percentile(buckets, count, 50),
+            callback_stats_percentile(buckets, count, 99),
+            slot.exceptions.load(std::memory_order_relaxed));
+  }
+
+  uint64_t dropped = sCallbackStatsDropped.load(std::memory_order_relaxed);
+  if (dropped) dprintf(fd, "  (%" PRIu64 " samples dropped)\n", dropped);
+}
+
+// Upper bound on the number of remote device addresses kept interned; the
+// least recently used entry is evicted beyond this.
+#define ADDRESS_CACHE_MAX_ENTRIES 32
+
+struct AddressCacheEntry {
+  RawAddress bd_addr;
+  jbyteArray bytes;
+  jstring string;
+};
+
+static std::mutex sAddressCacheMutex;
+static std::list<AddressCacheEntry> sAddressCacheLru;
+static std::map<RawAddress, std::list<AddressCacheEntry>::iterator>
+    sAddressCacheIndex;
+
+static void address_cache_release(JNIEnv* env,
+                                  const AddressCacheEntry& entry) {
+  if (entry.bytes) env->DeleteGlobalRef(entry.bytes);
+  if (entry.string) env->DeleteGlobalRef(entry.string);
+}
+
+// Returns the entry for |bd_addr|, moved to the front of the LRU list.
+// Must be called with sAddressCacheMutex held.
+static AddressCacheEntry& address_cache_get(JNIEnv* env,
+                                            const RawAddress& bd_addr) {
+  auto it = sAddressCacheIndex.find(bd_addr);
+  if (it != sAddressCacheIndex.end()) {
+    sAddressCacheLru.splice(sAddressCacheLru.begin(), sAddressCacheLru,
+                            it->second);
+    return sAddressCacheLru.front();
+  }
+
+  if (sAddressCacheLru.size() >= ADDRESS_CACHE_MAX_ENTRIES) {
+    address_cache_release(env, sAddressCacheLru.back());
+    sAddressCacheIndex.erase(sAddressCacheLru.back().bd_addr);
+    sAddressCacheLru.pop_back();
+  }
+
+  sAddressCacheLru.push_front({bd_addr, NULL, NULL});
+  sAddressCacheIndex[bd_addr] = sAddressCacheLru.begin();
+  return sAddressCacheLru.front();
+}
+
+jbyteArray getAddressByteArray(JNIEnv* env, const RawAddress& bd_addr) {
+  std::lock_guard<std::mutex> lock(sAddressCacheMutex);
+  AddressCacheEntry& entry = address_cache_get(env, bd_addr);
+  if (!entry.bytes) {
+    ScopedLocalRef<jbyteArray> bytes(env,
+                                     env->NewByteArray(sizeof(RawAddress)));
+    if (!bytes.get()) return NULL;
+    env->SetByteArrayRegion(bytes.get(), 0, sizeof(RawAddress),
+                            (const jbyte*)bd_addr.address);
+    entry.bytes = (jbyteArray)env->NewGlobalRef(bytes.get());
+  }
+  return (jbyteArray)env->NewLocalRef(entry.bytes);
+}
+
+jstring getAddressString(JNIEnv* env, const RawAddress& bd_addr) {
+  std::lock_guard<std::mutex> lock(sAddressCacheMutex);
+  AddressCacheEntry& entry = address_cache_get(env, bd_addr);
+  if (!entry.string) {
+    char c_address[18];
+    snprintf(c_address, sizeof(c_address), "%02X:%02X:%02X:%02X:%02X:%02X",
+             bd_addr.address[0], bd_addr.address[1], bd_addr.address[2],
+             bd_addr.address[3], bd_addr.address[4], bd_addr.address[5]);
+    ScopedLocalRef<jstring> string(env, env->NewStringUTF(c_address));
+    if (!string.get()) return NULL;
+    entry.string = (jstring)env->NewGlobalRef(string.get());
+  }
+  return (jstring)env->NewLocalRef(entry.string);
+}
+
+void clearAddressCache(JNIEnv* env) {
+  std::lock_guard<std::mutex> lock(sAddressCacheMutex);
+  for (const AddressCacheEntry& entry : sAddressCacheLru)
+    address_cache_release(env, entry);
+  sAddressCacheLru.clear();
+  sAddressCacheIndex.clear();
+}
+
 static void adapter_state_change_callback(bt_state_t status) {
   CallbackEnv sCallbackEnv(__func__);
   if (!sCallbackEnv.valid()) return;
@@ -150,68 +361,256 @@ static void adapter_properties_callback(bt_status_t status, int num_properties,
                                types.get(), props.get());
 }
 
-static void remote_device_properties_callback(bt_status_t status,
-                                              RawAddress* bd_addr,
-                                              int num_properties,
-                                              bt_property_t* properties) {
-  CallbackEnv sCallbackEnv(__func__);
-  if (!sCallbackEnv.valid()) return;
+/* Remote device properties last delivered to Java. Discovery reports the
+ * same name, class and type of a device on every inquiry result; only the
+ * properties whose value differs from the stored one are forwarded, packed
+ * into a single buffer (little endian, repeated):
+ *   u32 type | u16 len | u8[len] value
+ * RemoteDevices calls forgetRemoteDevicePropertiesNative whenever it drops or
+ * recreates its record of a device, so the next report is delivered in full.
+ */
+#define DEVICE_PROPERTY_STORE_MAX_ENTRIES 200
+#define DEVICE_PROPERTY_PACKED_HEADER_LEN 6
 
-  ALOGV("%s: Status is: %d, Properties: %d", __func__, status, num_properties);
+struct DevicePropertyEntry {
+  RawAddress bd_addr;
+  std::map<int, std::vector<uint8_t>> values;
+};
 
-  if (status != BT_STATUS_SUCCESS) {
-    ALOGE("%s: Status %d is incorrect", __func__, status);
-    return;
+static std::mutex sDevicePropertyMutex;
+static std::list<DevicePropertyEntry> sDevicePropertyLru;
+static std::map<RawAddress, std::list<DevicePropertyEntry>::iterator>
+    sDevicePropertyIndex;
+
+// Returns the stored properties of |bd_addr|, moved to the front of the LRU
+// list. Must be called with sDevicePropertyMutex held.
+static DevicePropertyEntry& device_property_entry_get(
+    const RawAddress& bd_addr) {
+  auto it = sDevicePropertyIndex.find(bd_addr);
+  if (it != sDevicePropertyIndex.end()) {
+    sDevicePropertyLru.splice(sDevicePropertyLru.begin(), sDevicePropertyLru,
+                              it->second);
+    return sDevicePropertyLru.front();
   }
 
-  ScopedLocalRef<jbyteArray> val(
-      sCallbackEnv.get(),
-      (jbyteArray)sCallbackEnv->NewByteArray(num_properties));
-  if (!val.get()) {
-    ALOGE("%s: Error allocating byteArray", __func__);
-    return;
+  if (sDevicePropertyLru.size() >= DEVICE_PROPERTY_STORE_MAX_ENTRIES) {
+    sDevicePropertyIndex.erase(sDevicePropertyLru.back().bd_addr);
+    sDevicePropertyLru.pop_back();
   }
 
-  ScopedLocalRef<jclass> mclass(sCallbackEnv.get(),
-                                sCallbackEnv->GetObjectClass(val.get()));
+  sDevicePropertyLru.push_front({bd_addr, {}});
+  sDevicePropertyIndex[bd_addr] = sDevicePropertyLru.begin();
+  return sDevicePropertyLru.front();
+}
 
-  /* Initialize the jobjectArray and jintArray here itself and send the
-   initialized array pointers alone to get_properties */
+// Packs the properties of |bd_addr| that changed since they were last
+// delivered and records their new values. UUIDs are packed even if unchanged
+// when |force_uuids| is set, since Java reports every delivery as an
+// ACTION_UUID result.
+static std::vector<uint8_t> device_property_diff(
+    const RawAddress& bd_addr, int num_properties,
+    const bt_property_t* properties, bool force_uuids) {
+  std::vector<uint8_t> packed;
+  std::lock_guard<std::mutex> lock(sDevicePropertyMutex);
+  DevicePropertyEntry& entry = device_property_entry_get(bd_addr);
 
-  ScopedLocalRef<jobjectArray> props(
-      sCallbackEnv.get(),
-      sCallbackEnv->NewObjectArray(num_properties, mclass.get(), NULL));
-  if (!props.get()) {
-    ALOGE("%s: Error allocating object Array for properties", __func__);
-    return;
-  }
+  for (int i = 0; i < num_properties; i++) {
+    const bt_property_t& prop = properties[i];
+    if (prop.len < 0 || prop.len > UINT16_MAX) {
+      ALOGE("%s: dropping property %d of length %d", __func__, prop.type,
+            prop.len);
+      continue;
+    }
 
-  ScopedLocalRef<jintArray> types(
-      sCallbackEnv.get(), (jintArray)sCallbackEnv->NewIntArray(num_properties));
-  if (!types.get()) {
-    ALOGE("%s: Error allocating int Array for values", __func__);
-    return;
-  }
+    const uint8_t* val = (const uint8_t*)prop.val;
+    std::vector<uint8_t>& stored = entry.values[prop.type];
+    bool unchanged = stored.size() == (size_t)prop.len &&
+                     std::equal(stored.begin(), stored.end(), val);
+    if (unchanged && !(force_uuids && prop.type == BT_PROPERTY_UUIDS))
+      continue;
+    if (!unchanged) stored.assign(val, val + prop.len);
+
+    uint32_t type = prop.type;
+    uint16_t len = prop.len;
+    packed.push_back(type & 0xFF);
+    packed.push_back((type >> 8) & 0xFF);
+    packed.push_back((type >> 16) & 0xFF);
+    packed.push_back((type >> 24) & 0xFF);
+    packed.push_back(len & 0xFF);
+    packed.push_back((len >> 8) & 0xFF);
+    packed.insert(packed.end(), val, val + len);
+  }
+  return packed;
+}
+
+static void device_property_forget_all() {
+  std::lock_guard<std::mutex> lock(sDevicePropertyMutex);
+  sDevicePropertyLru.clear();
+  sDevicePropertyIndex.clear();
+}
+
+// Hands the changed properties of |bd_addr| to Java. Nothing is delivered if
+// no property changed.
+static void deliver_device_properties(CallbackEnv& sCallbackEnv,
+                                      const RawAddress& bd_addr,
+                                      const std::vector<uint8_t>& packed) {
+  if (packed.empty()) return;
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), bd_addr));
   if (!addr.get()) {
     ALOGE("Error while allocation byte array in %s", __func__);
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
-
-  jintArray typesPtr = types.get();
-  jobjectArray propsPtr = props.get();
-  if (get_properties(num_properties, properties, &typesPtr, &propsPtr) < 0) {
+  ScopedLocalRef<jbyteArray> values(sCallbackEnv.get(),
+                                    sCallbackEnv->NewByteArray(packed.size()));
+  if (!values.get()) {
+    ALOGE("%s: Error allocating byteArray", __func__);
     return;
   }
+  sCallbackEnv->SetByteArrayRegion(values.get(), 0, packed.size(),
+                                   (const jbyte*)packed.data());
 
   sCallbackEnv->CallVoidMethod(sJniCallbacksObj,
-                               method_devicePropertyChangedCallback, addr.get(),
-                               types.get(), props.get());
+                               method_devicePropertiesChangedCallback,
+                               addr.get(), values.get());
+}
+
+/* Inquiry results are not handed to Java one by one. A report for an address
+ * already waiting in the queue is merged into it: later values replace
+ * earlier ones, except the RSSI, which keeps the strongest reading. Java is
+ * told once that results are pending, lets its dedup window
+ * (persist.bt.discovery.window_ms) pass and collects the whole batch with
+ * drainDiscoveryResultsNative. Once the queue holds
+ * persist.bt.discovery.queue_size addresses Java is asked to drain it right
+ * away instead; reports keep being queued until it does.
+ */
+#define DISCOVERY_QUEUE_DEFAULT_SIZE 64
+
+struct DiscoveryResult {
+  RawAddress bd_addr;
+  std::map<int, std::vector<uint8_t>> values;
+};
+
+static struct {
+  std::mutex lock;
+  std::vector<DiscoveryResult> queue;
+  std::map<RawAddress, size_t> index;
+  size_t max_size = DISCOVERY_QUEUE_DEFAULT_SIZE;
+  bool drain_requested = false;
+  bool flush_requested = false;
+  uint64_t received = 0;
+  uint64_t merged = 0;
+  uint64_t flushed = 0;
+  uint64_t delivered = 0;
+} sDiscovery;
+
+static void discovery_result_merge(DiscoveryResult& result, int num_properties,
+                                   const bt_property_t* properties,
+                                   bool keep_strongest_rssi) {
+  for (int i = 0; i < num_properties; i++) {
+    const bt_property_t& prop = properties[i];
+    if (prop.len < 0) continue;
+
+    const uint8_t* val = (const uint8_t*)prop.val;
+    std::vector<uint8_t>& stored = result.values[prop.type];
+    if (keep_strongest_rssi && prop.type == BT_PROPERTY_REMOTE_RSSI &&
+        prop.len == 1 && stored.size() == 1 &&
+        (int8_t)stored[0] >= (int8_t)val[0]) {
+      continue;
+    }
+    stored.assign(val, val + prop.len);
+  }
+}
+
+enum DiscoveryNotify {
+  DISCOVERY_NOTIFY_NONE,
+  DISCOVERY_NOTIFY_PENDING,  // drain after the dedup window
+  DISCOVERY_NOTIFY_FULL,     // drain now
+};
+
+// Queues or merges an inquiry result and returns what Java has to be told.
+static DiscoveryNotify discovery_queue_add(const RawAddress& bd_addr,
+                                           int num_properties,
+                                           const bt_property_t* properties) {
+  std::lock_guard<std::mutex> lock(sDiscovery.lock);
+  sDiscovery.received++;
+
+  auto it = sDiscovery.index.find(bd_addr);
+  if (it != sDiscovery.index.end()) {
+    discovery_result_merge(sDiscovery.queue[it->second], num_properties,
+                           properties, true);
+    sDiscovery.merged++;
+    return DISCOVERY_NOTIFY_NONE;
+  }
+
+  sDiscovery.index[bd_addr] = sDiscovery.queue.size();
+  sDiscovery.queue.push_back({bd_addr, {}});
+  discovery_result_merge(sDiscovery.queue.back(), num_properties, properties,
+                         true);
+
+  if (sDiscovery.queue.size() >= sDiscovery.max_size) {
+    if (sDiscovery.flush_requested) return DISCOVERY_NOTIFY_NONE;
+    sDiscovery.flush_requested = true;
+    sDiscovery.drain_requested = true;
+    sDiscovery.flushed++;
+    return DISCOVERY_NOTIFY_FULL;
+  }
+
+  if (sDiscovery.drain_requested) return DISCOVERY_NOTIFY_NONE;
+  sDiscovery.drain_requested = true;
+  return DISCOVERY_NOTIFY_PENDING;
+}
+
+// Folds properties delivered outside discovery into a queued result, so the
+// batch does not replay older values once drained.
+static void discovery_queue_refresh(const RawAddress& bd_addr,
+                                    int num_properties,
+                                    const bt_property_t* properties) {
+  std::lock_guard<std::mutex> lock(sDiscovery.lock);
+  auto it = sDiscovery.index.find(bd_addr);
+  if (it == sDiscovery.index.end()) return;
+  discovery_result_merge(sDiscovery.queue[it->second], num_properties,
+                         properties, false);
+}
+
+static void discovery_queue_clear() {
+  std::lock_guard<std::mutex> lock(sDiscovery.lock);
+  sDiscovery.queue.clear();
+  sDiscovery.index.clear();
+  sDiscovery.drain_requested = false;
+  sDiscovery.flush_requested = false;
+}
+
+static void dumpDiscoveryStats(int fd) {
+  std::lock_guard<std::mutex> lock(sDiscovery.lock);
+  dprintf(fd, "\nDiscovery results: received %" PRIu64 " merged %" PRIu64
+              " flushed early %" PRIu64 " delivered %" PRIu64
+              " queued %zu/%zu\n",
+          sDiscovery.received, sDiscovery.merged, sDiscovery.flushed,
+          sDiscovery.delivered, sDiscovery.queue.size(), sDiscovery.max_size);
+}
+
+static void remote_device_properties_callback(bt_status_t status,
+                                              RawAddress* bd_addr,
+                                              int num_properties,
+                                              bt_property_t* properties) {
+  CallbackEnv sCallbackEnv(__func__);
+  if (!sCallbackEnv.valid()) return;
+
+  ALOGV("%s: Status is: %d, Properties: %d", __func__, status, num_properties);
+
+  if (status != BT_STATUS_SUCCESS) {
+    ALOGE("%s: Status %d is incorrect", __func__, status);
+    return;
+  }
+
+  discovery_queue_refresh(*bd_addr, num_properties, properties);
+
+  std::vector<uint8_t> packed =
+      device_property_diff(*bd_addr, num_properties, properties, true);
+  deliver_device_properties(sCallbackEnv, *bd_addr, packed);
 }
 
 static void device_found_callback(int num_properties,
@@ -219,34 +618,27 @@ static void device_found_callback(int num_properties,
   CallbackEnv sCallbackEnv(__func__);
   if (!sCallbackEnv.valid()) return;
 
-  ScopedLocalRef<jbyteArray> addr(sCallbackEnv.get(), NULL);
-  int addr_index;
+  const RawAddress* bd_addr = NULL;
   for (int i = 0; i < num_properties; i++) {
-    if (properties[i].type == BT_PROPERTY_BDADDR) {
-      addr.reset(sCallbackEnv->NewByteArray(properties[i].len));
-      if (!addr.get()) {
-        ALOGE("Address is NULL (unable to allocate) in %s", __func__);
-        return;
-      }
-      sCallbackEnv->SetByteArrayRegion(addr.get(), 0, properties[i].len,
-                                       (jbyte*)properties[i].val);
-      addr_index = i;
+    if (properties[i].type == BT_PROPERTY_BDADDR &&
+        properties[i].len == (int)sizeof(RawAddress)) {
+      bd_addr = (const RawAddress*)properties[i].val;
     }
   }
-  if (!addr.get()) {
+  if (!bd_addr) {
     ALOGE("Address is NULL in %s", __func__);
     return;
   }
 
-  ALOGV("%s: Properties: %d, Address: %s", __func__, num_properties,
-        (const char*)properties[addr_index].val);
+  ALOGV("%s: Properties: %d", __func__, num_properties);
 
-  remote_device_properties_callback(BT_STATUS_SUCCESS,
-                                    (RawAddress*)properties[addr_index].val,
-                                    num_properties, properties);
+  DiscoveryNotify notify =
+      discovery_queue_add(*bd_addr, num_properties, properties);
+  if (notify == DISCOVERY_NOTIFY_NONE) return;
 
-  sCallbackEnv->CallVoidMethod(sJniCallbacksObj, method_deviceFoundCallback,
-                               addr.get());
+  sCallbackEnv->CallVoidMethod(sJniCallbacksObj,
+                               method_discoveryResultsPendingCallback,
+                               (jboolean)(notify == DISCOVERY_NOTIFY_FULL));
 }
 
 static void bond_state_changed_callback(bt_status_t status, RawAddress* bd_addr,
@@ -259,14 +651,18 @@ static void bond_state_changed_callback(bt_status_t status, RawAddress* bd_addr,
     return;
   }
 
+  // The remote may have dropped the bond itself; its records may change too.
+  if (state == BT_BOND_STATE_NONE) {
+    sdpCacheInvalidate(*bd_addr);
+    gattCacheInvalidate(*bd_addr);
+  }
+
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Address allocation failed in %s", __func__);
     return;
   }
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
 
   sCallbackEnv->CallVoidMethod(sJniCallbacksObj, method_bondStateChangeCallback,
                                (jint)status, addr.get(), (jint)state);
@@ -283,13 +679,11 @@ static void acl_state_changed_callback(bt_status_t status, RawAddress* bd_addr,
   if (!sCallbackEnv.valid()) return;
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Address allocation failed in %s", __func__);
     return;
   }
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
 
   sCallbackEnv->CallVoidMethod(sJniCallbacksObj, method_aclStateChangeCallback,
                                (jint)status, addr.get(), (jint)state);
@@ -316,15 +710,12 @@ static void pin_request_callback(RawAddress* bd_addr, bt_bdname_t* bdname,
   if (!sCallbackEnv.valid()) return;
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Error while allocating in: %s", __func__);
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
-
   ScopedLocalRef<jbyteArray> devname(
       sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(bt_bdname_t)));
   if (!devname.get()) {
@@ -350,15 +741,12 @@ static void ssp_request_callback(RawAddress* bd_addr, bt_bdname_t* bdname,
   if (!sCallbackEnv.valid()) return;
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) {
     ALOGE("Error while allocating in: %s", __func__);
     return;
   }
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
-
   ScopedLocalRef<jbyteArray> devname(
       sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(bt_bdname_t)));
   if (!devname.get()) {
@@ -616,10 +1004,10 @@ static void classInitNative(JNIEnv* env, jclass clazz) {
   method_discoveryStateChangeCallback = env->GetMethodID(
       jniCallbackClass, "discoveryStateChangeCallback", "(I)V");
 
-  method_devicePropertyChangedCallback = env->GetMethodID(
-      jniCallbackClass, "devicePropertyChangedCallback", "([B[I[[B)V");
-  method_deviceFoundCallback =
-      env->GetMethodID(jniCallbackClass, "deviceFoundCallback", "([B)V");
+  method_devicePropertiesChangedCallback = env->GetMethodID(
+      jniCallbackClass, "devicePropertiesChangedCallback", "([B[B)V");
+  method_discoveryResultsPendingCallback = env->GetMethodID(
+      jniCallbackClass, "discoveryResultsPendingCallback", "(Z)V");
   method_pinRequestCallback =
       env->GetMethodID(jniCallbackClass, "pinRequestCallback", "([B[BIZ)V");
   method_sspRequestCallback =
@@ -676,6 +1064,16 @@ static bool initNative(JNIEnv* env, jobject obj) {
     return JNI_FALSE;
   }
 
+  sCallbackStatsEnabled =
+      property_get_bool("persist.bt.callback_stats", false);
+
+  {
+    std::lock_guard<std::mutex> lock(sDiscovery.lock);
+    sDiscovery.max_size = std::max(
+        1, property_get_int32("persist.bt.discovery.queue_size",
+                              DISCOVERY_QUEUE_DEFAULT_SIZE));
+  }
+
   int ret = sBluetoothInterface->init(&sBluetoothCallbacks);
   if (ret != BT_STATUS_SUCCESS && ret != BT_STATUS_DONE) {
     ALOGE("Error while setting the callbacks: %d\n", ret);
@@ -712,6 +1110,10 @@ static bool cleanupNative(JNIEnv* env, jobject obj) {
   sBluetoothInterface->cleanup();
   ALOGI("%s: return from cleanup", __func__);
 
+  clearAddressCache(env);
+  device_property_forget_all();
+  discovery_queue_clear();
+
   env->DeleteGlobalRef(sJniCallbacksObj);
   env->DeleteGlobalRef(sJniAdapterServiceObj);
   env->DeleteGlobalRef(android_bluetooth_UidTraffic.clazz);
@@ -899,6 +1301,8 @@ static jboolean removeBondNative(JNIEnv* env, jobject obj, jbyteArray address) {
     return JNI_FALSE;
   }
 
+  sdpCacheInvalidate(*(RawAddress*)addr);
+  gattCacheInvalidate(*(RawAddress*)addr);
   int ret = sBluetoothInterface->remove_bond((RawAddress*)addr);
   env->ReleaseByteArrayElements(address, addr, 0);
 
@@ -1199,6 +1603,8 @@ static void dumpNative(JNIEnv* env, jobject obj, jobject fdObj,
   }
 
   sBluetoothInterface->dump(fd, args);
+  dumpCallbackStats(fd);
+  dumpDiscoveryStats(fd);
 
   for (int i = 0; i < numArgs; i++) {
     env->ReleaseStringUTFChars(argObjs[i], args[i]);
@@ -1237,6 +1643,74 @@ static void interopDatabaseAddNative(JNIEnv* env, jobject obj, int feature,
 }
 
 
+/* Hands the queued inquiry results to Java, each packed as
+ *   u8[6] address | u16 len | u8[len] changed properties
+ * where the properties use the devicePropertiesChangedCallback layout. A
+ * result is included even if none of its properties changed, so Java can
+ * still report the device as found. */
+static jbyteArray drainDiscoveryResultsNative(JNIEnv* env, jobject obj) {
+  std::vector<DiscoveryResult> results;
+  {
+    std::lock_guard<std::mutex> lock(sDiscovery.lock);
+    results.swap(sDiscovery.queue);
+    sDiscovery.index.clear();
+    sDiscovery.drain_requested = false;
+    sDiscovery.flush_requested = false;
+    sDiscovery.delivered += results.size();
+  }
+
+  std::vector<uint8_t> packed;
+  std::vector<bt_property_t> properties;
+  for (DiscoveryResult& result : results) {
+    properties.clear();
+    for (auto& value : result.values) {
+      bt_property_t prop;
+      prop.type = (bt_property_type_t)value.first;
+      prop.len = value.second.size();
+      prop.val = value.second.data();
+      properties.push_back(prop);
+    }
+
+    std::vector<uint8_t> changed = device_property_diff(
+        result.bd_addr, properties.size(), properties.data(), false);
+    if (changed.size() > UINT16_MAX) {
+      ALOGE("%s: dropping oversized result", __func__);
+      continue;
+    }
+
+    packed.insert(packed.end(), result.bd_addr.address,
+                  result.bd_addr.address + sizeof(RawAddress));
+    packed.push_back(changed.size() & 0xFF);
+    packed.push_back((changed.size() >> 8) & 0xFF);
+    packed.insert(packed.end(), changed.begin(), changed.end());
+  }
+
+  jbyteArray array = env->NewByteArray(packed.size());
+  if (!array) return NULL;
+  env->SetByteArrayRegion(array, 0, packed.size(), (const jbyte*)packed.data());
+  return array;
+}
+
+// Drops the stored properties of |address|, or of every device if NULL.
+static void forgetRemoteDevicePropertiesNative(JNIEnv* env, jobject obj,
+                                               jbyteArray address) {
+  if (address == NULL) {
+    device_property_forget_all();
+    return;
+  }
+
+  RawAddress bd_addr;
+  if (env->GetArrayLength(address) != (jsize)sizeof(RawAddress)) return;
+  env->GetByteArrayRegion(address, 0, sizeof(RawAddress),
+                          (jbyte*)bd_addr.address);
+
+  std::lock_guard<std::mutex> lock(sDevicePropertyMutex);
+  auto it = sDevicePropertyIndex.find(bd_addr);
+  if (it == sDevicePropertyIndex.end()) return;
+  sDevicePropertyLru.erase(it->second);
+  sDevicePropertyIndex.erase(it);
+}
+
 static int getSocketOptNative(JNIEnv *env, jobject obj, jint type, jint channel, jint optionName,
                                         jbyteArray optionVal) {
     ALOGV("%s:",__FUNCTION__);
@@ -1331,6 +1805,9 @@ static JNINativeMethod sMethods[] = {
     {"factoryResetNative", "()Z", (void*)factoryResetNative},
     {"interopDatabaseClearNative", "()V", (void*)interopDatabaseClearNative},
     {"interopDatabaseAddNative", "(I[BI)V", (void*)interopDatabaseAddNative},
+    {"forgetRemoteDevicePropertiesNative", "([B)V",
+     (void*)forgetRemoteDevicePropertiesNative},
+    {"drainDiscoveryResultsNative", "()[B", (void*)drainDiscoveryResultsNative},
     {"getSocketOptNative", "(III[B)I", (void*) getSocketOptNative},
     {"setSocketOptNative", "(III[BI)I", (void*) setSocketOptNative}};
 
@@ -20,12 +20,31 @@
 
 #include "android_runtime/AndroidRuntime.h"
 #include "com_android_bluetooth.h"
+#include "cutils/properties.h"
 #include "hardware/bt_gatt.h"
 #include "utils/Log.h"
 
 #include <base/bind.h>
+#include <errno.h>
+#include <stdio.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iterator>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <cutils/log.h>
 #define info(fmt, ...) ALOGI("%s(L%d): " fmt, __func__, __LINE__, ##__VA_ARGS__)
@@ -108,15 +127,19 @@ namespace android {
 static jmethodID method_onClientRegistered;
 static jmethodID method_onScannerRegistered;
 static jmethodID method_onScanResult;
+static jmethodID method_onScanResultBatch;
 static jmethodID method_onConnected;
 static jmethodID method_onDisconnected;
+static jmethodID method_onClientFleetProgress;
 static jmethodID method_onReadCharacteristic;
+static jmethodID method_onReadCharacteristicBatch;
 static jmethodID method_onWriteCharacteristic;
 static jmethodID method_onExecuteCompleted;
 static jmethodID method_onSearchCompleted;
 static jmethodID method_onReadDescriptor;
 static jmethodID method_onWriteDescriptor;
 static jmethodID method_onNotify;
+static jmethodID method_onNotifyPooled;
 static jmethodID method_onRegisterForNotifications;
 static jmethodID method_onReadRemoteRssi;
 static jmethodID method_onConfigureMTU;
@@ -132,8 +155,8 @@ static jmethodID method_onBatchScanThresholdCrossed;
 static jmethodID method_CreateonTrackAdvFoundLostObject;
 static jmethodID method_onTrackAdvFoundLost;
 static jmethodID method_onScanParamSetupCompleted;
-static jmethodID method_getSampleGattDbElement;
 static jmethodID method_onGetGattDb;
+static jmethodID method_onGetGattDbDelta;
 static jmethodID method_onClientPhyUpdate;
 static jmethodID method_onClientPhyRead;
 static jmethodID method_onClientConnUpdate;
@@ -179,6 +202,55 @@ static jmethodID method_onSyncLost;
 static jmethodID method_onSyncReport;
 static jmethodID method_onSyncStarted;
 
+/**
+ * GATT database marshalling IDs, resolved once in classInitNative.
+ * Callbacks run with the system class loader, so the application classes
+ * must be looked up here and kept as global references.
+ */
+static struct {
+  jclass clazz;
+  jmethodID constructor;
+  jfieldID id;
+  jfieldID uuid;
+  jfieldID type;
+  jfieldID attributeHandle;
+  jfieldID startHandle;
+  jfieldID endHandle;
+  jfieldID properties;
+  jfieldID permissions;
+} sGattDbElementClass;
+
+static struct {
+  jclass clazz;
+  jmethodID constructor;
+  jmethodID add;
+  jmethodID get;
+  jmethodID size;
+} sArrayListClass;
+
+static struct {
+  jclass clazz;
+  jmethodID constructor;
+  jmethodID getMostSignificantBits;
+  jmethodID getLeastSignificantBits;
+} sUuidClass;
+
+/**
+ * Packed GATT database layout used by onGetGattDb, one jlong per field and
+ * GATT_DB_PACKED_ELEMENT_LEN fields per element. Must be kept in sync with
+ * GattDbElement.unpack().
+ */
+#define GATT_DB_PACKED_ID 0
+#define GATT_DB_PACKED_TYPE 1
+#define GATT_DB_PACKED_ATTRIBUTE_HANDLE 2
+#define GATT_DB_PACKED_START_HANDLE 3
+#define GATT_DB_PACKED_END_HANDLE 4
+#define GATT_DB_PACKED_PROPERTIES 5
+#define GATT_DB_PACKED_PERMISSIONS 6
+#define GATT_DB_PACKED_UUID_LSB 7
+#define GATT_DB_PACKED_UUID_MSB 8
+#define GATT_DB_PACKED_ELEMENT_LEN 9
+
 /**
  * Static variables
  */
@@ -188,6 +260,435 @@ static jobject mCallbacksObj = NULL;
 static jobject mAdvertiseCallbacksObj = NULL;
 static jobject mPeriodicScanCallbacksObj = NULL;
 
+/**
+ * AD structure index
+ *
+ * ad_index_parse() walks advertising or EIR data once and records, for every
+ * AD structure, its type and where its value sits in the original buffer.
+ * Nothing is copied or allocated; consumers jump straight to the fields they
+ * need. Parsing stops at a zero length field, like ScanRecord does.
+ */
+#define AD_INDEX_MAX_ENTRIES 64
+#define AD_INDEX_NONE 0xFF
+
+#define AD_TYPE_16BIT_UUIDS_MORE 0x02
+#define AD_TYPE_16BIT_UUIDS 0x03
+#define AD_TYPE_32BIT_UUIDS_MORE 0x04
+#define AD_TYPE_32BIT_UUIDS 0x05
+#define AD_TYPE_128BIT_UUIDS_MORE 0x06
+#define AD_TYPE_128BIT_UUIDS 0x07
+#define AD_TYPE_SHORT_NAME 0x08
+#define AD_TYPE_NAME 0x09
+#define AD_TYPE_SERVICE_DATA_16BIT 0x16
+#define AD_TYPE_SERVICE_DATA_32BIT 0x20
+#define AD_TYPE_SERVICE_DATA_128BIT 0x21
+#define AD_TYPE_MANUFACTURER_DATA 0xFF
+
+struct AdIndexEntry {
+  uint8_t type;
+  uint16_t offset;  // of the value, past the length and type bytes
+  uint8_t len;      // of the value
+};
+
+/* Indexes |len| bytes of AD structures into |entries|. Returns the number of
+ * structures, or -1 if the data is malformed or has more than |max|. */
+static int ad_index_parse(const uint8_t* data, size_t len,
+                          AdIndexEntry* entries, int max) {
+  int count = 0;
+  size_t pos = 0;
+  while (pos < len) {
+    size_t field_len = data[pos];
+    if (field_len == 0) break;
+    if (pos + 1 + field_len > len || pos + 2 > UINT16_MAX || count == max)
+      return -1;
+
+    entries[count].type = data[pos + 1];
+    entries[count].offset = pos + 2;
+    entries[count].len = field_len - 1;
+    count++;
+    pos += 1 + field_len;
+  }
+  return count;
+}
+
+/**
+ * Scan result batching
+ *
+ * When enabled, scan results are packed into the direct ByteBuffer handed
+ * over by GattService and delivered with a single onScanResultBatch upcall
+ * once either the result count or the flush latency threshold is reached.
+ *
+ * Records are staged in native memory and only copied into the ByteBuffer
+ * right before the upcall. Flushes hold deliver_lock from taking the staged
+ * records until the upcall returns, so batches reach Java in order and the
+ * ByteBuffer is never written while Java reads it; the upcall itself runs
+ * without the staging lock. Batches that hit the latency while no further
+ * results arrive are delivered from the flusher thread, serialized with the
+ * callback thread by deliver_lock. Results that cannot be batched are
+ * delivered directly, after the staged ones.
+ *
+ * Packed record layout, little endian:
+ *   u16 event_type | u8 addr_type | u8[6] address | u8 primary_phy |
+ *   u8 secondary_phy | u8 advertising_sid | i8 tx_power | i8 rssi |
+ *   u16 periodic_adv_int | u16 adv_data_len | u8[adv_data_len] adv_data |
+ *   u8 ad_count | ad_count * (u8 type | u16 offset | u8 len)
+ * The trailer is the AD structure index of adv_data; ad_count is
+ * AD_INDEX_NONE if adv_data could not be indexed.
+ */
+
+#define SCAN_BATCH_RECORD_HEADER_LEN 18
+#define SCAN_BATCH_AD_ENTRY_LEN 4
+
+static struct {
+  // Lock order: deliver_lock, then lock.
+  std::mutex deliver_lock;
+  std::mutex lock;
+  std::condition_variable cv;
+  std::thread flusher;
+  bool enabled;
+  // Guarded by deliver_lock.
+  jobject buffer;
+  uint8_t* data;
+  std::vector<uint8_t> delivering;
+  // Guarded by lock.
+  size_t capacity;
+  std::vector<uint8_t> staged;
+  int count;
+  int max_results;
+  std::chrono::milliseconds max_latency;
+  std::chrono::steady_clock::time_point oldest;
+} sScanBatch;
+
+static void scan_batch_put_u16(uint8_t* p, uint16_t v) {
+  p[0] = v & 0xFF;
+  p[1] = (v >> 8) & 0xFF;
+}
+
+// Delivers the staged records, if any. Must be called without either lock.
+static void scan_batch_flush(JNIEnv* env) {
+  std::lock_guard<std::mutex> deliver_lock(sScanBatch.deliver_lock);
+  std::vector<uint8_t>& records = sScanBatch.delivering;
+  int count;
+  {
+    std::lock_guard<std::mutex> lock(sScanBatch.lock);
+    count = sScanBatch.count;
+    if (count == 0) return;
+    records.swap(sScanBatch.staged);
+    sScanBatch.count = 0;
+  }
+
+  if (mCallbacksObj != NULL && sScanBatch.data != NULL) {
+    memcpy(sScanBatch.data, records.data(), records.size());
+    env->CallVoidMethod(mCallbacksObj, method_onScanResultBatch, count,
+                        (jint)records.size());
+    if (env->ExceptionCheck()) {
+      ALOGE("An exception was thrown by callback 'onScanResultBatch'.");
+      LOGE_EX(env);
+      env->ExceptionClear();
+    }
+  }
+  records.clear();
+}
+
+// Appends a scan result to the staged batch. Returns false if batching is
+// disabled or the record cannot be batched and must be delivered directly;
+// staged records have been delivered by then.
+static bool scan_batch_add(JNIEnv* env, uint16_t event_type, uint8_t addr_type,
+                           const RawAddress* bda, uint8_t primary_phy,
+                           uint8_t secondary_phy, uint8_t advertising_sid,
+                           int8_t tx_power, int8_t rssi,
+                           uint16_t periodic_adv_int,
+                           const std::vector<uint8_t>& adv_data,
+                           const AdIndexEntry* ad_index, int ad_count) {
+  std::unique_lock<std::mutex> lock(sScanBatch.lock);
+  if (!sScanBatch.enabled) return false;
+
+  size_t index_len = 1 + std::max(ad_count, 0) * SCAN_BATCH_AD_ENTRY_LEN;
+  size_t record_len =
+      SCAN_BATCH_RECORD_HEADER_LEN + adv_data.size() + index_len;
+  if (record_len > sScanBatch.capacity) {
+    lock.unlock();
+    scan_batch_flush(env);
+    return false;
+  }
+
+  if (sScanBatch.staged.size() + record_len > sScanBatch.capacity) {
+    lock.unlock();
+    scan_batch_flush(env);
+    lock.lock();
+    if (!sScanBatch.enabled) return false;
+  }
+
+  std::vector<uint8_t>& staged = sScanBatch.staged;
+  size_t used = staged.size();
+  staged.resize(used + record_len);
+  uint8_t* p = staged.data() + used;
+  scan_batch_put_u16(p, event_type);
+  p[2] = addr_type;
+  memcpy(p + 3, bda->address, BD_ADDR_LEN);
+  p[9] = primary_phy;
+  p[10] = secondary_phy;
+  p[11] = advertising_sid;
+  p[12] = (uint8_t)tx_power;
+  p[13] = (uint8_t)rssi;
+  scan_batch_put_u16(p + 14, periodic_adv_int);
+  scan_batch_put_u16(p + 16, adv_data.size());
+  memcpy(p + SCAN_BATCH_RECORD_HEADER_LEN, adv_data.data(), adv_data.size());
+  p += SCAN_BATCH_RECORD_HEADER_LEN + adv_data.size();
+  *p++ = ad_count < 0 ? AD_INDEX_NONE : ad_count;
+  for (int i = 0; i < ad_count; i++, p += SCAN_BATCH_AD_ENTRY_LEN) {
+    p[0] = ad_index[i].type;
+    scan_batch_put_u16(p + 1, ad_index[i].offset);
+    p[3] = ad_index[i].len;
+  }
+
+  auto now = std::chrono::steady_clock::now();
+  if (sScanBatch.count == 0) {
+    sScanBatch.oldest = now;
+    sScanBatch.cv.notify_one();
+  }
+  sScanBatch.count++;
+
+  bool flush = sScanBatch.count >= sScanBatch.max_results ||
+               now - sScanBatch.oldest >= sScanBatch.max_latency;
+  lock.unlock();
+  if (flush) scan_batch_flush(env);
+  return true;
+}
+
+// Delivers batches that reached the flush latency while no further scan
+// results arrived on the callback thread.
+static void scan_batch_flusher_run() {
+  JavaVM* vm = AndroidRuntime::getJavaVM();
+  JNIEnv* env = NULL;
+  char name[] = "BT Scan Batch Flusher";
+  JavaVMAttachArgs args = {
+      .version = JNI_VERSION_1_6, .name = name, .group = NULL};
+  if (vm->AttachCurrentThread(&env, &args) != JNI_OK) {
+    error("Unable to attach scan batch flusher to VM");
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(sScanBatch.lock);
+  while (sScanBatch.enabled) {
+    if (sScanBatch.count == 0) {
+      sScanBatch.cv.wait(lock);
+      continue;
+    }
+
+    auto deadline = sScanBatch.oldest + sScanBatch.max_latency;
+    if (std::chrono::steady_clock::now() < deadline) {
+      sScanBatch.cv.wait_until(lock, deadline);
+      continue;
+    }
+
+    lock.unlock();
+    scan_batch_flush(env);
+    lock.lock();
+  }
+  lock.unlock();
+
+  vm->DetachCurrentThread();
+}
+
+static void scan_batch_stop(JNIEnv* env) {
+  scan_batch_flush(env);
+
+  std::unique_lock<std::mutex> lock(sScanBatch.lock);
+  if (!sScanBatch.enabled) return;
+  sScanBatch.enabled = false;
+  sScanBatch.cv.notify_all();
+  lock.unlock();
+
+  if (sScanBatch.flusher.joinable()) sScanBatch.flusher.join();
+
+  // Results staged after the flush above are dropped with the batch.
+  std::lock_guard<std::mutex> deliver_lock(sScanBatch.deliver_lock);
+  lock.lock();
+  env->DeleteGlobalRef(sScanBatch.buffer);
+  sScanBatch.buffer = NULL;
+  sScanBatch.data = NULL;
+  sScanBatch.capacity = 0;
+  sScanBatch.count = 0;
+  std::vector<uint8_t>().swap(sScanBatch.staged);
+  std::vector<uint8_t>().swap(sScanBatch.delivering);
+}
+
+/**
+ * Notification buffer pool
+ *
+ * Every connection gets a direct ByteBuffer wrapping native storage large
+ * enough for any attribute value. Notifications are copied into it and
+ * delivered with onNotifyPooled, keyed by conn_id only, so the hot path
+ * allocates neither an address string nor a JNI byte array. Java still
+ * copies the value into the byte[] the application callback takes, once it
+ * knows the notification is delivered. Hits count notifications delivered
+ * through the pool, misses those that fell back to onNotify. Upcalls are
+ * synchronous, so a single buffer per connection is never overwritten while
+ * Java still reads it. Buffers are released when the connection closes.
+ */
+
+struct NotifyBuffer {
+  jobject buffer;
+  uint8_t data[BTGATT_MAX_ATTR_LEN];
+};
+
+static struct {
+  std::mutex lock;
+  std::map<int, std::unique_ptr<NotifyBuffer>> buffers;
+  std::atomic<uint64_t> hits;
+  std::atomic<uint64_t> misses;
+} sNotifyPool;
+
+/* Returns the pooled buffer for conn_id, creating it on first use. */
+static NotifyBuffer* notify_pool_get(JNIEnv* env, int conn_id) {
+  std::lock_guard<std::mutex> lock(sNotifyPool.lock);
+  auto it = sNotifyPool.buffers.find(conn_id);
+  if (it != sNotifyPool.buffers.end()) return it->second.get();
+
+  std::unique_ptr<NotifyBuffer> entry(new NotifyBuffer);
+  ScopedLocalRef<jobject> buffer(
+      env, env->NewDirectByteBuffer(entry->data, sizeof(entry->data)));
+  if (!buffer.get()) return NULL;
+
+  entry->buffer = env->NewGlobalRef(buffer.get());
+  NotifyBuffer* result = entry.get();
+  sNotifyPool.buffers[conn_id] = std::move(entry);
+  return result;
+}
+
+static void notify_pool_release(JNIEnv* env, int conn_id) {
+  std::lock_guard<std::mutex> lock(sNotifyPool.lock);
+  auto it = sNotifyPool.buffers.find(conn_id);
+  if (it == sNotifyPool.buffers.end()) return;
+
+  env->DeleteGlobalRef(it->second->buffer);
+  sNotifyPool.buffers.erase(it);
+}
+
+static void notify_pool_clear(JNIEnv* env) {
+  std::lock_guard<std::mutex> lock(sNotifyPool.lock);
+  for (auto& it : sNotifyPool.buffers) env->DeleteGlobalRef(it.second->buffer);
+  sNotifyPool.buffers.clear();
+}
+
+/**
+ * Write pipelining
+ *
+ * gattClientWriteCharacteristicBatchNative queues a packed buffer of
+ * write-without-response records for a connection. BTA runs a single command
+ * per connection, so one write is in flight at a time and each completion
+ * issues the next one from here instead of going through Java; issuing
+ * stops while the link reports congestion. Intermediate completions are
+ * consumed here, only the last write of the queue (or the first failure) is
+ * reported to Java. GattService refuses other operations on the connection
+ * until then, so every completion seen while a write is in flight is ours.
+ *
+ * Packed record layout, little endian:
+ *   u16 handle | u16 len | u8[len] value
+ */
+
+#define WRITE_RECORD_HEADER_LEN 4
+#define GATT_WRITE_NO_RSP 1
+#define GATT_ERROR 0x85
+#define GATT_DEF_MTU 23
+
+struct PendingWrite {
+  uint16_t handle;
+  std::vector<uint8_t> value;
+};
+
+struct WriteQueue {
+  std::deque<PendingWrite> pending;
+  int auth_req;
+  bool in_flight;
+  uint16_t last_handle;
+  int status;
+  bool congested;
+};
+
+static struct {
+  std::mutex lock;
+  std::map<int, WriteQueue> queues;
+  std::map<int, int> mtus;
+} sWritePipeline;
+
+/* Issues the next pending write unless one is in flight or the link is
+ * congested. A write the stack refuses fails the rest of the queue. */
+static void write_pipeline_pump_locked(int conn_id, WriteQueue& queue) {
+  if (queue.congested || queue.in_flight || queue.pending.empty()) return;
+
+  PendingWrite write = std::move(queue.pending.front());
+  queue.pending.pop_front();
+  queue.last_handle = write.handle;
+  bt_status_t status =
+      sGattIf ? sGattIf->client->write_characteristic(
+                    conn_id, write.handle, GATT_WRITE_NO_RSP, queue.auth_req,
+                    std::move(write.value))
+              : BT_STATUS_NOT_READY;
+  if (status == BT_STATUS_SUCCESS) {
+    queue.in_flight = true;
+  } else {
+    queue.status = GATT_ERROR;
+    queue.pending.clear();
+  }
+}
+
+/* Returns true if the queue is done, either drained or failed, and erases
+ * it; |status| and |handle| then hold what to report to Java. */
+static bool write_pipeline_finish_locked(
+    std::map<int, WriteQueue>::iterator it, int* status, uint16_t* handle) {
+  WriteQueue& queue = it->second;
+  if (queue.in_flight || (queue.status == 0 && !queue.pending.empty()))
+    return false;
+
+  *status = queue.status;
+  *handle = queue.last_handle;
+  sWritePipeline.queues.erase(it);
+  return true;
+}
+
+/* Returns true if the completion belongs to a pipelined write and must not be
+ * reported to Java. |status| is updated if a later write of the queue could
+ * not be issued. */
+static bool write_pipeline_on_write_complete(int conn_id, int* status) {
+  std::lock_guard<std::mutex> lock(sWritePipeline.lock);
+  auto it = sWritePipeline.queues.find(conn_id);
+  if (it == sWritePipeline.queues.end() || !it->second.in_flight)
+    return false;
+
+  WriteQueue& queue = it->second;
+  queue.in_flight = false;
+  if (*status != 0) {
+    queue.status = *status;
+    queue.pending.clear();
+  }
+  write_pipeline_pump_locked(conn_id, queue);
+
+  uint16_t handle;
+  return !write_pipeline_finish_locked(it, status, &handle);
+}
+
+/* Returns true if resuming the queue failed; |status| and |handle| then hold
+ * the failure to report to Java. */
+static bool write_pipeline_on_congestion(int conn_id, bool congested,
+                                         int* status, uint16_t* handle) {
+  std::lock_guard<std::mutex> lock(sWritePipeline.lock);
+  auto it = sWritePipeline.queues.find(conn_id);
+  if (it == sWritePipeline.queues.end()) return false;
+
+  it->second.congested = congested;
+  if (congested) return false;
+  write_pipeline_pump_locked(conn_id, it->second);
+  return write_pipeline_finish_locked(it, status, handle);
+}
+
+static void write_pipeline_release(int conn_id) {
+  std::lock_guard<std::mutex> lock(sWritePipeline.lock);
+  sWritePipeline.queues.erase(conn_id);
+  sWritePipeline.mtus.erase(conn_id);
+}
+
 /**
  * BTA client callbacks
  */
@@ -200,35 +701,1334 @@ void btgattc_register_app_cb(int status, int clientIf,
                                clientIf, UUID_PARAMS(app_uuid));
 }
 
+/**
+ * Software scan filter
+ *
+ * ScanManager pushes the union of the regular scan clients' filters with
+ * gattClientSetSoftwareScanFilterNative whenever every client has filters.
+ * btgattc_scan_result_cb then drops advertisements that match none of them
+ * before any JNI work, so hundreds of filters beyond the controller's APCF
+ * slots don't cost a Java upcall per advertisement. GattService still applies
+ * the exact ScanFilter matching; this filter only has to pass a superset, so
+ * anything it can't evaluate (malformed or oversized AD data) is passed.
+ *
+ * The filters are compiled into lookup tables keyed by address,
+ * manufacturer id, service data UUID or fully masked service UUID, so an
+ * advertisement only evaluates the filters its own fields can select; filters
+ * with none of those keys are evaluated for every advertisement.
+ *
+ * Program layout, little endian:
+ *   u16 count, followed by count filters of
+ *   u8 flags (SW_FILTER_*) and, in flag order, the present fields:
+ *     address:         u8[6]
+ *     name:            u8 len | u8[len] UTF-8
+ *     service uuid:    u8[16] uuid | u8[16] mask, both big endian
+ *     service data:    u8[16] uuid | u8 len | u8[len] data | u8[len] mask
+ *     manufacturer:    u16 id | u8 len | u8[len] data | u8[len] mask
+ */
+#define SW_FILTER_ADDRESS 0x01
+#define SW_FILTER_NAME 0x02
+#define SW_FILTER_SERVICE_UUID 0x04
+#define SW_FILTER_SERVICE_DATA 0x08
+#define SW_FILTER_MANUFACTURER 0x10
+
+#define SW_FILTER_MAX_UUIDS 32
+#define SW_FILTER_MAX_DATA 8
+#define SW_FILTER_MAX_NAMES 2
+
+typedef std::array<uint8_t, 16> ScanUuid;  // big endian, as java.util.UUID
+
+struct SwScanFilter {
+  uint8_t flags;
+  RawAddress address;
+  std::string name;
+  ScanUuid uuid;
+  ScanUuid uuid_mask;
+  ScanUuid data_uuid;
+  std::vector<uint8_t> data;
+  std::vector<uint8_t> data_mask;
+  uint16_t manufacturer_id;
+  std::vector<uint8_t> manufacturer_data;
+  std::vector<uint8_t> manufacturer_mask;
+};
+
+struct SwScanFilterProgram {
+  std::vector<SwScanFilter> filters;
+  std::map<RawAddress, std::vector<uint16_t>> by_address;
+  std::map<uint16_t, std::vector<uint16_t>> by_manufacturer;
+  std::map<ScanUuid, std::vector<uint16_t>> by_service_data;
+  std::map<ScanUuid, std::vector<uint16_t>> by_service_uuid;
+  std::vector<uint16_t> unindexed;
+};
+
+/* Fields of one advertisement the filters look at, pointing into adv_data.
+ * Fixed size so matching never allocates. */
+struct SwScanAdFields {
+  bool complete;
+  int uuid_count;
+  ScanUuid uuids[SW_FILTER_MAX_UUIDS];
+  int data_count;
+  ScanUuid data_uuids[SW_FILTER_MAX_DATA];
+  const uint8_t* data[SW_FILTER_MAX_DATA];
+  size_t data_len[SW_FILTER_MAX_DATA];
+  int manufacturer_count;
+  uint16_t manufacturer_ids[SW_FILTER_MAX_DATA];
+  const uint8_t* manufacturer_data[SW_FILTER_MAX_DATA];
+  size_t manufacturer_len[SW_FILTER_MAX_DATA];
+  int name_count;
+  const uint8_t* names[SW_FILTER_MAX_NAMES];
+  size_t name_len[SW_FILTER_MAX_NAMES];
+};
+
+static struct {
+  std::mutex lock;
+  std::shared_ptr<const SwScanFilterProgram> program;
+  std::atomic<uint64_t> passed;
+  std::atomic<uint64_t> dropped;
+} sSwScanFilter;
+
+static const ScanUuid kBaseUuid = {{0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                    0x10, 0x00, 0x80, 0x00, 0x00, 0x80,
+                                    0x5F, 0x9B, 0x34, 0xFB}};
+
+/* Expands a little endian 16, 32 or 128 bit AD UUID to 128 bits. */
+static ScanUuid sw_filter_uuid(const uint8_t* p, size_t len) {
+  ScanUuid uuid = kBaseUuid;
+  if (len == 16) {
+    for (size_t i = 0; i < 16; i++) uuid[i] = p[15 - i];
+  } else {
+    for (size_t i = 0; i < len; i++) uuid[3 - i] = p[i];
+  }
+  return uuid;
+}
+
+/* Compares |len| bytes of |value| and |pattern| under |mask|, a word at a
+ * time. */
+static bool sw_filter_masked_equal(const uint8_t* value, const uint8_t* pattern,
+                                   const uint8_t* mask, size_t len) {
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+    uint64_t v, p, m;
+    memcpy(&v, value + i, sizeof(v));
+    memcpy(&p, pattern + i, sizeof(p));
+    memcpy(&m, mask + i, sizeof(m));
+    if ((v ^ p) & m) return false;
+  }
+  for (; i < len; i++) {
+    if ((value[i] ^ pattern[i]) & mask[i]) return false;
+  }
+  return true;
+}
+
+static void sw_filter_parse(const uint8_t* adv, const AdIndexEntry* ad_index,
+                            int ad_count, SwScanAdFields* fields) {
+  fields->complete = false;
+  fields->uuid_count = 0;
+  fields->data_count = 0;
+  fields->manufacturer_count = 0;
+  fields->name_count = 0;
+  if (ad_count < 0) return;
+
+  for (int n = 0; n < ad_count; n++) {
+    uint8_t type = ad_index[n].type;
+    const uint8_t* value = adv + ad_index[n].offset;
+    size_t value_len = ad_index[n].len;
+
+    size_t uuid_len = 0;
+    switch (type) {
+      case AD_TYPE_16BIT_UUIDS_MORE:
+      case AD_TYPE_16BIT_UUIDS:
+        uuid_len = 2;
+        break;
+      case AD_TYPE_32BIT_UUIDS_MORE:
+      case AD_TYPE_32BIT_UUIDS:
+        uuid_len = 4;
+        break;
+      case AD_TYPE_128BIT_UUIDS_MORE:
+      case AD_TYPE_128BIT_UUIDS:
+        uuid_len = 16;
+        break;
+      case AD_TYPE_SHORT_NAME:
+      case AD_TYPE_NAME:
+        if (fields->name_count == SW_FILTER_MAX_NAMES) return;
+        fields->names[fields->name_count] = value;
+        fields->name_len[fields->name_count++] = value_len;
+        continue;
+      case AD_TYPE_SERVICE_DATA_16BIT:
+      case AD_TYPE_SERVICE_DATA_32BIT:
+      case AD_TYPE_SERVICE_DATA_128BIT: {
+        size_t key_len = type == AD_TYPE_SERVICE_DATA_16BIT
+                             ? 2
+                             : type == AD_TYPE_SERVICE_DATA_32BIT ? 4 : 16;
+        if (value_len < key_len || fields->data_count == SW_FILTER_MAX_DATA)
+          return;
+        int i = fields->data_count++;
+        fields->data_uuids[i] = sw_filter_uuid(value, key_len);
+        fields->data[i] = value + key_len;
+        fields->data_len[i] = value_len - key_len;
+        continue;
+      }
+      case AD_TYPE_MANUFACTURER_DATA: {
+        if (value_len < 2 || fields->manufacturer_count == SW_FILTER_MAX_DATA)
+          return;
+        int i = fields->manufacturer_count++;
+        fields->manufacturer_ids[i] = value[0] | (value[1] << 8);
+        fields->manufacturer_data[i] = value + 2;
+        fields->manufacturer_len[i] = value_len - 2;
+        continue;
+      }
+      default:
+        continue;
+    }
+
+    if (value_len % uuid_len) return;
+    for (size_t i = 0; i < value_len; i += uuid_len) {
+      if (fields->uuid_count == SW_FILTER_MAX_UUIDS) return;
+      fields->uuids[fields->uuid_count++] = sw_filter_uuid(value + i, uuid_len);
+    }
+  }
+  fields->complete = true;
+}
+
+static bool sw_filter_matches(const SwScanFilter& filter, const RawAddress& bda,
+                              const SwScanAdFields& fields) {
+  if ((filter.flags & SW_FILTER_ADDRESS) && !(filter.address == bda))
+    return false;
+
+  if (filter.flags & SW_FILTER_NAME) {
+    bool found = false;
+    for (int i = 0; i < fields.name_count && !found; i++) {
+      found = fields.name_len[i] == filter.name.size() &&
+              !memcmp(fields.names[i], filter.name.data(), filter.name.size());
+    }
+    if (!found) return false;
+  }
+
+  if (filter.flags & SW_FILTER_SERVICE_UUID) {
+    bool found = false;
+    for (int i = 0; i < fields.uuid_count && !found; i++) {
+      found = sw_filter_masked_equal(fields.uuids[i].data(), filter.uuid.data(),
+                                     filter.uuid_mask.data(), 16);
+    }
+    if (!found) return false;
+  }
+
+  if (filter.flags & SW_FILTER_SERVICE_DATA) {
+    bool found = false;
+    for (int i = 0; i < fields.data_count && !found; i++) {
+      found = fields.data_uuids[i] == filter.data_uuid &&
+              fields.data_len[i] >= filter.data.size() &&
+              sw_filter_masked_equal(fields.data[i], filter.data.data(),
+                                     filter.data_mask.data(),
+                                     filter.data.size());
+    }
+    if (!found) return false;
+  }
+
+  if (filter.flags & SW_FILTER_MANUFACTURER) {
+    bool found = false;
+    for (int i = 0; i < fields.manufacturer_count && !found; i++) {
+      found = fields.manufacturer_ids[i] == filter.manufacturer_id &&
+              fields.manufacturer_len[i] >= filter.manufacturer_data.size() &&
+              sw_filter_masked_equal(fields.manufacturer_data[i],
+                                     filter.manufacturer_data.data(),
+                                     filter.manufacturer_mask.data(),
+                                     filter.manufacturer_data.size());
+    }
+    if (!found) return false;
+  }
+
+  return true;
+}
+
+static bool sw_filter_any(const SwScanFilterProgram& program,
+                          const std::vector<uint16_t>& candidates,
+                          const RawAddress& bda, const SwScanAdFields& fields) {
+  for (uint16_t i : candidates) {
+    if (sw_filter_matches(program.filters[i], bda, fields)) return true;
+  }
+  return false;
+}
+
+template <typename Key>
+static bool sw_filter_lookup(
+    const SwScanFilterProgram& program,
+    const std::map<Key, std::vector<uint16_t>>& table, const Key& key,
+    const RawAddress& bda, const SwScanAdFields& fields) {
+  auto it = table.find(key);
+  return it != table.end() && sw_filter_any(program, it->second, bda, fields);
+}
+
+/* Returns true if the advertisement may match a scan client's filter and has
+ * to be delivered to Java. */
+static bool sw_filter_accept(const RawAddress& bda,
+                             const std::vector<uint8_t>& adv_data,
+                             const AdIndexEntry* ad_index, int ad_count) {
+  std::shared_ptr<const SwScanFilterProgram> program;
+  {
+    std::lock_guard<std::mutex> lock(sSwScanFilter.lock);
+    program = sSwScanFilter.program;
+  }
+  if (!program) return true;
+
+  SwScanAdFields fields;
+  sw_filter_parse(adv_data.data(), ad_index, ad_count, &fields);
+
+  bool accept =
+      !fields.complete ||
+      sw_filter_lookup(*program, program->by_address, bda, bda, fields) ||
+      sw_filter_any(*program, program->unindexed, bda, fields);
+  for (int i = 0; i < fields.manufacturer_count && !accept; i++) {
+    accept = sw_filter_lookup(*program, program->by_manufacturer,
+                              fields.manufacturer_ids[i], bda, fields);
+  }
+  for (int i = 0; i < fields.data_count && !accept; i++) {
+    accept = sw_filter_lookup(*program, program->by_service_data,
+                              fields.data_uuids[i], bda, fields);
+  }
+  for (int i = 0; i < fields.uuid_count && !accept; i++) {
+    accept = sw_filter_lookup(*program, program->by_service_uuid,
+                              fields.uuids[i], bda, fields);
+  }
+
+  if (accept)
+    sSwScanFilter.passed++;
+  else
+    sSwScanFilter.dropped++;
+  return accept;
+}
+
+/* Parses and indexes a program, see "Software scan filter" for the layout.
+ * Returns NULL if it is malformed. */
+static std::shared_ptr<SwScanFilterProgram> sw_filter_compile(
+    const uint8_t* p, size_t len) {
+  const uint8_t* end = p + len;
+  auto need = [&p, end](size_t n) { return (size_t)(end - p) >= n; };
+
+  if (!need(2)) return NULL;
+  uint16_t count = p[0] | (p[1] << 8);
+  p += 2;
+
+  auto program = std::make_shared<SwScanFilterProgram>();
+  program->filters.resize(count);
+  for (uint16_t i = 0; i < count; i++) {
+    SwScanFilter& filter = program->filters[i];
+    if (!need(1)) return NULL;
+    filter.flags = *p++;
+
+    if (filter.flags & SW_FILTER_ADDRESS) {
+      if (!need(sizeof(filter.address.address))) return NULL;
+      memcpy(filter.address.address, p, sizeof(filter.address.address));
+      p += sizeof(filter.address.address);
+    }
+    if (filter.flags & SW_FILTER_NAME) {
+      if (!need(1) || !need(1 + p[0])) return NULL;
+      filter.name.assign((const char*)p + 1, p[0]);
+      p += 1 + p[0];
+    }
+    if (filter.flags & SW_FILTER_SERVICE_UUID) {
+      if (!need(32)) return NULL;
+      memcpy(filter.uuid.data(), p, 16);
+      memcpy(filter.uuid_mask.data(), p + 16, 16);
+      p += 32;
+    }
+    if (filter.flags & SW_FILTER_SERVICE_DATA) {
+      if (!need(17) || !need(17 + 2 * p[16])) return NULL;
+      memcpy(filter.data_uuid.data(), p, 16);
+      size_t data_len = p[16];
+      p += 17;
+      filter.data.assign(p, p + data_len);
+      filter.data_mask.assign(p + data_len, p + 2 * data_len);
+      p += 2 * data_len;
+    }
+    if (filter.flags & SW_FILTER_MANUFACTURER) {
+      if (!need(3) || !need(3 + 2 * p[2])) return NULL;
+      filter.manufacturer_id = p[0] | (p[1] << 8);
+      size_t data_len = p[2];
+      p += 3;
+      filter.manufacturer_data.assign(p, p + data_len);
+      filter.manufacturer_mask.assign(p + data_len, p + 2 * data_len);
+      p += 2 * data_len;
+    }
+
+    static const ScanUuid kFullMask = {{0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                        0xFF, 0xFF, 0xFF, 0xFF}};
+    if (filter.flags & SW_FILTER_ADDRESS) {
+      program->by_address[filter.address].push_back(i);
+    } else if (filter.flags & SW_FILTER_MANUFACTURER) {
+      program->by_manufacturer[filter.manufacturer_id].push_back(i);
+    } else if (filter.flags & SW_FILTER_SERVICE_DATA) {
+      program->by_service_data[filter.data_uuid].push_back(i);
+    } else if ((filter.flags & SW_FILTER_SERVICE_UUID) &&
+               filter.uuid_mask == kFullMask) {
+      program->by_service_uuid[filter.uuid].push_back(i);
+    } else {
+      program->unindexed.push_back(i);
+    }
+  }
+  if (p != end) return NULL;
+  return program;
+}
+
+/**
+ * Adaptive scan scheduling
+ *
+ * While enabled with gattClientSetAdaptiveScanNative, regular scans move
+ * between ADAPTIVE_SCAN_LEVELS sets of scan parameters, from the floor (the
+ * lowest duty cycle and longest interval Java allows) to the ceiling (the
+ * parameters the most aggressive scan client asked for). The levels in
+ * between are interpolated.
+ *
+ * btgattc_scan_result_cb counts results and addresses not seen recently.
+ * Once per scan interval the scheduler looks at the last period:
+ *  - ADAPTIVE_SCAN_BURST_DEVICES or more new devices passing the software
+ *    scan filter jump to the ceiling,
+ *  - fewer new devices, or a result density (results per window unit) well
+ *    above its average, step one level up,
+ *  - ADAPTIVE_SCAN_IDLE_PERIODS periods in a row without either step one
+ *    level down.
+ * The scan is restarted with the new parameters, the same way ScanManager
+ * applies them.
+ */
+
+#define ADAPTIVE_SCAN_LEVELS 4
+#define ADAPTIVE_SCAN_BURST_DEVICES 3
+#define ADAPTIVE_SCAN_IDLE_PERIODS 3
+#define ADAPTIVE_SCAN_SURGE_MIN_RESULTS 8
+#define ADAPTIVE_SCAN_FORGET_PERIODS 12
+#define ADAPTIVE_SCAN_MAX_TRACKED 2048
+#define ADAPTIVE_SCAN_MIN_PERIOD_MS 1000
+// Controller limits, in 0.625 ms units.
+#define LE_SCAN_INTERVAL_MIN 0x0004
+#define LE_SCAN_INTERVAL_MAX 0x4000
+
+static struct {
+  std::mutex lock;
+  std::condition_variable cv;
+  std::thread worker;
+  std::atomic<bool> enabled;
+  bool running;
+  bool scanning;
+  int ceiling_interval, ceiling_window;
+  int floor_interval, floor_window;
+  int level;
+  int idle_periods;
+  int periods;
+  // Addresses seen in this and the previous tracking generation.
+  std::unordered_set<uint64_t> seen, seen_previous;
+  int results;
+  int new_devices;
+  int new_hits;
+  float density_avg;
+  uint64_t retunes;
+} sAdaptiveScan;
+
+static int adaptive_scan_lerp(int floor, int ceiling, int level) {
+  return floor + (ceiling - floor) * level / (ADAPTIVE_SCAN_LEVELS - 1);
+}
+
+static int adaptive_scan_interval_locked() {
+  return adaptive_scan_lerp(sAdaptiveScan.floor_interval,
+                            sAdaptiveScan.ceiling_interval,
+                            sAdaptiveScan.level);
+}
+
+static int adaptive_scan_window_locked() {
+  return adaptive_scan_lerp(sAdaptiveScan.floor_window,
+                            sAdaptiveScan.ceiling_window, sAdaptiveScan.level);
+}
+
+static void adaptive_scan_params_cb(uint8_t status) {
+  if (status != 0) error("failed to retune scan parameters, status %d", status);
+}
+
+static void adaptive_scan_apply_locked() {
+  if (!sGattIf || !sAdaptiveScan.scanning) return;
+
+  sGattIf->scanner->Scan(false);
+  sGattIf->scanner->SetScanParameters(adaptive_scan_interval_locked(),
+                                      adaptive_scan_window_locked(),
+                                      base::Bind(&adaptive_scan_params_cb));
+  sGattIf->scanner->Scan(true);
+  sAdaptiveScan.retunes++;
+}
+
+/* Called for every scan result; |accepted| is the software scan filter
+ * verdict. */
+static void adaptive_scan_on_result(const RawAddress& bda, bool accepted) {
+  if (!sAdaptiveScan.enabled) return;
+
+  uint64_t key = 0;
+  for (int i = 0; i < BD_ADDR_LEN; i++) key = (key << 8) | bda.address[i];
+
+  std::lock_guard<std::mutex> lock(sAdaptiveScan.lock);
+  sAdaptiveScan.results++;
+  if (!sAdaptiveScan.seen.insert(key).second) return;
+  if (sAdaptiveScan.seen_previous.erase(key)) return;
+  sAdaptiveScan.new_devices++;
+  if (accepted) sAdaptiveScan.new_hits++;
+}
+
+static void adaptive_scan_evaluate_locked() {
+  int window = adaptive_scan_window_locked();
+  float density = (float)sAdaptiveScan.results / std::max(window, 1);
+  bool surge = sAdaptiveScan.results >= ADAPTIVE_SCAN_SURGE_MIN_RESULTS &&
+               density > 2 * sAdaptiveScan.density_avg;
+  sAdaptiveScan.density_avg += (density - sAdaptiveScan.density_avg) / 4;
+
+  int new_hits = sAdaptiveScan.new_hits;
+  int level = sAdaptiveScan.level;
+  if (new_hits >= ADAPTIVE_SCAN_BURST_DEVICES) {
+    level = ADAPTIVE_SCAN_LEVELS - 1;
+  } else if (new_hits > 0 || surge) {
+    level = std::min(level + 1, ADAPTIVE_SCAN_LEVELS - 1);
+  } else if (++sAdaptiveScan.idle_periods >= ADAPTIVE_SCAN_IDLE_PERIODS) {
+    level = std::max(level - 1, 0);
+  }
+  if (level != sAdaptiveScan.level || new_hits > 0 || surge)
+    sAdaptiveScan.idle_periods = 0;
+
+  if (++sAdaptiveScan.periods >= ADAPTIVE_SCAN_FORGET_PERIODS ||
+      sAdaptiveScan.seen.size() >= ADAPTIVE_SCAN_MAX_TRACKED) {
+    sAdaptiveScan.seen_previous.swap(sAdaptiveScan.seen);
+    sAdaptiveScan.seen.clear();
+    sAdaptiveScan.periods = 0;
+  }
+  sAdaptiveScan.results = 0;
+  sAdaptiveScan.new_devices = 0;
+  sAdaptiveScan.new_hits = 0;
+
+  if (level == sAdaptiveScan.level) return;
+  debug("scan level %d -> %d, new devices %d", sAdaptiveScan.level, level,
+        new_hits);
+  sAdaptiveScan.level = level;
+  adaptive_scan_apply_locked();
+}
+
+static void adaptive_scan_run() {
+  std::unique_lock<std::mutex> lock(sAdaptiveScan.lock);
+  while (sAdaptiveScan.running) {
+    if (!sAdaptiveScan.enabled || !sAdaptiveScan.scanning) {
+      sAdaptiveScan.cv.wait(lock);
+      continue;
+    }
+
+    // Scan units are 0.625 ms.
+    std::chrono::milliseconds period(std::max(
+        adaptive_scan_interval_locked() * 5 / 8, ADAPTIVE_SCAN_MIN_PERIOD_MS));
+    if (sAdaptiveScan.cv.wait_for(lock, period) == std::cv_status::no_timeout)
+      continue;
+    if (sAdaptiveScan.enabled && sAdaptiveScan.scanning)
+      adaptive_scan_evaluate_locked();
+  }
+}
+
+static void adaptive_scan_stop() {
+  std::unique_lock<std::mutex> lock(sAdaptiveScan.lock);
+  sAdaptiveScan.enabled = false;
+  sAdaptiveScan.running = false;
+  sAdaptiveScan.cv.notify_all();
+  lock.unlock();
+
+  if (sAdaptiveScan.worker.joinable()) sAdaptiveScan.worker.join();
+
+  lock.lock();
+  sAdaptiveScan.seen.clear();
+  sAdaptiveScan.seen_previous.clear();
+}
+
 void btgattc_scan_result_cb(uint16_t event_type, uint8_t addr_type,
                             RawAddress* bda, uint8_t primary_phy,
                             uint8_t secondary_phy, uint8_t advertising_sid,
                             int8_t tx_power, int8_t rssi,
                             uint16_t periodic_adv_int,
                             std::vector<uint8_t> adv_data) {
+  AdIndexEntry ad_index[AD_INDEX_MAX_ENTRIES];
+  int ad_count = ad_index_parse(adv_data.data(), adv_data.size(), ad_index,
+                                AD_INDEX_MAX_ENTRIES);
+  bool accepted = sw_filter_accept(*bda, adv_data, ad_index, ad_count);
+  adaptive_scan_on_result(*bda, accepted);
+  if (!accepted) return;
+
   CallbackEnv sCallbackEnv(__func__);
   if (!sCallbackEnv.valid()) return;
 
-  ScopedLocalRef<jstring> address(sCallbackEnv.get(),
-                                  bdaddr2newjstr(sCallbackEnv.get(), bda));
-  ScopedLocalRef<jbyteArray> jb(sCallbackEnv.get(),
-                                sCallbackEnv->NewByteArray(adv_data.size()));
-  sCallbackEnv->SetByteArrayRegion(jb.get(), 0, adv_data.size(),
-                                   (jbyte*)adv_data.data());
+  if (scan_batch_add(sCallbackEnv.get(), event_type, addr_type, bda,
+                     primary_phy, secondary_phy, advertising_sid, tx_power,
+                     rssi, periodic_adv_int, adv_data, ad_index, ad_count))
+    return;
+
+  ScopedLocalRef<jstring> address(sCallbackEnv.get(),
+                                  bdaddr2newjstr(sCallbackEnv.get(), bda));
+  ScopedLocalRef<jbyteArray> jb(sCallbackEnv.get(),
+                                sCallbackEnv->NewByteArray(adv_data.size()));
+  sCallbackEnv->SetByteArrayRegion(jb.get(), 0, adv_data.size(),
+                                   (jbyte*)adv_data.data());
+
+  sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onScanResult, event_type,
+                               addr_type, address.get(), primary_phy,
+                               secondary_phy, advertising_sid, tx_power, rssi,
+                               periodic_adv_int, jb.get());
+}
+
+/**
+ * Read batching
+ *
+ * gattClientReadCharacteristicBatchNative reads a list of handles on a
+ * connection. The stack accepts one outstanding request per connection, so
+ * each completion issues the next read from here instead of going through
+ * Java. The values are collected and reported with a single
+ * onReadCharacteristicBatch once the last read completed.
+ *
+ * Packed result layout, little endian, one record per handle in request
+ * order:
+ *   u16 handle | u8 status | u16 len | u8[len] value
+ * Failed reads carry the single zero byte value onReadCharacteristic reports.
+ */
+
+#define READ_BATCH_MAX_HANDLES 64
+#define READ_RECORD_HEADER_LEN 5
+
+struct ReadBatch {
+  std::deque<uint16_t> pending;
+  int auth_req;
+  uint16_t in_flight;
+  std::vector<uint8_t> packed;
+};
+
+static struct {
+  std::mutex lock;
+  std::map<int, ReadBatch> batches;
+} sReadBatch;
+
+static void read_batch_pack(ReadBatch& batch, uint16_t handle, int status,
+                            const uint8_t* value, uint16_t len) {
+  static const uint8_t kFailedValue = 0;
+  if (status != 0) {
+    value = &kFailedValue;
+    len = 1;
+  }
+  batch.packed.push_back(handle & 0xFF);
+  batch.packed.push_back(handle >> 8);
+  batch.packed.push_back(status);
+  batch.packed.push_back(len & 0xFF);
+  batch.packed.push_back(len >> 8);
+  batch.packed.insert(batch.packed.end(), value, value + len);
+}
+
+/* Issues the next pending read. Returns false once the batch is complete. */
+static bool read_batch_pump_locked(int conn_id, ReadBatch& batch) {
+  while (!batch.pending.empty()) {
+    uint16_t handle = batch.pending.front();
+    batch.pending.pop_front();
+    bt_status_t status =
+        sGattIf ? sGattIf->client->read_characteristic(conn_id, handle,
+                                                       batch.auth_req)
+                : BT_STATUS_NOT_READY;
+    if (status == BT_STATUS_SUCCESS) {
+      batch.in_flight = handle;
+      return true;
+    }
+    read_batch_pack(batch, handle, GATT_ERROR, NULL, 0);
+  }
+  return false;
+}
+
+/* Returns true if the read belongs to a batch and must not be reported to
+ * Java on its own. |done| receives the packed results once the batch is
+ * complete. */
+static bool read_batch_on_read(int conn_id, int status,
+                               const btgatt_read_params_t* p_data,
+                               std::vector<uint8_t>* done) {
+  std::lock_guard<std::mutex> lock(sReadBatch.lock);
+  auto it = sReadBatch.batches.find(conn_id);
+  if (it == sReadBatch.batches.end() || it->second.in_flight != p_data->handle)
+    return false;
+
+  ReadBatch& batch = it->second;
+  read_batch_pack(batch, p_data->handle, status, p_data->value.value,
+                  p_data->value.len);
+  if (read_batch_pump_locked(conn_id, batch)) return true;
+
+  done->swap(batch.packed);
+  sReadBatch.batches.erase(it);
+  return true;
+}
+
+static void read_batch_release(int conn_id) {
+  std::lock_guard<std::mutex> lock(sReadBatch.lock);
+  sReadBatch.batches.erase(conn_id);
+}
+
+/**
+ * GATT database diff
+ *
+ * The last database delivered for each connection is kept natively. When the
+ * database is fetched again (after a refresh or service changed indication),
+ * only services whose elements differ are packed; Java is given the ids of
+ * services to drop and the packed added or changed services through
+ * onGetGattDbDelta, and patches its copy. A service is identified by its type,
+ * handle range and UUID and compared element by element. The first database
+ * of a connection is always delivered whole through onGetGattDb.
+ */
+static struct {
+  std::mutex lock;
+  std::map<int, std::vector<btgatt_db_element_t>> databases;
+} sGattDbCache;
+
+static bool gatt_db_is_service(const btgatt_db_element_t& el) {
+  return el.type == BTGATT_DB_PRIMARY_SERVICE ||
+         el.type == BTGATT_DB_SECONDARY_SERVICE;
+}
+
+static bool gatt_db_element_equal(const btgatt_db_element_t& a,
+                                  const btgatt_db_element_t& b) {
+  return a.id == b.id && a.type == b.type &&
+         a.attribute_handle == b.attribute_handle &&
+         a.start_handle == b.start_handle && a.end_handle == b.end_handle &&
+         a.properties == b.properties && a.permissions == b.permissions &&
+         !memcmp(a.uuid.uu, b.uuid.uu, sizeof(a.uuid.uu));
+}
+
+/* Splits |db| into [begin, end) element ranges, one per service. Returns false
+ * if the database does not start with a service. */
+static bool gatt_db_split(const btgatt_db_element_t* db, int count,
+                          std::vector<std::pair<int, int>>* services) {
+  for (int i = 0; i < count; i++) {
+    if (gatt_db_is_service(db[i])) {
+      services->emplace_back(i, i + 1);
+    } else if (services->empty()) {
+      return false;
+    } else {
+      services->back().second = i + 1;
+    }
+  }
+  return true;
+}
+
+/* Diffs |db| against |previous|. Fills |removed| with the ids of services
+ * that are gone or changed and |added| with the elements of services that
+ * are new or changed. Returns false if the databases can't be diffed. */
+static bool gatt_db_diff(const std::vector<btgatt_db_element_t>& previous,
+                         const btgatt_db_element_t* db, int count,
+                         std::vector<jint>* removed,
+                         std::vector<btgatt_db_element_t>* added) {
+  std::vector<std::pair<int, int>> old_services, new_services;
+  if (!gatt_db_split(previous.data(), previous.size(), &old_services) ||
+      !gatt_db_split(db, count, &new_services))
+    return false;
+
+  std::vector<bool> kept(old_services.size(), false);
+  for (const auto& range : new_services) {
+    const btgatt_db_element_t& service = db[range.first];
+    int len = range.second - range.first;
+
+    bool unchanged = false;
+    for (size_t i = 0; i < old_services.size() && !unchanged; i++) {
+      const auto& old_range = old_services[i];
+      const btgatt_db_element_t& old_service = previous[old_range.first];
+      if (kept[i] || old_service.type != service.type ||
+          old_service.start_handle != service.start_handle ||
+          old_service.end_handle != service.end_handle ||
+          memcmp(old_service.uuid.uu, service.uuid.uu, sizeof(service.uuid.uu)))
+        continue;
+      if (old_range.second - old_range.first != len) break;
+
+      unchanged = true;
+      for (int j = 0; j < len && unchanged; j++) {
+        unchanged = gatt_db_element_equal(previous[old_range.first + j],
+                                          db[range.first + j]);
+      }
+      if (unchanged) kept[i] = true;
+    }
+
+    if (!unchanged)
+      added->insert(added->end(), db + range.first, db + range.second);
+  }
+
+  for (size_t i = 0; i < old_services.size(); i++) {
+    if (!kept[i]) removed->push_back(previous[old_services[i].first].id);
+  }
+  return true;
+}
+
+static void gatt_db_cache_release(int conn_id) {
+  std::lock_guard<std::mutex> lock(sGattDbCache.lock);
+  sGattDbCache.databases.erase(conn_id);
+}
+
+static void gatt_db_cache_clear() {
+  std::lock_guard<std::mutex> lock(sGattDbCache.lock);
+  sGattDbCache.databases.clear();
+}
+
+/**
+ * Persistent GATT cache
+ *
+ * The database of bonded peripherals is kept per address together with a
+ * hash of its elements, and persisted to GATT_CACHE_PATH. On the first
+ * discovery of a connection GattService fetches the cached database through
+ * gattClientLoadGattCacheNative and posts it to the app, while the regular
+ * discovery runs in the background to validate it. When the discovered
+ * database hashes the same it is not delivered again; otherwise the cache is
+ * replaced and the change reaches Java as a regular delta, so the app sees a
+ * second onSearchComplete.
+ * Entries expire after persist.bt.gatt.cache_ttl_s seconds (0, the default,
+ * disables the cache) and are dropped when the bond is removed. Changes are
+ * written by a writer thread, so the file is never rewritten on the callback
+ * or binder threads. The file holds
+ *   u32 magic | u32 version
+ * followed by entries of
+ *   u8[6] address | u64 hash | i64 stored_at | u32 count | elements
+ * with every element written as
+ *   u16 id | u8[16] uuid | u8 type | u16 attribute_handle | u16 start_handle |
+ *   u16 end_handle | u8 properties | u16 permissions
+ */
+#define GATT_CACHE_PATH "/data/misc/bluedroid/gatt_cache.bin"
+#define GATT_CACHE_MAGIC 0x43544147 /* "GATC" */
+#define GATT_CACHE_VERSION 1
+#define GATT_CACHE_MAX_ENTRIES 32
+#define GATT_CACHE_MAX_ELEMENTS 1024
+#define GATT_CACHE_DEFAULT_TTL_S 0
+
+struct GattCacheEntry {
+  uint64_t hash;
+  int64_t stored_at;
+  std::vector<btgatt_db_element_t> db;
+};
+
+typedef std::map<RawAddress, GattCacheEntry> GattCacheEntries;
+
+struct GattCacheConnection {
+  RawAddress bda;
+  bool bonded;
+  bool validating;
+};
+
+static struct {
+  std::mutex lock;
+  std::condition_variable cv;
+  std::thread writer;
+  bool writer_running;
+  bool dirty;
+  int64_t ttl;
+  GattCacheEntries entries;
+  std::map<int, GattCacheConnection> connections;
+} sGattCache;
+
+// 64 bit FNV-1a over the element fields, independent of struct padding.
+static uint64_t gatt_db_hash(const btgatt_db_element_t* db, int count) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  auto mix = [&hash](uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+      hash ^= (value >> (8 * i)) & 0xFF;
+      hash *= 0x100000001b3ULL;
+    }
+  };
+  for (int i = 0; i < count; i++) {
+    const btgatt_db_element_t& el = db[i];
+    mix(el.id, 2);
+    for (uint8_t b : el.uuid.uu) mix(b, 1);
+    mix(el.type, 1);
+    mix(el.attribute_handle, 2);
+    mix(el.start_handle, 2);
+    mix(el.end_handle, 2);
+    mix(el.properties, 1);
+    mix(el.permissions, 2);
+  }
+  return hash;
+}
+
+static bool gatt_cache_read_element(FILE* file, btgatt_db_element_t* el) {
+  uint8_t type;
+  memset(el, 0, sizeof(*el));
+  if (fread(&el->id, sizeof(el->id), 1, file) != 1 ||
+      fread(el->uuid.uu, sizeof(el->uuid.uu), 1, file) != 1 ||
+      fread(&type, sizeof(type), 1, file) != 1 ||
+      fread(&el->attribute_handle, sizeof(el->attribute_handle), 1, file) !=
+          1 ||
+      fread(&el->start_handle, sizeof(el->start_handle), 1, file) != 1 ||
+      fread(&el->end_handle, sizeof(el->end_handle), 1, file) != 1 ||
+      fread(&el->properties, sizeof(el->properties), 1, file) != 1 ||
+      fread(&el->permissions, sizeof(el->permissions), 1, file) != 1 ||
+      type > BTGATT_DB_DESCRIPTOR) {
+    return false;
+  }
+  el->type = (bt_gatt_db_attribute_type_t)type;
+  return true;
+}
+
+static bool gatt_cache_write_element(FILE* file,
+                                     const btgatt_db_element_t& el) {
+  uint8_t type = el.type;
+  return fwrite(&el.id, sizeof(el.id), 1, file) == 1 &&
+         fwrite(el.uuid.uu, sizeof(el.uuid.uu), 1, file) == 1 &&
+         fwrite(&type, sizeof(type), 1, file) == 1 &&
+         fwrite(&el.attribute_handle, sizeof(el.attribute_handle), 1, file) ==
+             1 &&
+         fwrite(&el.start_handle, sizeof(el.start_handle), 1, file) == 1 &&
+         fwrite(&el.end_handle, sizeof(el.end_handle), 1, file) == 1 &&
+         fwrite(&el.properties, sizeof(el.properties), 1, file) == 1 &&
+         fwrite(&el.permissions, sizeof(el.permissions), 1, file) == 1;
+}
+
+// Must be called with sGattCache.lock held.
+static bool gatt_cache_expired_locked(const GattCacheEntry& entry,
+                                      int64_t now) {
+  return entry.stored_at > now || now - entry.stored_at >= sGattCache.ttl;
+}
+
+// Must be called with sGattCache.lock held.
+static void gatt_cache_load_locked() {
+  sGattCache.entries.clear();
+
+  FILE* file = fopen(GATT_CACHE_PATH, "rb");
+  if (!file) return;
+
+  uint32_t header[2];
+  if (fread(header, sizeof(header), 1, file) != 1 ||
+      header[0] != GATT_CACHE_MAGIC || header[1] != GATT_CACHE_VERSION) {
+    ALOGW("%s: ignoring unknown cache file", __func__);
+    fclose(file);
+    return;
+  }
+
+  int64_t now = time(NULL);
+  bool ok = true;
+  while (ok && sGattCache.entries.size() < GATT_CACHE_MAX_ENTRIES) {
+    RawAddress bda;
+    GattCacheEntry entry;
+    uint32_t count;
+    if (fread(bda.address, sizeof(bda.address), 1, file) != 1 ||
+        fread(&entry.hash, sizeof(entry.hash), 1, file) != 1 ||
+        fread(&entry.stored_at, sizeof(entry.stored_at), 1, file) != 1 ||
+        fread(&count, sizeof(count), 1, file) != 1 ||
+        count > GATT_CACHE_MAX_ELEMENTS) {
+      break;
+    }
+    entry.db.resize(count);
+    for (uint32_t i = 0; i < count && ok; i++)
+      ok = gatt_cache_read_element(file, &entry.db[i]);
+
+    if (!ok || gatt_cache_expired_locked(entry, now) ||
+        gatt_db_hash(entry.db.data(), count) != entry.hash)
+      continue;
+    sGattCache.entries[bda] = std::move(entry);
+  }
+  fclose(file);
+  ALOGD("%s: loaded %zu entries", __func__, sGattCache.entries.size());
+}
+
+static void gatt_cache_write(const GattCacheEntries& entries) {
+  std::string tmp_path = std::string(GATT_CACHE_PATH) + ".tmp";
+  FILE* file = fopen(tmp_path.c_str(), "wb");
+  if (!file) {
+    ALOGE("%s: unable to open %s: %s", __func__, tmp_path.c_str(),
+          strerror(errno));
+    return;
+  }
+
+  uint32_t header[2] = {GATT_CACHE_MAGIC, GATT_CACHE_VERSION};
+  bool ok = fwrite(header, sizeof(header), 1, file) == 1;
+  for (const auto& it : entries) {
+    if (!ok) break;
+    uint32_t count = it.second.db.size();
+    ok = fwrite(it.first.address, sizeof(it.first.address), 1, file) == 1 &&
+         fwrite(&it.second.hash, sizeof(it.second.hash), 1, file) == 1 &&
+         fwrite(&it.second.stored_at, sizeof(it.second.stored_at), 1, file) ==
+             1 &&
+         fwrite(&count, sizeof(count), 1, file) == 1;
+    for (uint32_t i = 0; i < count && ok; i++)
+      ok = gatt_cache_write_element(file, it.second.db[i]);
+  }
+  if (fclose(file) != 0) ok = false;
+
+  if (!ok || rename(tmp_path.c_str(), GATT_CACHE_PATH) != 0) {
+    ALOGE("%s: unable to write %s", __func__, GATT_CACHE_PATH);
+    unlink(tmp_path.c_str());
+  }
+}
+
+// Writes a snapshot of the entries whenever they changed. Changes still
+// pending when the writer is stopped are written before it exits.
+static void gatt_cache_writer_run() {
+  std::unique_lock<std::mutex> lock(sGattCache.lock);
+  while (true) {
+    sGattCache.cv.wait(
+        lock, [] { return sGattCache.dirty || !sGattCache.writer_running; });
+    if (!sGattCache.dirty) break;
+
+    sGattCache.dirty = false;
+    GattCacheEntries snapshot = sGattCache.entries;
+    lock.unlock();
+    gatt_cache_write(snapshot);
+    lock.lock();
+  }
+}
+
+// Must be called with sGattCache.lock held.
+static void gatt_cache_save_locked() {
+  if (!sGattCache.writer_running) return;
+  sGattCache.dirty = true;
+  sGattCache.cv.notify_one();
+}
+
+static void gatt_cache_init() {
+  std::lock_guard<std::mutex> lock(sGattCache.lock);
+  sGattCache.connections.clear();
+  if (sGattCache.writer_running) return;
+
+  sGattCache.ttl = property_get_int32("persist.bt.gatt.cache_ttl_s",
+                                      GATT_CACHE_DEFAULT_TTL_S);
+  if (sGattCache.ttl <= 0) {
+    sGattCache.entries.clear();
+    return;
+  }
+
+  gatt_cache_load_locked();
+  sGattCache.dirty = false;
+  sGattCache.writer_running = true;
+  sGattCache.writer = std::thread(gatt_cache_writer_run);
+}
+
+static void gatt_cache_cleanup() {
+  std::unique_lock<std::mutex> lock(sGattCache.lock);
+  if (!sGattCache.writer_running) return;
+  sGattCache.writer_running = false;
+  sGattCache.cv.notify_all();
+  lock.unlock();
+
+  sGattCache.writer.join();
+}
+
+static void gatt_cache_on_open(int conn_id, const RawAddress& bda) {
+  std::lock_guard<std::mutex> lock(sGattCache.lock);
+  sGattCache.connections[conn_id] = {bda, false, false};
+}
+
+static void gatt_cache_on_close(int conn_id) {
+  std::lock_guard<std::mutex> lock(sGattCache.lock);
+  sGattCache.connections.erase(conn_id);
+}
+
+/* Updates the cache with a database discovered on |conn_id|. Returns true if
+ * it validates the cached database served for the connection, in which case
+ * Java already has it. */
+static bool gatt_cache_on_db(int conn_id, const btgatt_db_element_t* db,
+                             int count) {
+  std::lock_guard<std::mutex> lock(sGattCache.lock);
+  auto conn = sGattCache.connections.find(conn_id);
+  if (conn == sGattCache.connections.end() || !conn->second.bonded ||
+      sGattCache.ttl <= 0)
+    return false;
+
+  uint64_t hash = gatt_db_hash(db, count);
+  bool validating = conn->second.validating;
+  conn->second.validating = false;
+
+  auto it = sGattCache.entries.find(conn->second.bda);
+  if (it != sGattCache.entries.end() && it->second.hash == hash) {
+    it->second.stored_at = time(NULL);
+    return validating;
+  }
+  if (count > GATT_CACHE_MAX_ELEMENTS) return false;
+
+  if (it == sGattCache.entries.end() &&
+      sGattCache.entries.size() >= GATT_CACHE_MAX_ENTRIES) {
+    auto oldest = std::min_element(
+        sGattCache.entries.begin(), sGattCache.entries.end(),
+        [](const std::pair<const RawAddress, GattCacheEntry>& a,
+           const std::pair<const RawAddress, GattCacheEntry>& b) {
+          return a.second.stored_at < b.second.stored_at;
+        });
+    sGattCache.entries.erase(oldest);
+  }
+  GattCacheEntry& entry = sGattCache.entries[conn->second.bda];
+  entry.hash = hash;
+  entry.stored_at = time(NULL);
+  entry.db.assign(db, db + count);
+  gatt_cache_save_locked();
+  return false;
+}
+
+void gattCacheInvalidate(const RawAddress& bd_addr) {
+  std::lock_guard<std::mutex> lock(sGattCache.lock);
+  if (sGattCache.entries.erase(bd_addr)) gatt_cache_save_locked();
+}
+
+/* Connection orchestrator for clients that (re)connect a whole set of
+ * peripherals. gattClientConnectFleetNative hands over the addresses with
+ * their priorities; the "BT GATT Fleet" thread keeps up to max_concurrent
+ * direct connects in flight, highest priority first. A failed direct connect
+ * is retried after an exponential backoff; after FLEET_DIRECT_ATTEMPTS
+ * failures the device is left to a background connect, which completes
+ * whenever it is seen. Retried failures are not reported to Java, but the one
+ * that ends the direct attempts reaches onConnected like any other failure. A
+ * device whose background connect is refused is given up on and counted as
+ * failed; progress of the whole set is reported through onClientFleetProgress.
+ * Connected devices that drop are reconnected until Java disconnects them.
+ */
+#define FLEET_DEFAULT_MAX_CONCURRENT 4
+#define FLEET_DIRECT_ATTEMPTS 3
+#define FLEET_BACKOFF_BASE_MS 500
+#define FLEET_BACKOFF_MAX_MS 30000
+#define FLEET_INITIATING_PHYS 1 /* LE 1M */
+
+enum FleetState {
+  FLEET_WAITING,
+  FLEET_CONNECTING,
+  FLEET_CONNECTED,
+  FLEET_BACKGROUND_PENDING,
+  FLEET_BACKGROUND,
+  FLEET_FAILED,
+};
+
+struct FleetTarget {
+  int client_if;
+  RawAddress bda;
+  int priority;
+  int transport;
+  FleetState state;
+  int attempts;
+  std::chrono::steady_clock::time_point next_attempt;
+};
+
+static struct {
+  std::mutex lock;
+  std::condition_variable cv;
+  std::thread worker;
+  bool running;
+  int max_concurrent;
+  std::vector<FleetTarget> targets;
+  std::set<int> dirty_clients;
+} sFleet;
+
+// Must be called with sFleet.lock held.
+static FleetTarget* fleet_find_locked(int client_if, const RawAddress& bda) {
+  for (FleetTarget& target : sFleet.targets) {
+    if (target.client_if == client_if && target.bda == bda) return &target;
+  }
+  return NULL;
+}
+
+// Must be called with sFleet.lock held. Returns true if the direct connect
+// will be retried, false once the device is left to a background connect.
+static bool fleet_direct_failed_locked(FleetTarget* target) {
+  bool retry = true;
+  target->attempts++;
+  if (target->attempts >= FLEET_DIRECT_ATTEMPTS) {
+    target->state = FLEET_BACKGROUND_PENDING;
+    retry = false;
+  } else {
+    int backoff_ms = std::min(FLEET_BACKOFF_BASE_MS << (target->attempts - 1),
+                              FLEET_BACKOFF_MAX_MS);
+    target->state = FLEET_WAITING;
+    target->next_attempt = std::chrono::steady_clock::now() +
+                           std::chrono::milliseconds(backoff_ms);
+  }
+  sFleet.dirty_clients.insert(target->client_if);
+  sFleet.cv.notify_one();
+  return retry;
+}
+
+/* Updates the fleet with a connection result. Returns true if the result is
+ * a failure the orchestrator retries, which Java need not see. */
+static bool fleet_on_open(int client_if, const RawAddress& bda, int status) {
+  std::lock_guard<std::mutex> lock(sFleet.lock);
+  FleetTarget* target = fleet_find_locked(client_if, bda);
+  if (target == NULL) return false;
+
+  if (status == BT_STATUS_SUCCESS) {
+    target->state = FLEET_CONNECTED;
+    target->attempts = 0;
+    sFleet.dirty_clients.insert(client_if);
+    sFleet.cv.notify_one();
+    return false;
+  }
+
+  if (target->state != FLEET_CONNECTING) return false;
+  return fleet_direct_failed_locked(target);
+}
+
+static void fleet_on_close(int client_if, const RawAddress& bda) {
+  std::lock_guard<std::mutex> lock(sFleet.lock);
+  FleetTarget* target = fleet_find_locked(client_if, bda);
+  if (target == NULL || target->state != FLEET_CONNECTED) return;
+
+  target->state = FLEET_WAITING;
+  target->next_attempt = std::chrono::steady_clock::now();
+  sFleet.dirty_clients.insert(client_if);
+  sFleet.cv.notify_one();
+}
+
+// Stops orchestrating |bda| for |client_if|, or every device of the client
+// if |bda| is NULL.
+static void fleet_remove(int client_if, const RawAddress* bda) {
+  std::lock_guard<std::mutex> lock(sFleet.lock);
+  auto end = std::remove_if(
+      sFleet.targets.begin(), sFleet.targets.end(),
+      [&](const FleetTarget& target) {
+        return target.client_if == client_if &&
+               (bda == NULL || target.bda == *bda);
+      });
+  if (end == sFleet.targets.end()) return;
+  sFleet.targets.erase(end, sFleet.targets.end());
+  sFleet.dirty_clients.insert(client_if);
+  sFleet.cv.notify_one();
+}
+
+struct FleetProgress {
+  int client_if;
+  int counts[6];
+};
+
+struct FleetFailure {
+  int client_if;
+  RawAddress bda;
+  int status;
+};
+
+static void fleet_run() {
+  JavaVM* vm = AndroidRuntime::getJavaVM();
+  JNIEnv* env = NULL;
+  char name[] = "BT GATT Fleet";
+  JavaVMAttachArgs args = {
+      .version = JNI_VERSION_1_6, .name = name, .group = NULL};
+  if (vm->AttachCurrentThread(&env, &args) != JNI_OK) {
+    error("Unable to attach GATT fleet thread to VM");
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(sFleet.lock);
+  while (sFleet.running) {
+    auto now = std::chrono::steady_clock::now();
+    auto next = std::chrono::steady_clock::time_point::max();
+
+    int in_flight = 0;
+    std::vector<FleetTarget*> due;
+    std::vector<FleetTarget> issue;
+    for (FleetTarget& target : sFleet.targets) {
+      if (target.state == FLEET_CONNECTING) {
+        in_flight++;
+      } else if (target.state == FLEET_BACKGROUND_PENDING) {
+        target.state = FLEET_BACKGROUND;
+        issue.push_back(target);
+      } else if (target.state == FLEET_WAITING) {
+        if (target.next_attempt <= now)
+          due.push_back(&target);
+        else
+          next = std::min(next, target.next_attempt);
+      }
+    }
+
+    std::stable_sort(due.begin(), due.end(),
+                     [](const FleetTarget* a, const FleetTarget* b) {
+                       return a->priority > b->priority;
+                     });
+    for (FleetTarget* target : due) {
+      if (in_flight >= sFleet.max_concurrent) break;
+      target->state = FLEET_CONNECTING;
+      sFleet.dirty_clients.insert(target->client_if);
+      issue.push_back(*target);
+      in_flight++;
+    }
+
+    std::vector<FleetProgress> progress;
+    for (int client_if : sFleet.dirty_clients) {
+      FleetProgress p = {client_if, {0, 0, 0, 0, 0, 0}};
+      for (const FleetTarget& target : sFleet.targets) {
+        if (target.client_if == client_if) p.counts[target.state]++;
+      }
+      progress.push_back(p);
+    }
+    sFleet.dirty_clients.clear();
+
+    if (issue.empty() && progress.empty()) {
+      if (next == std::chrono::steady_clock::time_point::max())
+        sFleet.cv.wait(lock);
+      else
+        sFleet.cv.wait_until(lock, next);
+      continue;
+    }
+
+    lock.unlock();
+    std::vector<FleetFailure> failures;
+    for (const FleetTarget& target : issue) {
+      bool direct = target.state == FLEET_CONNECTING;
+      bt_status_t status =
+          sGattIf ? sGattIf->client->connect(target.client_if, target.bda,
+                                             direct, target.transport, false,
+                                             FLEET_INITIATING_PHYS)
+                  : BT_STATUS_NOT_READY;
+      if (status == BT_STATUS_SUCCESS) continue;
+
+      std::lock_guard<std::mutex> relock(sFleet.lock);
+      FleetTarget* current = fleet_find_locked(target.client_if, target.bda);
+      if (current == NULL) continue;
+      if (direct && current->state == FLEET_CONNECTING) {
+        if (!fleet_direct_failed_locked(current))
+          failures.push_back({target.client_if, target.bda, status});
+      } else if (!direct && current->state == FLEET_BACKGROUND) {
+        current->state = FLEET_FAILED;
+        sFleet.dirty_clients.insert(target.client_if);
+      }
+    }
+    for (const FleetFailure& f : failures) {
+      if (mCallbacksObj == NULL) break;
+      ScopedLocalRef<jstring> address(env, getAddressString(env, f.bda));
+      env->CallVoidMethod(mCallbacksObj, method_onConnected, f.client_if, 0,
+                          f.status, address.get());
+      if (env->ExceptionCheck()) {
+        ALOGE("An exception was thrown by callback 'onConnected'.");
+        LOGE_EX(env);
+        env->ExceptionClear();
+      }
+    }
+    for (const FleetProgress& p : progress) {
+      if (mCallbacksObj == NULL) break;
+      env->CallVoidMethod(
+          mCallbacksObj, method_onClientFleetProgress, p.client_if,
+          p.counts[FLEET_CONNECTED], p.counts[FLEET_CONNECTING],
+          p.counts[FLEET_WAITING],
+          p.counts[FLEET_BACKGROUND_PENDING] + p.counts[FLEET_BACKGROUND],
+          p.counts[FLEET_FAILED]);
+      if (env->ExceptionCheck()) {
+        ALOGE("An exception was thrown by callback 'onClientFleetProgress'.");
+        LOGE_EX(env);
+        env->ExceptionClear();
+      }
+    }
+    lock.lock();
+  }
+  lock.unlock();
+
+  vm->DetachCurrentThread();
+}
 
-  sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onScanResult, event_type,
-                               addr_type, address.get(), primary_phy,
-                               secondary_phy, advertising_sid, tx_power, rssi,
-                               periodic_adv_int, jb.get());
+static void fleet_stop() {
+  std::unique_lock<std::mutex> lock(sFleet.lock);
+  sFleet.targets.clear();
+  sFleet.dirty_clients.clear();
+  if (!sFleet.running) return;
+
+  sFleet.running = false;
+  sFleet.cv.notify_all();
+  lock.unlock();
+
+  if (sFleet.worker.joinable()) sFleet.worker.join();
 }
 
 void btgattc_open_cb(int conn_id, int status, int clientIf,
                      const RawAddress& bda) {
+  if (status == BT_STATUS_SUCCESS) gatt_cache_on_open(conn_id, bda);
+  if (fleet_on_open(clientIf, bda, status)) return;
+
   CallbackEnv sCallbackEnv(__func__);
   if (!sCallbackEnv.valid()) return;
 
   ScopedLocalRef<jstring> address(sCallbackEnv.get(),
-                                  bdaddr2newjstr(sCallbackEnv.get(), &bda));
+                                  getAddressString(sCallbackEnv.get(), bda));
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onConnected, clientIf,
                                conn_id, status, address.get());
 }
@@ -239,9 +2039,16 @@ void btgattc_close_cb(int conn_id, int status, int clientIf,
   if (!sCallbackEnv.valid()) return;
 
   ScopedLocalRef<jstring> address(sCallbackEnv.get(),
-                                  bdaddr2newjstr(sCallbackEnv.get(), &bda));
+                                  getAddressString(sCallbackEnv.get(), bda));
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onDisconnected, clientIf,
                                conn_id, status, address.get());
+
+  notify_pool_release(sCallbackEnv.get(), conn_id);
+  write_pipeline_release(conn_id);
+  read_batch_release(conn_id);
+  gatt_db_cache_release(conn_id);
+  gatt_cache_on_close(conn_id);
+  fleet_on_close(clientIf, bda);
 }
 
 void btgattc_search_complete_cb(int conn_id, int status) {
@@ -265,8 +2072,19 @@ void btgattc_notify_cb(int conn_id, const btgatt_notify_params_t& p_data) {
   CallbackEnv sCallbackEnv(__func__);
   if (!sCallbackEnv.valid()) return;
 
+  NotifyBuffer* pooled = notify_pool_get(sCallbackEnv.get(), conn_id);
+  if (pooled && p_data.len <= sizeof(pooled->data)) {
+    sNotifyPool.hits++;
+    memcpy(pooled->data, p_data.value, p_data.len);
+    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onNotifyPooled, conn_id,
+                                 p_data.handle, p_data.is_notify,
+                                 pooled->buffer, p_data.len);
+    return;
+  }
+
+  sNotifyPool.misses++;
   ScopedLocalRef<jstring> address(
-      sCallbackEnv.get(), bdaddr2newjstr(sCallbackEnv.get(), &p_data.bda));
+      sCallbackEnv.get(), getAddressString(sCallbackEnv.get(), p_data.bda));
   ScopedLocalRef<jbyteArray> jb(sCallbackEnv.get(),
                                 sCallbackEnv->NewByteArray(p_data.len));
   sCallbackEnv->SetByteArrayRegion(jb.get(), 0, p_data.len,
@@ -279,6 +2097,27 @@ void btgattc_notify_cb(int conn_id, const btgatt_notify_params_t& p_data) {
 
 void btgattc_read_characteristic_cb(int conn_id, int status,
                                     btgatt_read_params_t* p_data) {
+  std::vector<uint8_t> batch;
+  if (read_batch_on_read(conn_id, status, p_data, &batch)) {
+    if (batch.empty()) return;
+
+    CallbackEnv sCallbackEnv(__func__);
+    if (!sCallbackEnv.valid()) return;
+
+    ScopedLocalRef<jbyteArray> packed(sCallbackEnv.get(),
+                                      sCallbackEnv->NewByteArray(batch.size()));
+    if (!packed.get()) {
+      ALOGE("%s: failed to allocate read batch array", __func__);
+      return;
+    }
+    sCallbackEnv->SetByteArrayRegion(packed.get(), 0, batch.size(),
+                                     (jbyte*)batch.data());
+    sCallbackEnv->CallVoidMethod(mCallbacksObj,
+                                 method_onReadCharacteristicBatch, conn_id,
+                                 packed.get());
+    return;
+  }
+
   CallbackEnv sCallbackEnv(__func__);
   if (!sCallbackEnv.valid()) return;
 
@@ -298,6 +2137,8 @@ void btgattc_read_characteristic_cb(int conn_id, int status,
 }
 
 void btgattc_write_characteristic_cb(int conn_id, int status, uint16_t handle) {
+  if (write_pipeline_on_write_complete(conn_id, &status)) return;
+
   CallbackEnv sCallbackEnv(__func__);
   if (!sCallbackEnv.valid()) return;
 
@@ -345,13 +2186,18 @@ void btgattc_remote_rssi_cb(int client_if, const RawAddress& bda, int rssi,
   if (!sCallbackEnv.valid()) return;
 
   ScopedLocalRef<jstring> address(sCallbackEnv.get(),
-                                  bdaddr2newjstr(sCallbackEnv.get(), &bda));
+                                  getAddressString(sCallbackEnv.get(), bda));
 
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onReadRemoteRssi,
                                client_if, address.get(), rssi, status);
 }
 
 void btgattc_configure_mtu_cb(int conn_id, int status, int mtu) {
+  if (status == 0) {
+    std::lock_guard<std::mutex> lock(sWritePipeline.lock);
+    sWritePipeline.mtus[conn_id] = mtu;
+  }
+
   CallbackEnv sCallbackEnv(__func__);
   if (!sCallbackEnv.valid()) return;
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onConfigureMTU, conn_id,
@@ -359,23 +2205,188 @@ void btgattc_configure_mtu_cb(int conn_id, int status, int mtu) {
 }
 
 void btgattc_congestion_cb(int conn_id, bool congested) {
+  int write_status;
+  uint16_t write_handle;
+  bool write_failed = write_pipeline_on_congestion(
+      conn_id, congested, &write_status, &write_handle);
+
   CallbackEnv sCallbackEnv(__func__);
   if (!sCallbackEnv.valid()) return;
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onClientCongestion,
                                conn_id, congested);
+  if (write_failed) {
+    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onWriteCharacteristic,
+                                 conn_id, write_status, write_handle);
+  }
+}
+
+/**
+ * Batch scan report decoding
+ *
+ * Batch scan reports arrive as num_records controller records back to back:
+ *   truncated: u8[6] bda | u8 addr_type | u8 tx_power | s8 rssi |
+ *              u16 timestamp
+ *   full:      truncated record | u8 adv_len | u8[adv_len] adv |
+ *              u8 scan_rsp_len | u8[scan_rsp_len] scan_rsp
+ * bda is little endian, timestamp is the age of the record in 50 ms units.
+ *
+ * Records of the same address with an identical advertisement and scan
+ * response are merged here, keeping the RSSI and age of the most recent
+ * sighting; records that differ in their payload, e.g. rotating beacon frames,
+ * stay separate results. Truncated records carry no payload and merge per
+ * address. The results are handed to Java column wise: a byte array holding
+ * the addresses of all results, most significant byte first, followed by the
+ * scan records of full reports, and an int array of BATCH_REPORT_COLUMNS
+ * columns of num_results values each.
+ */
+
+#define BATCH_REPORT_FORMAT_TRUNCATED 1
+#define BATCH_REPORT_TRUNCATED_LEN 11
+#define BATCH_REPORT_TIMESTAMP_UNIT_MS 50
+
+#define BATCH_REPORT_COL_RSSI 0
+#define BATCH_REPORT_COL_AGE_MS 1
+#define BATCH_REPORT_COL_DATA_OFFSET 2
+#define BATCH_REPORT_COL_DATA_LEN 3
+#define BATCH_REPORT_COLUMNS 4
+
+// Address and payload of a record, pointing into the report.
+struct BatchReportKey {
+  const uint8_t* bda;
+  const uint8_t* adv;
+  const uint8_t* scan_rsp;
+  uint8_t adv_len, scan_rsp_len;
+
+  bool operator==(const BatchReportKey& other) const {
+    return memcmp(bda, other.bda, BD_ADDR_LEN) == 0 &&
+           adv_len == other.adv_len && scan_rsp_len == other.scan_rsp_len &&
+           (adv_len == 0 || memcmp(adv, other.adv, adv_len) == 0) &&
+           (scan_rsp_len == 0 ||
+            memcmp(scan_rsp, other.scan_rsp, scan_rsp_len) == 0);
+  }
+};
+
+struct BatchReportKeyHash {
+  size_t operator()(const BatchReportKey& key) const {
+    // FNV-1a over the address and both payloads.
+    uint64_t hash = 14695981039346656037ULL;
+    auto mix = [&hash](const uint8_t* p, size_t len) {
+      for (size_t i = 0; i < len; i++) hash = (hash ^ p[i]) * 1099511628211ULL;
+    };
+    mix(key.bda, BD_ADDR_LEN);
+    mix(&key.adv_len, 1);
+    mix(key.adv, key.adv_len);
+    mix(&key.scan_rsp_len, 1);
+    mix(key.scan_rsp, key.scan_rsp_len);
+    return hash;
+  }
+};
+
+struct BatchReportResult {
+  BatchReportKey key;
+  int rssi;
+  int age;
+};
+
+/* Splits the records of a report and merges identical ones. Decoding stops at
+ * the first malformed record; the results decoded up to there are kept. */
+static void batch_report_decode(int report_format, int num_records,
+                                const std::vector<uint8_t>& data,
+                                std::vector<BatchReportResult>* results) {
+  const uint8_t* p = data.data();
+  const uint8_t* end = p + data.size();
+  bool truncated = report_format == BATCH_REPORT_FORMAT_TRUNCATED;
+  // Full records carry at least the two length bytes.
+  size_t min_len = BATCH_REPORT_TRUNCATED_LEN + (truncated ? 0 : 2);
+  size_t expected = std::max(num_records, 0);
+  size_t capacity = std::min(expected, data.size() / min_len);
+
+  std::unordered_map<BatchReportKey, size_t, BatchReportKeyHash> merged(
+      capacity);
+  results->reserve(capacity);
+  size_t decoded = 0;
+  for (; decoded < capacity; decoded++) {
+    if ((size_t)(end - p) < min_len) break;
+    const uint8_t* record = p;
+    BatchReportKey key = {record, NULL, NULL, 0, 0};
+    p += BATCH_REPORT_TRUNCATED_LEN;
+    if (!truncated) {
+      key.adv_len = *p++;
+      key.adv = p;
+      if ((size_t)(end - p) < key.adv_len + 1u) break;
+      p += key.adv_len;
+      key.scan_rsp_len = *p++;
+      key.scan_rsp = p;
+      if ((size_t)(end - p) < key.scan_rsp_len) break;
+      p += key.scan_rsp_len;
+    }
+    int rssi = (int8_t)record[8];
+    int age = (record[9] | (record[10] << 8)) * BATCH_REPORT_TIMESTAMP_UNIT_MS;
+
+    auto inserted = merged.emplace(key, results->size());
+    if (inserted.second) {
+      results->push_back({key, rssi, age});
+      continue;
+    }
+
+    BatchReportResult& result = (*results)[inserted.first->second];
+    if (age <= result.age) {
+      result.rssi = rssi;
+      result.age = age;
+    }
+  }
+  if (decoded < expected || p != end) {
+    error("malformed batch scan report, format %d, %d records, %zu bytes",
+          report_format, num_records, data.size());
+  }
 }
 
 void btgattc_batchscan_reports_cb(int client_if, int status, int report_format,
                                   int num_records, std::vector<uint8_t> data) {
+  std::vector<BatchReportResult> results;
+  batch_report_decode(report_format, num_records, data, &results);
+
+  size_t num_results = results.size();
+  size_t blob_len = num_results * BD_ADDR_LEN;
+  for (const BatchReportResult& result : results)
+    blob_len += result.key.adv_len + result.key.scan_rsp_len;
+  std::vector<uint8_t> blob(blob_len);
+  std::vector<jint> columns(num_results * BATCH_REPORT_COLUMNS);
+  uint8_t* out = blob.data();
+  uint8_t* record_out = out + num_results * BD_ADDR_LEN;
+  for (size_t i = 0; i < num_results; i++) {
+    const BatchReportResult& result = results[i];
+    const BatchReportKey& key = result.key;
+    for (int j = 0; j < BD_ADDR_LEN; j++)
+      *out++ = key.bda[BD_ADDR_LEN - 1 - j];
+
+    jint* column = columns.data() + i;
+    column[BATCH_REPORT_COL_RSSI * num_results] = result.rssi;
+    column[BATCH_REPORT_COL_AGE_MS * num_results] = result.age;
+    column[BATCH_REPORT_COL_DATA_OFFSET * num_results] =
+        record_out - blob.data();
+    column[BATCH_REPORT_COL_DATA_LEN * num_results] =
+        key.adv_len + key.scan_rsp_len;
+    if (key.adv_len) memcpy(record_out, key.adv, key.adv_len);
+    record_out += key.adv_len;
+    if (key.scan_rsp_len) memcpy(record_out, key.scan_rsp, key.scan_rsp_len);
+    record_out += key.scan_rsp_len;
+  }
+
   CallbackEnv sCallbackEnv(__func__);
   if (!sCallbackEnv.valid()) return;
   ScopedLocalRef<jbyteArray> jb(sCallbackEnv.get(),
-                                sCallbackEnv->NewByteArray(data.size()));
-  sCallbackEnv->SetByteArrayRegion(jb.get(), 0, data.size(),
-                                   (jbyte*)data.data());
+                                sCallbackEnv->NewByteArray(blob.size()));
+  sCallbackEnv->SetByteArrayRegion(jb.get(), 0, blob.size(),
+                                   (jbyte*)blob.data());
+  ScopedLocalRef<jintArray> jcolumns(
+      sCallbackEnv.get(), sCallbackEnv->NewIntArray(columns.size()));
+  sCallbackEnv->SetIntArrayRegion(jcolumns.get(), 0, columns.size(),
+                                  columns.data());
 
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onBatchScanReports, status,
-                               client_if, report_format, num_records, jb.get());
+                               client_if, report_format, num_records, jb.get(),
+                               jcolumns.get());
 }
 
 void btgattc_batchscan_threshold_cb(int client_if) {
@@ -427,64 +2438,67 @@ void btgattc_track_adv_event_cb(btgatt_track_adv_info_t* p_adv_track_info) {
 
 void fillGattDbElementArray(JNIEnv* env, jobject* array,
                             const btgatt_db_element_t* db, int count) {
-  // Because JNI uses a different class loader in the callback context, we
-  // cannot simply get the class.
-  // As a workaround, we have to make sure we obtain an object of the class
-  // first, as this will cause
-  // class loader to load it.
-  ScopedLocalRef<jobject> objectForClass(
-      env, env->CallObjectMethod(mCallbacksObj, method_getSampleGattDbElement));
-  ScopedLocalRef<jclass> gattDbElementClazz(
-      env, env->GetObjectClass(objectForClass.get()));
-
-  jmethodID gattDbElementConstructor =
-      env->GetMethodID(gattDbElementClazz.get(), "<init>", "()V");
-
-  ScopedLocalRef<jclass> arrayListclazz(env,
-                                        env->FindClass("java/util/ArrayList"));
-  jmethodID arrayAdd =
-      env->GetMethodID(arrayListclazz.get(), "add", "(Ljava/lang/Object;)Z");
-
-  ScopedLocalRef<jclass> uuidClazz(env, env->FindClass("java/util/UUID"));
-  jmethodID uuidConstructor =
-      env->GetMethodID(uuidClazz.get(), "<init>", "(JJ)V");
-
   for (int i = 0; i < count; i++) {
     const btgatt_db_element_t& curr = db[i];
 
     ScopedLocalRef<jobject> element(
-        env,
-        env->NewObject(gattDbElementClazz.get(), gattDbElementConstructor));
-
-    jfieldID fid = env->GetFieldID(gattDbElementClazz.get(), "id", "I");
-    env->SetIntField(element.get(), fid, curr.id);
+        env, env->NewObject(sGattDbElementClass.clazz,
+                            sGattDbElementClass.constructor));
 
-    fid = env->GetFieldID(gattDbElementClazz.get(), "attributeHandle", "I");
-    env->SetIntField(element.get(), fid, curr.attribute_handle);
+    env->SetIntField(element.get(), sGattDbElementClass.id, curr.id);
 
     ScopedLocalRef<jobject> uuid(
-        env, env->NewObject(uuidClazz.get(), uuidConstructor,
+        env, env->NewObject(sUuidClass.clazz, sUuidClass.constructor,
                             uuid_msb(curr.uuid), uuid_lsb(curr.uuid)));
-    fid = env->GetFieldID(gattDbElementClazz.get(), "uuid", "Ljava/util/UUID;");
-    env->SetObjectField(element.get(), fid, uuid.get());
-
-    fid = env->GetFieldID(gattDbElementClazz.get(), "type", "I");
-    env->SetIntField(element.get(), fid, curr.type);
-
-    fid = env->GetFieldID(gattDbElementClazz.get(), "attributeHandle", "I");
-    env->SetIntField(element.get(), fid, curr.attribute_handle);
-
-    fid = env->GetFieldID(gattDbElementClazz.get(), "startHandle", "I");
-    env->SetIntField(element.get(), fid, curr.start_handle);
-
-    fid = env->GetFieldID(gattDbElementClazz.get(), "endHandle", "I");
-    env->SetIntField(element.get(), fid, curr.end_handle);
+    env->SetObjectField(element.get(), sGattDbElementClass.uuid, uuid.get());
+
+    env->SetIntField(element.get(), sGattDbElementClass.type, curr.type);
+    env->SetIntField(element.get(), sGattDbElementClass.attributeHandle,
+                     curr.attribute_handle);
+    env->SetIntField(element.get(), sGattDbElementClass.startHandle,
+                     curr.start_handle);
+    env->SetIntField(element.get(), sGattDbElementClass.endHandle,
+                     curr.end_handle);
+    env->SetIntField(element.get(), sGattDbElementClass.properties,
+                     curr.properties);
+
+    env->CallBooleanMethod(*array, sArrayListClass.add, element.get());
+  }
+}
 
-    fid = env->GetFieldID(gattDbElementClazz.get(), "properties", "I");
-    env->SetIntField(element.get(), fid, curr.properties);
+/**
+ * Packs the database into a single jlong array, see GATT_DB_PACKED_* for the
+ * layout. Returns NULL on allocation failure.
+ */
+static jlongArray packGattDbElementArray(JNIEnv* env,
+                                         const btgatt_db_element_t* db,
+                                         int count) {
+  jlongArray array = env->NewLongArray(count * GATT_DB_PACKED_ELEMENT_LEN);
+  if (!array) return NULL;
+
+  jlong* packed = env->GetLongArrayElements(array, NULL);
+  if (!packed) {
+    env->DeleteLocalRef(array);
+    return NULL;
+  }
 
-    env->CallBooleanMethod(*array, arrayAdd, element.get());
+  for (int i = 0; i < count; i++) {
+    const btgatt_db_element_t& curr = db[i];
+    jlong* p = packed + i * GATT_DB_PACKED_ELEMENT_LEN;
+
+    p[GATT_DB_PACKED_ID] = curr.id;
+    p[GATT_DB_PACKED_TYPE] = curr.type;
+    p[GATT_DB_PACKED_ATTRIBUTE_HANDLE] = curr.attribute_handle;
+    p[GATT_DB_PACKED_START_HANDLE] = curr.start_handle;
+    p[GATT_DB_PACKED_END_HANDLE] = curr.end_handle;
+    p[GATT_DB_PACKED_PROPERTIES] = curr.properties;
+    p[GATT_DB_PACKED_PERMISSIONS] = curr.permissions;
+    p[GATT_DB_PACKED_UUID_LSB] = uuid_lsb(curr.uuid);
+    p[GATT_DB_PACKED_UUID_MSB] = uuid_msb(curr.uuid);
   }
+
+  env->ReleaseLongArrayElements(array, packed, 0);
+  return array;
 }
 
 void btgattc_get_gatt_db_cb(int conn_id, const btgatt_db_element_t* db,
@@ -492,18 +2506,53 @@ void btgattc_get_gatt_db_cb(int conn_id, const btgatt_db_element_t* db,
   CallbackEnv sCallbackEnv(__func__);
   if (!sCallbackEnv.valid()) return;
 
-  jclass arrayListclazz = sCallbackEnv->FindClass("java/util/ArrayList");
-  ScopedLocalRef<jobject> array(
-      sCallbackEnv.get(),
-      sCallbackEnv->NewObject(
-          arrayListclazz,
-          sCallbackEnv->GetMethodID(arrayListclazz, "<init>", "()V")));
+  if (gatt_cache_on_db(conn_id, db, count)) {
+    std::lock_guard<std::mutex> lock(sGattDbCache.lock);
+    sGattDbCache.databases[conn_id].assign(db, db + count);
+    return;
+  }
 
-  jobject arrayPtr = array.get();
-  fillGattDbElementArray(sCallbackEnv.get(), &arrayPtr, db, count);
+  std::vector<jint> removed;
+  std::vector<btgatt_db_element_t> added;
+  bool is_delta;
+  {
+    std::lock_guard<std::mutex> lock(sGattDbCache.lock);
+    auto it = sGattDbCache.databases.find(conn_id);
+    is_delta = it != sGattDbCache.databases.end() &&
+               gatt_db_diff(it->second, db, count, &removed, &added);
+    sGattDbCache.databases[conn_id].assign(db, db + count);
+  }
+
+  if (!is_delta) {
+    ScopedLocalRef<jlongArray> array(
+        sCallbackEnv.get(),
+        packGattDbElementArray(sCallbackEnv.get(), db, count));
+    if (!array.get()) {
+      ALOGE("%s: failed to allocate GATT database array", __func__);
+      gatt_db_cache_release(conn_id);
+      return;
+    }
+
+    sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onGetGattDb, conn_id,
+                                 array.get());
+    return;
+  }
+
+  ScopedLocalRef<jintArray> removed_ids(
+      sCallbackEnv.get(), sCallbackEnv->NewIntArray(removed.size()));
+  ScopedLocalRef<jlongArray> array(
+      sCallbackEnv.get(), packGattDbElementArray(sCallbackEnv.get(),
+                                                 added.data(), added.size()));
+  if (!removed_ids.get() || !array.get()) {
+    ALOGE("%s: failed to allocate GATT database delta", __func__);
+    gatt_db_cache_release(conn_id);
+    return;
+  }
+  sCallbackEnv->SetIntArrayRegion(removed_ids.get(), 0, removed.size(),
+                                  removed.data());
 
-  sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onGetGattDb, conn_id,
-                               array.get());
+  sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onGetGattDbDelta, conn_id,
+                               removed_ids.get(), array.get());
 }
 
 void btgattc_phy_updated_cb(int conn_id, uint8_t tx_phy, uint8_t rx_phy,
@@ -569,7 +2618,7 @@ void btgatts_connection_cb(int conn_id, int server_if, int connected,
   if (!sCallbackEnv.valid()) return;
 
   ScopedLocalRef<jstring> address(sCallbackEnv.get(),
-                                  bdaddr2newjstr(sCallbackEnv.get(), &bda));
+                                  getAddressString(sCallbackEnv.get(), bda));
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onClientConnected,
                                address.get(), connected, conn_id, server_if);
 }
@@ -579,12 +2628,9 @@ void btgatts_service_added_cb(int status, int server_if,
   CallbackEnv sCallbackEnv(__func__);
   if (!sCallbackEnv.valid()) return;
 
-  jclass arrayListclazz = sCallbackEnv->FindClass("java/util/ArrayList");
   ScopedLocalRef<jobject> array(
-      sCallbackEnv.get(),
-      sCallbackEnv->NewObject(
-          arrayListclazz,
-          sCallbackEnv->GetMethodID(arrayListclazz, "<init>", "()V")));
+      sCallbackEnv.get(), sCallbackEnv->NewObject(sArrayListClass.clazz,
+                                                  sArrayListClass.constructor));
   jobject arrayPtr = array.get();
   fillGattDbElementArray(sCallbackEnv.get(), &arrayPtr, service.data(),
                          service.size());
@@ -615,7 +2661,7 @@ void btgatts_request_read_characteristic_cb(int conn_id, int trans_id,
   if (!sCallbackEnv.valid()) return;
 
   ScopedLocalRef<jstring> address(sCallbackEnv.get(),
-                                  bdaddr2newjstr(sCallbackEnv.get(), &bda));
+                                  getAddressString(sCallbackEnv.get(), bda));
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onServerReadCharacteristic,
                                address.get(), conn_id, trans_id, attr_handle,
                                offset, is_long);
@@ -628,7 +2674,7 @@ void btgatts_request_read_descriptor_cb(int conn_id, int trans_id,
   if (!sCallbackEnv.valid()) return;
 
   ScopedLocalRef<jstring> address(sCallbackEnv.get(),
-                                  bdaddr2newjstr(sCallbackEnv.get(), &bda));
+                                  getAddressString(sCallbackEnv.get(), bda));
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onServerReadDescriptor,
                                address.get(), conn_id, trans_id, attr_handle,
                                offset, is_long);
@@ -643,7 +2689,7 @@ void btgatts_request_write_characteristic_cb(int conn_id, int trans_id,
   if (!sCallbackEnv.valid()) return;
 
   ScopedLocalRef<jstring> address(sCallbackEnv.get(),
-                                  bdaddr2newjstr(sCallbackEnv.get(), &bda));
+                                  getAddressString(sCallbackEnv.get(), bda));
   ScopedLocalRef<jbyteArray> val(sCallbackEnv.get(),
                                  sCallbackEnv->NewByteArray(value.size()));
   if (val.get())
@@ -664,7 +2710,7 @@ void btgatts_request_write_descriptor_cb(int conn_id, int trans_id,
   if (!sCallbackEnv.valid()) return;
 
   ScopedLocalRef<jstring> address(sCallbackEnv.get(),
-                                  bdaddr2newjstr(sCallbackEnv.get(), &bda));
+                                  getAddressString(sCallbackEnv.get(), bda));
   ScopedLocalRef<jbyteArray> val(sCallbackEnv.get(),
                                  sCallbackEnv->NewByteArray(value.size()));
   if (val.get())
@@ -682,7 +2728,7 @@ void btgatts_request_exec_write_cb(int conn_id, int trans_id,
   if (!sCallbackEnv.valid()) return;
 
   ScopedLocalRef<jstring> address(sCallbackEnv.get(),
-                                  bdaddr2newjstr(sCallbackEnv.get(), &bda));
+                                  getAddressString(sCallbackEnv.get(), bda));
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onExecuteWrite,
                                address.get(), conn_id, trans_id, exec_write);
 }
@@ -763,6 +2809,45 @@ static const btgatt_callbacks_t sGattCallbacks = {
 /**
  * Native function definitions
  */
+static void initGattDbClassIds(JNIEnv* env) {
+  jclass clazz = env->FindClass("com/android/bluetooth/gatt/GattDbElement");
+  sGattDbElementClass.clazz = (jclass)env->NewGlobalRef(clazz);
+  sGattDbElementClass.constructor = env->GetMethodID(clazz, "<init>", "()V");
+  sGattDbElementClass.id = env->GetFieldID(clazz, "id", "I");
+  sGattDbElementClass.uuid =
+      env->GetFieldID(clazz, "uuid", "Ljava/util/UUID;");
+  sGattDbElementClass.type = env->GetFieldID(clazz, "type", "I");
+  sGattDbElementClass.attributeHandle =
+      env->GetFieldID(clazz, "attributeHandle", "I");
+  sGattDbElementClass.startHandle = env->GetFieldID(clazz, "startHandle", "I");
+  sGattDbElementClass.endHandle = env->GetFieldID(clazz, "endHandle", "I");
+  sGattDbElementClass.properties = env->GetFieldID(clazz, "properties", "I");
+  sGattDbElementClass.permissions =
+      env->GetFieldID(clazz, "permissions", "I");
+  env->DeleteLocalRef(clazz);
+
+  clazz = env->FindClass("java/util/ArrayList");
+  sArrayListClass.clazz = (jclass)env->NewGlobalRef(clazz);
+  sArrayListClass.constructor = env->GetMethodID(clazz, "<init>", "()V");
+  sArrayListClass.add =
+      env->GetMethodID(clazz, "add", "(Ljava/lang/Object;)Z");
+  env->DeleteLocalRef(clazz);
+
+  clazz = env->FindClass("java/util/List");
+  sArrayListClass.get = env->GetMethodID(clazz, "get", "(I)Ljava/lang/Object;");
+  sArrayListClass.size = env->GetMethodID(clazz, "size", "()I");
+  env->DeleteLocalRef(clazz);
+
+  clazz = env->FindClass("java/util/UUID");
+  sUuidClass.clazz = (jclass)env->NewGlobalRef(clazz);
+  sUuidClass.constructor = env->GetMethodID(clazz, "<init>", "(JJ)V");
+  sUuidClass.getMostSignificantBits =
+      env->GetMethodID(clazz, "getMostSignificantBits", "()J");
+  sUuidClass.getLeastSignificantBits =
+      env->GetMethodID(clazz, "getLeastSignificantBits", "()J");
+  env->DeleteLocalRef(clazz);
+}
+
 static void classInitNative(JNIEnv* env, jclass clazz) {
   // Client callbacks
 
@@ -772,12 +2857,18 @@ static void classInitNative(JNIEnv* env, jclass clazz) {
       env->GetMethodID(clazz, "onScannerRegistered", "(IIJJ)V");
   method_onScanResult = env->GetMethodID(clazz, "onScanResult",
                                          "(IILjava/lang/String;IIIIII[B)V");
+  method_onScanResultBatch =
+      env->GetMethodID(clazz, "onScanResultBatch", "(II)V");
   method_onConnected =
       env->GetMethodID(clazz, "onConnected", "(IIILjava/lang/String;)V");
   method_onDisconnected =
       env->GetMethodID(clazz, "onDisconnected", "(IIILjava/lang/String;)V");
+  method_onClientFleetProgress =
+      env->GetMethodID(clazz, "onClientFleetProgress", "(IIIIII)V");
   method_onReadCharacteristic =
       env->GetMethodID(clazz, "onReadCharacteristic", "(III[B)V");
+  method_onReadCharacteristicBatch =
+      env->GetMethodID(clazz, "onReadCharacteristicBatch", "(I[B)V");
   method_onWriteCharacteristic =
       env->GetMethodID(clazz, "onWriteCharacteristic", "(III)V");
   method_onExecuteCompleted =
@@ -790,6 +2881,8 @@ static void classInitNative(JNIEnv* env, jclass clazz) {
       env->GetMethodID(clazz, "onWriteDescriptor", "(III)V");
   method_onNotify =
       env->GetMethodID(clazz, "onNotify", "(ILjava/lang/String;IZ[B)V");
+  method_onNotifyPooled = env->GetMethodID(clazz, "onNotifyPooled",
+                                           "(IIZLjava/nio/ByteBuffer;I)V");
   method_onRegisterForNotifications =
       env->GetMethodID(clazz, "onRegisterForNotifications", "(IIII)V");
   method_onReadRemoteRssi =
@@ -808,7 +2901,7 @@ static void classInitNative(JNIEnv* env, jclass clazz) {
   method_onBatchScanStartStopped =
       env->GetMethodID(clazz, "onBatchScanStartStopped", "(III)V");
   method_onBatchScanReports =
-      env->GetMethodID(clazz, "onBatchScanReports", "(IIII[B)V");
+      env->GetMethodID(clazz, "onBatchScanReports", "(IIII[B[I)V");
   method_onBatchScanThresholdCrossed =
       env->GetMethodID(clazz, "onBatchScanThresholdCrossed", "(I)V");
   method_CreateonTrackAdvFoundLostObject =
@@ -820,11 +2913,9 @@ static void classInitNative(JNIEnv* env, jclass clazz) {
       "(Lcom/android/bluetooth/gatt/AdvtFilterOnFoundOnLostInfo;)V");
   method_onScanParamSetupCompleted =
       env->GetMethodID(clazz, "onScanParamSetupCompleted", "(II)V");
-  method_getSampleGattDbElement =
-      env->GetMethodID(clazz, "GetSampleGattDbElement",
-                       "()Lcom/android/bluetooth/gatt/GattDbElement;");
-  method_onGetGattDb =
-      env->GetMethodID(clazz, "onGetGattDb", "(ILjava/util/ArrayList;)V");
+  method_onGetGattDb = env->GetMethodID(clazz, "onGetGattDb", "(I[J)V");
+  method_onGetGattDbDelta =
+      env->GetMethodID(clazz, "onGetGattDbDelta", "(I[I[J)V");
   method_onClientPhyRead =
       env->GetMethodID(clazz, "onClientPhyRead", "(ILjava/lang/String;III)V");
   method_onClientPhyUpdate =
@@ -868,6 +2959,8 @@ static void classInitNative(JNIEnv* env, jclass clazz) {
   method_onServerConnUpdate =
       env->GetMethodID(clazz, "onServerConnUpdate", "(IIIII)V");
 
+  initGattDbClassIds(env);
+
   info("classInitNative: Success!");
 }
 
@@ -909,15 +3002,34 @@ static void initializeNative(JNIEnv* env, jobject object) {
   }
 
   mCallbacksObj = env->NewGlobalRef(object);
+  gatt_cache_init();
 }
 
 static void cleanupNative(JNIEnv* env, jobject object) {
   if (!btIf) return;
 
+  scan_batch_stop(env);
+  adaptive_scan_stop();
+  fleet_stop();
+  {
+    std::lock_guard<std::mutex> lock(sSwScanFilter.lock);
+    sSwScanFilter.program.reset();
+  }
+  gatt_db_cache_clear();
+
   if (sGattIf != NULL) {
     sGattIf->cleanup();
     sGattIf = NULL;
   }
+  // Only now no notification can be writing into a pooled buffer.
+  notify_pool_clear(env);
+  gatt_cache_cleanup();
+
+  {
+    std::lock_guard<std::mutex> lock(sWritePipeline.lock);
+    sWritePipeline.queues.clear();
+    sWritePipeline.mtus.clear();
+  }
 
   if (mCallbacksObj != NULL) {
     env->DeleteGlobalRef(mCallbacksObj);
@@ -949,6 +3061,7 @@ static void gattClientRegisterAppNative(JNIEnv* env, jobject object,
 static void gattClientUnregisterAppNative(JNIEnv* env, jobject object,
                                           jint clientIf) {
   if (!sGattIf) return;
+  fleet_remove(clientIf, NULL);
   sGattIf->client->unregister_client(clientIf);
 }
 
@@ -979,9 +3092,84 @@ static void unregisterScannerNative(JNIEnv* env, jobject object,
 
 static void gattClientScanNative(JNIEnv* env, jobject object, jboolean start) {
   if (!sGattIf) return;
+
+  std::lock_guard<std::mutex> lock(sAdaptiveScan.lock);
+  sAdaptiveScan.scanning = start;
+  sAdaptiveScan.cv.notify_all();
   sGattIf->scanner->Scan(start);
 }
 
+static jlongArray gattClientGetNotifyPoolStatsNative(JNIEnv* env,
+                                                     jobject object) {
+  jlong stats[3];
+  {
+    std::lock_guard<std::mutex> lock(sNotifyPool.lock);
+    stats[0] = sNotifyPool.hits.load();
+    stats[1] = sNotifyPool.misses.load();
+    stats[2] = sNotifyPool.buffers.size();
+  }
+
+  jlongArray result = env->NewLongArray(3);
+  if (result) env->SetLongArrayRegion(result, 0, 3, stats);
+  return result;
+}
+
+static jlongArray gattClientGetSoftwareScanFilterStatsNative(JNIEnv* env,
+                                                             jobject object) {
+  jlong stats[2] = {(jlong)sSwScanFilter.passed.load(),
+                    (jlong)sSwScanFilter.dropped.load()};
+
+  jlongArray result = env->NewLongArray(2);
+  if (result) env->SetLongArrayRegion(result, 0, 2, stats);
+  return result;
+}
+
+static jlongArray gattClientGetAdaptiveScanStatsNative(JNIEnv* env,
+                                                      jobject object) {
+  jlong stats[4];
+  {
+    std::lock_guard<std::mutex> lock(sAdaptiveScan.lock);
+    bool enabled = sAdaptiveScan.enabled;
+    stats[0] = enabled ? sAdaptiveScan.level : -1;
+    stats[1] = enabled ? adaptive_scan_interval_locked() : 0;
+    stats[2] = enabled ? adaptive_scan_window_locked() : 0;
+    stats[3] = sAdaptiveScan.retunes;
+  }
+
+  jlongArray result = env->NewLongArray(4);
+  if (result) env->SetLongArrayRegion(result, 0, 4, stats);
+  return result;
+}
+
+static void gattClientConfigScanBatchingNative(JNIEnv* env, jobject object,
+                                               jobject buffer,
+                                               jint max_results,
+                                               jint max_latency_ms) {
+  scan_batch_stop(env);
+
+  if (buffer == NULL || max_results <= 0 || max_latency_ms <= 0) return;
+
+  uint8_t* data = (uint8_t*)env->GetDirectBufferAddress(buffer);
+  jlong capacity = env->GetDirectBufferCapacity(buffer);
+  if (data == NULL || capacity < SCAN_BATCH_RECORD_HEADER_LEN) {
+    error("Scan batching requires a direct ByteBuffer");
+    return;
+  }
+
+  std::lock_guard<std::mutex> deliver_lock(sScanBatch.deliver_lock);
+  std::lock_guard<std::mutex> lock(sScanBatch.lock);
+  sScanBatch.buffer = env->NewGlobalRef(buffer);
+  sScanBatch.data = data;
+  sScanBatch.capacity = capacity;
+  sScanBatch.staged.reserve(capacity);
+  sScanBatch.delivering.reserve(capacity);
+  sScanBatch.count = 0;
+  sScanBatch.max_results = max_results;
+  sScanBatch.max_latency = std::chrono::milliseconds(max_latency_ms);
+  sScanBatch.enabled = true;
+  sScanBatch.flusher = std::thread(scan_batch_flusher_run);
+}
+
 static void gattClientConnectNative(JNIEnv* env, jobject object, jint clientif,
                                     jstring address, jboolean isDirect,
                                     jint transport, jboolean opportunistic,
@@ -992,11 +3180,61 @@ static void gattClientConnectNative(JNIEnv* env, jobject object, jint clientif,
                            transport, opportunistic, initiating_phys);
 }
 
+/* Adds |addresses| to the devices orchestrated for |clientIf|, or updates
+ * their priority. |max_concurrent| caps the direct connects in flight;
+ * 0 keeps the current limit. */
+static void gattClientConnectFleetNative(JNIEnv* env, jobject object,
+                                         jint clientIf, jobjectArray addresses,
+                                         jintArray priorities, jint transport,
+                                         jint max_concurrent) {
+  if (!sGattIf) return;
+
+  jsize count = env->GetArrayLength(addresses);
+  if (env->GetArrayLength(priorities) != count) {
+    jniThrowIOException(env, EINVAL);
+    return;
+  }
+  std::vector<jint> prio(count);
+  env->GetIntArrayRegion(priorities, 0, count, prio.data());
+
+  std::lock_guard<std::mutex> lock(sFleet.lock);
+  if (max_concurrent > 0) {
+    sFleet.max_concurrent = max_concurrent;
+  } else if (sFleet.max_concurrent <= 0) {
+    sFleet.max_concurrent = FLEET_DEFAULT_MAX_CONCURRENT;
+  }
+
+  auto now = std::chrono::steady_clock::now();
+  for (jsize i = 0; i < count; i++) {
+    ScopedLocalRef<jstring> address(
+        env, (jstring)env->GetObjectArrayElement(addresses, i));
+    if (!address.get()) continue;
+    RawAddress bda = str2addr(env, address.get());
+
+    FleetTarget* target = fleet_find_locked(clientIf, bda);
+    if (target) {
+      target->priority = prio[i];
+      continue;
+    }
+    sFleet.targets.push_back(
+        {clientIf, bda, prio[i], transport, FLEET_WAITING, 0, now});
+  }
+  sFleet.dirty_clients.insert(clientIf);
+
+  if (!sFleet.running) {
+    sFleet.running = true;
+    sFleet.worker = std::thread(fleet_run);
+  }
+  sFleet.cv.notify_one();
+}
+
 static void gattClientDisconnectNative(JNIEnv* env, jobject object,
                                        jint clientIf, jstring address,
                                        jint conn_id) {
   if (!sGattIf) return;
-  sGattIf->client->disconnect(clientIf, str2addr(env, address), conn_id);
+  RawAddress bda = str2addr(env, address);
+  fleet_remove(clientIf, &bda);
+  sGattIf->client->disconnect(clientIf, bda, conn_id);
 }
 
 static void gattClientSetPreferredPhyNative(JNIEnv* env, jobject object,
@@ -1014,7 +3252,7 @@ static void readClientPhyCb(uint8_t clientIf, RawAddress bda, uint8_t tx_phy,
   if (!sCallbackEnv.valid()) return;
 
   ScopedLocalRef<jstring> address(sCallbackEnv.get(),
-                                  bdaddr2newjstr(sCallbackEnv.get(), &bda));
+                                  getAddressString(sCallbackEnv.get(), bda));
 
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onClientPhyRead, clientIf,
                                address.get(), tx_phy, rx_phy, status);
@@ -1064,6 +3302,49 @@ static void gattClientGetGattDbNative(JNIEnv* env, jobject object,
   sGattIf->client->get_gatt_db(conn_id);
 }
 
+/* Returns the cached database of the device on |conn_id| packed like
+ * onGetGattDb, or NULL if there is none or the connection already has a
+ * database. Databases of the connection are cached only if |bonded|. */
+static jlongArray gattClientLoadGattCacheNative(JNIEnv* env, jobject object,
+                                                jint conn_id,
+                                                jboolean bonded) {
+  std::vector<btgatt_db_element_t> db;
+  {
+    std::lock_guard<std::mutex> lock(sGattCache.lock);
+    auto conn = sGattCache.connections.find(conn_id);
+    if (conn == sGattCache.connections.end()) return NULL;
+    conn->second.bonded = bonded;
+    if (!bonded || sGattCache.ttl <= 0) return NULL;
+
+    auto it = sGattCache.entries.find(conn->second.bda);
+    if (it == sGattCache.entries.end()) return NULL;
+    if (gatt_cache_expired_locked(it->second, time(NULL))) {
+      sGattCache.entries.erase(it);
+      gatt_cache_save_locked();
+      return NULL;
+    }
+
+    {
+      std::lock_guard<std::mutex> db_lock(sGattDbCache.lock);
+      if (sGattDbCache.databases.count(conn_id)) return NULL;
+      sGattDbCache.databases[conn_id] = it->second.db;
+    }
+    conn->second.validating = true;
+    db = it->second.db;
+  }
+
+  jlongArray array = packGattDbElementArray(env, db.data(), db.size());
+  if (!array) gatt_db_cache_release(conn_id);
+  return array;
+}
+
+/* Drops the database kept for |conn_id|, so the next one is delivered whole
+ * through onGetGattDb. */
+static void gattClientForgetGattDbNative(JNIEnv* env, jobject object,
+                                         jint conn_id) {
+  gatt_db_cache_release(conn_id);
+}
+
 static void gattClientReadCharacteristicNative(JNIEnv* env, jobject object,
                                                jint conn_id, jint handle,
                                                jint authReq) {
@@ -1113,6 +3394,114 @@ static void gattClientWriteCharacteristicNative(JNIEnv* env, jobject object,
                                         std::move(vect_val));
 }
 
+/* Reads |handles| back to back on |conn_id|, see "Read batching". Returns
+ * false if a batch is already running on the connection. */
+static jboolean gattClientReadCharacteristicBatchNative(JNIEnv* env,
+                                                        jobject object,
+                                                        jint conn_id,
+                                                        jintArray handles,
+                                                        jint auth_req) {
+  if (!sGattIf) return JNI_FALSE;
+
+  if (handles == NULL) {
+    warn("gattClientReadCharacteristicBatchNative() ignoring NULL array");
+    return JNI_FALSE;
+  }
+
+  jsize count = env->GetArrayLength(handles);
+  if (count == 0 || count > READ_BATCH_MAX_HANDLES) {
+    error("Read batch of %d handles, at most %d supported", count,
+          READ_BATCH_MAX_HANDLES);
+    return JNI_FALSE;
+  }
+  std::vector<jint> values(count);
+  env->GetIntArrayRegion(handles, 0, count, values.data());
+
+  std::lock_guard<std::mutex> lock(sReadBatch.lock);
+  if (sReadBatch.batches.count(conn_id)) {
+    warn("Read batch already in progress on conn_id %d", conn_id);
+    return JNI_FALSE;
+  }
+
+  ReadBatch& batch = sReadBatch.batches[conn_id];
+  batch.auth_req = auth_req;
+  batch.in_flight = 0;
+  batch.packed.reserve(count * (READ_RECORD_HEADER_LEN + GATT_DEF_MTU - 1));
+  for (jint handle : values) batch.pending.push_back(handle);
+
+  if (!read_batch_pump_locked(conn_id, batch)) {
+    sReadBatch.batches.erase(conn_id);
+    return JNI_FALSE;
+  }
+  return JNI_TRUE;
+}
+
+static jboolean gattClientWriteCharacteristicBatchNative(JNIEnv* env,
+                                                         jobject object,
+                                                         jint conn_id,
+                                                         jint auth_req,
+                                                         jbyteArray records) {
+  if (!sGattIf) return JNI_FALSE;
+
+  if (records == NULL) {
+    warn("gattClientWriteCharacteristicBatchNative() ignoring NULL array");
+    return JNI_FALSE;
+  }
+
+  jsize len = env->GetArrayLength(records);
+  jbyte* p_records = env->GetByteArrayElements(records, NULL);
+  if (p_records == NULL) return JNI_FALSE;
+
+  std::lock_guard<std::mutex> lock(sWritePipeline.lock);
+  auto mtu_it = sWritePipeline.mtus.find(conn_id);
+  int max_value_len =
+      (mtu_it != sWritePipeline.mtus.end() ? mtu_it->second : GATT_DEF_MTU) -
+      3;
+
+  std::deque<PendingWrite> parsed;
+  const uint8_t* p = (const uint8_t*)p_records;
+  const uint8_t* end = p + len;
+  bool valid = true;
+  while (p < end) {
+    if (end - p < WRITE_RECORD_HEADER_LEN) {
+      valid = false;
+      break;
+    }
+    uint16_t handle = p[0] | (p[1] << 8);
+    uint16_t value_len = p[2] | (p[3] << 8);
+    p += WRITE_RECORD_HEADER_LEN;
+    if (value_len > max_value_len || end - p < value_len) {
+      valid = false;
+      break;
+    }
+    parsed.push_back({handle, std::vector<uint8_t>(p, p + value_len)});
+    p += value_len;
+  }
+  env->ReleaseByteArrayElements(records, p_records, JNI_ABORT);
+
+  if (!valid) {
+    error("Malformed write batch or value longer than MTU (%d)",
+          max_value_len + 3);
+    return JNI_FALSE;
+  }
+
+  if (parsed.empty()) return JNI_FALSE;
+  if (sWritePipeline.queues.count(conn_id)) {
+    warn("Write batch already in progress on conn_id %d", conn_id);
+    return JNI_FALSE;
+  }
+
+  WriteQueue& queue = sWritePipeline.queues[conn_id];
+  queue.auth_req = auth_req;
+  queue.pending = std::move(parsed);
+  write_pipeline_pump_locked(conn_id, queue);
+  if (!queue.in_flight) {
+    sWritePipeline.queues.erase(conn_id);
+    return JNI_FALSE;
+  }
+  return JNI_TRUE;
+}
+
 static void gattClientExecuteWriteNative(JNIEnv* env, jobject object,
                                          jint conn_id, jboolean execute) {
   if (!sGattIf) return;
@@ -1399,6 +3788,64 @@ static void gattClientScanFilterEnableNative(JNIEnv* env, jobject object,
                                      base::Bind(&scan_enable_cb, client_if));
 }
 
+/* Enables adaptive scan scheduling between the floor and ceiling
+ * parameters, in 0.625 ms units, see "Adaptive scan scheduling". A zero
+ * ceiling interval disables it; the scan parameters then stay as they are
+ * until ScanManager sets new ones. */
+static void gattClientSetAdaptiveScanNative(JNIEnv* env, jobject object,
+                                            jint ceiling_interval,
+                                            jint ceiling_window,
+                                            jint floor_interval,
+                                            jint floor_window) {
+  std::lock_guard<std::mutex> lock(sAdaptiveScan.lock);
+  if (ceiling_interval <= 0) {
+    sAdaptiveScan.enabled = false;
+    return;
+  }
+
+  auto clamp = [](int units) {
+    return std::min(std::max(units, LE_SCAN_INTERVAL_MIN),
+                    LE_SCAN_INTERVAL_MAX);
+  };
+  sAdaptiveScan.ceiling_interval = clamp(ceiling_interval);
+  sAdaptiveScan.ceiling_window =
+      std::min(clamp(ceiling_window), sAdaptiveScan.ceiling_interval);
+  sAdaptiveScan.floor_interval = clamp(floor_interval);
+  sAdaptiveScan.floor_window =
+      std::min(clamp(floor_window), sAdaptiveScan.floor_interval);
+  // ScanManager just applied the ceiling parameters.
+  sAdaptiveScan.level = ADAPTIVE_SCAN_LEVELS - 1;
+  sAdaptiveScan.idle_periods = 0;
+  sAdaptiveScan.periods = 0;
+  sAdaptiveScan.results = 0;
+  sAdaptiveScan.new_devices = 0;
+  sAdaptiveScan.new_hits = 0;
+  sAdaptiveScan.density_avg = 0;
+  sAdaptiveScan.enabled = true;
+  if (!sAdaptiveScan.running) {
+    sAdaptiveScan.running = true;
+    sAdaptiveScan.worker = std::thread(adaptive_scan_run);
+  }
+  sAdaptiveScan.cv.notify_all();
+}
+
+/* Installs the software scan filter program, or removes it if |program| is
+ * NULL. A malformed program removes the filter as well. */
+static void gattClientSetSoftwareScanFilterNative(JNIEnv* env, jobject object,
+                                                  jbyteArray program) {
+  std::shared_ptr<SwScanFilterProgram> compiled;
+  if (program != NULL) {
+    jsize len = env->GetArrayLength(program);
+    std::vector<uint8_t> bytes(len);
+    env->GetByteArrayRegion(program, 0, len, (jbyte*)bytes.data());
+    compiled = sw_filter_compile(bytes.data(), bytes.size());
+    if (!compiled) error("Malformed software scan filter program");
+  }
+
+  std::lock_guard<std::mutex> lock(sSwScanFilter.lock);
+  sSwScanFilter.program = compiled;
+}
+
 static void gattClientConfigureMTUNative(JNIEnv* env, jobject object,
                                          jint conn_id, jint mtu) {
   if (!sGattIf) return;
@@ -1512,7 +3959,7 @@ static void readServerPhyCb(uint8_t serverIf, RawAddress bda, uint8_t tx_phy,
   if (!sCallbackEnv.valid()) return;
 
   ScopedLocalRef<jstring> address(sCallbackEnv.get(),
-                                  bdaddr2newjstr(sCallbackEnv.get(), &bda));
+                                  getAddressString(sCallbackEnv.get(), bda));
 
   sCallbackEnv->CallVoidMethod(mCallbacksObj, method_onServerPhyRead, serverIf,
                                address.get(), tx_phy, rx_phy, status);
@@ -1531,61 +3978,41 @@ static void gattServerAddServiceNative(JNIEnv* env, jobject object,
                                        jobject gatt_db_elements) {
   if (!sGattIf) return;
 
-  jclass arrayListclazz = env->FindClass("java/util/List");
-  jmethodID arrayGet =
-      env->GetMethodID(arrayListclazz, "get", "(I)Ljava/lang/Object;");
-  jmethodID arraySize = env->GetMethodID(arrayListclazz, "size", "()I");
-
-  int count = env->CallIntMethod(gatt_db_elements, arraySize);
+  int count = env->CallIntMethod(gatt_db_elements, sArrayListClass.size);
   std::vector<btgatt_db_element_t> db;
-
-  jclass uuidClazz = env->FindClass("java/util/UUID");
-  jmethodID uuidGetMsb =
-      env->GetMethodID(uuidClazz, "getMostSignificantBits", "()J");
-  jmethodID uuidGetLsb =
-      env->GetMethodID(uuidClazz, "getLeastSignificantBits", "()J");
-
-  jobject objectForClass =
-      env->CallObjectMethod(mCallbacksObj, method_getSampleGattDbElement);
-  jclass gattDbElementClazz = env->GetObjectClass(objectForClass);
+  db.reserve(count);
 
   for (int i = 0; i < count; i++) {
     btgatt_db_element_t curr;
 
     jint index = i;
     ScopedLocalRef<jobject> element(
-        env, env->CallObjectMethod(gatt_db_elements, arrayGet, index));
+        env, env->CallObjectMethod(gatt_db_elements, sArrayListClass.get,
+                                   index));
 
-    jfieldID fid;
+    curr.id = env->GetIntField(element.get(), sGattDbElementClass.id);
 
-    fid = env->GetFieldID(gattDbElementClazz, "id", "I");
-    curr.id = env->GetIntField(element.get(), fid);
-
-    fid = env->GetFieldID(gattDbElementClazz, "uuid", "Ljava/util/UUID;");
-    ScopedLocalRef<jobject> uuid(env, env->GetObjectField(element.get(), fid));
+    ScopedLocalRef<jobject> uuid(
+        env, env->GetObjectField(element.get(), sGattDbElementClass.uuid));
 
-    jlong uuid_msb = env->CallLongMethod(uuid.get(), uuidGetMsb);
-    jlong uuid_lsb = env->CallLongMethod(uuid.get(), uuidGetLsb);
+    jlong uuid_msb =
+        env->CallLongMethod(uuid.get(), sUuidClass.getMostSignificantBits);
+    jlong uuid_lsb =
+        env->CallLongMethod(uuid.get(), sUuidClass.getLeastSignificantBits);
     set_uuid(curr.uuid.uu, uuid_msb, uuid_lsb);
 
-    fid = env->GetFieldID(gattDbElementClazz, "type", "I");
-    curr.type =
-        (bt_gatt_db_attribute_type_t)env->GetIntField(element.get(), fid);
-
-    fid = env->GetFieldID(gattDbElementClazz, "attributeHandle", "I");
-    curr.attribute_handle = env->GetIntField(element.get(), fid);
-
-    fid = env->GetFieldID(gattDbElementClazz, "startHandle", "I");
-    curr.start_handle = env->GetIntField(element.get(), fid);
-
-    fid = env->GetFieldID(gattDbElementClazz, "endHandle", "I");
-    curr.end_handle = env->GetIntField(element.get(), fid);
-
-    fid = env->GetFieldID(gattDbElementClazz, "properties", "I");
-    curr.properties = env->GetIntField(element.get(), fid);
-
-    fid = env->GetFieldID(gattDbElementClazz, "permissions", "I");
-    curr.permissions = env->GetIntField(element.get(), fid);
+    curr.type = (bt_gatt_db_attribute_type_t)env->GetIntField(
+        element.get(), sGattDbElementClass.type);
+    curr.attribute_handle =
+        env->GetIntField(element.get(), sGattDbElementClass.attributeHandle);
+    curr.start_handle =
+        env->GetIntField(element.get(), sGattDbElementClass.startHandle);
+    curr.end_handle =
+        env->GetIntField(element.get(), sGattDbElementClass.endHandle);
+    curr.properties =
+        env->GetIntField(element.get(), sGattDbElementClass.properties);
+    curr.permissions =
+        env->GetIntField(element.get(), sGattDbElementClass.permissions);
 
     db.push_back(curr);
   }
@@ -1661,6 +4088,194 @@ static void gattServerSendResponseNative(JNIEnv* env, jobject object,
   sGattIf->server->send_response(conn_id, trans_id, status, response);
 }
 
+static void callJniCallback(jmethodID method, uint8_t advertiser_id,
+                            uint8_t status) {
+  CallbackEnv sCallbackEnv(__func__);
+  if (!sCallbackEnv.valid()) return;
+  sCallbackEnv->CallVoidMethod(mAdvertiseCallbacksObj, method, advertiser_id,
+                               status);
+}
+
+/**
+ * Advertising rotation
+ *
+ * The advertising and scan response data last handed to the controller is
+ * kept per advertiser, and SetData is skipped when the same bytes are set
+ * again. Java still gets its onAdvertisingDataSet/onScanResponseDataSet: the
+ * skipped call is completed from the "BT Adv Rotation" thread, never on the
+ * calling binder thread.
+ *
+ * setAdvertisingRotationNative installs a schedule of payloads for an
+ * advertiser. A native timer steps through it every period_ms without any
+ * Java involvement. Step i sets payload i and scan response i, each modulo
+ * its count; without scan responses the current one is kept. Rotations only
+ * report failures to Java. Setting data from Java or stopping the advertiser
+ * cancels its rotation.
+ */
+
+#define ADV_ROTATION_MIN_PERIOD_MS 100
+
+struct AdvRotation {
+  std::vector<std::vector<uint8_t>> adv_data;
+  std::vector<std::vector<uint8_t>> scan_resp;
+  size_t next;
+  std::chrono::milliseconds period;
+  std::chrono::steady_clock::time_point due;
+};
+
+static struct {
+  std::mutex lock;
+  std::condition_variable cv;
+  std::thread worker;
+  bool running;
+  // Last data set per advertiser, indexed by scan_rsp.
+  std::map<int, std::vector<uint8_t>> last_data[2];
+  std::map<int, AdvRotation> rotations;
+  // Skipped SetData calls still to be completed, as (advertiser_id, scan_rsp).
+  std::vector<std::pair<int, bool>> completions;
+} sAdvRotation;
+
+static void adv_data_set_cb(uint8_t advertiser_id, bool scan_rsp,
+                            bool rotation, uint8_t status) {
+  if (status != 0) {
+    // The controller state is unknown, let the next SetData through.
+    std::lock_guard<std::mutex> lock(sAdvRotation.lock);
+    sAdvRotation.last_data[scan_rsp].erase(advertiser_id);
+  } else if (rotation) {
+    return;
+  }
+
+  callJniCallback(
+      scan_rsp ? method_onScanResponseDataSet : method_onAdvertisingDataSet,
+      advertiser_id, status);
+}
+
+/* Hands |data| to the controller unless it is already set. Returns false if
+ * SetData was skipped. */
+static bool adv_data_set_locked(int advertiser_id, bool scan_rsp,
+                                const std::vector<uint8_t>& data,
+                                bool rotation) {
+  auto& last = sAdvRotation.last_data[scan_rsp];
+  auto it = last.find(advertiser_id);
+  if (it != last.end() && it->second == data) return false;
+
+  last[advertiser_id] = data;
+  sGattIf->advertiser->SetData(
+      advertiser_id, scan_rsp, data,
+      base::Bind(&adv_data_set_cb, advertiser_id, scan_rsp, rotation));
+  return true;
+}
+
+static void adv_rotation_step_locked(int advertiser_id, AdvRotation& rotation) {
+  size_t i = rotation.next;
+  rotation.next = (i + 1) % std::max(rotation.adv_data.size(),
+                                     rotation.scan_resp.size());
+  adv_data_set_locked(advertiser_id, false,
+                      rotation.adv_data[i % rotation.adv_data.size()], true);
+  if (!rotation.scan_resp.empty()) {
+    adv_data_set_locked(advertiser_id, true,
+                        rotation.scan_resp[i % rotation.scan_resp.size()],
+                        true);
+  }
+}
+
+static void adv_rotation_run() {
+  JavaVM* vm = AndroidRuntime::getJavaVM();
+  JNIEnv* env = NULL;
+  char name[] = "BT Adv Rotation";
+  JavaVMAttachArgs args = {
+      .version = JNI_VERSION_1_6, .name = name, .group = NULL};
+  if (vm->AttachCurrentThread(&env, &args) != JNI_OK) {
+    error("Unable to attach advertising rotation thread to VM");
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(sAdvRotation.lock);
+  while (sAdvRotation.running) {
+    if (!sAdvRotation.completions.empty()) {
+      std::vector<std::pair<int, bool>> completions;
+      completions.swap(sAdvRotation.completions);
+      lock.unlock();
+      for (const auto& completion : completions) {
+        if (mAdvertiseCallbacksObj == NULL) break;
+        env->CallVoidMethod(mAdvertiseCallbacksObj,
+                            completion.second ? method_onScanResponseDataSet
+                                              : method_onAdvertisingDataSet,
+                            completion.first, 0);
+        if (env->ExceptionCheck()) {
+          ALOGE("An exception was thrown by an advertising data callback.");
+          LOGE_EX(env);
+          env->ExceptionClear();
+        }
+      }
+      lock.lock();
+      continue;
+    }
+
+    if (sAdvRotation.rotations.empty()) {
+      sAdvRotation.cv.wait(lock);
+      continue;
+    }
+
+    auto next = std::min_element(
+        sAdvRotation.rotations.begin(), sAdvRotation.rotations.end(),
+        [](const std::pair<const int, AdvRotation>& a,
+           const std::pair<const int, AdvRotation>& b) {
+          return a.second.due < b.second.due;
+        });
+    auto now = std::chrono::steady_clock::now();
+    if (now < next->second.due) {
+      sAdvRotation.cv.wait_until(lock, next->second.due);
+      continue;
+    }
+
+    if (!sGattIf) {
+      sAdvRotation.rotations.clear();
+      continue;
+    }
+    AdvRotation& rotation = next->second;
+    adv_rotation_step_locked(next->first, rotation);
+    // Keep to the schedule, but don't catch up on missed rotations.
+    rotation.due += rotation.period;
+    if (rotation.due <= now) rotation.due = now + rotation.period;
+  }
+  lock.unlock();
+
+  vm->DetachCurrentThread();
+}
+
+// Must be called with sAdvRotation.lock held.
+static void adv_rotation_start_locked() {
+  if (!sAdvRotation.running) {
+    sAdvRotation.running = true;
+    sAdvRotation.worker = std::thread(adv_rotation_run);
+  }
+  sAdvRotation.cv.notify_all();
+}
+
+/* Drops the rotation and cached data of an advertiser. */
+static void adv_rotation_release(int advertiser_id) {
+  std::lock_guard<std::mutex> lock(sAdvRotation.lock);
+  sAdvRotation.rotations.erase(advertiser_id);
+  sAdvRotation.last_data[0].erase(advertiser_id);
+  sAdvRotation.last_data[1].erase(advertiser_id);
+}
+
+static void adv_rotation_stop() {
+  std::unique_lock<std::mutex> lock(sAdvRotation.lock);
+  sAdvRotation.running = false;
+  sAdvRotation.cv.notify_all();
+  lock.unlock();
+
+  if (sAdvRotation.worker.joinable()) sAdvRotation.worker.join();
+
+  lock.lock();
+  sAdvRotation.rotations.clear();
+  sAdvRotation.completions.clear();
+  sAdvRotation.last_data[0].clear();
+  sAdvRotation.last_data[1].clear();
+}
+
 static void advertiseClassInitNative(JNIEnv* env, jclass clazz) {
   method_onAdvertisingSetStarted =
       env->GetMethodID(clazz, "onAdvertisingSetStarted", "(IIII)V");
@@ -1693,6 +4308,7 @@ static void advertiseInitializeNative(JNIEnv* env, jobject object) {
 }
 
 static void advertiseCleanupNative(JNIEnv* env, jobject object) {
+  adv_rotation_stop();
   if (mAdvertiseCallbacksObj != NULL) {
     env->DeleteGlobalRef(mAdvertiseCallbacksObj);
     mAdvertiseCallbacksObj = NULL;
@@ -1833,6 +4449,7 @@ static void stopAdvertisingSetNative(JNIEnv* env, jobject object,
                                      jint advertiser_id) {
   if (!sGattIf) return;
 
+  adv_rotation_release(advertiser_id);
   sGattIf->advertiser->Unregister(advertiser_id);
 }
 
@@ -1854,14 +4471,6 @@ static void getOwnAddressNative(JNIEnv* env, jobject object,
       advertiser_id, base::Bind(&getOwnAddressCb, advertiser_id));
 }
 
-static void callJniCallback(jmethodID method, uint8_t advertiser_id,
-                            uint8_t status) {
-  CallbackEnv sCallbackEnv(__func__);
-  if (!sCallbackEnv.valid()) return;
-  sCallbackEnv->CallVoidMethod(mAdvertiseCallbacksObj, method, advertiser_id,
-                               status);
-}
-
 static void enableSetCb(uint8_t advertiser_id, bool enable, uint8_t status) {
   CallbackEnv sCallbackEnv(__func__);
   if (!sCallbackEnv.valid()) return;
@@ -1881,23 +4490,74 @@ static void enableAdvertisingSetNative(JNIEnv* env, jobject object,
                               base::Bind(&enableSetCb, advertiser_id, false));
 }
 
-static void setAdvertisingDataNative(JNIEnv* env, jobject object,
-                                     jint advertiser_id, jbyteArray data) {
+static void adv_data_set(JNIEnv* env, jint advertiser_id, bool scan_rsp,
+                         jbyteArray data) {
   if (!sGattIf) return;
 
-  sGattIf->advertiser->SetData(
-      advertiser_id, false, toVector(env, data),
-      base::Bind(&callJniCallback, method_onAdvertisingDataSet, advertiser_id));
+  std::vector<uint8_t> data_vec = toVector(env, data);
+  std::lock_guard<std::mutex> lock(sAdvRotation.lock);
+  sAdvRotation.rotations.erase(advertiser_id);
+  if (adv_data_set_locked(advertiser_id, scan_rsp, data_vec, false)) return;
+
+  // Nothing to send, complete from the rotation thread like a SetData would.
+  sAdvRotation.completions.emplace_back(advertiser_id, scan_rsp);
+  adv_rotation_start_locked();
+}
+
+static void setAdvertisingDataNative(JNIEnv* env, jobject object,
+                                     jint advertiser_id, jbyteArray data) {
+  adv_data_set(env, advertiser_id, false, data);
 }
 
 static void setScanResponseDataNative(JNIEnv* env, jobject object,
                                       jint advertiser_id, jbyteArray data) {
+  adv_data_set(env, advertiser_id, true, data);
+}
+
+static std::vector<std::vector<uint8_t>> toVectors(JNIEnv* env,
+                                                   jobjectArray arrays) {
+  std::vector<std::vector<uint8_t>> result;
+  if (arrays == NULL) return result;
+
+  jsize count = env->GetArrayLength(arrays);
+  result.reserve(count);
+  for (jsize i = 0; i < count; i++) {
+    ScopedLocalRef<jbyteArray> array(
+        env, (jbyteArray)env->GetObjectArrayElement(arrays, i));
+    result.push_back(array.get() ? toVector(env, array.get())
+                                 : std::vector<uint8_t>());
+  }
+  return result;
+}
+
+/* Rotates the advertiser through |adv_data| and |scan_resp| every
+ * |period_ms|, starting with the first payload right away. An empty schedule
+ * cancels the rotation and keeps the current data. */
+static void setAdvertisingRotationNative(JNIEnv* env, jobject object,
+                                         jint advertiser_id,
+                                         jobjectArray adv_data,
+                                         jobjectArray scan_resp,
+                                         jint period_ms) {
   if (!sGattIf) return;
 
-  sGattIf->advertiser->SetData(
-      advertiser_id, true, toVector(env, data),
-      base::Bind(&callJniCallback, method_onScanResponseDataSet,
-                 advertiser_id));
+  AdvRotation rotation;
+  rotation.adv_data = toVectors(env, adv_data);
+  rotation.scan_resp = toVectors(env, scan_resp);
+  rotation.next = 0;
+  rotation.period = std::chrono::milliseconds(
+      std::max((int)period_ms, ADV_ROTATION_MIN_PERIOD_MS));
+
+  std::lock_guard<std::mutex> lock(sAdvRotation.lock);
+  sAdvRotation.rotations.erase(advertiser_id);
+  if (rotation.adv_data.empty()) return;
+
+  adv_rotation_step_locked(advertiser_id, rotation);
+  rotation.due = std::chrono::steady_clock::now() + rotation.period;
+  // A single payload needs no timer.
+  if (rotation.next == 0) return;
+
+  sAdvRotation.rotations[advertiser_id] = std::move(rotation);
+  adv_rotation_start_locked();
 }
 
 static void setAdvertisingParametersNativeCb(uint8_t advertiser_id,
@@ -2078,6 +4738,8 @@ static JNINativeMethod sAdvertiseMethods[] = {
      (void*)enableAdvertisingSetNative},
     {"setAdvertisingDataNative", "(I[B)V", (void*)setAdvertisingDataNative},
     {"setScanResponseDataNative", "(I[B)V", (void*)setScanResponseDataNative},
+    {"setAdvertisingRotationNative", "(I[[B[[BI)V",
+     (void*)setAdvertisingRotationNative},
     {"setAdvertisingParametersNative",
      "(ILandroid/bluetooth/le/AdvertisingSetParameters;)V",
      (void*)setAdvertisingParametersNative},
@@ -2131,6 +4793,10 @@ static JNINativeMethod sScanMethods[] = {
      (void*)gattClientScanFilterClearNative},
     {"gattClientScanFilterEnableNative", "(IZ)V",
      (void*)gattClientScanFilterEnableNative},
+    {"gattClientSetSoftwareScanFilterNative", "([B)V",
+     (void*)gattClientSetSoftwareScanFilterNative},
+    {"gattClientSetAdaptiveScanNative", "(IIII)V",
+     (void*)gattClientSetAdaptiveScanNative},
     {"gattSetScanParametersNative", "(III)V",
      (void*)gattSetScanParametersNative},
 };
@@ -2146,8 +4812,18 @@ static JNINativeMethod sMethods[] = {
      (void*)gattClientRegisterAppNative},
     {"gattClientUnregisterAppNative", "(I)V",
      (void*)gattClientUnregisterAppNative},
+    {"gattClientConfigScanBatchingNative", "(Ljava/nio/ByteBuffer;II)V",
+     (void*)gattClientConfigScanBatchingNative},
+    {"gattClientGetNotifyPoolStatsNative", "()[J",
+     (void*)gattClientGetNotifyPoolStatsNative},
+    {"gattClientGetSoftwareScanFilterStatsNative", "()[J",
+     (void*)gattClientGetSoftwareScanFilterStatsNative},
+    {"gattClientGetAdaptiveScanStatsNative", "()[J",
+     (void*)gattClientGetAdaptiveScanStatsNative},
     {"gattClientConnectNative", "(ILjava/lang/String;ZIZI)V",
      (void*)gattClientConnectNative},
+    {"gattClientConnectFleetNative", "(I[Ljava/lang/String;[III)V",
+     (void*)gattClientConnectFleetNative},
     {"gattClientDisconnectNative", "(ILjava/lang/String;I)V",
      (void*)gattClientDisconnectNative},
     {"gattClientSetPreferredPhyNative", "(ILjava/lang/String;III)V",
@@ -2161,6 +4837,10 @@ static JNINativeMethod sMethods[] = {
     {"gattClientDiscoverServiceByUuidNative", "(IJJ)V",
      (void*)gattClientDiscoverServiceByUuidNative},
     {"gattClientGetGattDbNative", "(I)V", (void*)gattClientGetGattDbNative},
+    {"gattClientForgetGattDbNative", "(I)V",
+     (void*)gattClientForgetGattDbNative},
+    {"gattClientLoadGattCacheNative", "(IZ)[J",
+     (void*)gattClientLoadGattCacheNative},
     {"gattClientReadCharacteristicNative", "(III)V",
      (void*)gattClientReadCharacteristicNative},
     {"gattClientReadUsingCharacteristicUuidNative", "(IJJIII)V",
@@ -2169,6 +4849,10 @@ static JNINativeMethod sMethods[] = {
      (void*)gattClientReadDescriptorNative},
     {"gattClientWriteCharacteristicNative", "(IIII[B)V",
      (void*)gattClientWriteCharacteristicNative},
+    {"gattClientReadCharacteristicBatchNative", "(I[II)Z",
+     (void*)gattClientReadCharacteristicBatchNative},
+    {"gattClientWriteCharacteristicBatchNative", "(II[B)Z",
+     (void*)gattClientWriteCharacteristicBatchNative},
     {"gattClientWriteDescriptorNative", "(III[B)V",
      (void*)gattClientWriteDescriptorNative},
     {"gattClientExecuteWriteNative", "(IZ)V",
@@ -56,13 +56,11 @@ static jbyteArray marshall_bda(const RawAddress* bd_addr) {
   CallbackEnv sCallbackEnv(__func__);
   if (!sCallbackEnv.valid()) return NULL;
 
-  jbyteArray addr = sCallbackEnv->NewByteArray(sizeof(RawAddress));
+  jbyteArray addr = getAddressByteArray(sCallbackEnv.get(), *bd_addr);
   if (!addr) {
     ALOGE("Fail to new jbyteArray bd addr");
     return NULL;
   }
-  sCallbackEnv->SetByteArrayRegion(addr, 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
   return addr;
 }
 
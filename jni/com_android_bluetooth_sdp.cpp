@@ -20,10 +20,24 @@
 
 #include "android_runtime/AndroidRuntime.h"
 #include "com_android_bluetooth.h"
+#include "cutils/properties.h"
 #include "hardware/bt_sdp.h"
 #include "utils/Log.h"
 
+#include <errno.h>
+#include <stdio.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 static const uint8_t UUID_OBEX_OBJECT_PUSH[] = {
     0x00, 0x00, 0x11, 0x05, 0x00, 0x00, 0x10, 0x00,
@@ -56,12 +70,14 @@ static jmethodID method_sdpMnsRecordFoundCallback;
 static jmethodID method_sdpPseRecordFoundCallback;
 static jmethodID method_sdpOppOpsRecordFoundCallback;
 static jmethodID method_sdpSapsRecordFoundCallback;
+static jmethodID method_sdpBatchRecordsFoundCallback;
 
 static const btsdp_interface_t* sBluetoothSdpInterface = NULL;
 
 static void sdp_search_callback(bt_status_t status, RawAddress* bd_addr,
                                 uint8_t* uuid_in, int record_size,
                                 bluetooth_sdp_record* record);
+static void sdp_cache_init();
 
 btsdp_callbacks_t sBluetoothSdpCallbacks = {sizeof(sBluetoothSdpCallbacks),
                                             sdp_search_callback};
@@ -90,6 +106,8 @@ static void initializeNative(JNIEnv* env, jobject object) {
   }
 
   sCallbacksObj = env->NewGlobalRef(object);
+
+  sdp_cache_init();
 }
 
 static void classInitNative(JNIEnv* env, jclass clazz) {
@@ -113,6 +131,9 @@ static void classInitNative(JNIEnv* env, jclass clazz) {
   /* SAP Server record */
   method_sdpSapsRecordFoundCallback = env->GetMethodID(
       clazz, "sdpSapsRecordFoundCallback", "(I[B[BIILjava/lang/String;Z)V");
+  /* Records of a batched search */
+  method_sdpBatchRecordsFoundCallback =
+      env->GetMethodID(clazz, "sdpBatchRecordsFoundCallback", "(I[B[B)V");
 }
 
 static jboolean sdpSearchNative(JNIEnv* env, jobject obj, jbyteArray address,
@@ -146,6 +167,535 @@ static jboolean sdpSearchNative(JNIEnv* env, jobject obj, jbyteArray address,
   return (ret == BT_STATUS_SUCCESS) ? JNI_TRUE : JNI_FALSE;
 }
 
+/* Record types with a dedicated Java callback; anything else is delivered as
+ * raw record data. The values are also used as record kinds in the packed
+ * batch results and must match SdpManager. */
+enum SdpRecordKind {
+  SDP_RECORD_KIND_RAW = 0,
+  SDP_RECORD_KIND_MAS = 1,
+  SDP_RECORD_KIND_MNS = 2,
+  SDP_RECORD_KIND_PSE = 3,
+  SDP_RECORD_KIND_OPS = 4,
+  SDP_RECORD_KIND_SAPS = 5,
+};
+
+static const struct {
+  const uint8_t* uuid;
+  SdpRecordKind kind;
+} sSdpRecordKinds[] = {
+    {UUID_MAP_MAS, SDP_RECORD_KIND_MAS},
+    {UUID_MAP_MNS, SDP_RECORD_KIND_MNS},
+    {UUID_PBAP_PSE, SDP_RECORD_KIND_PSE},
+    {UUID_OBEX_OBJECT_PUSH, SDP_RECORD_KIND_OPS},
+    {UUID_SAP, SDP_RECORD_KIND_SAPS},
+};
+
+static SdpRecordKind sdp_record_kind(const uint8_t* uuid) {
+  for (const auto& entry : sSdpRecordKinds) {
+    if (IS_UUID(entry.uuid, uuid)) return entry.kind;
+  }
+  return SDP_RECORD_KIND_RAW;
+}
+
+/* The values a record of a given kind hands to Java. |params| are the
+ * kind specific integers in the order of the Java callback arguments;
+ * |data| is the OPP formats list or the raw record. */
+struct SdpRecordFields {
+  jint l2cap_psm;
+  jint rfcomm_channel_number;
+  jint profile_version;
+  jint params[3];
+  const char* service_name;
+  const uint8_t* data;
+  jint data_len;
+};
+
+static void sdp_record_fields(SdpRecordKind kind,
+                              const bluetooth_sdp_record* record,
+                              SdpRecordFields* fields) {
+  memset(fields, 0, sizeof(*fields));
+  fields->l2cap_psm = record->hdr.l2cap_psm;
+  fields->rfcomm_channel_number = record->hdr.rfcomm_channel_number;
+  fields->profile_version = record->hdr.profile_version;
+  if (record->hdr.service_name_length > 0)
+    fields->service_name = record->hdr.service_name;
+
+  switch (kind) {
+    case SDP_RECORD_KIND_MAS:
+      fields->params[0] = record->mas.mas_instance_id;
+      fields->params[1] = record->mas.supported_features;
+      fields->params[2] = record->mas.supported_message_types;
+      break;
+    case SDP_RECORD_KIND_MNS:
+      fields->params[0] = record->mns.supported_features;
+      break;
+    case SDP_RECORD_KIND_PSE:
+      fields->params[0] = record->pse.supported_features;
+      fields->params[1] = record->pse.supported_repositories;
+      break;
+    case SDP_RECORD_KIND_OPS:
+      fields->data = record->ops.supported_formats_list;
+      fields->data_len = record->ops.supported_formats_list_len;
+      break;
+    case SDP_RECORD_KIND_SAPS:
+      break;
+    case SDP_RECORD_KIND_RAW:
+      fields->data = record->hdr.user1_ptr;
+      fields->data_len = record->hdr.user1_ptr_len;
+      break;
+  }
+}
+
+/* Batched search. sdpSearchBatchNative runs one HAL search per UUID for a
+ * device, back to back, and packs every record found; Java receives them in
+ * a single sdpBatchRecordsFoundCallback once the last UUID completes. Only
+ * one batch runs at a time, as SdpManager never has more than one search
+ * outstanding. The callback carries the id SdpManager gave the batch, so
+ * results of a batch it has given up on are told apart. Each record is
+ * packed little endian as:
+ *   u8[16] uuid | u8 status | u8 more_results | u8 kind |
+ *   i32 l2cap_psm | i32 rfcomm_channel | i32 profile_version | i32[3] params |
+ *   u16 name_len | name | u16 data_len | data
+ * A UUID without records yields one entry carrying the search status.
+ */
+static struct {
+  std::mutex lock;
+  bool active;
+  jint id;
+  RawAddress bd_addr;
+  std::vector<uint8_t> uuids;
+  size_t next;
+  std::vector<uint8_t> packed;
+} sSdpBatch;
+
+static void sdp_batch_put_u16(std::vector<uint8_t>& out, uint16_t v) {
+  out.push_back(v & 0xFF);
+  out.push_back((v >> 8) & 0xFF);
+}
+
+static void sdp_batch_put_i32(std::vector<uint8_t>& out, jint v) {
+  uint32_t u = v;
+  for (int i = 0; i < 4; i++) out.push_back((u >> (8 * i)) & 0xFF);
+}
+
+static void sdp_batch_pack(std::vector<uint8_t>& out, const uint8_t* uuid,
+                           bt_status_t status, bool more_results,
+                           SdpRecordKind kind, const SdpRecordFields& fields) {
+  out.insert(out.end(), uuid, uuid + UUID_MAX_LENGTH);
+  out.push_back(status);
+  out.push_back(more_results);
+  out.push_back(kind);
+  sdp_batch_put_i32(out, fields.l2cap_psm);
+  sdp_batch_put_i32(out, fields.rfcomm_channel_number);
+  sdp_batch_put_i32(out, fields.profile_version);
+  for (jint param : fields.params) sdp_batch_put_i32(out, param);
+
+  size_t name_len = fields.service_name ? strlen(fields.service_name) : 0;
+  name_len = std::min(name_len, (size_t)UINT16_MAX);
+  sdp_batch_put_u16(out, name_len);
+  out.insert(out.end(), fields.service_name, fields.service_name + name_len);
+
+  size_t data_len = fields.data ? std::max(fields.data_len, 0) : 0;
+  data_len = std::min(data_len, (size_t)UINT16_MAX);
+  sdp_batch_put_u16(out, data_len);
+  out.insert(out.end(), fields.data, fields.data + data_len);
+}
+
+// Packs an error entry for every UUID of the batch that was not searched.
+// Must be called with sSdpBatch.lock held.
+static void sdp_batch_fail_remaining_locked(bt_status_t status) {
+  SdpRecordFields fields = {};
+  for (; sSdpBatch.next * UUID_MAX_LENGTH < sSdpBatch.uuids.size();
+       sSdpBatch.next++) {
+    const uint8_t* uuid = &sSdpBatch.uuids[sSdpBatch.next * UUID_MAX_LENGTH];
+    sdp_batch_pack(sSdpBatch.packed, uuid, status, false,
+                   sdp_record_kind(uuid), fields);
+  }
+}
+
+// Starts the search for the next UUID of the batch; on failure the rest of
+// the batch is failed. Returns false once nothing is left to search.
+// Must be called with sSdpBatch.lock held.
+static bool sdp_batch_search_next_locked() {
+  if (sSdpBatch.next * UUID_MAX_LENGTH >= sSdpBatch.uuids.size()) return false;
+
+  const uint8_t* uuid = &sSdpBatch.uuids[sSdpBatch.next * UUID_MAX_LENGTH];
+  int ret = sBluetoothSdpInterface
+                ? sBluetoothSdpInterface->sdp_search(&sSdpBatch.bd_addr, uuid)
+                : BT_STATUS_NOT_READY;
+  if (ret == BT_STATUS_SUCCESS) return true;
+
+  ALOGE("%s: SDP Search initialization failed: %d", __func__, ret);
+  sdp_batch_fail_remaining_locked((bt_status_t)ret);
+  return false;
+}
+
+/* Records the results of a batched search. Returns false if the results
+ * belong to a plain sdpSearchNative search. Otherwise the next UUID is
+ * searched, or the batch is complete and |packed| is filled. */
+static bool sdp_batch_on_results(bt_status_t status, const RawAddress& bd_addr,
+                                 const uint8_t* uuid_in, int count,
+                                 const bluetooth_sdp_record* records,
+                                 bool* complete, jint* id,
+                                 std::vector<uint8_t>* packed) {
+  std::lock_guard<std::mutex> lock(sSdpBatch.lock);
+  if (!sSdpBatch.active || bd_addr != sSdpBatch.bd_addr) return false;
+
+  size_t offset = sSdpBatch.next * UUID_MAX_LENGTH;
+  if (offset >= sSdpBatch.uuids.size() ||
+      !IS_UUID(&sSdpBatch.uuids[offset], uuid_in)) {
+    return false;
+  }
+
+  SdpRecordKind kind = sdp_record_kind(uuid_in);
+  SdpRecordFields fields = {};
+  if (count == 0) {
+    sdp_batch_pack(sSdpBatch.packed, uuid_in, status, false, kind, fields);
+  }
+  for (int i = 0; i < count; i++) {
+    sdp_record_fields(kind, &records[i], &fields);
+    sdp_batch_pack(sSdpBatch.packed, uuid_in, status, i < count - 1, kind,
+                   fields);
+  }
+  sSdpBatch.next++;
+
+  *complete = !sdp_batch_search_next_locked();
+  if (*complete) {
+    *id = sSdpBatch.id;
+    packed->swap(sSdpBatch.packed);
+    sSdpBatch.packed.clear();
+    sSdpBatch.uuids.clear();
+    sSdpBatch.active = false;
+  }
+  return true;
+}
+
+/* Search results are cached per (device, UUID) for
+ * persist.bt.sdp.cache_ttl_s seconds (0, the default, disables the cache) and
+ * persisted to SDP_CACHE_PATH so they survive a restart. SdpManager checks
+ * the cache with sdpGetCachedRecordsNative before searching over the air.
+ * Only searches that found records are cached; a device's entries are
+ * dropped when its bond is removed and when a profile fails to connect to a
+ * channel taken from them (sdpCacheInvalidateNative). The file is rewritten
+ * by the "BT SDP Cache" thread, so callers never wait for storage and bursts
+ * of changes share one write. Records are kept in the packed batch layout.
+ * The file holds
+ *   u32 magic | u32 version
+ * followed by entries of
+ *   u8[6] address | u8[16] uuid | i64 stored_at | u32 len | u8[len] records
+ */
+#define SDP_CACHE_PATH "/data/misc/bluedroid/sdp_cache.bin"
+#define SDP_CACHE_MAGIC 0x43504453 /* "SDPC" */
+#define SDP_CACHE_VERSION 1
+#define SDP_CACHE_MAX_ENTRIES 64
+#define SDP_CACHE_MAX_RECORDS_LEN 65536
+#define SDP_CACHE_DEFAULT_TTL_S 0
+
+typedef std::pair<RawAddress, std::array<uint8_t, UUID_MAX_LENGTH>>
+    SdpCacheKey;
+
+struct SdpCacheEntry {
+  int64_t stored_at;
+  std::vector<uint8_t> records;
+};
+
+typedef std::map<SdpCacheKey, SdpCacheEntry> SdpCacheEntries;
+
+static struct {
+  std::mutex lock;
+  std::condition_variable cv;
+  std::thread writer;
+  bool writer_running;
+  bool dirty;
+  int64_t ttl;
+  SdpCacheEntries entries;
+} sSdpCache;
+
+static SdpCacheKey sdp_cache_key(const RawAddress& bd_addr,
+                                 const uint8_t* uuid) {
+  SdpCacheKey key;
+  key.first = bd_addr;
+  memcpy(key.second.data(), uuid, UUID_MAX_LENGTH);
+  return key;
+}
+
+// Must be called with sSdpCache.lock held.
+static bool sdp_cache_expired_locked(const SdpCacheEntry& entry, int64_t now) {
+  return entry.stored_at > now || now - entry.stored_at >= sSdpCache.ttl;
+}
+
+// Must be called with sSdpCache.lock held.
+static void sdp_cache_load_locked() {
+  sSdpCache.entries.clear();
+
+  FILE* file = fopen(SDP_CACHE_PATH, "rb");
+  if (!file) return;
+
+  uint32_t header[2];
+  if (fread(header, sizeof(header), 1, file) != 1 ||
+      header[0] != SDP_CACHE_MAGIC || header[1] != SDP_CACHE_VERSION) {
+    ALOGW("%s: ignoring unknown cache file", __func__);
+    fclose(file);
+    return;
+  }
+
+  int64_t now = time(NULL);
+  while (sSdpCache.entries.size() < SDP_CACHE_MAX_ENTRIES) {
+    RawAddress bd_addr;
+    uint8_t uuid[UUID_MAX_LENGTH];
+    SdpCacheEntry entry;
+    uint32_t len;
+    if (fread(bd_addr.address, sizeof(bd_addr.address), 1, file) != 1 ||
+        fread(uuid, sizeof(uuid), 1, file) != 1 ||
+        fread(&entry.stored_at, sizeof(entry.stored_at), 1, file) != 1 ||
+        fread(&len, sizeof(len), 1, file) != 1 ||
+        len > SDP_CACHE_MAX_RECORDS_LEN) {
+      break;
+    }
+    entry.records.resize(len);
+    if (len && fread(entry.records.data(), len, 1, file) != 1) break;
+
+    if (sdp_cache_expired_locked(entry, now)) continue;
+    sSdpCache.entries[sdp_cache_key(bd_addr, uuid)] = std::move(entry);
+  }
+  fclose(file);
+  ALOGD("%s: loaded %zu entries", __func__, sSdpCache.entries.size());
+}
+
+static void sdp_cache_write(const SdpCacheEntries& entries) {
+  std::string tmp_path = std::string(SDP_CACHE_PATH) + ".tmp";
+  FILE* file = fopen(tmp_path.c_str(), "wb");
+  if (!file) {
+    ALOGE("%s: unable to open %s: %s", __func__, tmp_path.c_str(),
+          strerror(errno));
+    return;
+  }
+
+  uint32_t header[2] = {SDP_CACHE_MAGIC, SDP_CACHE_VERSION};
+  bool ok = fwrite(header, sizeof(header), 1, file) == 1;
+  for (const auto& it : entries) {
+    if (!ok) break;
+    uint32_t len = it.second.records.size();
+    ok = fwrite(it.first.first.address, sizeof(it.first.first.address), 1,
+                file) == 1 &&
+         fwrite(it.first.second.data(), UUID_MAX_LENGTH, 1, file) == 1 &&
+         fwrite(&it.second.stored_at, sizeof(it.second.stored_at), 1, file) ==
+             1 &&
+         fwrite(&len, sizeof(len), 1, file) == 1 &&
+         (len == 0 || fwrite(it.second.records.data(), len, 1, file) == 1);
+  }
+  if (fclose(file) != 0) ok = false;
+
+  if (!ok || rename(tmp_path.c_str(), SDP_CACHE_PATH) != 0) {
+    ALOGE("%s: unable to write %s", __func__, SDP_CACHE_PATH);
+    unlink(tmp_path.c_str());
+  }
+}
+
+// Writes a snapshot of the entries whenever they changed. Changes still
+// pending when the writer is stopped are written before it exits.
+static void sdp_cache_writer_run() {
+  std::unique_lock<std::mutex> lock(sSdpCache.lock);
+  while (true) {
+    sSdpCache.cv.wait(
+        lock, [] { return sSdpCache.dirty || !sSdpCache.writer_running; });
+    if (!sSdpCache.dirty) break;
+
+    sSdpCache.dirty = false;
+    SdpCacheEntries snapshot = sSdpCache.entries;
+    lock.unlock();
+    sdp_cache_write(snapshot);
+    lock.lock();
+  }
+}
+
+// Must be called with sSdpCache.lock held.
+static void sdp_cache_save_locked() {
+  if (!sSdpCache.writer_running) return;
+  sSdpCache.dirty = true;
+  sSdpCache.cv.notify_one();
+}
+
+static void sdp_cache_init() {
+  std::lock_guard<std::mutex> lock(sSdpCache.lock);
+  if (sSdpCache.writer_running) return;
+
+  sSdpCache.ttl = property_get_int32("persist.bt.sdp.cache_ttl_s",
+                                     SDP_CACHE_DEFAULT_TTL_S);
+  if (sSdpCache.ttl <= 0) {
+    sSdpCache.entries.clear();
+    return;
+  }
+
+  sdp_cache_load_locked();
+  sSdpCache.dirty = false;
+  sSdpCache.writer_running = true;
+  sSdpCache.writer = std::thread(sdp_cache_writer_run);
+}
+
+static void sdp_cache_cleanup() {
+  std::unique_lock<std::mutex> lock(sSdpCache.lock);
+  if (!sSdpCache.writer_running) return;
+  sSdpCache.writer_running = false;
+  sSdpCache.cv.notify_all();
+  lock.unlock();
+
+  sSdpCache.writer.join();
+}
+
+static void sdp_cache_store(bt_status_t status, const RawAddress& bd_addr,
+                            const uint8_t* uuid, int count,
+                            const bluetooth_sdp_record* records) {
+  if (status != BT_STATUS_SUCCESS || count <= 0) return;
+
+  SdpCacheEntry entry;
+  entry.stored_at = time(NULL);
+  SdpRecordKind kind = sdp_record_kind(uuid);
+  SdpRecordFields fields;
+  for (int i = 0; i < count; i++) {
+    sdp_record_fields(kind, &records[i], &fields);
+    sdp_batch_pack(entry.records, uuid, status, i < count - 1, kind, fields);
+  }
+  if (entry.records.size() > SDP_CACHE_MAX_RECORDS_LEN) return;
+
+  std::lock_guard<std::mutex> lock(sSdpCache.lock);
+  if (sSdpCache.ttl <= 0) return;
+
+  SdpCacheKey key = sdp_cache_key(bd_addr, uuid);
+  if (!sSdpCache.entries.count(key) &&
+      sSdpCache.entries.size() >= SDP_CACHE_MAX_ENTRIES) {
+    auto oldest = std::min_element(
+        sSdpCache.entries.begin(), sSdpCache.entries.end(),
+        [](const std::pair<const SdpCacheKey, SdpCacheEntry>& a,
+           const std::pair<const SdpCacheKey, SdpCacheEntry>& b) {
+          return a.second.stored_at < b.second.stored_at;
+        });
+    sSdpCache.entries.erase(oldest);
+  }
+  sSdpCache.entries[key] = std::move(entry);
+  sdp_cache_save_locked();
+}
+
+void sdpCacheInvalidate(const RawAddress& bd_addr) {
+  std::lock_guard<std::mutex> lock(sSdpCache.lock);
+  bool erased = false;
+  for (auto it = sSdpCache.entries.begin(); it != sSdpCache.entries.end();) {
+    if (it->first.first == bd_addr) {
+      it = sSdpCache.entries.erase(it);
+      erased = true;
+    } else {
+      ++it;
+    }
+  }
+  if (erased) sdp_cache_save_locked();
+}
+
+static void sdpCacheInvalidateNative(JNIEnv* env, jobject obj,
+                                     jbyteArray address) {
+  if (env->GetArrayLength(address) != (jsize)sizeof(RawAddress)) return;
+
+  RawAddress bd_addr;
+  env->GetByteArrayRegion(address, 0, sizeof(RawAddress),
+                          (jbyte*)bd_addr.address);
+  sdpCacheInvalidate(bd_addr);
+}
+
+/* Returns the cached records of all |uuids| in the packed batch layout, or
+ * NULL unless every one of them is cached and fresh. */
+static jbyteArray sdpGetCachedRecordsNative(JNIEnv* env, jobject obj,
+                                            jbyteArray address,
+                                            jbyteArray uuidsObj) {
+  jsize uuids_len = env->GetArrayLength(uuidsObj);
+  if (env->GetArrayLength(address) != (jsize)sizeof(RawAddress) ||
+      uuids_len == 0 || uuids_len % UUID_MAX_LENGTH != 0) {
+    return NULL;
+  }
+
+  RawAddress bd_addr;
+  env->GetByteArrayRegion(address, 0, sizeof(RawAddress),
+                          (jbyte*)bd_addr.address);
+  std::vector<uint8_t> uuids(uuids_len);
+  env->GetByteArrayRegion(uuidsObj, 0, uuids_len, (jbyte*)uuids.data());
+
+  std::vector<uint8_t> packed;
+  {
+    std::lock_guard<std::mutex> lock(sSdpCache.lock);
+    if (sSdpCache.ttl <= 0) return NULL;
+
+    int64_t now = time(NULL);
+    for (jsize offset = 0; offset < uuids_len; offset += UUID_MAX_LENGTH) {
+      auto it = sSdpCache.entries.find(sdp_cache_key(bd_addr, &uuids[offset]));
+      if (it == sSdpCache.entries.end()) return NULL;
+      if (sdp_cache_expired_locked(it->second, now)) {
+        sSdpCache.entries.erase(it);
+        return NULL;
+      }
+      packed.insert(packed.end(), it->second.records.begin(),
+                    it->second.records.end());
+    }
+  }
+
+  jbyteArray records = env->NewByteArray(packed.size());
+  if (!records) return NULL;
+  env->SetByteArrayRegion(records, 0, packed.size(),
+                          (const jbyte*)packed.data());
+  return records;
+}
+
+static void sdp_batch_deliver(CallbackEnv& sCallbackEnv, jint id,
+                              jbyteArray addr,
+                              const std::vector<uint8_t>& packed) {
+  ScopedLocalRef<jbyteArray> records(sCallbackEnv.get(),
+                                     sCallbackEnv->NewByteArray(packed.size()));
+  if (!records.get()) return;
+  sCallbackEnv->SetByteArrayRegion(records.get(), 0, packed.size(),
+                                   (const jbyte*)packed.data());
+  sCallbackEnv->CallVoidMethod(sCallbacksObj,
+                               method_sdpBatchRecordsFoundCallback, id, addr,
+                               records.get());
+}
+
+static jboolean sdpSearchBatchNative(JNIEnv* env, jobject obj,
+                                     jbyteArray address, jbyteArray uuidsObj,
+                                     jint id) {
+  ALOGD("%s", __func__);
+
+  if (!sBluetoothSdpInterface) return JNI_FALSE;
+
+  jsize uuids_len = env->GetArrayLength(uuidsObj);
+  if (env->GetArrayLength(address) != (jsize)sizeof(RawAddress) ||
+      uuids_len == 0 || uuids_len % UUID_MAX_LENGTH != 0) {
+    jniThrowIOException(env, EINVAL);
+    return JNI_FALSE;
+  }
+
+  std::lock_guard<std::mutex> lock(sSdpBatch.lock);
+  if (sSdpBatch.active) {
+    ALOGE("%s: a batched search is already running", __func__);
+    return JNI_FALSE;
+  }
+
+  env->GetByteArrayRegion(address, 0, sizeof(RawAddress),
+                          (jbyte*)sSdpBatch.bd_addr.address);
+  sSdpBatch.uuids.resize(uuids_len);
+  env->GetByteArrayRegion(uuidsObj, 0, uuids_len,
+                          (jbyte*)sSdpBatch.uuids.data());
+  sSdpBatch.id = id;
+  sSdpBatch.next = 0;
+  sSdpBatch.packed.clear();
+
+  int ret = sBluetoothSdpInterface->sdp_search(&sSdpBatch.bd_addr,
+                                               sSdpBatch.uuids.data());
+  if (ret != BT_STATUS_SUCCESS) {
+    ALOGE("SDP Search initialization failed: %d", ret);
+    sSdpBatch.uuids.clear();
+    return JNI_FALSE;
+  }
+
+  sSdpBatch.active = true;
+  return JNI_TRUE;
+}
+
 static void sdp_search_callback(bt_status_t status, RawAddress* bd_addr,
                                 uint8_t* uuid_in, int count,
                                 bluetooth_sdp_record* records) {
@@ -153,96 +703,99 @@ static void sdp_search_callback(bt_status_t status, RawAddress* bd_addr,
   if (!sCallbackEnv.valid()) return;
 
   ScopedLocalRef<jbyteArray> addr(
-      sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(RawAddress)));
+      sCallbackEnv.get(), getAddressByteArray(sCallbackEnv.get(), *bd_addr));
   if (!addr.get()) return;
 
+  ALOGD("%s: Status is: %d, Record count: %d", __func__, status, count);
+
+  sdp_cache_store(status, *bd_addr, uuid_in, count, records);
+
+  bool batch_complete = false;
+  jint batch_id = 0;
+  std::vector<uint8_t> batch_records;
+  if (sdp_batch_on_results(status, *bd_addr, uuid_in, count, records,
+                           &batch_complete, &batch_id, &batch_records)) {
+    if (batch_complete)
+      sdp_batch_deliver(sCallbackEnv, batch_id, addr.get(), batch_records);
+    return;
+  }
+
   ScopedLocalRef<jbyteArray> uuid(
       sCallbackEnv.get(), sCallbackEnv->NewByteArray(sizeof(bt_uuid_t)));
   if (!uuid.get()) return;
 
-  sCallbackEnv->SetByteArrayRegion(addr.get(), 0, sizeof(RawAddress),
-                                   (jbyte*)bd_addr);
   sCallbackEnv->SetByteArrayRegion(uuid.get(), 0, sizeof(bt_uuid_t),
                                    (jbyte*)uuid_in);
 
-  ALOGD("%s: Status is: %d, Record count: %d", __func__, status, count);
+  SdpRecordKind kind = sdp_record_kind(uuid_in);
+  const bluetooth_sdp_record empty_record = {};
 
   // Ensure we run the loop at least once, to also signal errors if they occur
   for (int i = 0; i < count || i == 0; i++) {
     bool more_results = (i < (count - 1)) ? true : false;
-    bluetooth_sdp_record* record = &records[i];
+    const bluetooth_sdp_record* record = i < count ? &records[i] : &empty_record;
+    SdpRecordFields fields;
+    sdp_record_fields(kind, record, &fields);
+
     ScopedLocalRef<jstring> service_name(sCallbackEnv.get(), NULL);
-    if (record->hdr.service_name_length > 0) {
-      ALOGD("%s, ServiceName:  %s", __func__, record->mas.hdr.service_name);
+    if (fields.service_name) {
+      ALOGD("%s, ServiceName:  %s", __func__, fields.service_name);
       service_name.reset(
-          (jstring)sCallbackEnv->NewStringUTF(record->mas.hdr.service_name));
+          (jstring)sCallbackEnv->NewStringUTF(fields.service_name));
+    }
+
+    ScopedLocalRef<jbyteArray> data(sCallbackEnv.get(), NULL);
+    if (kind == SDP_RECORD_KIND_OPS || kind == SDP_RECORD_KIND_RAW) {
+      data.reset(sCallbackEnv->NewByteArray(fields.data_len));
+      if (!data.get()) return;
+      sCallbackEnv->SetByteArrayRegion(data.get(), 0, fields.data_len,
+                                       (const jbyte*)fields.data);
     }
 
     /* call the right callback according to the uuid*/
-    if (IS_UUID(UUID_MAP_MAS, uuid_in)) {
-      sCallbackEnv->CallVoidMethod(
-          sCallbacksObj, method_sdpMasRecordFoundCallback, (jint)status,
-          addr.get(), uuid.get(), (jint)record->mas.mas_instance_id,
-          (jint)record->mas.hdr.l2cap_psm,
-          (jint)record->mas.hdr.rfcomm_channel_number,
-          (jint)record->mas.hdr.profile_version,
-          (jint)record->mas.supported_features,
-          (jint)record->mas.supported_message_types, service_name.get(),
-          more_results);
-
-    } else if (IS_UUID(UUID_MAP_MNS, uuid_in)) {
-      sCallbackEnv->CallVoidMethod(
-          sCallbacksObj, method_sdpMnsRecordFoundCallback, (jint)status,
-          addr.get(), uuid.get(), (jint)record->mns.hdr.l2cap_psm,
-          (jint)record->mns.hdr.rfcomm_channel_number,
-          (jint)record->mns.hdr.profile_version,
-          (jint)record->mns.supported_features, service_name.get(),
-          more_results);
-
-    } else if (IS_UUID(UUID_PBAP_PSE, uuid_in)) {
-      sCallbackEnv->CallVoidMethod(
-          sCallbacksObj, method_sdpPseRecordFoundCallback, (jint)status,
-          addr.get(), uuid.get(), (jint)record->pse.hdr.l2cap_psm,
-          (jint)record->pse.hdr.rfcomm_channel_number,
-          (jint)record->pse.hdr.profile_version,
-          (jint)record->pse.supported_features,
-          (jint)record->pse.supported_repositories, service_name.get(),
-          more_results);
-
-    } else if (IS_UUID(UUID_OBEX_OBJECT_PUSH, uuid_in)) {
-      jint formats_list_size = record->ops.supported_formats_list_len;
-      ScopedLocalRef<jbyteArray> formats_list(
-          sCallbackEnv.get(), sCallbackEnv->NewByteArray(formats_list_size));
-      if (!formats_list.get()) return;
-      sCallbackEnv->SetByteArrayRegion(
-          formats_list.get(), 0, formats_list_size,
-          (jbyte*)record->ops.supported_formats_list);
-
-      sCallbackEnv->CallVoidMethod(
-          sCallbacksObj, method_sdpOppOpsRecordFoundCallback, (jint)status,
-          addr.get(), uuid.get(), (jint)record->ops.hdr.l2cap_psm,
-          (jint)record->ops.hdr.rfcomm_channel_number,
-          (jint)record->ops.hdr.profile_version, service_name.get(),
-          formats_list.get(), more_results);
-
-    } else if (IS_UUID(UUID_SAP, uuid_in)) {
-      sCallbackEnv->CallVoidMethod(
-          sCallbacksObj, method_sdpSapsRecordFoundCallback, (jint)status,
-          addr.get(), uuid.get(), (jint)record->mas.hdr.rfcomm_channel_number,
-          (jint)record->mas.hdr.profile_version, service_name.get(),
-          more_results);
-    } else {
-      // we don't have a wrapper for this uuid, send as raw data
-      jint record_data_size = record->hdr.user1_ptr_len;
-      ScopedLocalRef<jbyteArray> record_data(
-          sCallbackEnv.get(), sCallbackEnv->NewByteArray(record_data_size));
-      if (!record_data.get()) return;
-
-      sCallbackEnv->SetByteArrayRegion(record_data.get(), 0, record_data_size,
-                                       (jbyte*)record->hdr.user1_ptr);
-      sCallbackEnv->CallVoidMethod(sCallbacksObj, method_sdpRecordFoundCallback,
-                                   (jint)status, addr.get(), uuid.get(),
-                                   record_data_size, record_data.get());
+    switch (kind) {
+      case SDP_RECORD_KIND_MAS:
+        sCallbackEnv->CallVoidMethod(
+            sCallbacksObj, method_sdpMasRecordFoundCallback, (jint)status,
+            addr.get(), uuid.get(), fields.params[0], fields.l2cap_psm,
+            fields.rfcomm_channel_number, fields.profile_version,
+            fields.params[1], fields.params[2], service_name.get(),
+            more_results);
+        break;
+      case SDP_RECORD_KIND_MNS:
+        sCallbackEnv->CallVoidMethod(
+            sCallbacksObj, method_sdpMnsRecordFoundCallback, (jint)status,
+            addr.get(), uuid.get(), fields.l2cap_psm,
+            fields.rfcomm_channel_number, fields.profile_version,
+            fields.params[0], service_name.get(), more_results);
+        break;
+      case SDP_RECORD_KIND_PSE:
+        sCallbackEnv->CallVoidMethod(
+            sCallbacksObj, method_sdpPseRecordFoundCallback, (jint)status,
+            addr.get(), uuid.get(), fields.l2cap_psm,
+            fields.rfcomm_channel_number, fields.profile_version,
+            fields.params[0], fields.params[1], service_name.get(),
+            more_results);
+        break;
+      case SDP_RECORD_KIND_OPS:
+        sCallbackEnv->CallVoidMethod(
+            sCallbacksObj, method_sdpOppOpsRecordFoundCallback, (jint)status,
+            addr.get(), uuid.get(), fields.l2cap_psm,
+            fields.rfcomm_channel_number, fields.profile_version,
+            service_name.get(), data.get(), more_results);
+        break;
+      case SDP_RECORD_KIND_SAPS:
+        sCallbackEnv->CallVoidMethod(
+            sCallbacksObj, method_sdpSapsRecordFoundCallback, (jint)status,
+            addr.get(), uuid.get(), fields.rfcomm_channel_number,
+            fields.profile_version, service_name.get(), more_results);
+        break;
+      case SDP_RECORD_KIND_RAW:
+        // we don't have a wrapper for this uuid, send as raw data
+        sCallbackEnv->CallVoidMethod(
+            sCallbacksObj, method_sdpRecordFoundCallback, (jint)status,
+            addr.get(), uuid.get(), fields.data_len, data.get());
+        break;
     }
   }  // End of for-loop
 }
@@ -473,6 +1026,15 @@ static void cleanupNative(JNIEnv* env, jobject object) {
     sBluetoothSdpInterface = NULL;
   }
 
+  {
+    std::lock_guard<std::mutex> lock(sSdpBatch.lock);
+    sSdpBatch.active = false;
+    sSdpBatch.uuids.clear();
+    sSdpBatch.packed.clear();
+  }
+
+  sdp_cache_cleanup();
+
   if (sCallbacksObj != NULL) {
     ALOGW("Cleaning up Bluetooth SDP object");
     env->DeleteGlobalRef(sCallbacksObj);
@@ -486,6 +1048,9 @@ static JNINativeMethod sMethods[] = {
     {"initializeNative", "()V", (void*)initializeNative},
     {"cleanupNative", "()V", (void*)cleanupNative},
     {"sdpSearchNative", "([B[B)Z", (void*)sdpSearchNative},
+    {"sdpSearchBatchNative", "([B[BI)Z", (void*)sdpSearchBatchNative},
+    {"sdpGetCachedRecordsNative", "([B[B)[B", (void*)sdpGetCachedRecordsNative},
+    {"sdpCacheInvalidateNative", "([B)V", (void*)sdpCacheInvalidateNative},
     {"sdpCreateMapMasRecordNative", "(Ljava/lang/String;IIIIII)I",
      (void*)sdpCreateMapMasRecordNative},
     {"sdpCreateMapMnsRecordNative", "(Ljava/lang/String;IIII)I",
@@ -395,7 +395,7 @@ public final class Avrcp {
     private Avrcp(Context context, A2dpService svc, int maxConnections ) {
         if (DEBUG) Log.v(TAG, "Avrcp");
         mAdapter = BluetoothAdapter.getDefaultAdapter();
-        mMediaAttributes = new MediaAttributes(null);
+        setMediaAttributes(new MediaAttributes(null));
         mLastQueueId = MediaSession.QueueItem.UNKNOWN_ID;
         mLastStateUpdate = -1L;
         mSongLengthMs = 0L;
@@ -1692,6 +1692,15 @@ public final class Avrcp {
         }
     }
 
+    /*
+     * GetElementAttributes responses are built from mMediaAttributes and cached
+     * natively, so every replacement must drop the native cache.
+     */
+    private void setMediaAttributes(MediaAttributes attributes) {
+        mMediaAttributes = attributes;
+        invalidateElementAttrCacheNative();
+    }
+
     private void updateCurrentMediaState(BluetoothDevice device) {
         // Only do player updates when we aren't registering for track changes.
         MediaAttributes currentAttributes;
@@ -1862,7 +1871,7 @@ public final class Avrcp {
                 }
 
                 Log.v(TAG, "Send track changed");
-                mMediaAttributes = currentAttributes;
+                setMediaAttributes(currentAttributes);
                 mLastQueueId = newQueueId;
             }
         } else {
@@ -3625,6 +3634,7 @@ public final class Avrcp {
                     mMediaController.unregisterCallback(mMediaControllerCb);
                 }
                 mMediaController = newController;
+                invalidateElementAttrCacheNative();
                 if (mMediaController != null) {
                     mMediaController.registerCallback(mMediaControllerCb, mHandler);
                 } else {
@@ -3838,6 +3848,7 @@ public final class Avrcp {
         if (rc_connected) {
             setAvrcpConnectedDevice(device);
         } else {
+            invalidateElementAttrCacheNative();
             setAvrcpDisconnectedDevice(device);
         }
     }
@@ -4102,11 +4113,9 @@ public final class Avrcp {
 
         public void folderItemsRsp(byte[] address, int rspStatus, FolderItemsRsp rspObj) {
             if (rspObj != null && rspStatus == AvrcpConstants.RSP_NO_ERROR) {
-                if (!getFolderItemsRspNative(address, rspStatus, sUIDCounter, rspObj.mScope,
-                        rspObj.mNumItems, rspObj.mFolderTypes, rspObj.mPlayable, rspObj.mItemTypes,
-                        rspObj.mItemUid, rspObj.mDisplayNames, rspObj.mAttributesNum,
-                        rspObj.mAttrIds, rspObj.mAttrValues))
-                    Log.e(TAG, "getFolderItemsRspNative failed!");
+                if (!getFolderItemsPackedRspNative(address, rspStatus, sUIDCounter,
+                        rspObj.mScope, rspObj.mNumItems, rspObj.pack()))
+                    Log.e(TAG, "getFolderItemsPackedRspNative failed!");
             } else {
                 Log.e(TAG, "folderItemsRsp: rspObj is null or rspStatus is error:" + rspStatus);
                 if (!getFolderItemsRspNative(address, rspStatus, sUIDCounter, (byte) 0x00, 0,
@@ -4534,6 +4543,9 @@ public final class Avrcp {
             byte scope, int numItems, byte[] folderTypes, byte[] playable, byte[] itemTypes,
             byte[] itemUidArray, String[] textArray, int[] AttributesNum, int[] AttributesIds,
             String[] attributesArray);
+    private native void invalidateElementAttrCacheNative();
+    private native boolean getFolderItemsPackedRspNative(byte[] address, int rspStatus,
+            short uidCounter, byte scope, int numItems, byte[] packedItems);
     private native boolean getListPlayerappAttrRspNative(byte attr,
             byte[] attrIds, byte[] address);
     private native boolean getPlayerAppValueRspNative(byte numberattr,
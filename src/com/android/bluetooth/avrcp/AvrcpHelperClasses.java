@@ -22,10 +22,15 @@ import android.media.session.MediaSession;
 
 import com.android.bluetooth.Utils;
 
+import java.io.ByteArrayOutputStream;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.charset.StandardCharsets;
 import java.util.List;
 import java.util.Arrays;
 import java.util.ArrayDeque;
 import java.util.Collection;
+import java.util.HashMap;
 
 /*************************************************************************************************
  * Helper classes used for callback/response of browsing commands:-
@@ -179,6 +184,70 @@ class FolderItemsRsp {
         this.mAttrIds = AttrIds;
         this.mAttrValues = attrValues;
     }
+
+    /* Length of one item and one attribute entry in the packed layout */
+    private static final int PACKED_ITEM_LEN = 8 + AvrcpConstants.UID_SIZE;
+    private static final int PACKED_ATTR_LEN = 8;
+
+    /**
+     * Serializes the items for getFolderItemsPackedRspNative: an item table, an attribute
+     * table and a pool of length prefixed UTF-8 strings, all little-endian. Identical strings
+     * (e.g. a shared album or artist name) are stored once in the pool.
+     */
+    byte[] pack() {
+        int numAttrs = 0;
+        for (int i = 0; i < mNumItems; i++) {
+            if (mItemTypes[i] == AvrcpConstants.BTRC_ITEM_MEDIA && mAttributesNum != null) {
+                numAttrs += mAttributesNum[i];
+            }
+        }
+
+        ByteArrayOutputStream pool = new ByteArrayOutputStream();
+        HashMap<String, Integer> poolOffsets = new HashMap<String, Integer>();
+        ByteBuffer tables = ByteBuffer.allocate(mNumItems * PACKED_ITEM_LEN
+                + numAttrs * PACKED_ATTR_LEN).order(ByteOrder.LITTLE_ENDIAN);
+        ByteBuffer attrs = tables.duplicate().order(ByteOrder.LITTLE_ENDIAN);
+        attrs.position(mNumItems * PACKED_ITEM_LEN);
+
+        int attrIndex = 0;
+        for (int i = 0; i < mNumItems; i++) {
+            int itemAttrs = 0;
+            if (mItemTypes[i] == AvrcpConstants.BTRC_ITEM_MEDIA && mAttributesNum != null) {
+                itemAttrs = mAttributesNum[i];
+            }
+            tables.put(mItemTypes[i]);
+            tables.put(mFolderTypes[i]);
+            tables.put(mPlayable[i]);
+            tables.put((byte) itemAttrs);
+            tables.put(mItemUid, i * AvrcpConstants.UID_SIZE, AvrcpConstants.UID_SIZE);
+            tables.putInt(poolString(pool, poolOffsets, mDisplayNames[i]));
+
+            for (int j = 0; j < itemAttrs; j++, attrIndex++) {
+                attrs.putInt(mAttrIds[attrIndex]);
+                attrs.putInt(poolString(pool, poolOffsets, mAttrValues[attrIndex]));
+            }
+        }
+
+        byte[] packed = Arrays.copyOf(tables.array(), tables.capacity() + pool.size());
+        System.arraycopy(pool.toByteArray(), 0, packed, tables.capacity(), pool.size());
+        return packed;
+    }
+
+    private static int poolString(ByteArrayOutputStream pool, HashMap<String, Integer> offsets,
+            String str) {
+        if (str == null) str = "";
+        Integer offset = offsets.get(str);
+        if (offset != null) return offset;
+
+        byte[] utf8 = str.getBytes(StandardCharsets.UTF_8);
+        int len = Math.min(utf8.length, 0xFFFF);
+        offset = pool.size();
+        pool.write(len & 0xFF);
+        pool.write((len >> 8) & 0xFF);
+        pool.write(utf8, 0, len);
+        offsets.put(str, offset);
+        return offset;
+    }
 }
 
 class ItemAttrRsp {
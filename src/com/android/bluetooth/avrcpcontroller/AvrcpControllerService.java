@@ -37,6 +37,9 @@ import android.util.Log;
 import com.android.bluetooth.Utils;
 import com.android.bluetooth.btservice.ProfileService;
 
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.charset.StandardCharsets;
 import java.util.ArrayList;
 import java.util.Arrays;
 import java.util.HashMap;
@@ -85,6 +88,17 @@ public class AvrcpControllerService extends ProfileService {
     private static final int JNI_FOLDER_TYPE_PLAYLISTS = 0x05;
     private static final int JNI_FOLDER_TYPE_YEARS = 0x06;
 
+    /*
+     * Browsing item types
+     * This should be kept in sync with BTRC_ITEM_* in bt_rc.h
+     */
+    private static final int JNI_ITEM_TYPE_FOLDER = 0x02;
+    private static final int JNI_ITEM_TYPE_MEDIA = 0x03;
+    private static final int JNI_UID_SIZE = 8;
+
+    /* Length of a packed item from getFolderItemsPageNative, without its name */
+    private static final int JNI_PACKED_ITEM_HEADER_LEN = 3 + JNI_UID_SIZE + 2;
+
     /*
      * AVRCP Error types as defined in spec. Also they should be in sync with btrc_status_t.
      * NOTE: Not all may be defined.
@@ -947,14 +961,15 @@ public class AvrcpControllerService extends ProfileService {
     }
 
     // Browsing related JNI callbacks.
-    void handleGetFolderItemsRsp(int status, MediaItem[] items) {
+    void handleGetFolderItemsPage(int status, int handle, int count) {
         if (DBG) {
-            Log.d(TAG, "handleGetFolderItemsRsp called with status " + status +
-                " items "  + items.length + " items.");
+            Log.d(TAG, "handleGetFolderItemsPage called with status " + status +
+                " handle " + handle + " items " + count);
         }
 
         if (status == JNI_AVRC_INV_RANGE) {
             Log.w(TAG, "Sending out of range message.");
+            releaseFolderItemsNative(handle);
             // Send a special message since this could be used by state machine
             // to take as a signal that fetch is finished.
             Message msg = mAvrcpCtSm.obtainMessage(AvrcpControllerStateMachine.
@@ -963,20 +978,45 @@ public class AvrcpControllerService extends ProfileService {
             return;
         }
 
-        for (MediaItem item : items) {
-            if (DBG) {
-                Log.d(TAG, "media item: " + item + " uid: " + item.getDescription().getMediaId());
-            }
-        }
-        ArrayList<MediaItem> itemsList = new ArrayList<>();
-        for (MediaItem item : items) {
-            itemsList.add(item);
-        }
+        // The items stay in native memory until the state machine reads them.
         Message msg = mAvrcpCtSm.obtainMessage(AvrcpControllerStateMachine.
-            MESSAGE_PROCESS_GET_FOLDER_ITEMS, itemsList);
+            MESSAGE_PROCESS_GET_FOLDER_ITEMS, handle, count);
         mAvrcpCtSm.sendMessage(msg);
     }
 
+    /**
+     * Materializes a page of folder items handed over by handleGetFolderItemsPage and
+     * releases its native storage.
+     */
+    static ArrayList<MediaItem> readFolderItemsPage(int handle, int count) {
+        ArrayList<MediaItem> items = new ArrayList<>(count);
+        byte[] packed = getFolderItemsPageNative(handle, 0, count);
+        releaseFolderItemsNative(handle);
+        if (packed == null) {
+            Log.e(TAG, "readFolderItemsPage: page " + handle + " is gone");
+            return items;
+        }
+
+        ByteBuffer buf = ByteBuffer.wrap(packed).order(ByteOrder.LITTLE_ENDIAN);
+        while (buf.remaining() >= JNI_PACKED_ITEM_HEADER_LEN) {
+            int itemType = buf.get();
+            int type = buf.get() & 0xFF;
+            int playable = buf.get() & 0xFF;
+            byte[] uid = new byte[JNI_UID_SIZE];
+            buf.get(uid);
+            int nameLen = buf.getShort() & 0xFFFF;
+            String name = new String(packed, buf.position(), nameLen, StandardCharsets.UTF_8);
+            buf.position(buf.position() + nameLen);
+
+            if (itemType == JNI_ITEM_TYPE_MEDIA) {
+                items.add(createFromNativeMediaItem(uid, type, name, null, null));
+            } else if (itemType == JNI_ITEM_TYPE_FOLDER) {
+                items.add(createFromNativeFolderItem(uid, type, name, playable));
+            }
+        }
+        return items;
+    }
+
     void handleGetPlayerItemsRsp(AvrcpPlayer[] items) {
         if (DBG) {
             Log.d(TAG, "handleGetFolderItemsRsp called with " + items.length + " items.");
@@ -997,7 +1037,7 @@ public class AvrcpControllerService extends ProfileService {
     }
 
     // JNI Helper functions to convert native objects to java.
-    MediaItem createFromNativeMediaItem(
+    static MediaItem createFromNativeMediaItem(
             byte[] uid, int type, String name, int[] attrIds, String[] attrVals) {
         if (DBG) {
             Log.d(TAG, "createFromNativeMediaItem uid: " + uid + " type " + type + " name " +
@@ -1022,7 +1062,7 @@ public class AvrcpControllerService extends ProfileService {
         return new MediaItem(mdb.build(), MediaItem.FLAG_PLAYABLE);
     }
 
-    MediaItem createFromNativeFolderItem(
+    static MediaItem createFromNativeFolderItem(
             byte[] uid, int type, String name, int playable) {
         if (DBG) {
             Log.d(TAG, "createFromNativeFolderItem uid: " + uid + " type " + type +
@@ -1151,4 +1191,6 @@ public class AvrcpControllerService extends ProfileService {
         byte[] address, byte scope, byte[] uid, int uidCounter);
     native static void setBrowsedPlayerNative(byte[] address, int playerId);
     native static void setAddressedPlayerNative(byte[] address, int playerId);
+    native static byte[] getFolderItemsPageNative(int handle, int start, int count);
+    native static void releaseFolderItemsNative(int handle);
 }
@@ -204,6 +204,11 @@ class AvrcpControllerStateMachine extends StateMachine {
                     }
                     break;
 
+                case MESSAGE_PROCESS_GET_FOLDER_ITEMS:
+                    // The native page outlives the connection unless released here.
+                    AvrcpControllerService.releaseFolderItemsNative(msg.arg1);
+                    break;
+
                 default:
                     Log.w(TAG,"Currently Disconnected not handling " + dumpMessageString(msg.what));
                     return false;
@@ -448,6 +453,12 @@ class AvrcpControllerStateMachine extends StateMachine {
                         }
                         break;
 
+                    case MESSAGE_PROCESS_GET_FOLDER_ITEMS:
+                        // A page for a fetch that already ended; nobody will read it.
+                        Log.w(TAG, "Dropping stale folder items page " + msg.arg1);
+                        AvrcpControllerService.releaseFolderItemsNative(msg.arg1);
+                        break;
+
                     default:
                         return false;
                 }
@@ -570,7 +581,8 @@ class AvrcpControllerStateMachine extends StateMachine {
             Log.d(STATE_TAG, "processMessage " + msg);
             switch (msg.what) {
                 case MESSAGE_PROCESS_GET_FOLDER_ITEMS:
-                    ArrayList<MediaItem> folderList = (ArrayList<MediaItem>) msg.obj;
+                    ArrayList<MediaItem> folderList =
+                        AvrcpControllerService.readFolderItemsPage(msg.arg1, msg.arg2);
                     mFolderList.addAll(folderList);
                     if (DBG) {
                         Log.d(STATE_TAG, "Start " + mStartInd + " End " + mEndInd + " Curr " +
@@ -2497,6 +2497,9 @@ public class AdapterService extends Service {
     private native void interopDatabaseClearNative();
     private native void interopDatabaseAddNative(int feature, byte[] address, int length);
 
+    /*package*/ native void forgetRemoteDevicePropertiesNative(byte[] address);
+    /*package*/ native byte[] drainDiscoveryResultsNative();
+
     protected void finalize() {
         debugLog("finalize() - clean up object " + this);
         cleanup();
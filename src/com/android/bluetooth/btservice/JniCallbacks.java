@@ -50,12 +50,12 @@ final class JniCallbacks {
         mBondStateMachine.sspRequestCallback(address, name, cod, pairingVariant,
             passkey);
     }
-    void devicePropertyChangedCallback(byte[] address, int[] types, byte[][] val) {
-        mRemoteDevices.devicePropertyChangedCallback(address, types, val);
+    void devicePropertiesChangedCallback(byte[] address, byte[] packed) {
+        mRemoteDevices.devicePropertiesChangedCallback(address, packed);
     }
 
-    void deviceFoundCallback(byte[] address) {
-        mRemoteDevices.deviceFoundCallback(address);
+    void discoveryResultsPendingCallback(boolean full) {
+        mRemoteDevices.discoveryResultsPendingCallback(full);
     }
 
     void pinRequestCallback(byte[] address, byte[] name, int cod, boolean min16Digits) {
@@ -74,8 +74,15 @@ final class JniCallbacks {
         mAdapterStateMachine.stateChangeCallback(status);
     }
 
-    void discoveryStateChangeCallback(int state) {
-        mAdapterProperties.discoveryStateChangeCallback(state);
+    void discoveryStateChangeCallback(final int state) {
+        // Report the last inquiry results before discovery is seen as finished
+        final AdapterProperties adapterProperties = mAdapterProperties;
+        mRemoteDevices.postAfterDiscoveryResults(new Runnable() {
+            @Override
+            public void run() {
+                adapterProperties.discoveryStateChangeCallback(state);
+            }
+        });
     }
 
     void adapterPropertyChangedCallback(int[] types, byte[][] val) {
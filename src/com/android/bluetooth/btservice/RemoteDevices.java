@@ -29,6 +29,7 @@ import android.content.IntentFilter;
 import android.os.Handler;
 import android.os.Message;
 import android.os.ParcelUuid;
+import android.os.SystemProperties;
 import android.support.annotation.VisibleForTesting;
 import android.util.Log;
 import com.android.bluetooth.R;
@@ -36,6 +37,7 @@ import com.android.bluetooth.Utils;
 import com.android.bluetooth.hfp.HeadsetHalConstants;
 
 import java.util.ArrayList;
+import java.util.Arrays;
 import java.util.HashMap;
 import java.util.LinkedList;
 import java.util.Queue;
@@ -46,6 +48,11 @@ final class RemoteDevices {
 
     // Maximum number of device properties to remember
     private static final int MAX_DEVICE_QUEUE_SIZE = 200;
+    // Header of one property in devicePropertiesChangedCallback: u32 type | u16 length
+    private static final int PACKED_PROPERTY_HEADER_LEN = 6;
+    // Header of one drained inquiry result: u8[6] address | u16 length
+    private static final int BD_ADDR_LEN = 6;
+    private static final int PACKED_RESULT_HEADER_LEN = BD_ADDR_LEN + 2;
 
     private static BluetoothAdapter mAdapter;
     private static AdapterService mAdapterService;
@@ -54,6 +61,12 @@ final class RemoteDevices {
 
     private static final int UUID_INTENT_DELAY = 6000;
     private static final int MESSAGE_UUID_INTENT = 1;
+    private static final int MESSAGE_DRAIN_DISCOVERY_RESULTS = 2;
+
+    // Inquiry results for the same device arriving within this window are
+    // merged natively and reported once.
+    private static final int DEFAULT_DISCOVERY_WINDOW_MS = 500;
+    private final int mDiscoveryWindowMs;
 
     private final HashMap<String, DeviceProperties> mDevices;
     private Queue<String> mDeviceQueue;
@@ -85,6 +98,8 @@ final class RemoteDevices {
         mSdpTracker = new ArrayList<BluetoothDevice>();
         mDevices = new HashMap<String, DeviceProperties>();
         mDeviceQueue = new LinkedList<String>();
+        mDiscoveryWindowMs = Math.max(0, SystemProperties.getInt(
+                "persist.bt.discovery.window_ms", DEFAULT_DISCOVERY_WINDOW_MS));
     }
 
     /**
@@ -122,8 +137,12 @@ final class RemoteDevices {
         if (mDevices != null)
             mDevices.clear();
 
+        mAdapterService.forgetRemoteDevicePropertiesNative(null);
+
         if (mDeviceQueue != null)
             mDeviceQueue.clear();
+
+        mHandler.removeMessages(MESSAGE_DRAIN_DISCOVERY_RESULTS);
     }
 
     @Override
@@ -154,6 +173,11 @@ final class RemoteDevices {
             prop.mAddress = address;
             String key = Utils.getAddressStringFromByte(address);
             DeviceProperties pv = mDevices.put(key, prop);
+            if (pv != null) {
+                // The native layer only forwards changed properties; make it
+                // deliver everything again for the fresh record.
+                mAdapterService.forgetRemoteDevicePropertiesNative(address);
+            }
 
             if (pv == null) {
                 mDeviceQueue.offer(key);
@@ -164,6 +188,8 @@ final class RemoteDevices {
                     }
                     debugLog("Removing device " + deleteKey + " from property map");
                     mDevices.remove(deleteKey);
+                    mAdapterService.forgetRemoteDevicePropertiesNative(
+                            Utils.getBytesFromAddress(deleteKey));
                 }
             }
             return prop;
@@ -506,6 +532,94 @@ final class RemoteDevices {
         }
     }
 
+    /**
+     * Applies the properties the native layer found changed, each stored as
+     * u32 type | u16 length | value (little endian).
+     */
+    void devicePropertiesChangedCallback(byte[] address, byte[] packed) {
+        devicePropertiesChangedCallback(address, packed, 0, packed.length);
+    }
+
+    private void devicePropertiesChangedCallback(byte[] address, byte[] packed, int offset,
+            int end) {
+        ArrayList<Integer> types = new ArrayList<Integer>();
+        ArrayList<byte[]> values = new ArrayList<byte[]>();
+        while (offset + PACKED_PROPERTY_HEADER_LEN <= end) {
+            int type = (packed[offset] & 0xFF) | ((packed[offset + 1] & 0xFF) << 8)
+                    | ((packed[offset + 2] & 0xFF) << 16) | ((packed[offset + 3] & 0xFF) << 24);
+            int len = (packed[offset + 4] & 0xFF) | ((packed[offset + 5] & 0xFF) << 8);
+            offset += PACKED_PROPERTY_HEADER_LEN;
+            if (offset + len > end) {
+                errorLog("Truncated property " + type);
+                break;
+            }
+            types.add(type);
+            values.add(Arrays.copyOfRange(packed, offset, offset + len));
+            offset += len;
+        }
+
+        if (types.isEmpty()) return;
+        int[] typeArray = new int[types.size()];
+        for (int i = 0; i < typeArray.length; i++) typeArray[i] = types.get(i);
+        devicePropertyChangedCallback(address, typeArray,
+                values.toArray(new byte[values.size()][]));
+    }
+
+    /**
+     * Called once inquiry results are queued natively; they are collected
+     * after the discovery window so repeated reports of a device merge, or
+     * right away if the native queue is full.
+     */
+    void discoveryResultsPendingCallback(boolean full) {
+        if (full) {
+            mHandler.removeMessages(MESSAGE_DRAIN_DISCOVERY_RESULTS);
+            mHandler.sendEmptyMessage(MESSAGE_DRAIN_DISCOVERY_RESULTS);
+        } else {
+            mHandler.sendEmptyMessageDelayed(MESSAGE_DRAIN_DISCOVERY_RESULTS,
+                    mDiscoveryWindowMs);
+        }
+    }
+
+    /**
+     * Runs report on the handler thread after draining the inquiry results
+     * queued so far, so it is ordered behind their ACTION_FOUND broadcasts.
+     */
+    void postAfterDiscoveryResults(final Runnable report) {
+        mHandler.post(new Runnable() {
+            @Override
+            public void run() {
+                drainDiscoveryResults();
+                report.run();
+            }
+        });
+    }
+
+    /**
+     * Collects the queued inquiry results, each packed as
+     * u8[6] address | u16 length | changed properties, and reports the
+     * devices as found. Only runs on the handler thread.
+     */
+    private void drainDiscoveryResults() {
+        mHandler.removeMessages(MESSAGE_DRAIN_DISCOVERY_RESULTS);
+        byte[] packed = mAdapterService.drainDiscoveryResultsNative();
+        if (packed == null) return;
+
+        int offset = 0;
+        while (offset + PACKED_RESULT_HEADER_LEN <= packed.length) {
+            byte[] address = Arrays.copyOfRange(packed, offset, offset + BD_ADDR_LEN);
+            int len = (packed[offset + BD_ADDR_LEN] & 0xFF)
+                    | ((packed[offset + BD_ADDR_LEN + 1] & 0xFF) << 8);
+            offset += PACKED_RESULT_HEADER_LEN;
+            if (offset + len > packed.length) {
+                errorLog("Truncated discovery result");
+                break;
+            }
+            devicePropertiesChangedCallback(address, packed, offset, offset + len);
+            deviceFoundCallback(address);
+            offset += len;
+        }
+    }
+
     void deviceFoundCallback(byte[] address) {
         // The device properties are already registered - we can send the intent
         // now
@@ -779,6 +893,9 @@ final class RemoteDevices {
                     sendUuidIntent(device);
                 }
                 break;
+            case MESSAGE_DRAIN_DISCOVERY_RESULTS:
+                drainDiscoveryResults();
+                break;
             }
         }
     };
@@ -267,6 +267,28 @@ class AdvertiseManager {
                 advertiserId, AdvertiseHelper.advertiseDataToBytes(data, deviceName));
     }
 
+    /**
+     * Rotates the advertiser through the given payloads every periodMillis, natively. Step i
+     * sets advertiseData[i] and scanResponses[i], each modulo its length; scanResponses may be
+     * null to keep the current scan response. Unchanged data is not resent to the controller.
+     * An empty schedule, setAdvertisingData or setScanResponseData cancel the rotation.
+     */
+    void setAdvertisingRotation(int advertiserId, AdvertiseData[] advertiseData,
+            AdvertiseData[] scanResponses, int periodMillis) {
+        String deviceName = AdapterService.getAdapterService().getName();
+        setAdvertisingRotationNative(advertiserId, advertiseDataToBytes(advertiseData, deviceName),
+                advertiseDataToBytes(scanResponses, deviceName), periodMillis);
+    }
+
+    private static byte[][] advertiseDataToBytes(AdvertiseData[] data, String deviceName) {
+        if (data == null) return null;
+        byte[][] bytes = new byte[data.length][];
+        for (int i = 0; i < data.length; i++) {
+            bytes[i] = AdvertiseHelper.advertiseDataToBytes(data[i], deviceName);
+        }
+        return bytes;
+    }
+
     void setAdvertisingParameters(int advertiserId, AdvertisingSetParameters parameters) {
         setAdvertisingParametersNative(advertiserId, parameters);
     }
@@ -424,6 +446,8 @@ class AdvertiseManager {
             int advertiserId, boolean enable, int duration, int maxExtAdvEvents);
     private native void setAdvertisingDataNative(int advertiserId, byte[] data);
     private native void setScanResponseDataNative(int advertiserId, byte[] data);
+    private native void setAdvertisingRotationNative(
+            int advertiserId, byte[][] advertiseData, byte[][] scanResponses, int periodMillis);
     private native void setAdvertisingParametersNative(
             int advertiserId, AdvertisingSetParameters parameters);
     private native void setPeriodicAdvertisingParametersNative(
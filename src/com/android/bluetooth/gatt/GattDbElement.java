@@ -52,6 +52,27 @@ public class GattDbElement {
     public int properties;
     public int permissions;
 
+    /*
+     * Number of longs per element in the packed database array delivered
+     * by the native layer. The field order must match GATT_DB_PACKED_* in
+     * com_android_bluetooth_gatt.cpp.
+     */
+    static final int PACKED_LENGTH = 9;
+
+    /*
+     * Fills this element from the packed database array, starting at offset.
+     */
+    void unpack(long[] packed, int offset) {
+        id = (int) packed[offset];
+        type = (int) packed[offset + 1];
+        attributeHandle = (int) packed[offset + 2];
+        startHandle = (int) packed[offset + 3];
+        endHandle = (int) packed[offset + 4];
+        properties = (int) packed[offset + 5];
+        permissions = (int) packed[offset + 6];
+        uuid = new UUID(packed[offset + 8], packed[offset + 7]);
+    }
+
     public static GattDbElement createPrimaryService(UUID uuid) {
         GattDbElement el = new GattDbElement();
         el.type = TYPE_PRIMARY_SERVICE;
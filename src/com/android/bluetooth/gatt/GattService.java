@@ -48,10 +48,13 @@ import android.bluetooth.le.ScanResult;
 import android.bluetooth.le.ScanSettings;
 import android.content.Intent;
 import android.os.Binder;
+import android.os.Handler;
 import android.os.IBinder;
+import android.os.Looper;
 import android.os.ParcelUuid;
 import android.os.RemoteException;
 import android.os.SystemClock;
+import android.os.SystemProperties;
 import android.os.WorkSource;
 import android.provider.Settings;
 import android.util.Log;
@@ -62,13 +65,15 @@ import com.android.bluetooth.btservice.AdapterService;
 import com.android.bluetooth.btservice.BluetoothProto;
 import com.android.bluetooth.a2dp.A2dpService;
 import com.android.bluetooth.btservice.ProfileService;
-import com.android.bluetooth.util.NumberUtils;
 import com.android.internal.annotations.VisibleForTesting;
 
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
 import java.security.Security;
 import java.util.ArrayList;
 import java.util.Arrays;
 import java.util.Collections;
+import java.util.Comparator;
 import java.util.HashMap;
 import java.util.HashSet;
 import java.util.List;
@@ -93,7 +98,6 @@ public class GattService extends ProfileService {
 
     private static final int MAC_ADDRESS_LENGTH = 6;
     // Batch scan related constants.
-    private static final int TRUNCATED_RESULT_SIZE = 11;
     private static final int TIME_STAMP_LENGTH = 2;
 
     // onFoundLost related constants
@@ -102,6 +106,22 @@ public class GattService extends ProfileService {
 
     private static final int ET_LEGACY_MASK = 0x10;
 
+    // Scan result batching related constants.
+    private static final int SCAN_BATCH_BUFFER_SIZE = 32 * 1024;
+    private static final int SCAN_BATCH_DEFAULT_MAX_RESULTS = 64;
+
+    // Must match BATCH_REPORT_COL* in com_android_bluetooth_gatt.cpp.
+    private static final int BATCH_REPORT_COL_RSSI = 0;
+    private static final int BATCH_REPORT_COL_AGE_MS = 1;
+    private static final int BATCH_REPORT_COL_DATA_OFFSET = 2;
+    private static final int BATCH_REPORT_COL_DATA_LEN = 3;
+    @VisibleForTesting
+    static final int BATCH_REPORT_COLUMNS = 4;
+
+    // Must match AD_INDEX_* in com_android_bluetooth_gatt.cpp.
+    private static final int AD_INDEX_MAX_ENTRIES = 64;
+    private static final int AD_INDEX_NONE = 0xFF;
+
     private static final UUID[] HID_UUIDS = {
         UUID.fromString("00002A4A-0000-1000-8000-00805F9B34FB"),
         UUID.fromString("00002A4B-0000-1000-8000-00805F9B34FB"),
@@ -162,19 +182,47 @@ public class GattService extends ProfileService {
     ArrayList<BluetoothProto.ScanEvent> mScanEvents =
         new ArrayList<BluetoothProto.ScanEvent>(NUM_SCAN_EVENTS_KEPT);
 
-    private Map<Integer, List<BluetoothGattService>> gattClientDatabases =
-            new HashMap<Integer, List<BluetoothGattService>>();
+    /**
+     * Client databases per connection. Written from the JNI callback thread and,
+     * for cached databases, from mHandler.
+     */
+    private final Map<Integer, List<BluetoothGattService>> gattClientDatabases =
+            Collections.synchronizedMap(new HashMap<Integer, List<BluetoothGattService>>());
+
+    private final Handler mHandler = new Handler(Looper.getMainLooper());
+
+    /**
+     * Last connection orchestrator progress per client, as
+     * {connected, connecting, waiting, background}.
+     */
+    private final Map<Integer, int[]> mClientFleetProgress = new HashMap<Integer, int[]>();
 
     private AdvertiseManager mAdvertiseManager;
     private PeriodicScanManager mPeriodicScanManager;
     private ScanManager mScanManager;
     private AppOpsManager mAppOps;
 
+    /**
+     * Shared with the native layer, which packs batched scan results into it.
+     */
+    private ByteBuffer mScanBatchBuffer;
+
     /**
      * Reliable write queue
      */
     private Set<String> mReliableQueue = new HashSet<String>();
 
+    /**
+     * Connections running a native read or write batch. BTA runs a single command per
+     * connection, so other client operations on them are refused with GATT_BUSY
+     * until the batch reports completion.
+     */
+    private final Set<Integer> mBatchConnIds =
+            Collections.synchronizedSet(new HashSet<Integer>());
+
+    // Stack status for an operation refused because another one is pending.
+    private static final int GATT_BUSY = 0x84;
+
     static {
         if (DBG) Log.d(TAG, "classInitNative called");
         System.loadLibrary("bluetooth_jni");
@@ -202,11 +250,24 @@ public class GattService extends ProfileService {
         mPeriodicScanManager = new PeriodicScanManager(AdapterService.getAdapterService());
         mPeriodicScanManager.start();
 
+        int batchLatencyMs = SystemProperties.getInt("persist.bt.gatt.scan_batch_latency_ms", 0);
+        if (batchLatencyMs > 0) {
+            int batchMaxResults = SystemProperties.getInt(
+                    "persist.bt.gatt.scan_batch_max_results", SCAN_BATCH_DEFAULT_MAX_RESULTS);
+            mScanBatchBuffer = ByteBuffer.allocateDirect(SCAN_BATCH_BUFFER_SIZE)
+                    .order(ByteOrder.LITTLE_ENDIAN);
+            gattClientConfigScanBatchingNative(mScanBatchBuffer, batchMaxResults, batchLatencyMs);
+        }
+
         return true;
     }
 
     protected boolean stop() {
         if (DBG) Log.d(TAG, "stop()");
+        if (mScanBatchBuffer != null) {
+            gattClientConfigScanBatchingNative(null, 0, 0);
+            mScanBatchBuffer = null;
+        }
         mScannerMap.clear();
         mClientMap.clear();
         mServerMap.clear();
@@ -467,6 +528,21 @@ public class GattService extends ProfileService {
             service.clientConnect(clientIf, address, isDirect, transport, opportunistic, phy);
         }
 
+        public void clientConnectFleet(
+                int clientIf, String[] addresses, int[] priorities, int transport) {
+            GattService service = getService();
+            if (service == null) return;
+
+            //do not allow new connections with active multicast
+            A2dpService a2dpService = A2dpService.getA2dpService();
+            if (a2dpService != null && a2dpService.isMulticastOngoing(null)) {
+                Log.i(TAG, "A2dp Multicast is Ongoing, ignore Connection Request");
+                return;
+            }
+
+            service.clientConnectFleet(clientIf, addresses, priorities, transport);
+        }
+
         @Override
         public void clientDisconnect(int clientIf, String address) {
             GattService service = getService();
@@ -528,6 +604,20 @@ public class GattService extends ProfileService {
             service.writeCharacteristic(clientIf, address, handle, writeType, authReq, value);
         }
 
+        public boolean readCharacteristics(
+                int clientIf, String address, int[] handles, int authReq) {
+            GattService service = getService();
+            if (service == null) return false;
+            return service.readCharacteristics(clientIf, address, handles, authReq);
+        }
+
+        public boolean writeCharacteristicBatch(
+                int clientIf, String address, int authReq, byte[] records) {
+            GattService service = getService();
+            if (service == null) return false;
+            return service.writeCharacteristicBatch(clientIf, address, authReq, records);
+        }
+
         public void readDescriptor(int clientIf, String address, int handle, int authReq) {
             GattService service = getService();
             if (service == null) return;
@@ -698,6 +788,14 @@ public class GattService extends ProfileService {
             service.setScanResponseData(advertiserId, data);
         }
 
+        public void setAdvertisingRotation(int advertiserId, AdvertiseData[] advertiseData,
+                AdvertiseData[] scanResponses, int periodMillis) {
+            GattService service = getService();
+            if (service == null) return;
+            service.setAdvertisingRotation(
+                    advertiserId, advertiseData, scanResponses, periodMillis);
+        }
+
         public void setAdvertisingParameters(
                 int advertiserId, AdvertisingSetParameters parameters) {
             GattService service = getService();
@@ -768,6 +866,17 @@ public class GattService extends ProfileService {
     void onScanResult(int event_type, int address_type, String address, int primary_phy,
             int secondary_phy, int advertising_sid, int tx_power, int rssi, int periodic_adv_int,
             byte[] adv_data) {
+        onScanResult(event_type, address_type, address, primary_phy, secondary_phy,
+                advertising_sid, tx_power, rssi, periodic_adv_int, adv_data, null);
+    }
+
+    /**
+     * @param adIndex AD structure index of adv_data as built natively, or null
+     *        to index it here when needed.
+     */
+    private void onScanResult(int event_type, int address_type, String address, int primary_phy,
+            int secondary_phy, int advertising_sid, int tx_power, int rssi, int periodic_adv_int,
+            byte[] adv_data, int[] adIndex) {
         if (VDBG) {
             Log.d(TAG, "onScanResult() - event_type=0x" + Integer.toHexString(event_type)
                             + ", address_type=" + address_type + ", address=" + address
@@ -776,13 +885,17 @@ public class GattService extends ProfileService {
                             + ", tx_power=" + tx_power + ", rssi=" + rssi + ", periodic_adv_int=0x"
                             + Integer.toHexString(periodic_adv_int));
         }
-        List<UUID> remoteUuids = parseUuids(adv_data);
+        List<UUID> remoteUuids = null;
         addScanResult();
 
         byte[] legacy_adv_data = Arrays.copyOfRange(adv_data, 0, 62);
 
         for (ScanClient client : mScanManager.getRegularScanQueue()) {
             if (client.uuids.length > 0) {
+                if (remoteUuids == null) {
+                    if (adIndex == null) adIndex = parseAdIndex(adv_data);
+                    remoteUuids = parseUuids(adv_data, adIndex);
+                }
                 int matches = 0;
                 for (UUID search : client.uuids) {
                     for (UUID remote: remoteUuids) {
@@ -851,6 +964,46 @@ public class GattService extends ProfileService {
         }
     }
 
+    void onScanResultBatch(int numResults, int length) {
+        if (VDBG) {
+            Log.d(TAG, "onScanResultBatch() - numResults=" + numResults + ", length=" + length);
+        }
+        ByteBuffer batch = mScanBatchBuffer;
+        if (batch == null) return;
+
+        byte[] address = new byte[MAC_ADDRESS_LENGTH];
+        int position = 0;
+        for (int i = 0; i < numResults && position < length; ++i) {
+            batch.position(position);
+            int eventType = batch.getShort() & 0xFFFF;
+            int addressType = batch.get() & 0xFF;
+            batch.get(address);
+            int primaryPhy = batch.get() & 0xFF;
+            int secondaryPhy = batch.get() & 0xFF;
+            int advertisingSid = batch.get() & 0xFF;
+            int txPower = batch.get();
+            int rssi = batch.get();
+            int periodicAdvInt = batch.getShort() & 0xFFFF;
+            byte[] advData = new byte[batch.getShort() & 0xFFFF];
+            batch.get(advData);
+            int adCount = batch.get() & 0xFF;
+            int[] adIndex = null;
+            if (adCount != AD_INDEX_NONE) {
+                adIndex = new int[adCount];
+                for (int j = 0; j < adCount; j++) {
+                    int type = batch.get() & 0xFF;
+                    int offset = batch.getShort() & 0xFFFF;
+                    adIndex[j] = adIndexEntry(type, offset, batch.get() & 0xFF);
+                }
+            }
+            position = batch.position();
+
+            onScanResult(eventType, addressType, Utils.getAddressStringFromByte(address),
+                    primaryPhy, secondaryPhy, advertisingSid, txPower, rssi, periodicAdvInt,
+                    advData, adIndex);
+        }
+    }
+
     private void sendResultByPendingIntent(PendingIntentInfo pii, ScanResult result,
             int callbackType, ScanClient client) {
         ArrayList<ScanResult> results = new ArrayList<>();
@@ -962,12 +1115,32 @@ public class GattService extends ProfileService {
         }
     }
 
+    void onClientFleetProgress(int clientIf, int connected, int connecting, int waiting,
+            int background, int failed) {
+        if (DBG) {
+            Log.d(TAG, "onClientFleetProgress() - clientIf=" + clientIf + ", connected="
+                    + connected + ", connecting=" + connecting + ", waiting=" + waiting
+                    + ", background=" + background + ", failed=" + failed);
+        }
+
+        synchronized (mClientFleetProgress) {
+            if (connected + connecting + waiting + background + failed == 0) {
+                mClientFleetProgress.remove(clientIf);
+            } else {
+                mClientFleetProgress.put(clientIf,
+                        new int[] {connected, connecting, waiting, background, failed});
+            }
+        }
+    }
+
     void onDisconnected(int clientIf, int connId, int status, String address)
             throws RemoteException {
         if (DBG) Log.d(TAG, "onDisconnected() - clientIf=" + clientIf
             + ", connId=" + connId + ", address=" + address);
 
         mClientMap.removeConnection(clientIf, connId);
+        mBatchConnIds.remove(connId);
+        gattClientDatabases.remove(connId);
         ClientMap.App app = mClientMap.getById(clientIf);
         if (app != null) {
             app.callback.onClientConnectionState(status, clientIf, false, address);
@@ -1072,14 +1245,63 @@ public class GattService extends ProfileService {
         t.start();
     }
 
-    GattDbElement GetSampleGattDbElement() {
-        return new GattDbElement();
+    void onGetGattDb(int connId, long[] packedDb) throws RemoteException {
+        String address = mClientMap.addressByConnId(connId);
+
+        if (DBG) Log.d(TAG, "onGetGattDb() - address=" + address);
+
+        // Stored even without an app, later deltas are applied to this copy.
+        List<BluetoothGattService> db_out = unpackGattDb(packedDb);
+        gattClientDatabases.put(connId, db_out);
+
+        ClientMap.App app = mClientMap.getByConnId(connId);
+        if (app == null || app.callback == null) {
+            Log.e(TAG, "app or callback is null");
+            return;
+        }
+
+        // Search is complete when there was error, or nothing more to process
+        app.callback.onSearchComplete(address, db_out, 0 /* status */);
     }
 
-    void onGetGattDb(int connId, ArrayList<GattDbElement> db) throws RemoteException {
+    void onGetGattDbDelta(int connId, int[] removedIds, long[] packedAdded)
+            throws RemoteException {
         String address = mClientMap.addressByConnId(connId);
 
-        if (DBG) Log.d(TAG, "onGetGattDb() - address=" + address);
+        if (DBG) {
+            Log.d(TAG, "onGetGattDbDelta() - address=" + address + ", removed="
+                    + removedIds.length + ", added elements="
+                    + packedAdded.length / GattDbElement.PACKED_LENGTH);
+        }
+
+        List<BluetoothGattService> previous = gattClientDatabases.get(connId);
+        if (previous == null) {
+            // Nothing to apply the delta to, have the whole database sent again.
+            Log.w(TAG, "onGetGattDbDelta() - no database for connId=" + connId);
+            gattClientForgetGattDbNative(connId);
+            Thread t = new Thread(new Runnable() {
+                public void run() {
+                    gattClientGetGattDbNative(connId);
+                }
+            });
+            t.start();
+            return;
+        }
+
+        Set<Integer> removed = new HashSet<Integer>();
+        for (int id : removedIds) removed.add(id);
+
+        List<BluetoothGattService> db_out = new ArrayList<BluetoothGattService>();
+        for (BluetoothGattService service : previous) {
+            if (!removed.contains(service.getInstanceId())) db_out.add(service);
+        }
+        db_out.addAll(unpackGattDb(packedAdded));
+        Collections.sort(db_out, new Comparator<BluetoothGattService>() {
+            public int compare(BluetoothGattService a, BluetoothGattService b) {
+                return Integer.compare(a.getInstanceId(), b.getInstanceId());
+            }
+        });
+        gattClientDatabases.put(connId, db_out);
 
         ClientMap.App app = mClientMap.getByConnId(connId);
         if (app == null || app.callback == null) {
@@ -1087,12 +1309,21 @@ public class GattService extends ProfileService {
             return;
         }
 
+        app.callback.onSearchComplete(address, db_out, 0 /* status */);
+    }
+
+    /**
+     * Builds services from a packed database, see GattDbElement.unpack().
+     */
+    private List<BluetoothGattService> unpackGattDb(long[] packedDb) {
         List<BluetoothGattService> db_out = new ArrayList<BluetoothGattService>();
 
         BluetoothGattService currSrvc = null;
         BluetoothGattCharacteristic currChar = null;
 
-        for (GattDbElement el: db) {
+        GattDbElement el = new GattDbElement();
+        for (int offset = 0; offset < packedDb.length; offset += GattDbElement.PACKED_LENGTH) {
+            el.unpack(packedDb, offset);
             switch (el.type)
             {
                 case GattDbElement.TYPE_PRIMARY_SERVICE:
@@ -1126,10 +1357,7 @@ public class GattService extends ProfileService {
                     Log.e(TAG, "got unknown element with type=" + el.type + " and UUID=" + el.uuid);
             }
         }
-
-        // Search is complete when there was error, or nothing more to process
-        gattClientDatabases.put(connId, db_out);
-        app.callback.onSearchComplete(address, db_out, 0 /* status */);
+        return db_out;
     }
 
     void onRegisterForNotifications(int connId, int status, int registered, int handle) {
@@ -1157,6 +1385,27 @@ public class GattService extends ProfileService {
         }
     }
 
+    void onNotifyPooled(int connId, int handle, boolean isNotify, ByteBuffer buffer,
+            int length) throws RemoteException {
+        String address = mClientMap.addressByConnId(connId);
+        if (VDBG) Log.d(TAG, "onNotifyPooled() - address=" + address
+            + ", handle=" + handle + ", length=" + length);
+
+        if (!permissionCheck(connId, handle)) {
+            Log.w(TAG, "onNotifyPooled() - permission check failed!");
+            return;
+        }
+
+        ClientMap.App app = mClientMap.getByConnId(connId);
+        if (app == null) return;
+
+        // The application callback takes a byte[]; copy only once it is delivered.
+        byte[] data = new byte[length];
+        buffer.clear();
+        buffer.get(data, 0, length);
+        app.callback.onNotify(address, handle, data);
+    }
+
     void onReadCharacteristic(int connId, int status, int handle, byte[] data) throws RemoteException {
         String address = mClientMap.addressByConnId(connId);
 
@@ -1169,6 +1418,30 @@ public class GattService extends ProfileService {
         }
     }
 
+    void onReadCharacteristicBatch(int connId, byte[] packed) throws RemoteException {
+        String address = mClientMap.addressByConnId(connId);
+
+        if (VDBG) Log.d(TAG, "onReadCharacteristicBatch() - address=" + address
+            + ", length=" + packed.length);
+
+        mBatchConnIds.remove(connId);
+
+        ClientMap.App app = mClientMap.getByConnId(connId);
+        if (app == null) return;
+
+        // u16 handle, u8 status, u16 length, value
+        ByteBuffer buffer = ByteBuffer.wrap(packed).order(ByteOrder.LITTLE_ENDIAN);
+        while (buffer.remaining() >= 5) {
+            int handle = buffer.getShort() & 0xFFFF;
+            int status = buffer.get() & 0xFF;
+            int length = buffer.getShort() & 0xFFFF;
+            if (length > buffer.remaining()) break;
+            byte[] data = new byte[length];
+            buffer.get(data);
+            app.callback.onCharacteristicRead(address, status, handle, data);
+        }
+    }
+
     void onWriteCharacteristic(int connId, int status, int handle)
             throws RemoteException {
         String address = mClientMap.addressByConnId(connId);
@@ -1176,6 +1449,9 @@ public class GattService extends ProfileService {
         if (VDBG) Log.d(TAG, "onWriteCharacteristic() - address=" + address
             + ", status=" + status);
 
+        // Only the last write of a batch, or its first failure, is reported.
+        mBatchConnIds.remove(connId);
+
         ClientMap.App app = mClientMap.getByConnId(connId);
         if (app == null) return;
 
@@ -1281,24 +1557,32 @@ public class GattService extends ProfileService {
         mScanManager.callbackDone(clientIf, status);
     }
 
+    /**
+     * Batch scan reports, decoded natively with identical records merged. |data| holds the
+     * result addresses followed by their scan records, |columns| holds BATCH_REPORT_COLUMNS
+     * columns of one value per result, see "Batch scan report decoding" in
+     * com_android_bluetooth_gatt.cpp.
+     */
     void onBatchScanReports(int status, int scannerId, int reportType, int numRecords,
-            byte[] recordData) throws RemoteException {
+            byte[] data, int[] columns) throws RemoteException {
         if (DBG) {
             Log.d(TAG, "onBatchScanReports() - scannerId=" + scannerId + ", status=" + status
-                    + ", reportType=" + reportType + ", numRecords=" + numRecords);
+                    + ", reportType=" + reportType + ", numRecords=" + numRecords
+                    + ", numResults=" + columns.length / BATCH_REPORT_COLUMNS);
         }
         mScanManager.callbackDone(scannerId, status);
-        Set<ScanResult> results = parseBatchScanResults(numRecords, reportType, recordData);
+        ArrayList<ScanResult> results = buildBatchScanResults(
+                mAdapter, reportType, data, columns, SystemClock.elapsedRealtimeNanos());
         if (reportType == ScanManager.SCAN_RESULT_TYPE_TRUNCATED) {
             // We only support single client for truncated mode.
             ScannerMap.App app = mScannerMap.getById(scannerId);
             if (app == null) return;
             if (app.callback != null) {
-                app.callback.onBatchScanResults(new ArrayList<ScanResult>(results));
+                app.callback.onBatchScanResults(results);
             } else {
                 // PendingIntent based
                 try {
-                    sendResultsByPendingIntent(app.info, new ArrayList<ScanResult>(results),
+                    sendResultsByPendingIntent(app.info, results,
                             ScanSettings.CALLBACK_TYPE_ALL_MATCHES);
                 } catch (PendingIntent.CanceledException e) {
                 }
@@ -1328,7 +1612,7 @@ public class GattService extends ProfileService {
     }
 
     // Check and deliver scan results for different scan clients.
-    private void deliverBatchScan(ScanClient client, Set<ScanResult> allResults) throws
+    private void deliverBatchScan(ScanClient client, List<ScanResult> allResults) throws
             RemoteException {
         ScannerMap.App app = mScannerMap.getById(client.scannerId);
         if (app == null) return;
@@ -1346,98 +1630,50 @@ public class GattService extends ProfileService {
         sendBatchScanResults(app, client, results);
     }
 
-    private Set<ScanResult> parseBatchScanResults(int numRecords, int reportType,
-            byte[] batchRecord) {
-        if (numRecords == 0) {
-            return Collections.emptySet();
-        }
-        if (DBG) Log.d(TAG, "current time is " + SystemClock.elapsedRealtimeNanos());
-        if (reportType == ScanManager.SCAN_RESULT_TYPE_TRUNCATED) {
-            return parseTruncatedResults(numRecords, batchRecord);
-        } else {
-            return parseFullResults(numRecords, batchRecord);
-        }
-    }
-
-    private Set<ScanResult> parseTruncatedResults(int numRecords, byte[] batchRecord) {
-        if (DBG) Log.d(TAG, "batch record " + Arrays.toString(batchRecord));
-        Set<ScanResult> results = new HashSet<ScanResult>(numRecords);
-        long now = SystemClock.elapsedRealtimeNanos();
-        for (int i = 0; i < numRecords; ++i) {
-            byte[] record = extractBytes(batchRecord, i * TRUNCATED_RESULT_SIZE,
-                    TRUNCATED_RESULT_SIZE);
-            byte[] address = extractBytes(record, 0, 6);
-            reverse(address);
-            BluetoothDevice device = mAdapter.getRemoteDevice(address);
-            int rssi = record[8];
-            long timestampNanos = now - parseTimestampNanos(extractBytes(record, 9, 2));
-            results.add(new ScanResult(device, ScanRecord.parseFromBytes(new byte[0]),
-                    rssi, timestampNanos));
-        }
-        return results;
-    }
-
+    /**
+     * Builds the ScanResults of a decoded batch scan report. Results whose address or scan
+     * record lies outside |data| end the report; the ones before them are kept.
+     */
     @VisibleForTesting
-    long parseTimestampNanos(byte[] data) {
-        long timestampUnit = NumberUtils.littleEndianByteArrayToInt(data);
-        // Timestamp is in every 50 ms.
-        return TimeUnit.MILLISECONDS.toNanos(timestampUnit * 50);
-    }
-
-    private Set<ScanResult> parseFullResults(int numRecords, byte[] batchRecord) {
-        if (DBG) Log.d(TAG, "Batch record : " + Arrays.toString(batchRecord));
-        Set<ScanResult> results = new HashSet<ScanResult>(numRecords);
-        int position = 0;
-        long now = SystemClock.elapsedRealtimeNanos();
-        while (position < batchRecord.length) {
-            byte[] address = extractBytes(batchRecord, position, 6);
-            // TODO: remove temp hack.
-            reverse(address);
-            BluetoothDevice device = mAdapter.getRemoteDevice(address);
-            position += 6;
-            // Skip address type.
-            position++;
-            // Skip tx power level.
-            position++;
-            int rssi = batchRecord[position++];
-            long timestampNanos = now - parseTimestampNanos(extractBytes(batchRecord, position, 2));
-            position += 2;
-
-            // Combine advertise packet and scan response packet.
-            int advertisePacketLen = batchRecord[position++];
-            byte[] advertiseBytes = extractBytes(batchRecord, position, advertisePacketLen);
-            position += advertisePacketLen;
-            int scanResponsePacketLen = batchRecord[position++];
-            byte[] scanResponseBytes = extractBytes(batchRecord, position, scanResponsePacketLen);
-            position += scanResponsePacketLen;
-            byte[] scanRecord = new byte[advertisePacketLen + scanResponsePacketLen];
-            System.arraycopy(advertiseBytes, 0, scanRecord, 0, advertisePacketLen);
-            System.arraycopy(scanResponseBytes, 0, scanRecord,
-                    advertisePacketLen, scanResponsePacketLen);
-            if (DBG) Log.d(TAG, "ScanRecord : " + Arrays.toString(scanRecord));
-            results.add(new ScanResult(device, ScanRecord.parseFromBytes(scanRecord),
-                    rssi, timestampNanos));
+    static ArrayList<ScanResult> buildBatchScanResults(BluetoothAdapter adapter, int reportType,
+            byte[] data, int[] columns, long now) {
+        int numResults = columns.length / BATCH_REPORT_COLUMNS;
+        ArrayList<ScanResult> results = new ArrayList<ScanResult>(numResults);
+        if (numResults == 0) {
+            return results;
+        }
+        if (DBG) Log.d(TAG, "current time is " + now);
+        boolean truncated = reportType == ScanManager.SCAN_RESULT_TYPE_TRUNCATED;
+        ScanRecord emptyRecord = truncated ? ScanRecord.parseFromBytes(new byte[0]) : null;
+        byte[] address = new byte[MAC_ADDRESS_LENGTH];
+        for (int i = 0; i < numResults; ++i) {
+            int addressOffset = i * address.length;
+            if (addressOffset + address.length > data.length) {
+                Log.e(TAG, "malformed batch scan result " + i + " of " + numResults);
+                break;
+            }
+            ScanRecord scanRecord = emptyRecord;
+            if (!truncated) {
+                int offset = columns[BATCH_REPORT_COL_DATA_OFFSET * numResults + i];
+                int length = columns[BATCH_REPORT_COL_DATA_LEN * numResults + i];
+                if (offset < 0 || length < 0 || offset > data.length - length) {
+                    Log.e(TAG, "malformed batch scan result " + i + " of " + numResults);
+                    break;
+                }
+                scanRecord = ScanRecord.parseFromBytes(
+                        Arrays.copyOfRange(data, offset, offset + length));
+            }
+            System.arraycopy(data, addressOffset, address, 0, address.length);
+            BluetoothDevice device = adapter.getRemoteDevice(address);
+            int rssi = columns[BATCH_REPORT_COL_RSSI * numResults + i];
+            long timestampNanos = now - TimeUnit.MILLISECONDS.toNanos(
+                    columns[BATCH_REPORT_COL_AGE_MS * numResults + i]);
+            if (VDBG) Log.d(TAG, "batch result " + device + ", rssi=" + rssi);
+            results.add(new ScanResult(device, scanRecord, rssi, timestampNanos));
         }
         return results;
     }
 
-    // Reverse byte array.
-    private void reverse(byte[] address) {
-        int len = address.length;
-        for (int i = 0; i < len / 2; ++i) {
-            byte b = address[i];
-            address[i] = address[len - 1 - i];
-            address[len - 1 - i] = b;
-        }
-    }
-
-    // Helper method to extract bytes from byte array.
-    private static byte[] extractBytes(byte[] scanRecord, int start, int length) {
-        byte[] bytes = new byte[length];
-        System.arraycopy(scanRecord, start, bytes, 0, length);
-        return bytes;
-    }
-
     void onBatchScanThresholdCrossed(int clientIf) {
         if (DBG) {
             Log.d(TAG, "onBatchScanThresholdCrossed() - clientIf=" + clientIf);
@@ -1858,6 +2094,14 @@ public class GattService extends ProfileService {
             mAdvertiseManager.setScanResponseData(advertiserId, data);
     }
 
+    void setAdvertisingRotation(int advertiserId, AdvertiseData[] advertiseData,
+            AdvertiseData[] scanResponses, int periodMillis) {
+        enforceAdminPermission();
+        if(mAdvertiseManager != null)
+            mAdvertiseManager.setAdvertisingRotation(
+                    advertiserId, advertiseData, scanResponses, periodMillis);
+    }
+
     void setAdvertisingParameters(int advertiserId, AdvertisingSetParameters parameters) {
         enforceAdminPermission();
         if(mAdvertiseManager != null)
@@ -1915,6 +2159,29 @@ public class GattService extends ProfileService {
         gattClientConnectNative(clientIf, address, isDirect, transport, opportunistic, phy);
     }
 
+    /**
+     * Connects |clientIf| to a set of devices. The native orchestrator keeps a
+     * bounded number of direct connects in flight, highest priority first,
+     * retries failures with backoff and falls back to background connects.
+     * Connection state of each device is still reported through onConnected;
+     * retried failures are not, but the one that ends the direct attempts is.
+     * Devices whose background connect is refused are counted as failed in
+     * onClientFleetProgress.
+     */
+    void clientConnectFleet(int clientIf, String[] addresses, int[] priorities, int transport) {
+        enforceCallingOrSelfPermission(BLUETOOTH_PERM, "Need BLUETOOTH permission");
+
+        if (addresses.length != priorities.length) {
+            throw new IllegalArgumentException("addresses and priorities differ in length");
+        }
+        int maxConcurrent = SystemProperties.getInt("persist.bt.gatt.max_concurrent_connects", 0);
+        if (DBG) {
+            Log.d(TAG, "clientConnectFleet() - clientIf=" + clientIf + ", devices="
+                    + addresses.length + ", maxConcurrent=" + maxConcurrent);
+        }
+        gattClientConnectFleetNative(clientIf, addresses, priorities, transport, maxConcurrent);
+    }
+
     void clientDisconnect(int clientIf, String address) {
         enforceCallingOrSelfPermission(BLUETOOTH_PERM, "Need BLUETOOTH permission");
 
@@ -1978,6 +2245,8 @@ public class GattService extends ProfileService {
         enforceCallingOrSelfPermission(BLUETOOTH_PERM, "Need BLUETOOTH permission");
 
         if (DBG) Log.d(TAG, "refreshDevice() - address=" + address);
+        Integer connId = mClientMap.connIdByAddress(clientIf, address);
+        if (connId != null && isBatchActive(connId, "refreshDevice()")) return;
         gattClientRefreshNative(clientIf, address);
     }
 
@@ -1987,21 +2256,87 @@ public class GattService extends ProfileService {
         Integer connId = mClientMap.connIdByAddress(clientIf, address);
         if (DBG) Log.d(TAG, "discoverServices() - address=" + address + ", connId=" + connId);
 
-        if (connId != null)
-            gattClientSearchServiceNative(connId, true, 0, 0);
-        else
+        if (connId == null) {
             Log.e(TAG, "discoverServices() - No connection for " + address + "...");
+            return;
+        }
+
+        if (isBatchActive(connId, "discoverServices()")) {
+            searchBusy(connId, address);
+            return;
+        }
+
+        // Bonded devices are answered from the persistent cache right away, the search
+        // below then validates it. An identical database is not delivered again; a
+        // different one follows as a second onSearchComplete that replaces the cached
+        // one, as after a Service Changed indication.
+        boolean bonded = mAdapter.getRemoteDevice(address).getBondState()
+                == BluetoothDevice.BOND_BONDED;
+        final long[] cachedDb = gattClientLoadGattCacheNative(connId, bonded);
+        if (cachedDb != null) {
+            if (DBG) Log.d(TAG, "discoverServices() - serving cached database");
+            final int cachedConnId = connId;
+            mHandler.post(new Runnable() {
+                public void run() {
+                    deliverCachedGattDb(cachedConnId, cachedDb);
+                }
+            });
+        }
+        gattClientSearchServiceNative(connId, true, 0, 0);
+    }
+
+    /**
+     * Hands a cached database to the app, unless the connection is gone or the
+     * discovery already delivered a database of its own.
+     */
+    private void deliverCachedGattDb(int connId, long[] packedDb) {
+        String address = mClientMap.addressByConnId(connId);
+        if (address == null) return;
+
+        List<BluetoothGattService> db_out = unpackGattDb(packedDb);
+        synchronized (gattClientDatabases) {
+            if (gattClientDatabases.containsKey(connId)) return;
+            gattClientDatabases.put(connId, db_out);
+        }
+
+        ClientMap.App app = mClientMap.getByConnId(connId);
+        if (app == null || app.callback == null) return;
+        try {
+            app.callback.onSearchComplete(address, db_out, 0 /* status */);
+        } catch (RemoteException e) {
+            Log.e(TAG, "deliverCachedGattDb() - unable to deliver cached database", e);
+        }
     }
 
     void discoverServiceByUuid(int clientIf, String address, UUID uuid) {
         enforceCallingOrSelfPermission(BLUETOOTH_PERM, "Need BLUETOOTH permission");
 
         Integer connId = mClientMap.connIdByAddress(clientIf, address);
-        if (connId != null)
-            gattClientDiscoverServiceByUuidNative(
-                    connId, uuid.getLeastSignificantBits(), uuid.getMostSignificantBits());
-        else
+        if (connId == null) {
             Log.e(TAG, "discoverServiceByUuid() - No connection for " + address + "...");
+            return;
+        }
+
+        if (isBatchActive(connId, "discoverServiceByUuid()")) {
+            searchBusy(connId, address);
+            return;
+        }
+
+        gattClientDiscoverServiceByUuidNative(
+                connId, uuid.getLeastSignificantBits(), uuid.getMostSignificantBits());
+    }
+
+    // Reports a service search refused while a batch holds the connection.
+    private void searchBusy(int connId, String address) {
+        ClientMap.App app = mClientMap.getByConnId(connId);
+        try {
+            if (app != null) {
+                app.callback.onSearchComplete(
+                        address, new ArrayList<BluetoothGattService>(), GATT_BUSY);
+            }
+        } catch (RemoteException e) {
+            Log.e(TAG, "Exception: " + e);
+        }
     }
 
     void readCharacteristic(int clientIf, String address, int handle, int authReq) {
@@ -2020,9 +2355,57 @@ public class GattService extends ProfileService {
             return;
         }
 
+        if (isBatchActive(connId, "readCharacteristic()")) {
+            ClientMap.App app = mClientMap.getByConnId(connId);
+            try {
+                if (app != null) {
+                    app.callback.onCharacteristicRead(address, GATT_BUSY, handle, new byte[0]);
+                }
+            } catch (RemoteException e) {
+                Log.e(TAG, "Exception: " + e);
+            }
+            return;
+        }
+
         gattClientReadCharacteristicNative(connId, handle, authReq);
     }
 
+    /**
+     * Reads several characteristics of a connection back to back. The reads
+     * are chained natively and all values come back in a single
+     * onReadCharacteristicBatch, which reports them to the app through
+     * onCharacteristicRead in request order.
+     */
+    boolean readCharacteristics(int clientIf, String address, int[] handles, int authReq) {
+        enforceCallingOrSelfPermission(BLUETOOTH_PERM, "Need BLUETOOTH permission");
+
+        if (VDBG) Log.d(TAG, "readCharacteristics() - address=" + address);
+
+        Integer connId = mClientMap.connIdByAddress(clientIf, address);
+        if (connId == null) {
+            Log.e(TAG, "readCharacteristics() - No connection for " + address + "...");
+            return false;
+        }
+
+        for (int handle : handles) {
+            if (!permissionCheck(connId, handle)) {
+                Log.w(TAG, "readCharacteristics() - permission check failed!");
+                return false;
+            }
+        }
+
+        // Claiming the connection is the check, so concurrent batches can't both pass.
+        if (!mBatchConnIds.add(connId)) {
+            Log.w(TAG, "readCharacteristics() - batch in progress on connId " + connId);
+            return false;
+        }
+        if (!gattClientReadCharacteristicBatchNative(connId, handles, authReq)) {
+            mBatchConnIds.remove(connId);
+            return false;
+        }
+        return true;
+    }
+
     void readUsingCharacteristicUuid(
             int clientIf, String address, UUID uuid, int startHandle, int endHandle, int authReq) {
         enforceCallingOrSelfPermission(BLUETOOTH_PERM, "Need BLUETOOTH permission");
@@ -2040,6 +2423,19 @@ public class GattService extends ProfileService {
             return;
         }
 
+        if (isBatchActive(connId, "readUsingCharacteristicUuid()")) {
+            ClientMap.App app = mClientMap.getByConnId(connId);
+            try {
+                if (app != null) {
+                    app.callback.onCharacteristicRead(
+                            address, GATT_BUSY, startHandle, new byte[0]);
+                }
+            } catch (RemoteException e) {
+                Log.e(TAG, "Exception: " + e);
+            }
+            return;
+        }
+
         gattClientReadUsingCharacteristicUuidNative(connId, uuid.getLeastSignificantBits(),
                 uuid.getMostSignificantBits(), startHandle, endHandle, authReq);
     }
@@ -2063,9 +2459,61 @@ public class GattService extends ProfileService {
             return;
         }
 
+        if (isBatchActive(connId, "writeCharacteristic()")) {
+            ClientMap.App app = mClientMap.getByConnId(connId);
+            try {
+                if (app != null) app.callback.onCharacteristicWrite(address, GATT_BUSY, handle);
+            } catch (RemoteException e) {
+                Log.e(TAG, "Exception: " + e);
+            }
+            return;
+        }
+
         gattClientWriteCharacteristicNative(connId, handle, writeType, authReq, value);
     }
 
+    /**
+     * Queues a batch of write-without-response operations, packed as
+     * little endian (u16 handle, u16 length, value) records. The writes are
+     * pipelined natively with congestion based flow control; a single
+     * onCharacteristicWrite is reported for the last record, or for the first
+     * failure.
+     */
+    boolean writeCharacteristicBatch(int clientIf, String address, int authReq, byte[] records) {
+        enforceCallingOrSelfPermission(BLUETOOTH_PERM, "Need BLUETOOTH permission");
+
+        if (VDBG) Log.d(TAG, "writeCharacteristicBatch() - address=" + address);
+
+        Integer connId = mClientMap.connIdByAddress(clientIf, address);
+        if (connId == null) {
+            Log.e(TAG, "writeCharacteristicBatch() - No connection for " + address + "...");
+            return false;
+        }
+
+        ByteBuffer buffer = ByteBuffer.wrap(records).order(ByteOrder.LITTLE_ENDIAN);
+        while (buffer.remaining() >= 4) {
+            int handle = buffer.getShort() & 0xFFFF;
+            int length = buffer.getShort() & 0xFFFF;
+            if (!permissionCheck(connId, handle)) {
+                Log.w(TAG, "writeCharacteristicBatch() - permission check failed!");
+                return false;
+            }
+            if (length > buffer.remaining()) break;
+            buffer.position(buffer.position() + length);
+        }
+
+        // Claiming the connection is the check, so concurrent batches can't both pass.
+        if (!mBatchConnIds.add(connId)) {
+            Log.w(TAG, "writeCharacteristicBatch() - batch in progress on connId " + connId);
+            return false;
+        }
+        if (!gattClientWriteCharacteristicBatchNative(connId, authReq, records)) {
+            mBatchConnIds.remove(connId);
+            return false;
+        }
+        return true;
+    }
+
     void readDescriptor(int clientIf, String address, int handle, int authReq) {
         enforceCallingOrSelfPermission(BLUETOOTH_PERM, "Need BLUETOOTH permission");
 
@@ -2082,6 +2530,18 @@ public class GattService extends ProfileService {
             return;
         }
 
+        if (isBatchActive(connId, "readDescriptor()")) {
+            ClientMap.App app = mClientMap.getByConnId(connId);
+            try {
+                if (app != null) {
+                    app.callback.onDescriptorRead(address, GATT_BUSY, handle, new byte[0]);
+                }
+            } catch (RemoteException e) {
+                Log.e(TAG, "Exception: " + e);
+            }
+            return;
+        }
+
         gattClientReadDescriptorNative(connId, handle, authReq);
     };
 
@@ -2101,9 +2561,25 @@ public class GattService extends ProfileService {
             return;
         }
 
+        if (isBatchActive(connId, "writeDescriptor()")) {
+            ClientMap.App app = mClientMap.getByConnId(connId);
+            try {
+                if (app != null) app.callback.onDescriptorWrite(address, GATT_BUSY, handle);
+            } catch (RemoteException e) {
+                Log.e(TAG, "Exception: " + e);
+            }
+            return;
+        }
+
         gattClientWriteDescriptorNative(connId, handle, authReq, value);
     }
 
+    private boolean isBatchActive(int connId, String method) {
+        if (!mBatchConnIds.contains(connId)) return false;
+        Log.w(TAG, method + " - batch in progress on connId " + connId);
+        return true;
+    }
+
     void beginReliableWrite(int clientIf, String address) {
         enforceCallingOrSelfPermission(BLUETOOTH_PERM, "Need BLUETOOTH permission");
 
@@ -2119,7 +2595,19 @@ public class GattService extends ProfileService {
         mReliableQueue.remove(address);
 
         Integer connId = mClientMap.connIdByAddress(clientIf, address);
-        if (connId != null) gattClientExecuteWriteNative(connId, execute);
+        if (connId == null) return;
+
+        if (isBatchActive(connId, "endReliableWrite()")) {
+            ClientMap.App app = mClientMap.getByConnId(connId);
+            try {
+                if (app != null) app.callback.onExecuteWrite(address, GATT_BUSY);
+            } catch (RemoteException e) {
+                Log.e(TAG, "Exception: " + e);
+            }
+            return;
+        }
+
+        gattClientExecuteWriteNative(connId, execute);
     }
 
     void registerForNotification(int clientIf, String address, int handle, boolean enable) {
@@ -2153,11 +2641,22 @@ public class GattService extends ProfileService {
 
         if (DBG) Log.d(TAG, "configureMTU() - address=" + address + " mtu=" + mtu);
         Integer connId = mClientMap.connIdByAddress(clientIf, address);
-        if (connId != null) {
-            gattClientConfigureMTUNative(connId, mtu);
-        } else {
+        if (connId == null) {
             Log.e(TAG, "configureMTU() - No connection for " + address + "...");
+            return;
         }
+
+        if (isBatchActive(connId, "configureMTU()")) {
+            ClientMap.App app = mClientMap.getByConnId(connId);
+            try {
+                if (app != null) app.callback.onConfigureMTU(address, mtu, GATT_BUSY);
+            } catch (RemoteException e) {
+                Log.e(TAG, "Exception: " + e);
+            }
+            return;
+        }
+
+        gattClientConfigureMTUNative(connId, mtu);
     }
 
     void connectionParameterUpdate(int clientIf, String address, int connectionPriority) {
@@ -2688,30 +3187,52 @@ public class GattService extends ProfileService {
         }
     }
 
-    private List<UUID> parseUuids(byte[] adv_data) {
-        List<UUID> uuids = new ArrayList<UUID>();
+    /*
+     * AD structure index entries pack the type, value offset and value length
+     * of one AD structure, see "AD structure index" in
+     * com_android_bluetooth_gatt.cpp.
+     */
+    private static int adIndexEntry(int type, int offset, int length) {
+        return (type << 24) | (offset << 8) | length;
+    }
 
-        int offset = 0;
-        while(offset < (adv_data.length-2)) {
-            int len = Byte.toUnsignedInt(adv_data[offset++]);
+    /**
+     * Indexes the AD structures of adv_data the way the native layer does.
+     * Returns null if the data is malformed.
+     */
+    @VisibleForTesting
+    static int[] parseAdIndex(byte[] adv_data) {
+        int[] index = new int[AD_INDEX_MAX_ENTRIES];
+        int count = 0;
+        int pos = 0;
+        while (pos < adv_data.length) {
+            int len = Byte.toUnsignedInt(adv_data[pos]);
             if (len == 0) break;
+            if (pos + 1 + len > adv_data.length || count == AD_INDEX_MAX_ENTRIES) return null;
+            index[count++] = adIndexEntry(Byte.toUnsignedInt(adv_data[pos + 1]), pos + 2, len - 1);
+            pos += 1 + len;
+        }
+        return Arrays.copyOf(index, count);
+    }
 
-            int type = adv_data[offset++];
-            switch (type) {
-                case 0x02: // Partial list of 16-bit UUIDs
-                case 0x03: // Complete list of 16-bit UUIDs
-                    while (len > 1) {
-                        int uuid16 = adv_data[offset++];
-                        uuid16 += (adv_data[offset++] << 8);
-                        len -= 2;
-                        uuids.add(UUID.fromString(String.format(
-                            "%08x-0000-1000-8000-00805f9b34fb", uuid16)));
-                    }
-                    break;
+    @VisibleForTesting
+    static List<UUID> parseUuids(byte[] adv_data, int[] adIndex) {
+        List<UUID> uuids = new ArrayList<UUID>();
+        if (adIndex == null) return uuids;
 
-                default:
-                    offset += (len - 1);
-                    break;
+        for (int entry : adIndex) {
+            int type = entry >>> 24;
+            if (type != 0x02 /* Partial list of 16-bit UUIDs */
+                    && type != 0x03 /* Complete list of 16-bit UUIDs */) {
+                continue;
+            }
+            int offset = (entry >> 8) & 0xFFFF;
+            int end = offset + (entry & 0xFF);
+            for (; offset + 1 < end; offset += 2) {
+                int uuid16 = Byte.toUnsignedInt(adv_data[offset])
+                        | (Byte.toUnsignedInt(adv_data[offset + 1]) << 8);
+                uuids.add(UUID.fromString(String.format(
+                    "%08x-0000-1000-8000-00805f9b34fb", uuid16)));
             }
         }
 
@@ -2739,6 +3260,35 @@ public class GattService extends ProfileService {
 
         sb.append("GATT Handle Map\n");
         mHandleMap.dump(sb);
+
+        long[] notifyPoolStats = gattClientGetNotifyPoolStatsNative();
+        if (notifyPoolStats != null) {
+            println(sb, "Notification buffer pool: hits=" + notifyPoolStats[0]
+                    + ", misses=" + notifyPoolStats[1] + ", active=" + notifyPoolStats[2]);
+        }
+
+        long[] swFilterStats = gattClientGetSoftwareScanFilterStatsNative();
+        if (swFilterStats != null) {
+            println(sb, "Software scan filter: passed=" + swFilterStats[0]
+                    + ", dropped=" + swFilterStats[1]);
+        }
+
+        long[] adaptiveScanStats = gattClientGetAdaptiveScanStatsNative();
+        if (adaptiveScanStats != null) {
+            println(sb, "Adaptive scan: level=" + adaptiveScanStats[0]
+                    + ", interval=" + adaptiveScanStats[1] + ", window=" + adaptiveScanStats[2]
+                    + ", retunes=" + adaptiveScanStats[3]);
+        }
+
+        synchronized (mClientFleetProgress) {
+            for (Map.Entry<Integer, int[]> entry : mClientFleetProgress.entrySet()) {
+                int[] progress = entry.getValue();
+                println(sb, "Connection orchestrator clientIf=" + entry.getKey()
+                        + ": connected=" + progress[0] + ", connecting=" + progress[1]
+                        + ", waiting=" + progress[2] + ", background=" + progress[3]
+                        + ", failed=" + progress[4]);
+            }
+        }
     }
 
     void addScanResult() {
@@ -2799,9 +3349,21 @@ public class GattService extends ProfileService {
 
     private native void gattClientUnregisterAppNative(int clientIf);
 
+    private native void gattClientConfigScanBatchingNative(ByteBuffer buffer, int maxResults,
+            int maxLatencyMs);
+
+    private native long[] gattClientGetNotifyPoolStatsNative();
+
+    private native long[] gattClientGetSoftwareScanFilterStatsNative();
+
+    private native long[] gattClientGetAdaptiveScanStatsNative();
+
     private native void gattClientConnectNative(int clientIf, String address, boolean isDirect,
             int transport, boolean opportunistic, int initiating_phys);
 
+    private native void gattClientConnectFleetNative(int clientIf, String[] addresses,
+            int[] priorities, int transport, int maxConcurrent);
+
     private native void gattClientDisconnectNative(int clientIf, String address,
             int conn_id);
 
@@ -2820,6 +3382,10 @@ public class GattService extends ProfileService {
 
     private native void gattClientGetGattDbNative(int conn_id);
 
+    private native void gattClientForgetGattDbNative(int conn_id);
+
+    private native long[] gattClientLoadGattCacheNative(int conn_id, boolean bonded);
+
     private native void gattClientReadCharacteristicNative(int conn_id, int handle, int authReq);
 
     private native void gattClientReadUsingCharacteristicUuidNative(
@@ -2833,6 +3399,12 @@ public class GattService extends ProfileService {
     private native void gattClientWriteDescriptorNative(int conn_id, int handle,
             int auth_req, byte[] value);
 
+    private native boolean gattClientReadCharacteristicBatchNative(int conn_id, int[] handles,
+            int auth_req);
+
+    private native boolean gattClientWriteCharacteristicBatchNative(int conn_id, int auth_req,
+            byte[] records);
+
     private native void gattClientExecuteWriteNative(int conn_id, boolean execute);
 
     private native void gattClientRegisterForNotificationsNative(int clientIf,
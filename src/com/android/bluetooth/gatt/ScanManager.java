@@ -33,6 +33,7 @@ import android.os.Looper;
 import android.os.Message;
 import android.os.RemoteException;
 import android.os.ServiceManager;
+import android.os.SystemProperties;
 import android.os.SystemClock;
 import android.util.Log;
 import android.view.Display;
@@ -40,11 +41,16 @@ import android.view.Display;
 import com.android.bluetooth.Utils;
 import com.android.bluetooth.btservice.AdapterService;
 
+import java.io.ByteArrayOutputStream;
+import java.nio.ByteBuffer;
+import java.nio.charset.StandardCharsets;
 import java.util.ArrayDeque;
+import java.util.ArrayList;
 import java.util.Collections;
 import java.util.Deque;
 import java.util.HashMap;
 import java.util.HashSet;
+import java.util.List;
 import java.util.Map;
 import java.util.Set;
 import java.util.UUID;
@@ -441,6 +447,15 @@ public class ScanManager {
 
         private static final int DISCARD_OLDEST_WHEN_BUFFER_FULL = 0;
 
+        // Software scan filter program flags, see "Software scan filter" in
+        // com_android_bluetooth_gatt.cpp for the layout.
+        private static final int SW_FILTER_ADDRESS = 0x01;
+        private static final int SW_FILTER_NAME = 0x02;
+        private static final int SW_FILTER_SERVICE_UUID = 0x04;
+        private static final int SW_FILTER_SERVICE_DATA = 0x08;
+        private static final int SW_FILTER_MANUFACTURER = 0x10;
+        private static final int SW_FILTER_MAX_LENGTH = 255;
+
         /**
          * Scan params corresponding to regular scan setting
          */
@@ -451,6 +466,16 @@ public class ScanManager {
         private static final int SCAN_MODE_LOW_LATENCY_WINDOW_MS = 5000;
         private static final int SCAN_MODE_LOW_LATENCY_INTERVAL_MS = 5000;
 
+        /**
+         * Adaptive scan budgets. The duty cycle may drop down to the minimum percentage and the
+         * interval grow up to the maximum while no new devices show up. A minimum duty cycle of 0
+         * disables adaptive scanning.
+         */
+        private static final String ADAPTIVE_SCAN_MIN_DUTY_PROPERTY =
+                "persist.bt.gatt.adaptive_scan_min_duty_pct";
+        private static final String ADAPTIVE_SCAN_MAX_INTERVAL_PROPERTY =
+                "persist.bt.gatt.adaptive_scan_max_interval_ms";
+
         /**
          * Onfound/onlost for scan settings
          */
@@ -548,6 +573,9 @@ public class ScanManager {
                     // convert scanWindow and scanInterval from ms to LE scan units(0.625ms)
                     scanWindow = Utils.millsToUnit(scanWindow);
                     scanInterval = Utils.millsToUnit(scanInterval);
+                    // Keep the adaptive scheduler from retuning with the old parameters while
+                    // the new ones are applied; configureAdaptiveScan() enables it again.
+                    gattClientSetAdaptiveScanNative(0, 0, 0, 0);
                     gattClientScanNative(false);
                     if (DBG) {
                         Log.d(TAG, "configureRegularScanParams - scanInterval = " + scanInterval
@@ -556,14 +584,35 @@ public class ScanManager {
                     }
                     gattSetScanParametersNative(client.scannerId, scanInterval, scanWindow);
                     gattClientScanNative(true);
+                    configureAdaptiveScan(scanInterval, scanWindow);
                     mLastConfiguredScanSetting = curScanSetting;
                 }
             } else {
+                gattClientSetAdaptiveScanNative(0, 0, 0, 0);
                 mLastConfiguredScanSetting = curScanSetting;
                 if (DBG) Log.d(TAG, "configureRegularScanParams() - queue emtpy, scan stopped");
             }
         }
 
+        // Lets the native scheduler lower the duty cycle below the requested scan parameters
+        // while the environment is static, see "Adaptive scan scheduling" in
+        // com_android_bluetooth_gatt.cpp. Parameters are in LE scan units.
+        private void configureAdaptiveScan(int scanInterval, int scanWindow) {
+            int minDutyPct = SystemProperties.getInt(ADAPTIVE_SCAN_MIN_DUTY_PROPERTY, 0);
+            if (minDutyPct <= 0 || scanWindow * 100L <= (long) scanInterval * minDutyPct) {
+                gattClientSetAdaptiveScanNative(0, 0, 0, 0);
+                return;
+            }
+            int floorInterval = Math.max(scanInterval, Utils.millsToUnit(
+                    SystemProperties.getInt(ADAPTIVE_SCAN_MAX_INTERVAL_PROPERTY, 0)));
+            int floorWindow = (int) ((long) floorInterval * minDutyPct / 100);
+            if (DBG) {
+                Log.d(TAG, "configureAdaptiveScan() - floorInterval=" + floorInterval
+                        + ", floorWindow=" + floorWindow);
+            }
+            gattClientSetAdaptiveScanNative(scanInterval, scanWindow, floorInterval, floorWindow);
+        }
+
         ScanClient getAggressiveClient(Set<ScanClient> cList) {
             ScanClient result = null;
             int curScanSetting = Integer.MIN_VALUE;
@@ -602,6 +651,7 @@ public class ScanManager {
             if (numRegularScanClients() == 1) {
                 gattClientScanNative(true);
             }
+            updateSoftwareScanFilter();
             return 0;
         }
 
@@ -782,6 +832,103 @@ public class ScanManager {
                 gattClientScanNative(false);
             }
             removeScanFilters(client.scannerId);
+            updateSoftwareScanFilter();
+        }
+
+        /**
+         * Hands the union of the regular scan clients' filters to the native
+         * software filter, which drops advertisements none of them can match
+         * before they reach Java. Clients are still matched exactly in
+         * GattService. A client without filters turns the software filter off.
+         */
+        void updateSoftwareScanFilter() {
+            List<ScanFilter> filters = new ArrayList<ScanFilter>();
+            for (ScanClient client : mRegularScanClients) {
+                if (client.filters == null || client.filters.isEmpty()) {
+                    gattClientSetSoftwareScanFilterNative(null);
+                    return;
+                }
+                filters.addAll(client.filters);
+            }
+
+            if (filters.isEmpty() || filters.size() > 0xFFFF) {
+                gattClientSetSoftwareScanFilterNative(null);
+                return;
+            }
+            if (DBG) Log.d(TAG, "updateSoftwareScanFilter() - filters=" + filters.size());
+            gattClientSetSoftwareScanFilterNative(packSoftwareScanFilters(filters));
+        }
+
+        /*
+         * Criteria that don't fit the program are left out, which only makes
+         * the software filter pass more.
+         */
+        private byte[] packSoftwareScanFilters(List<ScanFilter> filters) {
+            ByteArrayOutputStream out = new ByteArrayOutputStream();
+            out.write(filters.size() & 0xFF);
+            out.write(filters.size() >> 8);
+            for (ScanFilter filter : filters) {
+                byte[] name = filter.getDeviceName() != null
+                        ? filter.getDeviceName().getBytes(StandardCharsets.UTF_8) : null;
+                byte[] serviceData = filter.getServiceDataUuid() != null
+                        ? nonNull(filter.getServiceData()) : null;
+                byte[] manufacturerData = filter.getManufacturerId() >= 0
+                        ? nonNull(filter.getManufacturerData()) : null;
+
+                int flags = 0;
+                if (filter.getDeviceAddress() != null) flags |= SW_FILTER_ADDRESS;
+                if (name != null && name.length <= SW_FILTER_MAX_LENGTH) flags |= SW_FILTER_NAME;
+                if (filter.getServiceUuid() != null) flags |= SW_FILTER_SERVICE_UUID;
+                if (serviceData != null && serviceData.length <= SW_FILTER_MAX_LENGTH) {
+                    flags |= SW_FILTER_SERVICE_DATA;
+                }
+                if (manufacturerData != null && manufacturerData.length <= SW_FILTER_MAX_LENGTH) {
+                    flags |= SW_FILTER_MANUFACTURER;
+                }
+                out.write(flags);
+
+                if ((flags & SW_FILTER_ADDRESS) != 0) {
+                    out.write(Utils.getBytesFromAddress(filter.getDeviceAddress()), 0, 6);
+                }
+                if ((flags & SW_FILTER_NAME) != 0) {
+                    out.write(name.length);
+                    out.write(name, 0, name.length);
+                }
+                if ((flags & SW_FILTER_SERVICE_UUID) != 0) {
+                    writeUuid(out, filter.getServiceUuid().getUuid());
+                    writeUuid(out, filter.getServiceUuidMask() != null
+                            ? filter.getServiceUuidMask().getUuid() : new UUID(-1L, -1L));
+                }
+                if ((flags & SW_FILTER_SERVICE_DATA) != 0) {
+                    writeUuid(out, filter.getServiceDataUuid().getUuid());
+                    writeMaskedData(out, serviceData, filter.getServiceDataMask());
+                }
+                if ((flags & SW_FILTER_MANUFACTURER) != 0) {
+                    out.write(filter.getManufacturerId() & 0xFF);
+                    out.write((filter.getManufacturerId() >> 8) & 0xFF);
+                    writeMaskedData(out, manufacturerData, filter.getManufacturerDataMask());
+                }
+            }
+            return out.toByteArray();
+        }
+
+        private byte[] nonNull(byte[] data) {
+            return data != null ? data : new byte[0];
+        }
+
+        private void writeUuid(ByteArrayOutputStream out, UUID uuid) {
+            ByteBuffer buffer = ByteBuffer.allocate(16);
+            buffer.putLong(uuid.getMostSignificantBits());
+            buffer.putLong(uuid.getLeastSignificantBits());
+            out.write(buffer.array(), 0, 16);
+        }
+
+        private void writeMaskedData(ByteArrayOutputStream out, byte[] data, byte[] mask) {
+            out.write(data.length);
+            out.write(data, 0, data.length);
+            for (int i = 0; i < data.length; i++) {
+                out.write(mask != null && i < mask.length ? mask[i] : 0xFF);
+            }
         }
 
         void regularScanTimeout(ScanClient client) {
@@ -1261,6 +1408,11 @@ public class ScanManager {
         private native void gattClientScanFilterEnableNative(int client_if,
                 boolean enable);
 
+        private native void gattClientSetSoftwareScanFilterNative(byte[] program);
+
+        private native void gattClientSetAdaptiveScanNative(int ceiling_interval,
+                int ceiling_window, int floor_interval, int floor_window);
+
         /************************** Batch related native methods *********************************/
         private native void gattClientConfigBatchScanStorageNative(int client_if,
                 int max_full_reports_percent, int max_truncated_reports_percent,
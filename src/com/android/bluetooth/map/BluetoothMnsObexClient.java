@@ -26,6 +26,7 @@ import android.util.Log;
 import android.util.SparseBooleanArray;
 
 import com.android.bluetooth.BluetoothObexTransport;
+import com.android.bluetooth.sdp.SdpManager;
 
 import java.io.IOException;
 import java.io.OutputStream;
@@ -322,6 +323,7 @@ public class BluetoothMnsObexClient {
             btSocket.connect();
         } catch (IOException e) {
             Log.e(TAG, "BtSocket Connect error " + e.getMessage(), e);
+            if (isValidMnsRecord()) SdpManager.invalidateCachedRecords(mRemoteDevice);
             // TODO: do we need to report error somewhere?
             mConnected = false;
             return;
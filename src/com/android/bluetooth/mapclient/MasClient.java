@@ -26,6 +26,7 @@ import android.os.Message;
 import android.util.Log;
 
 import com.android.bluetooth.BluetoothObexTransport;
+import com.android.bluetooth.sdp.SdpManager;
 import com.android.internal.util.StateMachine;
 
 import java.io.IOException;
@@ -88,7 +89,12 @@ public class MasClient {
             }
             mSocket = mRemoteDevice.createRfcommSocket(mSdpMasRecord.getRfcommCannelNumber());
             Log.d(TAG, mRemoteDevice.toString() + "Socket: " + mSocket.toString());
-            mSocket.connect();
+            try {
+                mSocket.connect();
+            } catch (IOException e) {
+                SdpManager.invalidateCachedRecords(mRemoteDevice);
+                throw e;
+            }
             mTransport = new BluetoothObexTransport(mSocket);
 
             mSession = new ClientSession(mTransport);
@@ -61,6 +61,7 @@ import android.os.ParcelUuid;
 import android.bluetooth.SdpOppOpsRecord;
 
 import com.android.bluetooth.a2dp.A2dpService;
+import com.android.bluetooth.sdp.SdpManager;
 
 import java.io.File;
 import java.io.IOException;
@@ -768,6 +769,7 @@ public class BluetoothOppTransfer implements BluetoothOppBatch.BluetoothOppBatch
                 mSessionHandler.obtainMessage(TRANSPORT_CONNECTED, transport).sendToTarget();
             } catch (IOException e) {
                 Log.e(TAG, "L2cap socket connect exception", e);
+                SdpManager.invalidateCachedRecords(device);
                 try {
                     btSocket.close();
                 } catch (IOException e3) {
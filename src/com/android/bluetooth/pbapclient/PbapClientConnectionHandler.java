@@ -31,6 +31,7 @@ import android.util.Log;
 
 import com.android.bluetooth.BluetoothObexTransport;
 import com.android.bluetooth.R;
+import com.android.bluetooth.sdp.SdpManager;
 
 import java.io.IOException;
 
@@ -267,6 +268,7 @@ class PbapClientConnectionHandler extends Handler {
             }
         } catch (IOException e) {
             Log.e(TAG, "Error while connecting socket", e);
+            if (mPseRec != null) SdpManager.invalidateCachedRecords(mDevice);
         }
         return false;
     }
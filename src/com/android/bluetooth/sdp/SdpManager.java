@@ -27,13 +27,20 @@ import android.os.Message;
 import android.os.ParcelUuid;
 import android.os.Parcelable;
 import android.util.Log;
+import android.util.Pair;
 
 import com.android.bluetooth.Utils;
 import com.android.bluetooth.btservice.AbstractionLayer;
 import com.android.bluetooth.btservice.AdapterService;
+import com.android.internal.annotations.VisibleForTesting;
 
+import java.nio.BufferUnderflowException;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.charset.StandardCharsets;
 import java.util.ArrayList;
 import java.util.Arrays;
+import java.util.List;
 
 public class SdpManager {
 
@@ -54,11 +61,28 @@ public class SdpManager {
      * and mSearchInProgress. */
     static SdpSearchTracker sSdpSearchTracker;
     static boolean mSearchInProgress = false;
+    static boolean sDeliveringBatch = false;
+    /* Tag of the batch being searched natively, or null */
+    static Object sSdpBatch = null;
+    /* Id of the latest batch; results carrying another id are stale.
+     * Cached records of a single search are delivered with NO_BATCH. */
+    static int sSdpBatchId = 0;
+    private static final int NO_BATCH = 0;
     static Object mTrackerLock = new Object();
 
+    /* Record kinds in sdpBatchRecordsFoundCallback, as defined by the JNI layer */
+    private static final int RECORD_KIND_RAW = 0;
+    private static final int RECORD_KIND_MAS = 1;
+    private static final int RECORD_KIND_MNS = 2;
+    private static final int RECORD_KIND_PSE = 3;
+    private static final int RECORD_KIND_OPS = 4;
+    private static final int RECORD_KIND_SAPS = 5;
+    private static final int UUID_LEN = 16;
+
     /* The timeout to wait for reply from native. Should never fire. */
     private static final int SDP_INTENT_DELAY = 11000;
     private static final int MESSAGE_SDP_INTENT = 2;
+    private static final int MESSAGE_SDP_CACHED_RECORDS = 3;
 
     // We need a reference to the adapter service, to be able to send intents
     private static AdapterService sAdapterService;
@@ -75,6 +99,9 @@ public class SdpManager {
     private native void initializeNative();
     private native void cleanupNative();
     private native boolean sdpSearchNative(byte[] address, byte[] uuid);
+    private native boolean sdpSearchBatchNative(byte[] address, byte[] uuids, int batchId);
+    private native byte[] sdpGetCachedRecordsNative(byte[] address, byte[] uuids);
+    private native void sdpCacheInvalidateNative(byte[] address);
 
     private native int sdpCreateMapMasRecordNative(String serviceName, int masId,
             int rfcommChannel, int l2capPsm, int version, int msgTypes, int features);
@@ -100,6 +127,10 @@ public class SdpManager {
         private final ParcelUuid mUuid;
         private int mStatus = 0;
         private boolean mSearching;
+        /* Instances searched together in one native batch share this tag */
+        private Object mBatch;
+        /* Cleared once a batch holding this instance failed to start */
+        private boolean mBatchable = true;
         /* TODO: If we change the API to use another mechanism than intents for
          *       delivering the results, this would be the place to keep a list
          *       of the objects to deliver the results to. */
@@ -123,10 +154,31 @@ public class SdpManager {
             this.mStatus = status;
         }
 
+        public Object getBatch() {
+            return mBatch;
+        }
+
+        public void setBatch(Object batch) {
+            this.mBatch = batch;
+        }
+
+        public boolean isBatchable() {
+            return mBatchable;
+        }
+
+        public void setBatchable(boolean batchable) {
+            this.mBatchable = batchable;
+        }
+
         public void startSearch() {
+            startSearch(1);
+        }
+
+        /* A search chained behind others in a batch gets their time as well */
+        public void startSearch(int position) {
             mSearching = true;
             Message message = mHandler.obtainMessage(MESSAGE_SDP_INTENT, this);
-            mHandler.sendMessageDelayed(message, SDP_INTENT_DELAY);
+            mHandler.sendMessageDelayed(message, SDP_INTENT_DELAY * position);
         }
 
         public void stopSearch() {
@@ -167,6 +219,32 @@ public class SdpManager {
             return null;
         }
 
+        /* Tags the searches queued right behind |inst| for the same device as
+         * one batch, so profiles connecting to a device at once share the run.
+         * Only a contiguous run from the head of the queue is taken, so the
+         * searches still start in the order they were requested. */
+        void batchQueuedSearches(SdpSearchInstance inst) {
+            ArrayList<SdpSearchInstance> members = new ArrayList<SdpSearchInstance>();
+            for (SdpSearchInstance queued : list) {
+                if (queued.getBatch() != null || !queued.isBatchable()
+                        || !queued.getDevice().equals(inst.getDevice())) {
+                    break;
+                }
+                members.add(queued);
+            }
+            if (members.size() < 2) return;
+            Object batch = new Object();
+            for (SdpSearchInstance member : members) member.setBatch(batch);
+        }
+
+        ArrayList<SdpSearchInstance> getBatch(Object batch) {
+            ArrayList<SdpSearchInstance> members = new ArrayList<SdpSearchInstance>();
+            for (SdpSearchInstance inst : list) {
+                if (inst.getBatch() == batch) members.add(inst);
+            }
+            return members;
+        }
+
         SdpSearchInstance getSearchInstance(byte[] address, byte[] uuidBytes) {
             String addressString = Utils.getAddressStringFromByte(address);
             ParcelUuid uuid = Utils.byteArrayToUuid(uuidBytes)[0];
@@ -211,10 +289,22 @@ public class SdpManager {
         return sSdpManager;
     }
 
+    /**
+     * Drops the cached SDP records of a device. Profiles call this when a
+     * connection to a channel taken from its records fails, as the remote
+     * may have moved the service since the records were cached.
+     */
+    public static void invalidateCachedRecords(BluetoothDevice device) {
+        SdpManager manager = sSdpManager;
+        if (manager == null || !sNativeAvailable || device == null) return;
+        manager.sdpCacheInvalidateNative(Utils.getBytesFromAddress(device.getAddress()));
+    }
+
     public void cleanup() {
         if (sSdpSearchTracker !=null) {
             synchronized(mTrackerLock) {
                 sSdpSearchTracker.clear();
+                sSdpBatch = null;
             }
         }
 
@@ -397,6 +487,118 @@ public class SdpManager {
         }
     }
 
+    /* One record of a batched search, each packed little endian as
+     *   u8[16] uuid | u8 status | u8 moreResults | u8 kind |
+     *   i32 l2capPsm | i32 rfcommChannel | i32 profileVersion | i32[3] params |
+     *   u16 nameLen | name | u16 dataLen | data
+     */
+    @VisibleForTesting
+    static class BatchRecord {
+        final byte[] uuid = new byte[UUID_LEN];
+        int status;
+        boolean moreResults;
+        int kind;
+        int l2capPsm;
+        int rfcommChannel;
+        int profileVersion;
+        final int[] params = new int[3];
+        String serviceName;
+        byte[] data;
+
+        /* Returns the complete records of |records|; a truncated tail is dropped. */
+        static List<BatchRecord> parse(byte[] records) {
+            List<BatchRecord> parsed = new ArrayList<BatchRecord>();
+            ByteBuffer buf = ByteBuffer.wrap(records).order(ByteOrder.LITTLE_ENDIAN);
+            try {
+                while (buf.remaining() > 0) {
+                    BatchRecord record = new BatchRecord();
+                    buf.get(record.uuid);
+                    record.status = buf.get() & 0xFF;
+                    record.moreResults = buf.get() != 0;
+                    record.kind = buf.get() & 0xFF;
+                    record.l2capPsm = buf.getInt();
+                    record.rfcommChannel = buf.getInt();
+                    record.profileVersion = buf.getInt();
+                    for (int i = 0; i < record.params.length; i++) {
+                        record.params[i] = buf.getInt();
+                    }
+                    byte[] name = new byte[buf.getShort() & 0xFFFF];
+                    buf.get(name);
+                    record.serviceName = name.length > 0
+                            ? new String(name, StandardCharsets.UTF_8) : null;
+                    record.data = new byte[buf.getShort() & 0xFFFF];
+                    buf.get(record.data);
+                    parsed.add(record);
+                }
+            } catch (BufferUnderflowException e) {
+                Log.e(TAG, "sdpBatchRecordsFoundCallback: truncated records");
+            }
+            return parsed;
+        }
+    }
+
+    /* Records of a batched search are handed to the per record callbacks in
+     * order; the next queued search starts once all of them are delivered.
+     * Results of a batch that timed out or was cleaned up are dropped, as its
+     * members have already been answered. */
+    void sdpBatchRecordsFoundCallback(int batchId, byte[] address, byte[] records) {
+        List<BatchRecord> parsed = BatchRecord.parse(records);
+        synchronized (mTrackerLock) {
+            if (batchId != NO_BATCH && (sSdpBatch == null || batchId != sSdpBatchId)) {
+                Log.w(TAG, "sdpBatchRecordsFoundCallback: dropping stale batch " + batchId);
+                return;
+            }
+            sDeliveringBatch = true;
+            try {
+                for (BatchRecord r : parsed) {
+                    switch (r.kind) {
+                        case RECORD_KIND_MAS:
+                            sdpMasRecordFoundCallback(r.status, address, r.uuid, r.params[0],
+                                    r.l2capPsm, r.rfcommChannel, r.profileVersion, r.params[1],
+                                    r.params[2], r.serviceName, r.moreResults);
+                            break;
+                        case RECORD_KIND_MNS:
+                            sdpMnsRecordFoundCallback(r.status, address, r.uuid, r.l2capPsm,
+                                    r.rfcommChannel, r.profileVersion, r.params[0],
+                                    r.serviceName, r.moreResults);
+                            break;
+                        case RECORD_KIND_PSE:
+                            sdpPseRecordFoundCallback(r.status, address, r.uuid, r.l2capPsm,
+                                    r.rfcommChannel, r.profileVersion, r.params[0], r.params[1],
+                                    r.serviceName, r.moreResults);
+                            break;
+                        case RECORD_KIND_OPS:
+                            sdpOppOpsRecordFoundCallback(r.status, address, r.uuid, r.l2capPsm,
+                                    r.rfcommChannel, r.profileVersion, r.serviceName, r.data,
+                                    r.moreResults);
+                            break;
+                        case RECORD_KIND_SAPS:
+                            sdpSapsRecordFoundCallback(r.status, address, r.uuid,
+                                    r.rfcommChannel, r.profileVersion, r.serviceName,
+                                    r.moreResults);
+                            break;
+                        default:
+                            sdpRecordFoundCallback(r.status, address, r.uuid, r.data.length,
+                                    r.data);
+                            break;
+                    }
+                }
+            } finally {
+                if (sSdpBatch != null) {
+                    /* The batch is over; fail the members nothing was reported for */
+                    String addressString = Utils.getAddressStringFromByte(address);
+                    for (SdpSearchInstance member : sSdpSearchTracker.getBatch(sSdpBatch)) {
+                        if (member.getDevice().getAddress().equals(addressString)) {
+                            sendSdpIntent(member, null, false);
+                        }
+                    }
+                }
+                sDeliveringBatch = false;
+            }
+            startSearch();
+        }
+    }
+
     public void sdpSearch(BluetoothDevice device, ParcelUuid uuid) {
         if (sNativeAvailable == false) {
             Log.e(TAG, "Native not initialized!");
@@ -419,7 +621,17 @@ public class SdpManager {
     /* Caller must hold the mTrackerLock */
     private void startSearch() {
 
+        if (sDeliveringBatch) return; // Resumed once the batch is delivered
+
         SdpSearchInstance inst = sSdpSearchTracker.getNext();
+        if ((inst != null) && (mSearchInProgress == false) && (inst.getBatch() == null)) {
+            sSdpSearchTracker.batchQueuedSearches(inst);
+        }
+
+        if ((inst != null) && (mSearchInProgress == false) && (inst.getBatch() != null)
+                && startBatchSearch(inst)) {
+            return;
+        }
 
         if((inst != null) && (mSearchInProgress == false)) {
             if(D) Log.d(TAG, "Starting search for UUID: "+ inst.getUuid());
@@ -427,8 +639,11 @@ public class SdpManager {
 
             inst.startSearch(); // Trigger timeout message
 
-            sdpSearchNative(Utils.getBytesFromAddress(inst.getDevice().getAddress()),
-                                            Utils.uuidToByteArray(inst.getUuid()));
+            byte[] address = Utils.getBytesFromAddress(inst.getDevice().getAddress());
+            byte[] uuid = Utils.uuidToByteArray(inst.getUuid());
+            if (!deliverCachedRecords(address, uuid, NO_BATCH)) {
+                sdpSearchNative(address, uuid);
+            }
         } // Else queue is empty.
         else {
             if(D) Log.d(TAG, "startSearch(): nextInst = " + inst +
@@ -437,6 +652,56 @@ public class SdpManager {
         }
     }
 
+    /* Starts the batch |inst| heads. If the native layer refuses it, the members
+     * are untagged and searched one by one instead, and false is returned.
+     * Caller must hold the mTrackerLock */
+    private boolean startBatchSearch(SdpSearchInstance inst) {
+        ArrayList<SdpSearchInstance> batch = sSdpSearchTracker.getBatch(inst.getBatch());
+        byte[] uuids = new byte[batch.size() * UUID_LEN];
+        for (int i = 0; i < batch.size(); i++) {
+            System.arraycopy(Utils.uuidToByteArray(batch.get(i).getUuid()), 0, uuids,
+                    i * UUID_LEN, UUID_LEN);
+        }
+        if (D) Log.d(TAG, "Starting batched search for " + batch.size() + " UUIDs");
+        mSearchInProgress = true;
+        sSdpBatch = inst.getBatch();
+        if (++sSdpBatchId == NO_BATCH) sSdpBatchId++;
+
+        for (int i = 0; i < batch.size(); i++) {
+            batch.get(i).startSearch(i + 1); // Trigger timeout message
+        }
+
+        byte[] address = Utils.getBytesFromAddress(inst.getDevice().getAddress());
+        if (deliverCachedRecords(address, uuids, sSdpBatchId)
+                || sdpSearchBatchNative(address, uuids, sSdpBatchId)) {
+            return true;
+        }
+
+        Log.w(TAG, "Batched search failed to start, searching UUIDs one by one");
+        for (SdpSearchInstance member : batch) {
+            mHandler.removeMessages(MESSAGE_SDP_INTENT, member);
+            member.setBatch(null);
+            member.setBatchable(false);
+        }
+        sSdpBatch = null;
+        mSearchInProgress = false;
+        return false;
+    }
+
+    /* Answers a search from the native SDP cache, if it holds the records of
+     * all the UUIDs. The records are delivered asynchronously, like the
+     * results of a search over the air, tagged with |batchId|.
+     * Caller must hold the mTrackerLock */
+    private boolean deliverCachedRecords(byte[] address, byte[] uuids, int batchId) {
+        byte[] records = sdpGetCachedRecordsNative(address, uuids);
+        if (records == null) return false;
+
+        if (D) Log.d(TAG, "Using cached SDP records");
+        mHandler.obtainMessage(MESSAGE_SDP_CACHED_RECORDS, batchId, 0,
+                new Pair<byte[], byte[]>(address, records)).sendToTarget();
+        return true;
+    }
+
     /* Caller must hold the mTrackerLock */
     private void sendSdpIntent(SdpSearchInstance inst,
             Parcelable record, boolean moreResults) {
@@ -459,6 +724,14 @@ public class SdpManager {
         if(moreResults == false) {
             //Remove the outstanding UUID request
             sSdpSearchTracker.remove(inst);
+            if (sSdpBatch != null) {
+                /* The native batch is still searching the remaining members */
+                if (inst.getBatch() != sSdpBatch
+                        || !sSdpSearchTracker.getBatch(sSdpBatch).isEmpty()) {
+                    return;
+                }
+                sSdpBatch = null;
+            }
             mSearchInProgress = false;
             startSearch();
         }
@@ -475,6 +748,10 @@ public class SdpManager {
                     sendSdpIntent(msgObj, null, false);
                 }
                 break;
+            case MESSAGE_SDP_CACHED_RECORDS:
+                Pair<byte[], byte[]> cached = (Pair<byte[], byte[]>) msg.obj;
+                sdpBatchRecordsFoundCallback(msg.arg1, cached.first, cached.second);
+                break;
             }
         }
     };
@@ -0,0 +1,76 @@
+package com.android.bluetooth.avrcp;
+
+import android.test.AndroidTestCase;
+
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.charset.StandardCharsets;
+
+/** Unit tests for {@link FolderItemsRsp#pack}. */
+public class FolderItemsRspTest extends AndroidTestCase {
+    private static final int ATTR_TITLE = 1;
+    private static final int ATTR_ALBUM = 3;
+
+    public void testPack_sharesPooledStrings() {
+        byte[] uids = new byte[2 * AvrcpConstants.UID_SIZE];
+        uids[0] = 0x11;
+        uids[AvrcpConstants.UID_SIZE] = 0x22;
+        FolderItemsRsp rsp = new FolderItemsRsp(AvrcpConstants.RSP_NO_ERROR, (short) 0,
+                AvrcpConstants.BTRC_SCOPE_NOW_PLAYING, 2,
+                new byte[] {AvrcpConstants.FOLDER_TYPE_ALBUMS, 0},
+                new byte[] {AvrcpConstants.ITEM_NOT_PLAYABLE, AvrcpConstants.ITEM_PLAYABLE},
+                new byte[] {AvrcpConstants.BTRC_ITEM_FOLDER, AvrcpConstants.BTRC_ITEM_MEDIA},
+                uids, new String[] {"Album", "Song"}, new int[] {0, 2},
+                new int[] {ATTR_TITLE, ATTR_ALBUM}, new String[] {"Song", "Album"});
+
+        ByteBuffer packed = ByteBuffer.wrap(rsp.pack()).order(ByteOrder.LITTLE_ENDIAN);
+        int itemLen = 8 + AvrcpConstants.UID_SIZE;
+        int poolStart = 2 * itemLen + 2 * 8;
+        // "Album" and "Song" are stored once each.
+        assertEquals(poolStart + (2 + 5) + (2 + 4), packed.capacity());
+
+        assertEquals(AvrcpConstants.BTRC_ITEM_FOLDER, packed.get());
+        assertEquals(AvrcpConstants.FOLDER_TYPE_ALBUMS, packed.get());
+        assertEquals(AvrcpConstants.ITEM_NOT_PLAYABLE, packed.get());
+        assertEquals(0, packed.get());
+        assertEquals(0x11, packed.get());
+        packed.position(itemLen - 4);
+        int folderName = packed.getInt();
+
+        assertEquals(AvrcpConstants.BTRC_ITEM_MEDIA, packed.get());
+        packed.get();
+        assertEquals(AvrcpConstants.ITEM_PLAYABLE, packed.get());
+        assertEquals(2, packed.get());
+        assertEquals(0x22, packed.get());
+        packed.position(2 * itemLen - 4);
+        int songName = packed.getInt();
+
+        assertEquals(ATTR_TITLE, packed.getInt());
+        assertEquals(songName, packed.getInt());
+        assertEquals(ATTR_ALBUM, packed.getInt());
+        assertEquals(folderName, packed.getInt());
+
+        assertEquals("Album", poolString(packed, poolStart + folderName));
+        assertEquals("Song", poolString(packed, poolStart + songName));
+    }
+
+    public void testPack_ignoresAttributesOfFolders() {
+        FolderItemsRsp rsp = new FolderItemsRsp(AvrcpConstants.RSP_NO_ERROR, (short) 0,
+                AvrcpConstants.BTRC_SCOPE_NOW_PLAYING, 1,
+                new byte[] {AvrcpConstants.FOLDER_TYPE_MIXED},
+                new byte[] {AvrcpConstants.ITEM_NOT_PLAYABLE},
+                new byte[] {AvrcpConstants.BTRC_ITEM_FOLDER},
+                new byte[AvrcpConstants.UID_SIZE], new String[] {null}, new int[] {1},
+                new int[] {ATTR_TITLE}, new String[] {"Ignored"});
+
+        byte[] packed = rsp.pack();
+        // One item, no attribute entries and a single empty string in the pool.
+        assertEquals(8 + AvrcpConstants.UID_SIZE + 2, packed.length);
+        assertEquals(0, packed[3]);
+    }
+
+    private static String poolString(ByteBuffer packed, int offset) {
+        int len = packed.getShort(offset) & 0xFFFF;
+        return new String(packed.array(), offset + 2, len, StandardCharsets.UTF_8);
+    }
+}
@@ -1,22 +1,155 @@
-
 package com.android.bluetooth.gatt;
 
+import android.bluetooth.BluetoothAdapter;
+import android.bluetooth.le.ScanResult;
 import android.test.AndroidTestCase;
 import android.test.suitebuilder.annotation.SmallTest;
 
 import com.android.bluetooth.gatt.GattService;
 
+import java.util.List;
+import java.util.UUID;
+
 /**
  * Test cases for {@link GattService}.
  */
 public class GattServiceTest extends AndroidTestCase {
 
+    private static final long NOW_NANOS = 1000000000000L;
+
+    private static final UUID HEART_RATE_UUID =
+            UUID.fromString("0000180d-0000-1000-8000-00805f9b34fb");
+    private static final UUID BATTERY_UUID =
+            UUID.fromString("0000180f-0000-1000-8000-00805f9b34fb");
+
     @SmallTest
-    public void testParseBatchTimestamp() {
-        GattService service = new GattService();
-        long timestampNanos = service.parseTimestampNanos(new byte[] {
-                -54, 7 });
-        assertEquals(99700000000L, timestampNanos);
+    public void testBuildBatchScanResults() {
+        byte[] data = new byte[] {
+                0x00, 0x11, 0x22, 0x33, 0x44, 0x55,
+                0x00, 0x11, 0x22, 0x33, 0x44, 0x55,
+                0x02, 0x01, 0x06,
+                0x02, 0x01, 0x04,
+        };
+        // rssi, age in ms, scan record offset, scan record length per result
+        int[] columns = new int[] {
+                -40, -60,
+                100, 250,
+                12, 15,
+                3, 3,
+        };
+        List<ScanResult> results = GattService.buildBatchScanResults(
+                BluetoothAdapter.getDefaultAdapter(), ScanManager.SCAN_RESULT_TYPE_FULL, data,
+                columns, NOW_NANOS);
+        // Different payloads of one device are separate results.
+        assertEquals(2, results.size());
+        assertEquals("00:11:22:33:44:55", results.get(0).getDevice().getAddress());
+        assertEquals(-40, results.get(0).getRssi());
+        assertEquals(NOW_NANOS - 100000000L, results.get(0).getTimestampNanos());
+        assertEquals(0x06, results.get(0).getScanRecord().getAdvertiseFlags());
+        assertEquals(-60, results.get(1).getRssi());
+        assertEquals(NOW_NANOS - 250000000L, results.get(1).getTimestampNanos());
+        assertEquals(0x04, results.get(1).getScanRecord().getAdvertiseFlags());
+    }
+
+    @SmallTest
+    public void testBuildBatchScanResultsMalformed() {
+        byte[] data = new byte[] {
+                0x00, 0x11, 0x22, 0x33, 0x44, 0x55,
+                0x00, 0x11, 0x22, 0x33, 0x44, 0x66,
+                0x02, 0x01, 0x06,
+        };
+        // The second scan record points past the end of the data.
+        int[] columns = new int[] {-40, -60, 0, 0, 12, 14, 3, 3};
+        List<ScanResult> results = GattService.buildBatchScanResults(
+                BluetoothAdapter.getDefaultAdapter(), ScanManager.SCAN_RESULT_TYPE_FULL, data,
+                columns, NOW_NANOS);
+        assertEquals(1, results.size());
+        assertEquals("00:11:22:33:44:55", results.get(0).getDevice().getAddress());
+    }
+
+    @SmallTest
+    public void testBuildBatchScanResultsTruncatedBlob() {
+        // Two truncated results, but the addresses of only one and a half.
+        byte[] data = new byte[] {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x00, 0x11, 0x22};
+        int[] columns = new int[] {-40, -60, 0, 50, 0, 0, 0, 0};
+        List<ScanResult> results = GattService.buildBatchScanResults(
+                BluetoothAdapter.getDefaultAdapter(), ScanManager.SCAN_RESULT_TYPE_TRUNCATED,
+                data, columns, NOW_NANOS);
+        assertEquals(1, results.size());
+        assertEquals(-40, results.get(0).getRssi());
+        assertEquals(0, results.get(0).getScanRecord().getBytes().length);
+        assertTrue(GattService.buildBatchScanResults(BluetoothAdapter.getDefaultAdapter(),
+                ScanManager.SCAN_RESULT_TYPE_TRUNCATED, new byte[0], new int[0], NOW_NANOS)
+                .isEmpty());
+    }
+
+    @SmallTest
+    public void testParseAdIndex() {
+        byte[] advData = new byte[] {
+                0x02, 0x01, 0x06,                   // Flags
+                0x05, 0x03, 0x0D, 0x18, 0x0F, 0x18, // Complete list of 16-bit UUIDs
+        };
+        int[] index = GattService.parseAdIndex(advData);
+        assertEquals(2, index.length);
+        assertEquals((0x01 << 24) | (2 << 8) | 1, index[0]);
+        assertEquals((0x03 << 24) | (5 << 8) | 4, index[1]);
+    }
+
+    @SmallTest
+    public void testParseAdIndexStopsAtZeroLength() {
+        byte[] advData = new byte[] {0x02, 0x01, 0x06, 0x00, (byte) 0xFF, (byte) 0xFF};
+        int[] index = GattService.parseAdIndex(advData);
+        assertEquals(1, index.length);
+        assertEquals(0, GattService.parseAdIndex(new byte[0]).length);
+    }
+
+    @SmallTest
+    public void testParseAdIndexMalformed() {
+        // The second structure claims more bytes than are left.
+        byte[] advData = new byte[] {0x02, 0x01, 0x06, 0x05, 0x03, 0x0D};
+        assertNull(GattService.parseAdIndex(advData));
+    }
+
+    @SmallTest
+    public void testParseAdIndexEntryLimit() {
+        assertEquals(64, GattService.parseAdIndex(typeOnlyStructures(64)).length);
+        assertNull(GattService.parseAdIndex(typeOnlyStructures(65)));
+    }
+
+    @SmallTest
+    public void testParseUuids() {
+        byte[] advData = new byte[] {
+                0x02, 0x01, 0x06,
+                0x05, 0x03, 0x0D, 0x18, 0x0F, 0x18,
+        };
+        List<UUID> uuids = GattService.parseUuids(advData, GattService.parseAdIndex(advData));
+        assertEquals(2, uuids.size());
+        assertEquals(HEART_RATE_UUID, uuids.get(0));
+        assertEquals(BATTERY_UUID, uuids.get(1));
+    }
+
+    @SmallTest
+    public void testParseUuidsIgnoresOddTrailingByte() {
+        byte[] advData = new byte[] {0x04, 0x02, 0x0D, 0x18, 0x0F};
+        List<UUID> uuids = GattService.parseUuids(advData, GattService.parseAdIndex(advData));
+        assertEquals(1, uuids.size());
+        assertEquals(HEART_RATE_UUID, uuids.get(0));
+    }
+
+    @SmallTest
+    public void testParseUuidsMalformed() {
+        byte[] advData = new byte[] {0x05, 0x03, 0x0D, 0x18};
+        assertTrue(GattService.parseUuids(advData, GattService.parseAdIndex(advData)).isEmpty());
+    }
+
+    // |count| AD structures that carry only a type byte.
+    private static byte[] typeOnlyStructures(int count) {
+        byte[] advData = new byte[count * 2];
+        for (int i = 0; i < count; i++) {
+            advData[i * 2] = 0x01;
+            advData[i * 2 + 1] = (byte) 0xFF;
+        }
+        return advData;
     }
 
 }
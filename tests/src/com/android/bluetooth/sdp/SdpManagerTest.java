@@ -0,0 +1,87 @@
+package com.android.bluetooth.sdp;
+
+import android.test.AndroidTestCase;
+import android.test.suitebuilder.annotation.SmallTest;
+
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.charset.StandardCharsets;
+import java.util.Arrays;
+import java.util.List;
+
+/**
+ * Test cases for the batched record layout parsed by {@link SdpManager}.
+ */
+public class SdpManagerTest extends AndroidTestCase {
+
+    private static final int RECORD_KIND_RAW = 0;
+    private static final int RECORD_KIND_MAS = 1;
+
+    @SmallTest
+    public void testParseBatchRecords() {
+        byte[] rawData = new byte[] {0x35, 0x03, 0x19, 0x11, 0x01};
+        ByteBuffer buf = ByteBuffer.allocate(256).order(ByteOrder.LITTLE_ENDIAN);
+        putRecord(buf, (byte) 0x01, 0, true, RECORD_KIND_MAS, new int[] {0, 2, 0x0102},
+                "MAP MAS", new byte[0]);
+        putRecord(buf, (byte) 0x02, 1, false, RECORD_KIND_RAW, new int[] {0, 0, 0}, "",
+                rawData);
+
+        List<SdpManager.BatchRecord> records =
+                SdpManager.BatchRecord.parse(Arrays.copyOf(buf.array(), buf.position()));
+        assertEquals(2, records.size());
+
+        SdpManager.BatchRecord mas = records.get(0);
+        assertEquals(0x01, mas.uuid[0]);
+        assertEquals(0, mas.status);
+        assertTrue(mas.moreResults);
+        assertEquals(RECORD_KIND_MAS, mas.kind);
+        assertEquals(0x1005, mas.l2capPsm);
+        assertEquals(5, mas.rfcommChannel);
+        assertEquals(0x0102, mas.profileVersion);
+        assertEquals(2, mas.params[1]);
+        assertEquals("MAP MAS", mas.serviceName);
+        assertEquals(0, mas.data.length);
+
+        SdpManager.BatchRecord raw = records.get(1);
+        assertEquals(1, raw.status);
+        assertFalse(raw.moreResults);
+        assertNull(raw.serviceName);
+        assertTrue(Arrays.equals(rawData, raw.data));
+    }
+
+    @SmallTest
+    public void testParseBatchRecordsTruncated() {
+        ByteBuffer buf = ByteBuffer.allocate(256).order(ByteOrder.LITTLE_ENDIAN);
+        putRecord(buf, (byte) 0x01, 0, false, RECORD_KIND_RAW, new int[] {0, 0, 0}, "",
+                new byte[] {0x35, 0x00});
+        int complete = buf.position();
+        putRecord(buf, (byte) 0x02, 0, false, RECORD_KIND_RAW, new int[] {0, 0, 0}, "",
+                new byte[] {0x35, 0x00});
+
+        // Cut inside the data of the second record, and inside the fixed header.
+        byte[] packed = Arrays.copyOf(buf.array(), buf.position() - 1);
+        assertEquals(1, SdpManager.BatchRecord.parse(packed).size());
+        packed = Arrays.copyOf(buf.array(), complete + 10);
+        assertEquals(1, SdpManager.BatchRecord.parse(packed).size());
+        assertEquals(0, SdpManager.BatchRecord.parse(new byte[0]).size());
+    }
+
+    private static void putRecord(ByteBuffer buf, byte uuidFirstByte, int status,
+            boolean moreResults, int kind, int[] params, String name, byte[] data) {
+        byte[] uuid = new byte[16];
+        uuid[0] = uuidFirstByte;
+        buf.put(uuid);
+        buf.put((byte) status);
+        buf.put((byte) (moreResults ? 1 : 0));
+        buf.put((byte) kind);
+        buf.putInt(0x1005);
+        buf.putInt(5);
+        buf.putInt(0x0102);
+        for (int param : params) buf.putInt(param);
+        byte[] utf8 = name.getBytes(StandardCharsets.UTF_8);
+        buf.putShort((short) utf8.length);
+        buf.put(utf8);
+        buf.putShort((short) data.length);
+        buf.put(data);
+    }
+}